@@ -0,0 +1,2382 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+
+#include "PTZControl.h"
+#include "Benchmark.h"
+#include "CameraLayout.h"
+#include "SimulatedCamera.h"
+#include "SimulatedEnumerator.h"
+#include "TraceRecorder.h"
+#include "WebcamWorker.h"
+
+//////////////////////////////////////////////////////////////////////////
+//	Helpers
+
+// Percentiles, mean and max of the values as a JSON object
+static CStringA StatisticsJson(std::vector<double> values)
+{
+	CStringA str;
+	if (values.empty())
+		return "{}";
+
+	double dSum = 0;
+	for (double d : values)
+		dSum += d;
+	std::sort(values.begin(), values.end());
+	auto Percentile = [&](double dQuantile)
+	{
+		return values[std::min(values.size() - 1, static_cast<size_t>(dQuantile * values.size()))];
+	};
+	str.Format("{ \"count\": %u, \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f }",
+			   static_cast<UINT>(values.size()), dSum / values.size(), Percentile(0.5), Percentile(0.95), Percentile(0.99), values.back());
+	return str;
+}
+
+// Mean of the values, 0 if there are none
+static double Mean(const std::vector<double>& values)
+{
+	double dSum = 0;
+	for (double d : values)
+		dSum += d;
+	return values.empty() ? 0 : dSum / values.size();
+}
+
+// Largest of the values, 0 if there are none
+static double Max(const std::vector<double>& values)
+{
+	return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+}
+
+// The checks of the running benchmark, written after its result
+static std::vector<std::pair<CStringA, bool>> s_checks;
+
+// A property the benchmark must show. Any failed check fails the benchmark.
+static bool Check(const CStringA& strName, bool bPassed)
+{
+	if (!bPassed)
+		TRACE("Benchmark check %hs failed\n", strName.GetString());
+	s_checks.emplace_back(strName, bPassed);
+	return bPassed;
+}
+
+// A started worker with the device open, null if that failed
+static std::unique_ptr<WebcamWorker> OpenWorker(const CString& devicePath, WORD wCamera = 0)
+{
+	auto spWorker = std::make_unique<WebcamWorker>(HWND(NULL), 0, wCamera);
+	if (!spWorker->Start() || FAILED(spWorker->Open(devicePath)))
+		return nullptr;
+	return spWorker;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Benchmark
+
+bool Benchmark::Run(const CString& strName, int iCount, int iCameras, DWORD dwLatency)
+{
+	s_checks.clear();
+	CStringA strJson;
+	if (strName.CompareNoCase(_T("pulse")) == 0)
+		strJson = RunPulse(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("coalesce")) == 0)
+		strJson = RunCoalesce(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("zoom")) == 0)
+		strJson = RunZoom(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("drift")) == 0)
+		strJson = RunDrift(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("open")) == 0)
+		strJson = RunOpen(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("startup")) == 0)
+		strJson = RunStartup(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("enumerate")) == 0)
+		strJson = RunEnumerate(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("layout")) == 0)
+		strJson = RunLayout(iCount);
+	else if (strName.CompareNoCase(_T("diagonal")) == 0)
+		strJson = RunDiagonal(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("hang")) == 0)
+		strJson = RunHang(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("reconnect")) == 0)
+		strJson = RunReconnect(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("instrumentation")) == 0)
+		strJson = RunInstrumentation(iCount);
+	else if (strName.CompareNoCase(_T("kinematics")) == 0)
+		strJson = RunKinematics(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("faults")) == 0)
+		strJson = RunFaults(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("workload")) == 0)
+		strJson = RunWorkload(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("presets")) == 0)
+		strJson = RunPresets(iCount, iCameras, dwLatency);
+	else if (strName.CompareNoCase(_T("settle")) == 0)
+		strJson = RunSettle(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("travel")) == 0)
+		strJson = RunTravel(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("velocity")) == 0)
+		strJson = RunVelocity(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("zoomrange")) == 0)
+		strJson = RunZoomRange(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("xusteps")) == 0)
+		strJson = RunXUSteps(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("zoomscale")) == 0)
+		strJson = RunZoomScale(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("calibrate")) == 0)
+		strJson = RunCalibrate(iCount, dwLatency);
+	else if (strName.CompareNoCase(_T("deadreckoning")) == 0)
+		strJson = RunDeadReckoning(iCount, dwLatency);
+	else
+	{
+		TRACE(__FUNCTION__ " unknown benchmark %ls\n", strName.GetString());
+		return false;
+	}
+
+	if (strJson.IsEmpty())
+		return false;
+
+	// The checks are the last members of the result
+	bool bPassed = true;
+	CStringA strChecks;
+	for (const auto& check : s_checks)
+	{
+		CStringA strCheck;
+		strCheck.Format("%s    { \"name\": \"%s\", \"passed\": %s }", strChecks.IsEmpty() ? "" : ",\n",
+						check.first.GetString(), check.second ? "true" : "false");
+		strChecks += strCheck;
+		bPassed &= check.second;
+	}
+	CStringA strResult = strJson.Left(strJson.ReverseFind('}'));
+	strResult.TrimRight();
+	strResult.AppendFormat(",\n  \"passed\": %s,\n  \"checks\": [\n%s\n  ]\n}\n", bPassed ? "true" : "false", strChecks.GetString());
+	return WriteResult(strName, strResult) && bPassed;
+}
+
+bool Benchmark::WriteResult(const CString& strName, const CStringA& strJson)
+{
+	CString strFile;
+	strFile.Format(_T("PTZControl-%s.json"), strName.GetString());
+
+	CFile file;
+	if (!file.Open(strFile, CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite))
+		return false;
+	file.Write(strJson.GetString(), strJson.GetLength());
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Motor pulse jitter
+//	All cameras pulse at the same time with different widths, so the deadlines
+//	of the cameras interleave. Reports the achieved minus the requested motor
+//	on-time in microseconds.
+
+CStringA Benchmark::RunPulse(int iPulses, int iCameras, DWORD dwLatency)
+{
+	if (iPulses <= 0)
+		iPulses = 1000;
+	if (iCameras <= 0)
+		iCameras = 3;
+
+	struct Camera
+	{
+		std::unique_ptr<WebcamWorker> spWorker;
+		CEvent evPulse;
+		std::vector<double> errors;
+	};
+	std::vector<std::unique_ptr<Camera>> cameras;
+	for (const auto& device : SimulatedCamera::Devices(iCameras, dwLatency))
+	{
+		auto spCamera = std::make_unique<Camera>();
+		spCamera->spWorker = OpenWorker(device.devicePath, static_cast<WORD>(cameras.size()));
+		if (!spCamera->spWorker)
+			return "";
+
+		// Called on the worker thread. We wait for the event before we read the errors.
+		auto* pCamera = spCamera.get();
+		pCamera->spWorker->Camera().pulseObserver = [pCamera](WebcamController::MotorAxis, double dRequested, double dAchieved)
+		{
+			pCamera->errors.push_back((dAchieved - dRequested) * 1000.0);
+			pCamera->evPulse.SetEvent();
+		};
+		cameras.push_back(std::move(spCamera));
+	}
+
+	for (int i = 0; i < iPulses; ++i)
+	{
+		for (size_t c = 0; c < cameras.size(); ++c)
+		{
+			auto& worker = *cameras[c]->spWorker;
+			worker.Camera().motorIntervalTime = 20 + static_cast<int>((i * 37 + c * 53) % 131);	// 20-150 msec
+			worker.MovePan(i % 2 ? -1 : 1);
+		}
+		for (auto& spCamera : cameras)
+			::WaitForSingleObject(spCamera->evPulse, 10000);
+	}
+
+	std::vector<double> errors, absErrors;
+	for (auto& spCamera : cameras)
+	{
+		spCamera->spWorker->Stop(INFINITE);
+		errors.insert(errors.end(), spCamera->errors.begin(), spCamera->errors.end());
+	}
+	for (double d : errors)
+		absErrors.push_back(std::abs(d));
+
+	// The motor off call itself takes the latency. A timer without high resolution has its 1 msec steps.
+	const bool bHighResolution = MotorPulseScheduler::Get()->IsHighResolution();
+	std::sort(absErrors.begin(), absErrors.end());
+	const double dP99 = absErrors.empty() ? 0 : absErrors[std::min(absErrors.size() - 1, absErrors.size() * 99 / 100)];
+	Check("every_pulse_ended", errors.size() == static_cast<size_t>(iPulses) * cameras.size());
+	Check("p99_error_below_2ms_plus_latency", dP99 < (dwLatency + (bHighResolution ? 2 : 4)) * 1000.0);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"pulse\",\n  \"cameras\": %d,\n  \"latency_ms\": %u,\n  \"pulses\": %u,\n"
+			   "  \"high_resolution_timer\": %s,\n  \"error_us\": %s,\n  \"abs_error_us\": %s\n}\n",
+			   iCameras, dwLatency, static_cast<UINT>(errors.size()),
+			   bHighResolution ? "true" : "false",
+			   StatisticsJson(errors).GetString(), StatisticsJson(absErrors).GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Auto repeat against a slow camera
+//	A button is held for the given number of auto repeat ticks and released.
+//	Reports the deepest queue and the steps the camera still executes after
+//	the release, with and without merging of the axis commands.
+
+CStringA Benchmark::RunCoalesce(int iTicks, DWORD dwLatency)
+{
+	if (iTicks <= 0)
+		iTicks = 40;
+	if (dwLatency == 0)
+		dwLatency = 200;
+
+	CStringA strRuns;
+	for (bool bCoalesce : { false, true })
+	{
+		for (CameraAxis axis : { CameraAxis::Pan, CameraAxis::Zoom })
+		{
+			auto spWorker = OpenWorker(SimulatedCamera::Devices(1, dwLatency).front().devicePath);
+			if (!spWorker)
+				return "";
+			WebcamWorker& worker = *spWorker;
+			worker.EnableCoalescing(bCoalesce);
+
+			// Hold the button. Pan uses the motor until the release, zoom sends steps.
+			size_t nMaxDepth = 0;
+			for (int i = 0; i < iTicks; ++i)
+			{
+				if (axis == CameraAxis::Pan)
+					worker.Pan(1);
+				else
+					worker.Zoom(1);
+				nMaxDepth = std::max(nMaxDepth, worker.GetQueueDepth());
+				::Sleep(AUTO_REPEAT_DELAY);
+			}
+
+			// Release and wait until the camera is idle
+			LONGLONG llRelease = MotorPulseScheduler::Now();
+			UINT uStartedAtRelease = worker.GetStartedCount();
+			if (axis == CameraAxis::Pan)
+				worker.Pan(0);
+			worker.Sync();
+			double dIdle = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llRelease);
+
+			// Don't count the stop command and the sync
+			UINT uAfterRelease = worker.GetStartedCount() - uStartedAtRelease - 1;
+			if (axis == CameraAxis::Pan)
+				--uAfterRelease;
+			if (bCoalesce)
+			{
+				// The running command and one waiting one per axis
+				Check(axis == CameraAxis::Pan ? "pan_queue_bounded" : "zoom_queue_bounded", nMaxDepth <= 1);
+				Check(axis == CameraAxis::Pan ? "pan_one_step_after_release" : "zoom_one_step_after_release", uAfterRelease <= 1);
+			}
+
+			CStringA strRun;
+			strRun.Format("%s    { \"axis\": \"%s\", \"coalescing\": %s, \"max_queue_depth\": %u, \"steps_after_release\": %u, \"release_to_idle_ms\": %.1f }",
+						  strRuns.IsEmpty() ? "" : ",\n", axis == CameraAxis::Pan ? "pan" : "zoom", bCoalesce ? "true" : "false",
+						  static_cast<UINT>(nMaxDepth), uAfterRelease, dIdle);
+			strRuns += strRun;
+		}
+	}
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"coalesce\",\n  \"latency_ms\": %u,\n  \"ticks\": %d,\n  \"tick_ms\": %d,\n  \"runs\": [\n%s\n  ]\n}\n",
+			   dwLatency, iTicks, AUTO_REPEAT_DELAY, strRuns.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Transfers per zoom step
+//	Zooms in and out tick by tick, waiting for each step, and counts the calls
+//	the simulated device receives. A preset recall in the middle forces one
+//	read of the zoom.
+
+CStringA Benchmark::RunZoom(int iTicks, DWORD dwLatency)
+{
+	if (iTicks <= 0)
+		iTicks = 100;
+
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	const UINT uBefore = SimulatedCamera::GetCallCounts(strPath).Total();
+
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	const auto open = SimulatedCamera::GetCallCounts(strPath);
+
+	std::vector<double> durations;
+	for (int i = 0; i < iTicks; ++i)
+	{
+		if (i == iTicks / 2)
+		{
+			worker.GotoPreset(0);
+			worker.Sync();
+		}
+		LONGLONG llStart = MotorPulseScheduler::Now();
+		worker.Zoom(i < iTicks / 2 ? 1 : -1);
+		worker.Sync();
+		durations.push_back(MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart));
+	}
+	worker.Stop(INFINITE);
+	const auto done = SimulatedCamera::GetCallCounts(strPath);
+
+	// The preset recall is one property call
+	UINT uZoom = done.Total() - open.Total() - 1;
+
+	// Reads only after the recall and when the model is too old
+	double dTotalMs = 0;
+	for (double d : durations)
+		dTotalMs += d;
+	Check("one_set_per_tick", done.uSet - open.uSet == static_cast<UINT>(iTicks));
+	Check("no_range_reads", done.uGetRange == open.uGetRange);
+	Check("reads_only_to_resync", done.uGet - open.uGet <= 2 + static_cast<UINT>(dTotalMs / WebcamController::POSITION_RESYNC_INTERVAL));
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"zoom\",\n  \"latency_ms\": %u,\n  \"ticks\": %d,\n  \"open_transfers\": %u,\n"
+			   "  \"zoom_transfers\": { \"total\": %u, \"get_range\": %u, \"get\": %u, \"set\": %u },\n"
+			   "  \"transfers_per_tick\": %.3f,\n  \"tick_ms\": %s\n}\n",
+			   dwLatency, iTicks, open.Total() - uBefore,
+			   uZoom, done.uGetRange - open.uGetRange, done.uGet - open.uGet, done.uSet - open.uSet,
+			   static_cast<double>(uZoom) / iTicks, StatisticsJson(durations).GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Position model against a drifting camera
+//	Zoom changes by itself while it is stepped back and forth. After every
+//	tick the zoom the controller believes in is compared with the real one.
+//	The error must stay below the drift of one resync interval and must be
+//	gone after the final resync.
+
+CStringA Benchmark::RunDrift(int iTicks, DWORD dwLatency)
+{
+	static constexpr DWORD DRIFT{ 5 };		// Units per second
+	if (iTicks <= 0)
+		iTicks = 300;
+
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency, DRIFT).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+
+	// The zoom as the model knows it minus the real zoom
+	auto Error = [&]() -> double
+	{
+		long lKnown = 0;
+		if (worker.Send(CameraCommand::Sync, [&](WebcamController& camera)
+			{
+				return camera.GetKnownPosition(CameraControl_Zoom, lKnown) ? S_OK : S_FALSE;
+			}) != S_OK)
+			return 0;
+		SimulatedCamera::Position position{};
+		SimulatedCamera::GetPosition(strPath, position);
+		return std::abs(static_cast<double>(lKnown - position.lZoom));
+	};
+
+	std::vector<double> errors;
+	for (int i = 0; i < iTicks; ++i)
+	{
+		worker.Zoom((i / 40) % 2 ? -1 : 1);
+		errors.push_back(Error());
+		::Sleep(AUTO_REPEAT_DELAY);
+	}
+
+	// Let the model age and touch the zoom once more. This step reads the device.
+	::Sleep(static_cast<DWORD>(WebcamController::POSITION_RESYNC_INTERVAL));
+	worker.Zoom(0);
+	double dFinalError = Error();
+
+	auto stat = worker.Camera().GetPositionStatistics();
+	worker.Stop(INFINITE);
+
+	// The model may be off by the drift of one resync interval, a tick and the calls of a step
+	const double dAllowedMs = static_cast<double>(WebcamController::POSITION_RESYNC_INTERVAL) + AUTO_REPEAT_DELAY + 2.0 * dwLatency;
+	Check("error_within_one_resync", Max(errors) <= DRIFT * dAllowedMs / 1000 + 1);
+	Check("converged_after_resync", dFinalError <= DRIFT * 2.0 * dwLatency / 1000 + 1);
+	Check("reads_avoided", stat.uReadsAvoided > stat.uReads);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"drift\",\n  \"latency_ms\": %u,\n  \"ticks\": %d,\n  \"drift_per_s\": %u,\n"
+			   "  \"resync_interval_ms\": %u,\n  \"reads\": %u,\n  \"reads_avoided\": %u,\n  \"resyncs\": %u,\n  \"rejected_writes\": %u,\n"
+			   "  \"abs_error\": %s,\n  \"final_error\": %.0f\n}\n",
+			   dwLatency, iTicks, DRIFT, static_cast<UINT>(WebcamController::POSITION_RESYNC_INTERVAL),
+			   stat.uReads, stat.uReadsAvoided, stat.uResyncs, stat.uRejectedWrites,
+			   StatisticsJson(errors).GetString(), dFinalError);
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Open time with a cold and a warm topology cache
+//	Every camera is opened without a cache, then again with the topology of
+//	the first open. Reports the open time and the calls per open.
+
+CStringA Benchmark::RunOpen(int iRounds, int iCameras, DWORD dwLatency)
+{
+	if (iRounds <= 0)
+		iRounds = 5;
+	if (iCameras <= 0)
+		iCameras = 3;
+	if (dwLatency == 0)
+		dwLatency = 20;
+
+	struct Result
+	{
+		std::vector<double> times;
+		std::vector<double> calls;
+	};
+	Result cold, warm;
+	CStringA strCameras;
+	for (const auto& device : SimulatedCamera::Devices(iCameras, dwLatency))
+	{
+		Result coldCamera, warmCamera;
+		for (int i = 0; i < iRounds; ++i)
+		{
+			WebcamController::Topology topology{};
+			for (auto* pResult : { &coldCamera, &warmCamera })
+			{
+				WebcamWorker worker(HWND(NULL), 0, 0);
+				if (!worker.Start())
+					return "";
+				if (pResult == &warmCamera)
+					worker.Camera().SetCachedTopology(topology);
+
+				UINT uCalls = SimulatedCamera::GetCallCounts(device.devicePath).Total();
+				LONGLONG llStart = MotorPulseScheduler::Now();
+				if (FAILED(worker.Open(device.devicePath)))
+					return "";
+				pResult->times.push_back(MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart));
+				pResult->calls.push_back(SimulatedCamera::GetCallCounts(device.devicePath).Total() - uCalls);
+
+				// The warm open must not discover again
+				if ((pResult == &warmCamera) != worker.Camera().IsTopologyFromCache())
+					return "";
+				topology = worker.Camera().GetTopology();
+				worker.Stop(INFINITE);
+			}
+		}
+		for (auto pair : { std::make_pair(&cold, &coldCamera), std::make_pair(&warm, &warmCamera) })
+		{
+			pair.first->times.insert(pair.first->times.end(), pair.second->times.begin(), pair.second->times.end());
+			pair.first->calls.insert(pair.first->calls.end(), pair.second->calls.begin(), pair.second->calls.end());
+		}
+
+		CStringA strCamera;
+		strCamera.Format("%s    { \"camera\": \"%ls\", \"cold_ms\": %s, \"warm_ms\": %s }",
+						 strCameras.IsEmpty() ? "" : ",\n", device.deviceName.GetString(),
+						 StatisticsJson(coldCamera.times).GetString(), StatisticsJson(warmCamera.times).GetString());
+		strCameras += strCamera;
+	}
+
+	Check("warm_open_fewer_calls", Mean(warm.calls) < Mean(cold.calls));
+	Check("warm_open_faster", Mean(warm.times) < Mean(cold.times));
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"open\",\n  \"cameras\": %d,\n  \"latency_ms\": %u,\n  \"rounds\": %d,\n"
+			   "  \"cold_ms\": %s,\n  \"warm_ms\": %s,\n  \"cold_calls\": %s,\n  \"warm_calls\": %s,\n  \"per_camera\": [\n%s\n  ]\n}\n",
+			   iCameras, dwLatency, iRounds,
+			   StatisticsJson(cold.times).GetString(), StatisticsJson(warm.times).GetString(),
+			   StatisticsJson(cold.calls).GetString(), StatisticsJson(warm.calls).GetString(), strCameras.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Startup with several cameras
+//	Opens and homes all cameras one after the other, as the dialog did
+//	before, and all at the same time on their workers, as the dialog does
+//	now. Reports the wall time of both and the time of the slowest camera.
+
+CStringA Benchmark::RunStartup(int iRounds, int iCameras, DWORD dwLatency)
+{
+	if (iRounds <= 0)
+		iRounds = 5;
+	if (iCameras <= 0)
+		iCameras = 3;
+	if (dwLatency == 0)
+		dwLatency = 20;
+
+	std::vector<double> sequential, parallel, slowest;
+	const auto devices = SimulatedCamera::Devices(iCameras, dwLatency);
+	for (int i = 0; i < iRounds; ++i)
+	{
+		for (bool bParallel : { false, true })
+		{
+			std::vector<std::unique_ptr<WebcamWorker>> workers;
+			for (size_t c = 0; c < devices.size(); ++c)
+			{
+				workers.push_back(std::make_unique<WebcamWorker>(HWND(NULL), 0, static_cast<WORD>(c)));
+				if (!workers.back()->Start())
+					return "";
+			}
+
+			// Every camera notes when it is open and at home
+			std::vector<LONGLONG> ready(devices.size());
+			LONGLONG llStart = MotorPulseScheduler::Now();
+			for (size_t c = 0; c < devices.size(); ++c)
+			{
+				const CString strPath = devices[c].devicePath;
+				workers[c]->Post(CameraCommand::Open, [strPath](WebcamController& camera) { return camera.OpenDevice(strPath); });
+				workers[c]->GotoHome();
+				LONGLONG* pReady = &ready[c];
+				workers[c]->Post(CameraCommand::Sync, [pReady](WebcamController&) { *pReady = MotorPulseScheduler::Now(); return S_OK; });
+				if (!bParallel)
+					workers[c]->Sync();
+			}
+			for (auto& spWorker : workers)
+				spWorker->Sync();
+			double dWall = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+
+			if (bParallel)
+			{
+				parallel.push_back(dWall);
+				slowest.push_back(MotorPulseScheduler::ToMilliseconds(*std::max_element(ready.begin(), ready.end()) - llStart));
+			}
+			else
+				sequential.push_back(dWall);
+			for (auto& spWorker : workers)
+				spWorker->Stop(INFINITE);
+		}
+	}
+
+	// The wall time is the time of the slowest camera, not the sum
+	Check("wall_close_to_slowest", Mean(parallel) <= 1.25 * Mean(slowest) + 5);
+	Check("parallel_faster", iCameras < 2 || Mean(parallel) < Mean(sequential));
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"startup\",\n  \"cameras\": %d,\n  \"latency_ms\": %u,\n  \"rounds\": %d,\n"
+			   "  \"sequential_ms\": %s,\n  \"parallel_ms\": %s,\n  \"slowest_camera_ms\": %s\n}\n",
+			   iCameras, dwLatency, iRounds,
+			   StatisticsJson(sequential).GetString(), StatisticsJson(parallel).GetString(), StatisticsJson(slowest).GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Property reads to enumerate and open all devices
+//	A simulated enumerator replaces the system device enumerator. All its
+//	devices are enumerated and opened, once by device path, which searches
+//	the enumeration again for every device, and once by the moniker of the
+//	enumeration. Reports the property bag reads for growing device counts.
+
+CStringA Benchmark::RunEnumerate(int iDevices, DWORD dwLatency)
+{
+	if (iDevices <= 0)
+		iDevices = 20;
+
+	CStringA strRuns;
+	UINT uReadsOfOne = 0;
+	for (int iCount = 1; iCount <= iDevices; iCount = iCount < iDevices ? std::min(iCount * 2, iDevices) : iCount + 1)
+	{
+		WebcamController::SetDeviceSource(SimulatedEnumerator::Source(iCount, dwLatency));
+
+		UINT auReads[2]{};
+		for (bool bByPath : { true, false })
+		{
+			SimulatedEnumerator::ResetPropertyReads();
+			for (const auto& device : WebcamController::CompatibleDevices())
+			{
+				WebcamController camera;
+				if (FAILED(bByPath ? camera.OpenDevice(device.devicePath) : camera.OpenDevice(device)))
+					return "";
+			}
+			auReads[bByPath ? 0 : 1] = SimulatedEnumerator::GetPropertyReads();
+		}
+
+		// Opening by moniker reads as often per device as with a single one
+		if (iCount == 1)
+			uReadsOfOne = auReads[1];
+		CStringA strCheck;
+		strCheck.Format("linear_reads_%d_devices", iCount);
+		Check(strCheck, auReads[1] <= uReadsOfOne * iCount);
+
+		CStringA strRun;
+		strRun.Format("%s    { \"devices\": %d, \"reads_by_path\": %u, \"reads_by_moniker\": %u }",
+					  strRuns.IsEmpty() ? "" : ",\n", iCount, auReads[0], auReads[1]);
+		strRuns += strRun;
+	}
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"enumerate\",\n  \"latency_ms\": %u,\n  \"runs\": [\n%s\n  ]\n}\n",
+			   dwLatency, strRuns.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Button layout
+//	Computes the layout for 1 to count cameras and checks that every button has
+//	its own cell in the raster. No camera is used.
+
+CStringA Benchmark::RunLayout(int iMaxCameras)
+{
+	if (iMaxCameras <= 0)
+		iMaxCameras = 32;
+
+	CStringA strRuns;
+	bool bAllValid = true;
+	for (int iCount = 1; iCount <= iMaxCameras; ++iCount)
+	{
+		const auto layout = CameraLayout::Compute(iCount);
+		bool bValid = layout.IsValid() && layout.cameras.size() == static_cast<size_t>(iCount);
+		bAllValid &= bValid;
+
+		CStringA strRun;
+		strRun.Format("%s    { \"cameras\": %d, \"columns\": %d, \"valid\": %s }",
+					  strRuns.IsEmpty() ? "" : ",\n", iCount, layout.GetColumns(), bValid ? "true" : "false");
+		strRuns += strRun;
+	}
+
+	Check("every_button_own_cell", bAllValid);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"layout\",\n  \"valid\": %s,\n  \"runs\": [\n%s\n  ]\n}\n",
+			   bAllValid ? "true" : "false", strRuns.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Diagonal moves
+//	Holds a diagonal for count ticks, once with combined pan/tilt steps and once
+//	with a pan step followed by a tilt step, with the Logitech XU and with motor
+//	pulses. Reports the transfers per tick and the distance of the camera from
+//	the diagonal, sampled after every command and after every pulse.
+
+CStringA Benchmark::RunDiagonal(int iTicks, DWORD dwLatency)
+{
+	static constexpr int MOTOR_INTERVAL{ 50 };	// msec, keeps the tilt inside its range
+	if (iTicks <= 0)
+		iTicks = 20;
+
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	worker.Camera().motorIntervalTime = MOTOR_INTERVAL;
+	// The simulated unit divides its steps
+	worker.Camera().useLogitechMotorSteps = true;
+
+	CStringA strRuns;
+	for (bool bLogitech : { true, false })
+	{
+		worker.Camera().useLogitechMotionControl = bLogitech;
+		for (bool bCombined : { true, false })
+		{
+			worker.GotoHome();
+			worker.Sync();
+			SimulatedCamera::Position start{};
+			SimulatedCamera::GetPosition(strPath, start);
+			const UINT uBefore = SimulatedCamera::GetCallCounts(strPath).Total();
+
+			std::vector<double> deviations;
+			auto Sample = [&]()
+			{
+				SimulatedCamera::Position position{};
+				SimulatedCamera::GetPosition(strPath, position);
+				long lPan = std::abs(position.lPan - start.lPan);
+				long lTilt = std::abs(position.lTilt - start.lTilt);
+				deviations.push_back(std::abs(lPan - lTilt) / std::sqrt(2.0));
+			};
+
+			for (int i = 0; i < iTicks; ++i)
+			{
+				if (bCombined)
+					worker.MovePanTilt(1, 1);
+				else
+				{
+					worker.MovePan(1);
+					worker.Sync();
+					Sample();
+					worker.MoveTilt(1);
+				}
+				worker.Sync();
+				Sample();
+				if (!bLogitech)
+				{
+					// Let the pulses end
+					::Sleep(2 * MOTOR_INTERVAL);
+					worker.Sync();
+					Sample();
+				}
+			}
+			const UINT uTransfers = SimulatedCamera::GetCallCounts(strPath).Total() - uBefore;
+			if (bCombined)
+			{
+				// One transfer per tick through the XU, motor on and off with pulses, on a straight line.
+				// The XU may need one more transfer to set its step size once.
+				Check(bLogitech ? "xu_one_transfer_per_tick" : "motor_two_transfers_per_tick",
+					  uTransfers <= (bLogitech ? iTicks + 1u : 2u * iTicks));
+				Check(bLogitech ? "xu_straight" : "motor_straight", Max(deviations) <= (bLogitech ? 1 : 2));
+			}
+
+			CStringA strRun;
+			strRun.Format("%s    { \"mode\": \"%s\", \"combined\": %s, \"transfers_per_tick\": %.3f, \"deviation\": %s }",
+						  strRuns.IsEmpty() ? "" : ",\n", bLogitech ? "xu" : "motor", bCombined ? "true" : "false",
+						  static_cast<double>(uTransfers) / iTicks, StatisticsJson(deviations).GetString());
+			strRuns += strRun;
+		}
+	}
+	worker.Stop(INFINITE);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"diagonal\",\n  \"latency_ms\": %u,\n  \"ticks\": %d,\n  \"runs\": [\n%s\n  ]\n}\n",
+			   dwLatency, iTicks, strRuns.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Hanging camera
+//	The zoom property of the first camera blocks for ever. While its worker
+//	waits for the deadline, the other cameras zoom as before. Reports the
+//	command latency of the other cameras before and during the hang and
+//	when the hanging camera was quarantined.
+
+CStringA Benchmark::RunHang(int iTicks, int iCameras, DWORD dwLatency)
+{
+	if (iTicks <= 0)
+		iTicks = 50;
+	if (iCameras < 2)
+		iCameras = 3;
+	if (dwLatency == 0)
+		dwLatency = 20;
+	const DWORD DEADLINE = 500;
+
+	auto aDevices = SimulatedCamera::Devices(iCameras, dwLatency);
+	std::vector<std::unique_ptr<WebcamWorker>> workers;
+	for (const auto& device : aDevices)
+	{
+		workers.push_back(OpenWorker(device.devicePath, static_cast<WORD>(workers.size())));
+		if (!workers.back())
+			return "";
+		workers.back()->SetDeadline(DEADLINE);
+	}
+
+	// One zoom step on every other camera, each waited for
+	auto ZoomOthers = [&](std::vector<double>& times, int iTick)
+	{
+		for (size_t c = 1; c < workers.size(); ++c)
+		{
+			LONGLONG llStart = MotorPulseScheduler::Now();
+			workers[c]->Zoom(iTick % 2 ? -1 : 1);
+			if (FAILED(workers[c]->Sync()))
+				return false;
+			times.push_back(MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart));
+		}
+		return true;
+	};
+
+	std::vector<double> before, during;
+	for (int i = 0; i < iTicks; ++i)
+	{
+		if (!ZoomOthers(before, i))
+			return "";
+	}
+
+	SimulatedCamera::BlockProperty(aDevices[0].devicePath, CameraControl_Zoom);
+	LONGLONG llHang = MotorPulseScheduler::Now();
+	workers[0]->Zoom(1);
+
+	double dQuarantinedMs = -1;
+	for (int i = 0; i < iTicks; ++i)
+	{
+		if (!ZoomOthers(during, i))
+			return "";
+		if (dQuarantinedMs < 0 && workers[0]->IsQuarantined())
+			dQuarantinedMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llHang);
+	}
+	while (dQuarantinedMs < 0 && MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llHang) < 4 * DEADLINE)
+	{
+		if (workers[0]->IsQuarantined())
+			dQuarantinedMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llHang);
+		else
+			::Sleep(1);
+	}
+
+	// A quarantined camera must not block the caller either
+	LONGLONG llSend = MotorPulseScheduler::Now();
+	HRESULT hrSend = workers[0]->Sync();
+	double dSendMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llSend);
+
+	// Let the abandoned thread run out
+	SimulatedCamera::ReleaseBlocked(aDevices[0].devicePath);
+	for (auto& spWorker : workers)
+		spWorker->Stop(INFINITE);
+
+	// Quarantined within the deadline, without blocking the caller or the others
+	Check("quarantined", dQuarantinedMs >= 0 && dQuarantinedMs <= 2 * DEADLINE);
+	Check("quarantined_send_aborted", hrSend == E_ABORT);
+	Check("others_not_delayed", Max(during) <= 2 * Max(before) + 10);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"hang\",\n  \"cameras\": %d,\n  \"latency_ms\": %u,\n  \"deadline_ms\": %u,\n"
+			   "  \"quarantined\": %s,\n  \"quarantined_after_ms\": %.3f,\n  \"quarantined_send_ms\": %.3f,\n  \"quarantined_send_aborted\": %s,\n"
+			   "  \"others_before_ms\": %s,\n  \"others_during_ms\": %s\n}\n",
+			   iCameras, dwLatency, DEADLINE,
+			   dQuarantinedMs >= 0 ? "true" : "false", dQuarantinedMs, dSendMs, hrSend == E_ABORT ? "true" : "false",
+			   StatisticsJson(before).GetString(), StatisticsJson(during).GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Reconnect
+//	One camera after the other is unplugged and plugged in again. It is
+//	enumerated last then, so it is found by its identity and not by its
+//	place. Reports the time from the arrival until the camera is open and
+//	until its preset is restored, the zoom latency of the other cameras in
+//	the meantime and, for comparison, a restart that opens and homes all.
+
+CStringA Benchmark::RunReconnect(int iRounds, int iCameras, DWORD dwLatency)
+{
+	if (iRounds <= 0)
+		iRounds = 10;
+	if (iCameras <= 0)
+		iCameras = 3;
+	if (dwLatency == 0)
+		dwLatency = 20;
+	const int PRESET = 1;
+
+	WebcamController::SetDeviceSource(SimulatedEnumerator::Source(iCameras, dwLatency));
+	auto aDevices = WebcamController::CompatibleDevices();
+	if (static_cast<int>(aDevices.size()) != iCameras)
+		return "";
+
+	struct Camera
+	{
+		std::unique_ptr<WebcamWorker> spWorker;
+		CString strIdentity;
+		CString strSimulatedPath;
+		SimulatedCamera::Position preset;
+	};
+	std::vector<Camera> cameras;
+	for (const auto& device : aDevices)
+	{
+		Camera camera{ std::make_unique<WebcamWorker>(HWND(NULL), 0, static_cast<WORD>(cameras.size())),
+					   WebcamController::DeviceIdentity(device.devicePath), device.displayName, {} };
+		camera.spWorker->Camera().useLogitechMotionControl = true;
+		if (!camera.spWorker->Start() ||
+			FAILED(camera.spWorker->Send(CameraCommand::Open, [device](WebcamController& webCam) { return webCam.OpenDevice(device); })))
+			return "";
+
+		// Every camera gets another preset position
+		int iSteps = static_cast<int>(cameras.size()) + 2;
+		if (FAILED(camera.spWorker->Send(CameraCommand::SavePreset, [iSteps](WebcamController& webCam)
+			{
+				webCam.MovePanTilt(iSteps, -iSteps);
+				return webCam.SavePreset(PRESET);
+			})) ||
+			!SimulatedCamera::GetPosition(camera.strSimulatedPath, camera.preset))
+			return "";
+		cameras.push_back(std::move(camera));
+	}
+
+	std::vector<double> usable, restored, others, calls;
+	int iFromCache = 0, iRestored = 0, iMoved = 0;
+	for (int i = 0; i < iRounds; ++i)
+	{
+		auto& victim = cameras[i % cameras.size()];
+		auto& worker = *victim.spWorker;
+		CString devicePath = aDevices[i % cameras.size()].devicePath;
+
+		if (!SimulatedEnumerator::Unplug(devicePath))
+			return "";
+		worker.Disconnect();
+		worker.Sync();
+
+		// The others are not touched
+		for (auto& camera : cameras)
+		{
+			if (&camera == &victim)
+				continue;
+			LONGLONG llStart = MotorPulseScheduler::Now();
+			camera.spWorker->Zoom(i % 2 ? -1 : 1);
+			camera.spWorker->Sync();
+			others.push_back(MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart));
+		}
+
+		UINT uCalls = SimulatedCamera::GetCallCounts(victim.strSimulatedPath).Total();
+		SimulatedEnumerator::Plug(devicePath);
+		LONGLONG llArrival = MotorPulseScheduler::Now();
+
+		// As the dialog does it: the identity selects the camera, which opens the arrived path.
+		CString strIdentity = WebcamController::DeviceIdentity(devicePath);
+		auto itCamera = std::find_if(cameras.begin(), cameras.end(), [&](const Camera& camera) { return camera.strIdentity == strIdentity; });
+		if (itCamera == cameras.end() || &*itCamera != &victim || !WebcamController::IsVideoInput(devicePath))
+			return "";
+
+		// The preset starts as soon as the open is done
+		UINT uStarted = worker.GetStartedCount();
+		worker.Reconnect(WebcamDevice{ CString(), devicePath, CString() }, PRESET);
+		while (worker.GetStartedCount() < uStarted + 2 && MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llArrival) < 10000)
+			::Sleep(0);
+		usable.push_back(MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llArrival));
+		worker.Sync();
+		restored.push_back(MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llArrival));
+		calls.push_back(SimulatedCamera::GetCallCounts(victim.strSimulatedPath).Total() - uCalls);
+
+		// It is enumerated last now, not at its old place
+		auto aPresent = WebcamController::CompatibleDevices();
+		auto itDevice = std::find_if(aPresent.begin(), aPresent.end(), [&](const WebcamDevice& device) { return device.devicePath.CompareNoCase(devicePath) == 0; });
+		if (itDevice != aPresent.end() && itDevice - aPresent.begin() != static_cast<ptrdiff_t>(i % cameras.size()))
+			++iMoved;
+
+		SimulatedCamera::Position position;
+		if (worker.Camera().IsTopologyFromCache())
+			++iFromCache;
+		if (SimulatedCamera::GetPosition(victim.strSimulatedPath, position) &&
+			position.lPan == victim.preset.lPan && position.lTilt == victim.preset.lTilt)
+			++iRestored;
+	}
+
+	// What a restart costs: all cameras are opened and homed again
+	for (auto& camera : cameras)
+		camera.spWorker->Stop(INFINITE);
+	LONGLONG llRestart = MotorPulseScheduler::Now();
+	{
+		std::vector<std::unique_ptr<WebcamWorker>> workers;
+		for (const auto& device : WebcamController::CompatibleDevices())
+		{
+			workers.push_back(std::make_unique<WebcamWorker>(HWND(NULL), 0, static_cast<WORD>(workers.size())));
+			if (!workers.back()->Start())
+				return "";
+			workers.back()->Post(CameraCommand::Open, [device](WebcamController& webCam) { return webCam.OpenDevice(device); });
+			workers.back()->GotoHome();
+		}
+		for (auto& spWorker : workers)
+			spWorker->Sync();
+	}
+	double dRestartMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llRestart);
+
+	Check("every_preset_restored", iRestored == iRounds);
+	Check("every_topology_from_cache", iFromCache == iRounds);
+	Check("reconnect_faster_than_restart", Mean(restored) < dRestartMs);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"reconnect\",\n  \"cameras\": %d,\n  \"latency_ms\": %u,\n  \"rounds\": %d,\n"
+			   "  \"enumerated_elsewhere\": %d,\n  \"topology_from_cache\": %d,\n  \"preset_restored\": %d,\n"
+			   "  \"arrival_to_usable_ms\": %s,\n  \"arrival_to_restored_ms\": %s,\n  \"calls_per_reconnect\": %s,\n"
+			   "  \"others_while_unplugged_ms\": %s,\n  \"restart_all_ms\": %.3f\n}\n",
+			   iCameras, dwLatency, iRounds, iMoved, iFromCache, iRestored,
+			   StatisticsJson(usable).GetString(), StatisticsJson(restored).GetString(), StatisticsJson(calls).GetString(),
+			   StatisticsJson(others).GetString(), dRestartMs);
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Overhead of the latency histograms
+//	Times count calls of the instrumentation as it wraps every driver call:
+//	two counter reads and one Record. The counter reads alone are timed too,
+//	and the calls with a trace span in addition.
+//	Known latencies are recorded afterwards to check the error of the
+//	percentiles against the exact ones.
+
+CStringA Benchmark::RunInstrumentation(int iCalls)
+{
+	if (iCalls <= 0)
+		iCalls = 1000000;
+
+	auto NanosecondsPerCall = [iCalls](LONGLONG llTicks)
+	{
+		return MotorPulseScheduler::ToMilliseconds(llTicks) * 1e6 / iCalls;
+	};
+
+	// The counter reads alone
+	LONGLONG llStart = MotorPulseScheduler::Now();
+	for (int i = 0; i < iCalls; ++i)
+	{
+		MotorPulseScheduler::Now();
+		MotorPulseScheduler::Now();
+	}
+	double dClockNs = NanosecondsPerCall(MotorPulseScheduler::Now() - llStart);
+
+	// Counter reads and Record, like WebcamController::Timed around an empty call
+	LatencyHistogram histogram;
+	llStart = MotorPulseScheduler::Now();
+	for (int i = 0; i < iCalls; ++i)
+	{
+		LONGLONG llCall = MotorPulseScheduler::Now();
+		histogram.Record(llCall, MotorPulseScheduler::Now(), (i & 0xFF) == 0);
+	}
+	double dInstrumentedNs = NanosecondsPerCall(MotorPulseScheduler::Now() - llStart);
+	const auto recorded = histogram.Summarize();
+
+	// The same with a trace span, as every driver call records when tracing is on
+	if (!TraceRecorder::Enable())
+		return "";
+	llStart = MotorPulseScheduler::Now();
+	for (int i = 0; i < iCalls; ++i)
+	{
+		LONGLONG llCall = MotorPulseScheduler::Now();
+		LONGLONG llEnd = MotorPulseScheduler::Now();
+		histogram.Record(llCall, llEnd, false);
+		TraceRecorder::Span(_T("Benchmark"), _T("driver"), llCall, llEnd);
+	}
+	double dTracedNs = NanosecondsPerCall(MotorPulseScheduler::Now() - llStart);
+
+	// Known latencies from 0.1 to 100 msec, spread evenly on a log scale
+	static constexpr int KNOWN_LATENCIES{ 10000 };
+	LatencyHistogram known;
+	std::vector<double> values;
+	for (int i = 0; i < KNOWN_LATENCIES; ++i)
+	{
+		double dMs = 0.1 * std::pow(1000.0, static_cast<double>((i * 7919) % KNOWN_LATENCIES) / KNOWN_LATENCIES);
+		LONGLONG llCall = (i + 1) * MotorPulseScheduler::FromMilliseconds(200);
+		known.Record(llCall, llCall + MotorPulseScheduler::FromMilliseconds(dMs), false);
+		values.push_back(dMs);
+	}
+	const auto summary = known.Summarize();
+	std::sort(values.begin(), values.end());
+	auto RelativeError = [&](double dQuantile, double dApproximated)
+	{
+		double dExact = values[std::min(values.size() - 1, static_cast<size_t>(dQuantile * values.size()))];
+		return std::abs(dApproximated - dExact) / dExact;
+	};
+
+	// Quarter octave buckets keep the percentiles within 20 percent
+	Check("record_below_one_usec", dInstrumentedNs - dClockNs < 1000);
+	Check("every_call_recorded", recorded.uCount == static_cast<UINT>(iCalls));
+	Check("p50_within_20_percent", RelativeError(0.50, summary.dP50) <= 0.2);
+	Check("p95_within_20_percent", RelativeError(0.95, summary.dP95) <= 0.2);
+	Check("p99_within_20_percent", RelativeError(0.99, summary.dP99) <= 0.2);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"instrumentation\",\n  \"calls\": %d,\n  \"clock_ns_per_call\": %.1f,\n"
+			   "  \"instrumented_ns_per_call\": %.1f,\n  \"record_ns_per_call\": %.1f,\n  \"below_one_usec\": %s,\n"
+			   "  \"traced_ns_per_call\": %.1f,\n  \"trace_ns_per_span\": %.1f,\n"
+			   "  \"recorded\": { \"count\": %u, \"errors\": %u },\n"
+			   "  \"percentile_relative_error\": { \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f }\n}\n",
+			   iCalls, dClockNs, dInstrumentedNs, dInstrumentedNs - dClockNs, dInstrumentedNs < 1000 ? "true" : "false",
+			   dTracedNs, dTracedNs - dInstrumentedNs,
+			   recorded.uCount, recorded.uErrors,
+			   RelativeError(0.50, summary.dP50), RelativeError(0.95, summary.dP95), RelativeError(0.99, summary.dP99));
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Motion of simulated cameras
+//	Drives the kinematics of many cameras twice with the same script on a
+//	virtual clock and checks that both runs end at the same positions. Then
+//	recalls two presets on a simulated device count times and compares the
+//	time until the camera stops with the travel time of the kinematics.
+
+CStringA Benchmark::RunKinematics(int iRecalls, int iCameras, DWORD dwLatency)
+{
+	static constexpr int SCRIPT_SECONDS{ 60 };
+	static constexpr double TICK{ 0.05 };		// Auto repeat interval in seconds
+	if (iRecalls <= 0)
+		iRecalls = 10;
+	if (iCameras <= 0)
+		iCameras = 16;
+
+	// Every camera gets its own mix of motor runs, steps and preset moves.
+	auto RunScript = [iCameras]()
+	{
+		std::vector<double> positions;
+		for (int c = 0; c < iCameras; ++c)
+		{
+			PtzKinematics kinematics;
+			int iTick = 0;
+			for (double dNow = 0; dNow < SCRIPT_SECONDS; dNow += TICK, ++iTick)
+			{
+				switch ((iTick + c) % 40)
+				{
+				case 0:		kinematics.Drive(PtzKinematics::AxisPan, 1, dNow); break;
+				case 7:		kinematics.Drive(PtzKinematics::AxisPan, 0, dNow); break;
+				case 10:	kinematics.MoveBy(PtzKinematics::AxisTilt, 2 * (c % 3 - 1), dNow); break;
+				case 20:	kinematics.MoveTo(PtzKinematics::AxisPan, -100 + 10 * c, dNow); break;
+				case 25:	kinematics.MoveTo(PtzKinematics::AxisZoom, 100 + 25 * c, dNow); break;
+				}
+			}
+			for (int i = 0; i < PtzKinematics::NUM_AXES; ++i)
+				positions.push_back(kinematics.GetPosition(static_cast<PtzKinematics::Axis>(i), SCRIPT_SECONDS));
+		}
+		return positions;
+	};
+	LONGLONG llStart = MotorPulseScheduler::Now();
+	const auto first = RunScript();
+	double dScriptMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+	const bool bDeterministic = first == RunScript();
+
+	// Preset travel on a simulated device: preset 0 at home, preset 1 after a diagonal motor run
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	auto WaitForStop = [&]()
+	{
+		while (SimulatedCamera::IsMoving(strPath))
+			::Sleep(1);
+	};
+	worker.GotoHome();
+	worker.Sync();
+	WaitForStop();
+	worker.SavePreset(0);
+	worker.PanTilt(1, 1);
+	worker.Sync();
+	::Sleep(1500);
+	worker.PanTilt(0, 0);
+	worker.Sync();
+	WaitForStop();
+	worker.SavePreset(1);
+	worker.Sync();
+
+	SimulatedCamera::Position presets[2]{};
+	SimulatedCamera::GetPosition(strPath, presets[1]);
+	worker.GotoPreset(0);
+	worker.Sync();
+	WaitForStop();
+	SimulatedCamera::GetPosition(strPath, presets[0]);
+
+	// The slowest axis decides
+	const PtzKinematics model;
+	const double dPredictedMs = 1000 * std::max(model.TravelTime(PtzKinematics::AxisPan, presets[0].lPan, presets[1].lPan),
+												model.TravelTime(PtzKinematics::AxisTilt, presets[0].lTilt, presets[1].lTilt));
+	std::vector<double> travel;
+	for (int i = 0; i < iRecalls; ++i)
+	{
+		worker.GotoPreset(1 - i % 2);
+		worker.Sync();
+		LONGLONG llMoving = MotorPulseScheduler::Now();
+		WaitForStop();
+		travel.push_back(MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llMoving));
+	}
+	worker.Stop(INFINITE);
+
+	// The stop is seen one poll and one transfer late at most
+	Check("deterministic", bDeterministic);
+	Check("travel_as_predicted", std::abs(Mean(travel) - dPredictedMs) <= 0.1 * dPredictedMs + 2 * dwLatency + 20);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"kinematics\",\n  \"cameras\": %d,\n  \"script_seconds\": %d,\n"
+			   "  \"script_ms\": %.3f,\n  \"deterministic\": %s,\n  \"latency_ms\": %u,\n  \"recalls\": %d,\n"
+			   "  \"preset_distance\": { \"pan\": %ld, \"tilt\": %ld },\n  \"predicted_travel_ms\": %.3f,\n  \"travel_ms\": %s\n}\n",
+			   iCameras, SCRIPT_SECONDS, dScriptMs, bDeterministic ? "true" : "false", dwLatency, iRecalls,
+			   std::abs(presets[1].lPan - presets[0].lPan), std::abs(presets[1].lTilt - presets[0].lTilt),
+			   dPredictedMs, StatisticsJson(travel).GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Injected faults
+//	Every n-th call of the first camera times out, the second camera is
+//	unplugged after some calls. All cameras zoom count ticks. Reports the
+//	failed commands per camera and the zoom latency of the healthy ones.
+
+CStringA Benchmark::RunFaults(int iTicks, int iCameras, DWORD dwLatency)
+{
+	static constexpr UINT TIMEOUT_EVERY{ 5 };
+	static constexpr DWORD TIMEOUT_DELAY{ 50 };	// msec
+	static constexpr UINT UNPLUG_AFTER{ 20 };
+	if (iTicks <= 0)
+		iTicks = 50;
+	iCameras = std::max(iCameras, 3);
+
+	const auto devices = SimulatedCamera::Devices(iCameras, dwLatency);
+	std::vector<std::unique_ptr<WebcamWorker>> workers;
+	for (const auto& device : devices)
+	{
+		workers.push_back(OpenWorker(device.devicePath, static_cast<WORD>(workers.size())));
+		if (!workers.back())
+			return "";
+	}
+	SimulatedCamera::InjectFaults(devices[0].devicePath, SimulatedCamera::Faults{ TIMEOUT_EVERY, TIMEOUT_DELAY, 0 });
+	SimulatedCamera::InjectFaults(devices[1].devicePath, SimulatedCamera::Faults{ 0, 0, UNPLUG_AFTER });
+
+	for (int i = 0; i < iTicks; ++i)
+	{
+		for (auto& spWorker : workers)
+			spWorker->Zoom(i < iTicks / 2 ? 1 : -1);
+		for (auto& spWorker : workers)
+			spWorker->Sync();
+	}
+
+	CStringA strCameras;
+	for (size_t c = 0; c < workers.size(); ++c)
+	{
+		const auto zoom = workers[c]->GetCommandLatency(CameraCommand::Zoom).Summarize();
+		CStringA strCamera;
+		strCamera.Format("%s    { \"camera\": %u, \"fault\": \"%s\", \"commands\": %u, \"failed\": %u, \"mean_ms\": %.3f, \"p99_ms\": %.3f }",
+						 strCameras.IsEmpty() ? "" : ",\n", static_cast<UINT>(c) + 1, c == 0 ? "timeout" : c == 1 ? "unplug" : "none",
+						 zoom.uCount, zoom.uErrors, zoom.dMean, zoom.dP99);
+		strCameras += strCamera;
+
+		// The faults stay with their cameras
+		CStringA strCheck;
+		strCheck.Format("camera_%u_%s", static_cast<UINT>(c) + 1, c < 2 ? "failed" : "healthy");
+		Check(strCheck, c < 2 ? zoom.uErrors > 0 : zoom.uErrors == 0);
+	}
+	for (auto& spWorker : workers)
+		spWorker->Stop(INFINITE);
+	SimulatedCamera::InjectFaults(devices[0].devicePath, SimulatedCamera::Faults{});
+	SimulatedCamera::InjectFaults(devices[1].devicePath, SimulatedCamera::Faults{});
+	SimulatedCamera::SetConnected(devices[1].devicePath, true);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"faults\",\n  \"cameras\": %d,\n  \"latency_ms\": %u,\n  \"ticks\": %d,\n"
+			   "  \"timeout_every\": %u,\n  \"unplug_after\": %u,\n  \"runs\": [\n%s\n  ]\n}\n",
+			   iCameras, dwLatency, iTicks, TIMEOUT_EVERY, UNPLUG_AFTER, strCameras.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	End to end workload
+//	Plays an operator script on 1, 2, 4, 8 and 16 cameras, as the dialog
+//	does it: switch to a camera, recall a preset, hold a pan button and hold
+//	a zoom button, then the next camera. Held buttons drive the velocity
+//	engine. The initial auto repeat delay is left out, it only waits for the
+//	operator. The script waits for a camera only before its next action, not
+//	before it switches to the next camera.
+//	Reports the commands per second, the latency from the first input of an
+//	action to its first transfer to the device and the transfers per action.
+
+CStringA Benchmark::RunWorkload(int iRounds, int iMaxCameras, DWORD dwLatency)
+{
+	static constexpr int HOLD_TICKS{ 4 };		// Time a button is held, in auto repeat ticks
+	if (iRounds <= 0)
+		iRounds = 2;
+	if (iMaxCameras <= 0)
+		iMaxCameras = 16;
+	if (dwLatency == 0)
+		dwLatency = 10;
+
+	enum Action { Recall, HeldPan, ZoomRamp, NUM_ACTIONS };
+	static const char* const s_actionNames[NUM_ACTIONS] = { "recall", "held_pan", "zoom_ramp" };
+
+	// The commands the cameras executed, without opens and the waits of the script
+	auto CountCommands = [](const WebcamWorker& worker)
+	{
+		UINT uCommands = 0;
+		for (int i = 0; i < static_cast<int>(CameraCommand::NUM_COMMANDS); ++i)
+		{
+			auto cmd = static_cast<CameraCommand>(i);
+			if (cmd != CameraCommand::Open && cmd != CameraCommand::Sync)
+				uCommands += worker.GetCommandLatency(cmd).Summarize().uCount;
+		}
+		return uCommands;
+	};
+
+	std::vector<int> cameraCounts;
+	for (int iCameras = 1; iCameras < iMaxCameras; iCameras *= 2)
+		cameraCounts.push_back(iCameras);
+	cameraCounts.push_back(iMaxCameras);
+
+	CStringA strRuns;
+	for (int iCameras : cameraCounts)
+	{
+		const auto devices = SimulatedCamera::Devices(iCameras, dwLatency);
+		std::vector<std::unique_ptr<WebcamWorker>> workers;
+		std::vector<UINT> commandsAtStart;
+		for (const auto& device : devices)
+		{
+			workers.push_back(OpenWorker(device.devicePath, static_cast<WORD>(workers.size())));
+			if (!workers.back())
+				return "";
+			auto& worker = *workers.back();
+			worker.GotoHome();
+			worker.SavePreset(0);
+			worker.Sync();
+			commandsAtStart.push_back(CountCommands(worker));
+		}
+
+		// An action is waited for before the next one on the same camera, so its transfers can be counted
+		struct Pending
+		{
+			bool bActive;
+			Action action;
+			LONGLONG llInput;
+			UINT uTransfers;
+		};
+		std::vector<Pending> pending(workers.size(), Pending{ false });
+		std::vector<double> latencies[NUM_ACTIONS], transfers[NUM_ACTIONS];
+		auto Finish = [&](size_t c)
+		{
+			if (!pending[c].bActive)
+				return;
+			workers[c]->Sync();
+			Pending& done = pending[c];
+			LONGLONG llTransfer = SimulatedCamera::GetWatchedTransfer(devices[c].devicePath);
+			if (llTransfer)
+				latencies[done.action].push_back(MotorPulseScheduler::ToMilliseconds(llTransfer - done.llInput));
+			transfers[done.action].push_back(SimulatedCamera::GetCallCounts(devices[c].devicePath).Total() - done.uTransfers);
+			done.bActive = false;
+		};
+		auto Start = [&](size_t c, Action action)
+		{
+			Finish(c);
+			SimulatedCamera::WatchNextTransfer(devices[c].devicePath);
+			pending[c] = Pending{ true, action, MotorPulseScheduler::Now(), SimulatedCamera::GetCallCounts(devices[c].devicePath).Total() };
+		};
+
+		int iSwitches = 0;
+		size_t currentCam = 0;
+		LONGLONG llStart = MotorPulseScheduler::Now();
+		for (int i = 0; i < iRounds; ++i)
+		{
+			for (size_t c = 0; c < workers.size(); ++c)
+			{
+				// Like SetActiveCam: only the target of the next inputs changes, nothing is sent
+				if (c != currentCam)
+				{
+					currentCam = c;
+					++iSwitches;
+				}
+				auto& worker = *workers[currentCam];
+				const int iDirection = i % 2 ? -1 : 1;
+
+				Start(currentCam, Recall);
+				worker.GotoPreset(0);
+
+				// Held buttons only set the velocity when they change, as UpdateHeldInputs does
+				Start(currentCam, HeldPan);
+				worker.SetVelocity(iDirection, 0);
+				::Sleep(HOLD_TICKS * AUTO_REPEAT_DELAY);
+				worker.SetVelocity(0, 0);
+
+				Start(currentCam, ZoomRamp);
+				worker.SetVelocity(0, 0, 1);
+				::Sleep(HOLD_TICKS * AUTO_REPEAT_DELAY);
+				worker.SetVelocity(0, 0, 0);
+			}
+		}
+		for (size_t c = 0; c < workers.size(); ++c)
+			Finish(c);
+		const double dSeconds = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart) / 1000.0;
+
+		UINT uCommands = 0;
+		for (size_t c = 0; c < workers.size(); ++c)
+			uCommands += CountCommands(*workers[c]) - commandsAtStart[c];
+		for (auto& spWorker : workers)
+			spWorker->Stop(INFINITE);
+
+		std::vector<double> allLatencies;
+		CStringA strActions;
+		for (int a = 0; a < NUM_ACTIONS; ++a)
+		{
+			allLatencies.insert(allLatencies.end(), latencies[a].begin(), latencies[a].end());
+
+			// Every action was done and reached the device
+			CStringA strCheck;
+			strCheck.Format("%s_%d_cameras_reached_bus", s_actionNames[a], iCameras);
+			Check(strCheck, transfers[a].size() == static_cast<size_t>(iRounds) * iCameras && latencies[a].size() == transfers[a].size());
+			double dTransfers = 0;
+			for (double d : transfers[a])
+				dTransfers += d;
+			CStringA strAction;
+			strAction.Format("%s        \"%s\": { \"actions\": %u, \"transfers_per_action\": %.2f, \"input_to_bus_ms\": %s }",
+							 strActions.IsEmpty() ? "" : ",\n", s_actionNames[a], static_cast<UINT>(transfers[a].size()),
+							 transfers[a].empty() ? 0.0 : dTransfers / transfers[a].size(), StatisticsJson(latencies[a]).GetString());
+			strActions += strAction;
+		}
+
+		CStringA strRun;
+		strRun.Format("%s    {\n      \"cameras\": %d,\n      \"seconds\": %.3f,\n      \"actions\": %d,\n      \"switches\": %d,\n"
+					  "      \"commands\": %u,\n      \"commands_per_second\": %.1f,\n      \"input_to_bus_ms\": %s,\n"
+					  "      \"by_action\": {\n%s\n      }\n    }",
+					  strRuns.IsEmpty() ? "" : ",\n", iCameras, dSeconds, iRounds * iCameras * NUM_ACTIONS + iSwitches, iSwitches,
+					  uCommands, uCommands / dSeconds, StatisticsJson(allLatencies).GetString(), strActions.GetString());
+		strRuns += strRun;
+	}
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"workload\",\n  \"latency_ms\": %u,\n  \"rounds\": %d,\n  \"tick_ms\": %d,\n  \"hold_ticks\": %d,\n"
+			   "  \"runs\": [\n%s\n  ]\n}\n",
+			   dwLatency, iRounds, AUTO_REPEAT_DELAY, HOLD_TICKS, strRuns.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Software presets
+//	Fills the stores of some cameras with count presets in total, saves and
+//	loads them as the dialog does at startup and times lookups by ID. Then
+//	recalls presets on a simulated camera and reports the transfers per
+//	recall and whether the camera arrived at the stored position.
+
+CStringA Benchmark::RunPresets(int iPresets, int iCameras, DWORD dwLatency)
+{
+	static constexpr int LOOKUPS{ 1000000 };
+	static constexpr int RECALLS{ 8 };
+	if (iPresets <= 0)
+		iPresets = 1000;
+	if (iCameras <= 0)
+		iCameras = 4;
+
+	std::vector<std::unique_ptr<PresetStore>> stores;
+	for (int c = 0; c < iCameras; ++c)
+	{
+		stores.push_back(std::make_unique<PresetStore>());
+		for (int i = c; i < iPresets; i += iCameras)
+		{
+			CString strName;
+			strName.Format(_T("Preset %d"), i + 1);
+			stores.back()->Put(static_cast<UINT>(i), strName, WebcamController::AbsolutePosition{ i % 341 - 170, i % 121 - 30, 100 + i % 401 });
+		}
+	}
+
+	LONGLONG llStart = MotorPulseScheduler::Now();
+	std::vector<std::vector<BYTE>> saved;
+	size_t nBytes = 0;
+	for (const auto& spStore : stores)
+	{
+		saved.push_back(spStore->Save());
+		nBytes += saved.back().size();
+	}
+	double dSaveMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+
+	llStart = MotorPulseScheduler::Now();
+	std::vector<std::unique_ptr<PresetStore>> loaded;
+	for (const auto& data : saved)
+	{
+		loaded.push_back(std::make_unique<PresetStore>());
+		if (!loaded.back()->Load(data.data(), data.size()))
+			return "";
+	}
+	double dLoadMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+
+	// Every ID is looked up in the store of its camera, some miss
+	int iFound = 0;
+	llStart = MotorPulseScheduler::Now();
+	for (int i = 0; i < LOOKUPS; ++i)
+	{
+		UINT uId = static_cast<UINT>(i) * 7919 % static_cast<UINT>(iPresets + iPresets / 10);
+		PresetStore::Preset preset;
+		if (loaded[uId % iCameras]->Find(uId, preset))
+			++iFound;
+	}
+	double dLookupNs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart) * 1e6 / LOOKUPS;
+
+	// Recalls on a simulated camera: capture positions, then move between them
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	auto WaitForStop = [&]()
+	{
+		while (SimulatedCamera::IsMoving(strPath))
+			::Sleep(1);
+	};
+	SimulatedCamera::Position positions[2]{};
+	for (UINT uId = 0; uId < 2; ++uId)
+	{
+		worker.Send(CameraCommand::GotoPosition, [uId](WebcamController& camera)
+		{
+			return camera.SetAbsolutePosition(WebcamController::AbsolutePosition{ uId ? 60L : -40L, uId ? 20L : -10L, uId ? 300L : 150L });
+		});
+		WaitForStop();
+		worker.SavePosition(uId, uId ? _T("Pulpit") : _T("Choir"));
+		worker.Sync();
+		SimulatedCamera::GetPosition(strPath, positions[uId]);
+	}
+
+	std::vector<double> transfers;
+	int iArrived = 0;
+	for (int i = 0; i < RECALLS; ++i)
+	{
+		UINT uId = i % 2;
+		UINT uCalls = SimulatedCamera::GetCallCounts(strPath).Total();
+		if (!worker.GotoPosition(uId))
+			return "";
+		worker.Sync();
+		transfers.push_back(SimulatedCamera::GetCallCounts(strPath).Total() - uCalls);
+		WaitForStop();
+		SimulatedCamera::Position position;
+		if (SimulatedCamera::GetPosition(strPath, position) && position.lPan == positions[uId].lPan &&
+			position.lTilt == positions[uId].lTilt && position.lZoom == positions[uId].lZoom)
+			++iArrived;
+	}
+	worker.Stop(INFINITE);
+
+	// Only IDs below the count exist, the others miss
+	int iExisting = 0;
+	for (int i = 0; i < LOOKUPS; ++i)
+	{
+		if (static_cast<UINT>(i) * 7919 % static_cast<UINT>(iPresets + iPresets / 10) < static_cast<UINT>(iPresets))
+			++iExisting;
+	}
+	Check("every_existing_found", iFound == iExisting);
+	Check("lookup_below_one_usec", dLookupNs < 1000);
+	Check("load_below_100ms", dLoadMs < 100);
+	Check("every_recall_arrived", iArrived == RECALLS);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"presets\",\n  \"presets\": %d,\n  \"cameras\": %d,\n  \"latency_ms\": %u,\n"
+			   "  \"saved_bytes\": %u,\n  \"save_ms\": %.3f,\n  \"load_ms\": %.3f,\n"
+			   "  \"lookups\": %d,\n  \"found\": %d,\n  \"lookup_ns\": %.1f,\n"
+			   "  \"recalls\": %d,\n  \"arrived\": %d,\n  \"transfers_per_recall\": %s\n}\n",
+			   iPresets, iCameras, dwLatency, static_cast<UINT>(nBytes), dSaveMs, dLoadMs,
+			   LOOKUPS, iFound, dLookupNs, RECALLS, iArrived, StatisticsJson(transfers).GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Arrival detection
+//	Recalls two presets on a simulated camera whose travel times are known.
+//	Compares the time the camera really stopped (looked at every msec) with
+//	the time the settled event was set and with the reported arrival, and
+//	counts the polling transfers per recall.
+
+CStringA Benchmark::RunSettle(int iRecalls, DWORD dwLatency)
+{
+	if (iRecalls <= 0)
+		iRecalls = 10;
+
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	const HANDLE hSettled = worker.GetSettledEvent();
+
+	// Preset 0 at home, preset 1 far away on all axes
+	const WebcamController::AbsolutePosition far{ 90, 45, 350 };
+	worker.GotoHome();
+	::WaitForSingleObject(hSettled, INFINITE);
+	worker.SavePreset(0);
+	worker.Send(CameraCommand::GotoPosition, [far](WebcamController& camera) { return camera.SetAbsolutePosition(far); });
+	while (SimulatedCamera::IsMoving(strPath))
+		::Sleep(1);
+	worker.SavePreset(1);
+	worker.Sync();
+
+	const PtzKinematics model;
+	SimulatedCamera::Position home{};
+	SimulatedCamera::GetPosition(strPath, home);
+	double dPredictedMs = 0;
+	for (auto axis : { PtzKinematics::AxisPan, PtzKinematics::AxisTilt, PtzKinematics::AxisZoom })
+	{
+		const long alHome[] = { home.lPan, home.lTilt, home.lZoom };
+		const long alFar[] = { far.lPan, far.lTilt, far.lZoom };
+		dPredictedMs = std::max(dPredictedMs, 1000 * model.TravelTime(axis, alHome[axis], alFar[axis]));
+	}
+
+	std::vector<double> stopped, detected, late, transfers;
+	for (int i = 0; i < iRecalls; ++i)
+	{
+		UINT uCalls = SimulatedCamera::GetCallCounts(strPath).Total();
+		LONGLONG llStart = MotorPulseScheduler::Now();
+		worker.GotoPreset(i % 2);
+
+		// Wait until it starts, then until it stops
+		bool bStarted = false;
+		double dStoppedMs = -1;
+		for (;;)
+		{
+			bool bMoving = SimulatedCamera::IsMoving(strPath);
+			double dNowMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+			bStarted |= bMoving;
+			if (bMoving)
+				dStoppedMs = -1;
+			else if (bStarted && dStoppedMs < 0)
+				dStoppedMs = dNowMs;
+			if (::WaitForSingleObject(hSettled, 0) == WAIT_OBJECT_0 || dNowMs > 10000)
+				break;
+			::Sleep(1);
+		}
+		double dDetectedMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+		worker.Sync();
+		stopped.push_back(dStoppedMs);
+		detected.push_back(dDetectedMs);
+		late.push_back(dDetectedMs - dStoppedMs);
+		// Without the recall itself
+		transfers.push_back(SimulatedCamera::GetCallCounts(strPath).Total() - uCalls - 1.0);
+	}
+	const auto arrival = worker.GetArrivalLatency(0).Summarize();
+	const auto arrivalFar = worker.GetArrivalLatency(1).Summarize();
+	worker.Stop(INFINITE);
+
+	// The arrival takes two equal samples, polled at most every 200 msec
+	Check("no_arrival_errors", arrival.uErrors + arrivalFar.uErrors == 0);
+	Check("every_recall_settled", Max(detected) <= 10000 && *std::min_element(stopped.begin(), stopped.end()) >= 0);
+	Check("detected_within_two_polls", Max(late) <= 2 * 200 + 4 * dwLatency + 20);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"settle\",\n  \"latency_ms\": %u,\n  \"recalls\": %d,\n  \"predicted_travel_ms\": %.3f,\n"
+			   "  \"stopped_ms\": %s,\n  \"settled_event_ms\": %s,\n  \"detected_late_ms\": %s,\n  \"poll_transfers_per_recall\": %s,\n"
+			   "  \"reported_arrival_ms\": { \"preset1_mean\": %.3f, \"preset2_mean\": %.3f, \"errors\": %u }\n}\n",
+			   dwLatency, iRecalls, dPredictedMs,
+			   StatisticsJson(stopped).GetString(), StatisticsJson(detected).GetString(), StatisticsJson(late).GetString(),
+			   StatisticsJson(transfers).GetString(), arrival.dMean, arrivalFar.dMean, arrival.uErrors + arrivalFar.uErrors);
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Travel time prediction
+//	Times learning and predicting of the travel model. Then recalls three
+//	presets of a simulated camera in turn count times and compares the
+//	prediction made before every recall with the time until the camera
+//	had settled.
+
+CStringA Benchmark::RunTravel(int iRecalls, DWORD dwLatency)
+{
+	static constexpr int LEARNED{ 1000000 };
+	static constexpr int PRESETS{ 3 };
+	if (iRecalls <= 0)
+		iRecalls = 30;
+
+	TravelModel model(WebcamWorker::NUM_TARGETS);
+	LONGLONG llStart = MotorPulseScheduler::Now();
+	double dSum = 0;
+	for (int i = 0; i < LEARNED; ++i)
+	{
+		model.Learn(i % WebcamWorker::NUM_TARGETS, (i / 3) % WebcamWorker::NUM_TARGETS, 1000.0 + i % 500);
+		dSum += model.Predict(i % WebcamWorker::NUM_TARGETS, (i / 7) % WebcamWorker::NUM_TARGETS);
+	}
+	const double dUpdateNs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart) * 1e6 / LEARNED;
+
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	const HANDLE hSettled = worker.GetSettledEvent();
+
+	// The presets are placed so every pair has another travel time
+	const WebcamController::AbsolutePosition positions[PRESETS]{ { 0, 0, 100 }, { 90, 45, 350 }, { -40, 10, 200 } };
+	for (int i = 0; i < PRESETS; ++i)
+	{
+		const auto position = positions[i];
+		worker.Send(CameraCommand::GotoPosition, [position](WebcamController& camera) { return camera.SetAbsolutePosition(position); });
+		while (SimulatedCamera::IsMoving(strPath))
+			::Sleep(1);
+		worker.SavePreset(i);
+	}
+	worker.Sync();
+
+	// Every transition is seen once before its prediction counts
+	std::vector<double> errors, absErrors;
+	int iPredicted = 0;
+	for (int i = 0; i < iRecalls; ++i)
+	{
+		int iPreset = i % PRESETS;
+		double dPredictedMs = worker.PredictTravel(iPreset);
+		LONGLONG llRecall = MotorPulseScheduler::Now();
+		worker.GotoPreset(iPreset);
+		::WaitForSingleObject(hSettled, INFINITE);
+		double dTravelMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llRecall);
+		worker.Sync();
+		if (dPredictedMs >= 0)
+			++iPredicted;
+		if (dPredictedMs >= 0 && i >= 2 * PRESETS)
+		{
+			errors.push_back(dPredictedMs - dTravelMs);
+			absErrors.push_back(std::abs(dPredictedMs - dTravelMs));
+		}
+	}
+	worker.Stop(INFINITE);
+
+	// The settled event comes up to two polls after the learned arrival
+	Check("learn_and_predict_below_one_usec", dUpdateNs < 1000);
+	Check("every_transition_predicted", !errors.empty() && iPredicted >= iRecalls - PRESETS);
+	Check("prediction_within_two_polls", Mean(absErrors) <= 2 * 200 + 4 * dwLatency + 20);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"travel\",\n  \"latency_ms\": %u,\n  \"recalls\": %d,\n"
+			   "  \"learn_and_predict_ns\": %.1f,\n  \"checksum\": %.0f,\n  \"predicted\": %d,\n"
+			   "  \"prediction_error_ms\": %s,\n  \"prediction_abs_error_ms\": %s\n}\n",
+			   dwLatency, iRecalls, dUpdateNs, dSum, iPredicted,
+			   StatisticsJson(errors).GetString(), StatisticsJson(absErrors).GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Held inputs
+//	Holds pan on a simulated camera with motors: a nudge, a slow and a fast
+//	hold, and the fast hold again with rare input repeats. Every phase runs
+//	count times from home. Compares the commanded way (steps times the motor
+//	interval times the speed) with the way the camera went, and counts the
+//	control steps per second, which must not depend on the input rate.
+
+CStringA Benchmark::RunVelocity(int iTrials, DWORD dwLatency)
+{
+	struct Phase
+	{
+		LPCSTR pszName;
+		double dIntent;
+		DWORD dwHold;		// msec
+		DWORD dwRepeat;		// msec between the inputs, 0 for a single one
+	};
+	static const Phase s_aPhases[] =
+	{
+		{ "nudge", 1.0, 0, 0 },
+		{ "fine", 0.3, 1500, 30 },
+		{ "sweep", 1.0, 2000, 30 },
+		{ "sweep_rare_input", 1.0, 2000, 500 },
+	};
+	if (iTrials <= 0)
+		iTrials = 3;
+
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	const double dStepDegrees = worker.Camera().motorIntervalTime / 1000.0 * PtzKinematics::DefaultLimits()[PtzKinematics::AxisPan].dSpeed;
+	auto GetPan = [&]()
+	{
+		SimulatedCamera::Position position{};
+		SimulatedCamera::GetPosition(strPath, position);
+		return static_cast<double>(position.lPan);
+	};
+
+	CStringA strPhases;
+	double dSweepRate = 0;
+	for (const Phase& phase : s_aPhases)
+	{
+		std::vector<double> steps, commanded, achieved, lag, rate;
+		for (int i = 0; i < iTrials; ++i)
+		{
+			worker.GotoHome();
+			::WaitForSingleObject(worker.GetSettledEvent(), INFINITE);
+			const double dSign = i % 2 ? -1 : 1;
+			const double dStartPan = GetPan();
+			const long long llStartSteps = worker.GetVelocitySteps(MotionEngine::AxisPan);
+			const UINT uStartCommands = worker.GetCommandLatency(CameraCommand::Velocity).Summarize().uCount;
+
+			// The inputs repeat as a key would, the camera is sampled every msec
+			double dMaxLag = 0;
+			LONGLONG llStart = MotorPulseScheduler::Now();
+			double dNextInput = 0;
+			for (;;)
+			{
+				double dNowMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+				if (dNowMs >= phase.dwHold)
+					break;
+				if (dNowMs >= dNextInput)
+				{
+					worker.SetVelocity(dSign * phase.dIntent, 0);
+					dNextInput = phase.dwRepeat ? dNextInput + phase.dwRepeat : phase.dwHold;
+				}
+				double dCommanded = (worker.GetVelocitySteps(MotionEngine::AxisPan) - llStartSteps) * dStepDegrees;
+				dMaxLag = std::max(dMaxLag, std::abs(dCommanded - (GetPan() - dStartPan)));
+				::Sleep(1);
+			}
+			if (phase.dwHold == 0)
+				worker.SetVelocity(dSign * phase.dIntent, 0);
+			double dHoldMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+			UINT uCommands = worker.GetCommandLatency(CameraCommand::Velocity).Summarize().uCount - uStartCommands;
+			worker.SetVelocity(0, 0);
+
+			// The last step and the pulse it started
+			::Sleep(2 * WebcamWorker::CONTROL_INTERVAL);
+			worker.Sync();
+			while (SimulatedCamera::IsMoving(strPath))
+				::Sleep(1);
+			double dSteps = static_cast<double>(worker.GetVelocitySteps(MotionEngine::AxisPan) - llStartSteps) * dSign;
+			steps.push_back(dSteps);
+			commanded.push_back(dSteps * dStepDegrees);
+			achieved.push_back((GetPan() - dStartPan) * dSign);
+			lag.push_back(dMaxLag);
+			if (phase.dwHold)
+				rate.push_back(uCommands * 1000.0 / dHoldMs);
+		}
+
+		// The camera goes the commanded way, the control rate doesn't follow the input rate
+		Check(CStringA(phase.pszName) + "_moves", Mean(achieved) > 0);
+		Check(CStringA(phase.pszName) + "_goes_commanded_way",
+			  Mean(achieved) >= 0.5 * Mean(commanded) && Mean(achieved) <= 1.5 * Mean(commanded) + dStepDegrees);
+		if (CStringA(phase.pszName) == "sweep")
+			dSweepRate = Mean(rate);
+		else if (CStringA(phase.pszName) == "sweep_rare_input")
+			Check("rate_independent_of_input", std::abs(Mean(rate) - dSweepRate) <= 0.2 * dSweepRate);
+
+		CStringA str;
+		str.Format("%s    \"%s\": { \"intent\": %.1f, \"hold_ms\": %u, \"input_repeat_ms\": %u,\n"
+				   "      \"steps\": %s,\n      \"commanded_deg\": %s,\n      \"achieved_deg\": %s,\n"
+				   "      \"max_lag_deg\": %s,\n      \"control_steps_per_second\": %s }",
+				   strPhases.IsEmpty() ? "" : ",\n", phase.pszName, phase.dIntent, phase.dwHold, phase.dwRepeat,
+				   StatisticsJson(steps).GetString(), StatisticsJson(commanded).GetString(), StatisticsJson(achieved).GetString(),
+				   StatisticsJson(lag).GetString(), StatisticsJson(rate).GetString());
+		strPhases += str;
+	}
+	worker.Stop(INFINITE);
+
+	const auto curve = MotionEngine::DefaultCurve(MotionEngine::AxisPan);
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"velocity\",\n  \"latency_ms\": %u,\n  \"trials\": %d,\n  \"control_interval_ms\": %u,\n"
+			   "  \"curve\": { \"min_speed\": %.1f, \"max_speed\": %.1f, \"ramp_s\": %.2f, \"exponent\": %.2f },\n"
+			   "  \"step_deg\": %.3f,\n  \"phases\": {\n%s\n  }\n}\n",
+			   dwLatency, iTrials, WebcamWorker::CONTROL_INTERVAL, curve.dMinSpeed, curve.dMaxSpeed, curve.dRampTime, curve.dExponent,
+			   dStepDegrees, strPhases.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Full range zoom
+//	Holds zoom in from the widest to the narrowest zoom: with the old auto
+//	repeat of single steps, with the steps of the motion engine that grow
+//	while held, and with the zoom motor of the camera. Counts the transfers
+//	and the time until the end of the range is reached.
+
+CStringA Benchmark::RunZoomRange(int iRounds, DWORD dwLatency)
+{
+	enum Mode
+	{
+		ModeAutoRepeat,
+		ModeAdaptive,
+		ModeMotor,
+	};
+	static const LPCSTR s_apszModes[] = { "auto_repeat", "adaptive", "motor" };
+	static const DWORD TIMEOUT{ 20000 };
+	if (iRounds <= 0)
+		iRounds = 3;
+
+	// The first device has a zoom motor, the second one only absolute zoom
+	const auto devices = SimulatedCamera::Devices(2, dwLatency);
+	SimulatedCamera::SetZoomMotor(devices[1].devicePath, false);
+	const double dMaxZoom = PtzKinematics::DefaultLimits()[PtzKinematics::AxisZoom].dMax;
+
+	CStringA strModes;
+	double dAutoRepeatTransfers = 0;
+	for (int iMode = ModeAutoRepeat; iMode <= ModeMotor; ++iMode)
+	{
+		const CString& strPath = devices[iMode == ModeMotor ? 0 : 1].devicePath;
+		auto spWorker = OpenWorker(strPath);
+		if (!spWorker)
+			return "";
+		WebcamWorker& worker = *spWorker;
+		auto GetZoom = [&]()
+		{
+			SimulatedCamera::Position position{};
+			SimulatedCamera::GetPosition(strPath, position);
+			return static_cast<double>(position.lZoom);
+		};
+
+		std::vector<double> transfers, durations;
+		for (int i = 0; i < iRounds; ++i)
+		{
+			worker.GotoHome();
+			worker.Sync();
+			::WaitForSingleObject(worker.GetSettledEvent(), INFINITE);
+			const UINT uBefore = SimulatedCamera::GetCallCounts(strPath).Total();
+
+			// Held until the camera is at the end of the range
+			LONGLONG llStart = MotorPulseScheduler::Now();
+			double dNextTick = 0;
+			double dElapsedMs = 0;
+			for (;;)
+			{
+				dElapsedMs = MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart);
+				if (GetZoom() >= dMaxZoom || dElapsedMs >= TIMEOUT)
+					break;
+				if (iMode == ModeAutoRepeat && dElapsedMs >= dNextTick)
+				{
+					worker.Zoom(1);
+					dNextTick += dNextTick == 0 ? AUTO_REPEAT_INITIAL_DELAY : AUTO_REPEAT_DELAY;
+				}
+				else if (iMode != ModeAutoRepeat && dNextTick == 0)
+				{
+					worker.SetVelocity(0, 0, 1);
+					dNextTick = TIMEOUT;
+				}
+				::Sleep(1);
+			}
+			if (iMode != ModeAutoRepeat)
+				worker.SetVelocity(0, 0, 0);
+
+			// The release stops a zoom motor with the next control step
+			::Sleep(2 * WebcamWorker::CONTROL_INTERVAL);
+			worker.Sync();
+			while (SimulatedCamera::IsMoving(strPath))
+				::Sleep(1);
+			transfers.push_back(SimulatedCamera::GetCallCounts(strPath).Total() - uBefore);
+			durations.push_back(dElapsedMs);
+		}
+		const bool bMotor = worker.Camera().HasZoomMotor();
+		worker.Stop(INFINITE);
+
+		// Every mode reaches the end, the engine and the motor with fewer transfers than the repeat
+		Check(CStringA(s_apszModes[iMode]) + "_reached_end", Max(durations) < TIMEOUT);
+		if (iMode == ModeAutoRepeat)
+			dAutoRepeatTransfers = Mean(transfers);
+		else
+			Check(CStringA(s_apszModes[iMode]) + "_fewer_transfers", Mean(transfers) < dAutoRepeatTransfers);
+
+		CStringA str;
+		str.Format("%s    \"%s\": { \"zoom_motor\": %s,\n      \"transfers\": %s,\n      \"duration_ms\": %s }",
+				   strModes.IsEmpty() ? "" : ",\n", s_apszModes[iMode], bMotor ? "true" : "false",
+				   StatisticsJson(transfers).GetString(), StatisticsJson(durations).GetString());
+		strModes += str;
+	}
+
+	const auto curve = MotionEngine::DefaultCurve(MotionEngine::AxisZoom);
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"zoomrange\",\n  \"latency_ms\": %u,\n  \"rounds\": %d,\n  \"auto_repeat_ms\": %u,\n"
+			   "  \"curve\": { \"min_speed\": %.1f, \"max_speed\": %.1f, \"ramp_s\": %.2f, \"exponent\": %.2f },\n"
+			   "  \"zoom_speed_percent\": %d,\n  \"modes\": {\n%s\n  }\n}\n",
+			   dwLatency, iRounds, AUTO_REPEAT_DELAY, curve.dMinSpeed, curve.dMaxSpeed, curve.dRampTime, curve.dExponent,
+			   WebcamController::DEFAULT_ZOOM_SPEED, strModes.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Step sizes of the Logitech motion control
+//	For some step sizes: count single nudges and a held pan of 2 seconds
+//	through the peripheral unit. Reports the way of a nudge, the way of the
+//	held pan and the transfers each of them needed.
+
+CStringA Benchmark::RunXUSteps(int iNudges, DWORD dwLatency)
+{
+	static const int s_aiStepSizes[] = { 100, 50, 25 };
+	static const DWORD HOLD{ 2000 };
+	if (iNudges <= 0)
+		iNudges = 10;
+
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	worker.Camera().useLogitechMotionControl = true;
+	worker.Camera().useLogitechMotorSteps = true;
+	auto GetPan = [&]()
+	{
+		SimulatedCamera::Position position{};
+		SimulatedCamera::GetPosition(strPath, position);
+		return static_cast<double>(position.lPan);
+	};
+	auto WaitForRest = [&]()
+	{
+		::Sleep(2 * WebcamWorker::CONTROL_INTERVAL);
+		worker.Sync();
+		while (SimulatedCamera::IsMoving(strPath))
+			::Sleep(1);
+	};
+
+	CStringA strRuns;
+	double dLastNudge = 0;
+	for (int iStepSize : s_aiStepSizes)
+	{
+		worker.Camera().logitechStepSize = iStepSize;
+
+		// Single presses, each one control step
+		worker.GotoHome();
+		::WaitForSingleObject(worker.GetSettledEvent(), INFINITE);
+		double dStart = GetPan();
+		UINT uBefore = SimulatedCamera::GetCallCounts(strPath).Total();
+		for (int i = 0; i < iNudges; ++i)
+		{
+			worker.SetVelocity(1, 0);
+			worker.SetVelocity(0, 0);
+			WaitForRest();
+		}
+		double dNudge = (GetPan() - dStart) / iNudges;
+		double dNudgeTransfers = static_cast<double>(SimulatedCamera::GetCallCounts(strPath).Total() - uBefore) / iNudges;
+
+		// A long press
+		worker.GotoHome();
+		::WaitForSingleObject(worker.GetSettledEvent(), INFINITE);
+		dStart = GetPan();
+		uBefore = SimulatedCamera::GetCallCounts(strPath).Total();
+		worker.SetVelocity(1, 0);
+		::Sleep(HOLD);
+		worker.SetVelocity(0, 0);
+		WaitForRest();
+		double dSweep = GetPan() - dStart;
+		UINT uSweepTransfers = SimulatedCamera::GetCallCounts(strPath).Total() - uBefore;
+
+		// The step sizes go from large to small
+		CStringA strCheck;
+		strCheck.Format("nudge_%d_smaller", iStepSize);
+		if (dLastNudge > 0)
+			Check(strCheck, dNudge > 0 && dNudge < dLastNudge);
+		dLastNudge = dNudge;
+
+		CStringA strRun;
+		strRun.Format("%s    { \"step_size_percent\": %d, \"nudge_deg\": %.2f, \"transfers_per_nudge\": %.2f, \"hold_deg\": %.1f, \"hold_transfers\": %u }",
+					  strRuns.IsEmpty() ? "" : ",\n", iStepSize, dNudge, dNudgeTransfers, dSweep, uSweepTransfers);
+		strRuns += strRun;
+	}
+	const DWORD dwResolution = worker.Camera().GetTopology().dwPanTiltResolution;
+	worker.Stop(INFINITE);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"xusteps\",\n  \"latency_ms\": %u,\n  \"nudges\": %d,\n  \"hold_ms\": %u,\n"
+			   "  \"resolution\": { \"pan\": %u, \"tilt\": %u },\n  \"runs\": [\n%s\n  ]\n}\n",
+			   dwLatency, iNudges, HOLD, LOWORD(dwResolution), HIWORD(dwResolution), strRuns.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Pan steps across the zoom range
+//	At five zoom levels from wide to narrow: count single pan steps with
+//	motor pulses and with the Logitech motion control, with and without the
+//	zoom scaling. Reports the way of a step in degrees and in percent of the
+//	picture width, and the reads the steps needed.
+
+CStringA Benchmark::RunZoomScale(int iNudges, DWORD dwLatency)
+{
+	static constexpr int ZOOM_LEVELS{ 5 };
+	static constexpr double WIDE_FIELD{ 80 };	// Picture width in degrees at the widest zoom
+	if (iNudges <= 0)
+		iNudges = 5;
+
+	const CString strPath = SimulatedCamera::Devices(1, dwLatency).front().devicePath;
+	auto spWorker = OpenWorker(strPath);
+	if (!spWorker)
+		return "";
+	WebcamWorker& worker = *spWorker;
+	// The simulated unit divides its steps, so scaled steps aren't collected to whole ones
+	worker.Camera().useLogitechMotorSteps = true;
+	const auto& zoom = PtzKinematics::DefaultLimits()[PtzKinematics::AxisZoom];
+
+	CStringA strRuns;
+	for (bool bLogitech : { false, true })
+	{
+		worker.Camera().useLogitechMotionControl = bLogitech;
+		for (int iScaling : { 0, WebcamController::DEFAULT_ZOOM_SCALING })
+		{
+			worker.Camera().zoomScaling = iScaling;
+			CStringA strLevels;
+			std::vector<double> fieldPercents;
+			UINT uLevelReads = 0;
+			for (int iLevel = 0; iLevel < ZOOM_LEVELS; ++iLevel)
+			{
+				// Home, then the zoom, so the controller knows it without a read
+				const long lZoom = std::lround(zoom.dMin + (zoom.dMax - zoom.dMin) * iLevel / (ZOOM_LEVELS - 1));
+				worker.GotoHome();
+				::WaitForSingleObject(worker.GetSettledEvent(), INFINITE);
+				worker.Send(CameraCommand::Zoom, [lZoom](WebcamController& camera)
+				{
+					WebcamController::AbsolutePosition position{};
+					HRESULT hr = camera.GetAbsolutePosition(position);
+					position.lZoom = lZoom;
+					return SUCCEEDED(hr) ? camera.SetAbsolutePosition(position) : hr;
+				});
+				while (SimulatedCamera::IsMoving(strPath))
+					::Sleep(1);
+
+				const double dStart = SimulatedCamera::GetExactPosition(strPath, PtzKinematics::AxisPan);
+				const UINT uReads = SimulatedCamera::GetCallCounts(strPath).uGet;
+				for (int i = 0; i < iNudges; ++i)
+				{
+					worker.MovePan(1);
+					worker.Sync();
+					::Sleep(2 * worker.Camera().motorIntervalTime);
+					worker.Sync();
+					while (SimulatedCamera::IsMoving(strPath))
+						::Sleep(1);
+				}
+				const double dStep = (SimulatedCamera::GetExactPosition(strPath, PtzKinematics::AxisPan) - dStart) / iNudges;
+				const double dField = WIDE_FIELD * zoom.dMin / lZoom;
+				fieldPercents.push_back(100 * dStep / dField);
+				uLevelReads += SimulatedCamera::GetCallCounts(strPath).uGet - uReads;
+
+				CStringA strLevel;
+				strLevel.Format("%s        { \"zoom\": %ld, \"step_deg\": %.3f, \"step_field_percent\": %.3f, \"reads\": %u }",
+								strLevels.IsEmpty() ? "" : ",\n", lZoom, dStep, 100 * dStep / dField,
+								SimulatedCamera::GetCallCounts(strPath).uGet - uReads);
+				strLevels += strLevel;
+			}
+
+			// Scaled steps keep their share of the picture, the zoom is known without reads
+			const CStringA strMode = bLogitech ? "xu" : "motor";
+			Check(strMode + (iScaling ? "_scaled" : "_unscaled") + "_no_reads", uLevelReads == 0);
+			if (iScaling)
+			{
+				Check(strMode + "_scaled_steps_even", *std::min_element(fieldPercents.begin(), fieldPercents.end()) > 0 &&
+					  Max(fieldPercents) <= 2 * *std::min_element(fieldPercents.begin(), fieldPercents.end()));
+			}
+
+			CStringA strRun;
+			strRun.Format("%s    { \"mode\": \"%s\", \"zoom_scaling\": %d, \"levels\": [\n%s\n      ] }",
+						  strRuns.IsEmpty() ? "" : ",\n", bLogitech ? "xu" : "motor", iScaling, strLevels.GetString());
+			strRuns += strRun;
+		}
+	}
+	worker.Stop(INFINITE);
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"zoomscale\",\n  \"latency_ms\": %u,\n  \"nudges\": %d,\n  \"wide_field_deg\": %.0f,\n"
+			   "  \"runs\": [\n%s\n  ]\n}\n",
+			   dwLatency, iNudges, WIDE_FIELD, strRuns.GetString());
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Pulse calibration
+//	Two cameras, one with the default motor and one with half its speed and
+//	acceleration, are calibrated count times. Reports the time a calibration
+//	takes, the fitted minimum pulse, speed and interval, and the way the
+//	curve predicts for some pulse widths against the way of the motor model.
+
+CStringA Benchmark::RunCalibrate(int iCalibrations, DWORD dwLatency)
+{
+	if (iCalibrations <= 0)
+		iCalibrations = 2;
+	static const double s_adWidths[] = { 50, 70, 100, 200, 400 };
+
+	const auto devices = SimulatedCamera::Devices(2, dwLatency);
+	PtzKinematics::Limits slow = PtzKinematics::DefaultLimits();
+	slow[PtzKinematics::AxisPan].dSpeed /= 2;
+	slow[PtzKinematics::AxisPan].dAcceleration /= 2;
+	SimulatedCamera::SetKinematics(devices[1].devicePath, slow);
+
+	CStringA strMotors;
+	for (size_t i = 0; i < devices.size(); ++i)
+	{
+		const auto limits = i == 0 ? PtzKinematics::DefaultLimits() : slow;
+		std::vector<double> durations, minimumPulses, speeds, intervals, errors;
+		double dMaxWay = 0;
+		CStringA strWays;
+		for (int iRun = 0; iRun < iCalibrations; ++iRun)
+		{
+			auto spWorker = OpenWorker(devices[i].devicePath);
+			if (!spWorker)
+				return "";
+			WebcamWorker& worker = *spWorker;
+
+			LONGLONG llStart = MotorPulseScheduler::Now();
+			worker.CalibratePulses();
+			worker.Sync();
+			durations.push_back(MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart));
+			const auto& calibration = worker.Camera().pulseCalibration;
+			if (!calibration.IsValid())
+				return "";
+			minimumPulses.push_back(calibration.GetMinimumPulse());
+			speeds.push_back(calibration.GetSpeed());
+			intervals.push_back(worker.Camera().motorIntervalTime);
+
+			// The way of the model: the motor runs for the width, then brakes to a stop
+			for (double dWidth : s_adWidths)
+			{
+				PtzKinematics model(limits);
+				model.Drive(PtzKinematics::AxisPan, 1, 0);
+				model.Drive(PtzKinematics::AxisPan, 0, dWidth / 1000);
+				const double dWay = model.GetPosition(PtzKinematics::AxisPan, dWidth / 1000 + 1) - limits[PtzKinematics::AxisPan].dHome;
+				const double dPredicted = calibration.WayOf(dWidth);
+				errors.push_back(std::abs(dPredicted - dWay));
+				dMaxWay = std::max(dMaxWay, dWay);
+				if (iRun == 0)
+				{
+					CStringA strWay;
+					strWay.Format("%s{ \"pulse_ms\": %.0f, \"model\": %.2f, \"calibrated\": %.2f }",
+								  strWays.IsEmpty() ? "" : ", ", dWidth, dWay, dPredicted);
+					strWays += strWay;
+				}
+			}
+			worker.Stop(INFINITE);
+		}
+
+		// A calibration is done within seconds and fits the motor model
+		CStringA strCheck;
+		strCheck.Format("motor_%u_", static_cast<UINT>(i) + 1);
+		Check(strCheck + "calibrated_within_10s", Max(durations) <= 10000);
+		Check(strCheck + "way_within_10_percent", Mean(errors) <= 0.1 * dMaxWay);
+
+		CStringA strMotor;
+		strMotor.Format("%s    { \"speed_deg_s\": %.0f, \"acceleration_deg_s2\": %.0f,\n      \"duration_ms\": %s,\n"
+						"      \"minimum_pulse_ms\": %s,\n      \"speed_deg_ms\": %s,\n      \"interval_ms\": %s,\n"
+						"      \"way_error_deg\": %s,\n      \"ways\": [ %s ] }",
+						strMotors.IsEmpty() ? "" : ",\n", limits[PtzKinematics::AxisPan].dSpeed, limits[PtzKinematics::AxisPan].dAcceleration,
+						StatisticsJson(durations).GetString(), StatisticsJson(minimumPulses).GetString(), StatisticsJson(speeds).GetString(),
+						StatisticsJson(intervals).GetString(), StatisticsJson(errors).GetString(), strWays.GetString());
+		strMotors += strMotor;
+	}
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"calibrate\",\n  \"latency_ms\": %u,\n  \"calibrations\": %d,\n  \"motors\": [\n%s\n  ]\n}\n",
+			   dwLatency, iCalibrations, strMotors.GetString());
+	return str;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//	Dead reckoning
+//	A simulated camera without absolute pan and tilt gets the calibration of
+//	a twin that has them. Then it plays a session of count moves: nudges,
+//	held motors and moves to absolute positions, with a recall of a device
+//	preset every 50 moves. After every move the estimate is compared with
+//	the real position. The same session runs with 0, 5 and 10 percent motor
+//	noise.
+
+CStringA Benchmark::RunDeadReckoning(int iMoves, DWORD dwLatency)
+{
+	static constexpr int ANCHOR_EVERY{ 50 };	// Moves between the recalls of the device preset
+	static constexpr int MAX_PAN{ 100 };		// The session stays away from the limits
+	static constexpr int MIN_TILT{ -20 };
+	static constexpr int MAX_TILT{ 60 };
+	if (iMoves <= 0)
+		iMoves = 100;
+
+	const auto devices = SimulatedCamera::Devices(2, dwLatency);
+	const CString strTwin = devices[0].devicePath;
+	const CString strPath = devices[1].devicePath;
+	SimulatedCamera::SetRelativeOnly(strPath, true);
+
+	CStringA strRuns;
+	for (DWORD dwNoise : { 0, 5, 10 })
+	{
+		SimulatedCamera::SetMotorNoise(strTwin, dwNoise);
+		SimulatedCamera::SetMotorNoise(strPath, dwNoise);
+
+		// The twin can read its position, so it can be calibrated
+		std::vector<BYTE> calibration;
+		int iInterval = 0;
+		{
+			auto spTwin = OpenWorker(strTwin);
+			if (!spTwin)
+				return "";
+			WebcamWorker& twin = *spTwin;
+			twin.CalibratePulses();
+			twin.Sync();
+			if (!twin.Camera().pulseCalibration.IsValid())
+				return "";
+			calibration = twin.Camera().pulseCalibration.Save();
+			iInterval = twin.Camera().motorIntervalTime;
+			twin.Stop(INFINITE);
+		}
+
+		auto spWorker = OpenWorker(strPath);
+		if (!spWorker)
+			return "";
+		WebcamWorker& worker = *spWorker;
+		worker.Camera().pulseCalibration.Load(calibration.data(), calibration.size());
+		worker.Camera().motorIntervalTime = iInterval;
+		const auto& estimator = worker.Camera().positionEstimator;
+		const HANDLE hSettled = worker.GetSettledEvent();
+		auto WaitForRest = [&]()
+		{
+			// The motor off command may still wait in the queue
+			worker.Sync();
+			while (SimulatedCamera::IsMoving(strPath))
+				::Sleep(1);
+			worker.Sync();
+		};
+
+		// Home is the first anchor, the device preset is saved away from it
+		worker.GotoHome();
+		::WaitForSingleObject(hSettled, INFINITE);
+		worker.Sync();
+		for (int i = 0; i < 3; ++i)
+		{
+			worker.MovePanTilt(3, 2);
+			WaitForRest();
+		}
+		worker.SavePreset(0);
+		worker.Sync();
+
+		std::minstd_rand random;
+		auto Uniform = [&](int iMin, int iMax) { return std::uniform_int_distribution<int>(iMin, iMax)(random); };
+		std::vector<double> panErrors, tiltErrors, uncertainties, beforeAnchor, gotoErrors;
+		int iInside = 0, iLost = 0, iGotoFailed = 0;
+		for (int iMove = 0; iMove < iMoves; ++iMove)
+		{
+			// Towards the middle near the limits
+			const double dPan = SimulatedCamera::GetExactPosition(strPath, PtzKinematics::AxisPan);
+			const double dTilt = SimulatedCamera::GetExactPosition(strPath, PtzKinematics::AxisTilt);
+			const int xSign = dPan > MAX_PAN / 2 ? -1 : dPan < -MAX_PAN / 2 ? 1 : Uniform(0, 1) ? 1 : -1;
+			const int ySign = dTilt > MAX_TILT - 20 ? -1 : dTilt < MIN_TILT + 10 ? 1 : Uniform(0, 1) ? 1 : -1;
+
+			if (iMove % ANCHOR_EVERY == ANCHOR_EVERY - 1)
+			{
+				worker.GotoPreset(0);
+				::WaitForSingleObject(hSettled, INFINITE);
+				worker.Sync();
+			}
+			else switch (iMove % 5)
+			{
+			case 0:
+			case 1:
+				worker.MovePan(xSign * Uniform(1, 3));
+				WaitForRest();
+				break;
+			case 2:
+				worker.MoveTilt(ySign * Uniform(1, 3));
+				WaitForRest();
+				break;
+			case 3:
+				// A held button
+				if (Uniform(0, 1))
+				{
+					worker.Pan(xSign);
+					::Sleep(Uniform(100, 600));
+					worker.Pan(0);
+				}
+				else
+				{
+					worker.Tilt(ySign);
+					::Sleep(Uniform(100, 600));
+					worker.Tilt(0);
+				}
+				WaitForRest();
+				break;
+			default:
+				{
+					// A position the camera can't set by itself
+					const WebcamController::AbsolutePosition target{ Uniform(-MAX_PAN, MAX_PAN), Uniform(MIN_TILT, MAX_TILT), 100 };
+					HRESULT hr = worker.Send(CameraCommand::GotoPosition, [target](WebcamController& camera) { return camera.SetAbsolutePosition(target); });
+					WaitForRest();
+					if (FAILED(hr))
+						++iGotoFailed;
+					else
+						gotoErrors.push_back(std::hypot(SimulatedCamera::GetExactPosition(strPath, PtzKinematics::AxisPan) - target.lPan,
+														SimulatedCamera::GetExactPosition(strPath, PtzKinematics::AxisTilt) - target.lTilt));
+				}
+				break;
+			}
+
+			const auto pan = estimator.Get(PositionEstimator::AxisPan);
+			const auto tilt = estimator.Get(PositionEstimator::AxisTilt);
+			if (!pan.bKnown || !tilt.bKnown)
+			{
+				++iLost;
+				continue;
+			}
+			const double dPanError = std::abs(pan.dPosition - SimulatedCamera::GetExactPosition(strPath, PtzKinematics::AxisPan));
+			const double dTiltError = std::abs(tilt.dPosition - SimulatedCamera::GetExactPosition(strPath, PtzKinematics::AxisTilt));
+			panErrors.push_back(dPanError);
+			tiltErrors.push_back(dTiltError);
+			uncertainties.push_back(std::max(pan.dUncertainty, tilt.dUncertainty));
+			if (dPanError <= pan.dUncertainty && dTiltError <= tilt.dUncertainty)
+				++iInside;
+			if (iMove % ANCHOR_EVERY == ANCHOR_EVERY - 2)
+				beforeAnchor.push_back(std::max(dPanError, dTiltError));
+		}
+		worker.Stop(INFINITE);
+
+		const size_t nSamples = panErrors.size();
+
+		// The real position stays inside the estimated bound
+		CStringA strCheck;
+		strCheck.Format("noise_%u_", dwNoise);
+		Check(strCheck + "inside_bound", nSamples && iInside >= 0.9 * nSamples);
+		Check(strCheck + "never_lost", iLost == 0);
+		Check(strCheck + "every_goto_done", iGotoFailed == 0);
+
+		CStringA strRun;
+		strRun.Format("%s    { \"motor_noise_percent\": %u, \"interval_ms\": %d, \"lost\": %d, \"inside_bound_percent\": %.1f,\n"
+					  "      \"pan_error_deg\": %s,\n      \"tilt_error_deg\": %s,\n      \"uncertainty_deg\": %s,\n"
+					  "      \"error_before_anchor_deg\": %s,\n      \"goto_error_deg\": %s,\n      \"goto_failed\": %d }",
+					  strRuns.IsEmpty() ? "" : ",\n", dwNoise, iInterval, iLost, nSamples ? 100.0 * iInside / nSamples : 0.0,
+					  StatisticsJson(panErrors).GetString(), StatisticsJson(tiltErrors).GetString(), StatisticsJson(uncertainties).GetString(),
+					  StatisticsJson(beforeAnchor).GetString(), StatisticsJson(gotoErrors).GetString(), iGotoFailed);
+		strRuns += strRun;
+	}
+
+	CStringA str;
+	str.Format("{\n  \"benchmark\": \"deadreckoning\",\n  \"latency_ms\": %u,\n  \"moves\": %d,\n  \"anchor_every\": %d,\n  \"runs\": [\n%s\n  ]\n}\n",
+			   dwLatency, iMoves, ANCHOR_EVERY, strRuns.GetString());
+	return str;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <afxstr.h>
+
+/**
+* Benchmarks that drive simulated cameras without showing the dialog.
+* Started with -benchmark:<name>[:<count>]. The results are written as JSON to
+* PTZControl-<name>.json in the current directory, followed by the checks the
+* results must pass.
+*/
+class Benchmark
+{
+public:
+	/** Returns false if the benchmark is unknown, could not be run or one of its checks failed. */
+	static bool Run(const CString& strName, int iCount, int iCameras, DWORD dwLatency);
+
+private:
+	static bool WriteResult(const CString& strName, const CStringA& strJson);
+
+	static CStringA RunPulse(int iPulses, int iCameras, DWORD dwLatency);
+	static CStringA RunCoalesce(int iTicks, DWORD dwLatency);
+	static CStringA RunZoom(int iTicks, DWORD dwLatency);
+	static CStringA RunDrift(int iTicks, DWORD dwLatency);
+	static CStringA RunOpen(int iRounds, int iCameras, DWORD dwLatency);
+	static CStringA RunStartup(int iRounds, int iCameras, DWORD dwLatency);
+	static CStringA RunEnumerate(int iDevices, DWORD dwLatency);
+	static CStringA RunLayout(int iMaxCameras);
+	static CStringA RunDiagonal(int iTicks, DWORD dwLatency);
+	static CStringA RunHang(int iTicks, int iCameras, DWORD dwLatency);
+	static CStringA RunReconnect(int iRounds, int iCameras, DWORD dwLatency);
+	static CStringA RunInstrumentation(int iCalls);
+	static CStringA RunKinematics(int iRecalls, int iCameras, DWORD dwLatency);
+	static CStringA RunFaults(int iTicks, int iCameras, DWORD dwLatency);
+	static CStringA RunWorkload(int iRounds, int iMaxCameras, DWORD dwLatency);
+	static CStringA RunPresets(int iPresets, int iCameras, DWORD dwLatency);
+	static CStringA RunSettle(int iRecalls, DWORD dwLatency);
+	static CStringA RunTravel(int iRecalls, DWORD dwLatency);
+	static CStringA RunVelocity(int iTrials, DWORD dwLatency);
+	static CStringA RunZoomRange(int iRounds, DWORD dwLatency);
+	static CStringA RunXUSteps(int iNudges, DWORD dwLatency);
+	static CStringA RunZoomScale(int iNudges, DWORD dwLatency);
+	static CStringA RunCalibrate(int iCalibrations, DWORD dwLatency);
+	static CStringA RunDeadReckoning(int iMoves, DWORD dwLatency);
+};
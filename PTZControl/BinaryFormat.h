@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+/**
+* Helpers for the binary blocks the models store in the registry. Values are written
+* in the byte order of the machine, as they are only read back on the same one.
+*/
+namespace BinaryFormat
+{
+	/** Append the bytes of value to data. */
+	template <typename T>
+	void Append(std::vector<BYTE>& data, const T& value)
+	{
+		const BYTE* p = reinterpret_cast<const BYTE*>(&value);
+		data.insert(data.end(), p, p + sizeof(value));
+	}
+
+	/** Read value at p and advance p. False if fewer bytes than its size are left before pEnd. */
+	template <typename T>
+	bool Extract(const BYTE*& p, const BYTE* pEnd, T& value)
+	{
+		if (static_cast<size_t>(pEnd - p) < sizeof(value))
+			return false;
+		memcpy(&value, p, sizeof(value));
+		p += sizeof(value);
+		return true;
+	}
+}
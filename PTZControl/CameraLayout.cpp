@@ -0,0 +1,66 @@
+#include "pch.h"
+
+#include <set>
+#include <utility>
+
+#include "CameraLayout.h"
+
+//////////////////////////////////////////////////////////////////////////
+// CameraLayout
+
+CameraLayout CameraLayout::Compute(size_t nCameras)
+{
+	CameraLayout layout;
+	layout.bShowCameras = nCameras > 1;
+
+	if (nCameras <= 1)
+	{
+		// Only one column, the camera button stays hidden
+		layout.cxDelta = -1;
+		layout.exit = { 0, 0 };
+		layout.settings = { 0, 1 };
+		layout.cameras.assign(nCameras, Cell{ 0, 0 });
+	}
+	else if (nCameras == 2)
+	{
+		// Both cameras in the bottom row
+		layout.cxDelta = 0;
+		layout.settings = { 0, 0 };
+		layout.exit = { 1, 0 };
+		layout.cameras = { { 0, 2 }, { 1, 2 } };
+	}
+	else
+	{
+		// Columns of cameras, exit and settings right of the last one
+		int nColumns = static_cast<int>((nCameras + NUM_ROWS - 1) / NUM_ROWS);
+		layout.cxDelta = nColumns - 1;
+		layout.exit = { nColumns, 0 };
+		layout.settings = { nColumns, 1 };
+		layout.cameras.reserve(nCameras);
+		for (size_t i = 0; i < nCameras; ++i)
+			layout.cameras.push_back({ static_cast<int>(i / NUM_ROWS), static_cast<int>(i % NUM_ROWS) });
+	}
+	return layout;
+}
+
+bool CameraLayout::IsValid() const
+{
+	std::set<std::pair<int, int>> used;
+	auto Place = [&](const Cell& cell)
+	{
+		return cell.x >= 0 && cell.x < GetColumns() && cell.y >= 0 && cell.y < NUM_ROWS &&
+			used.insert(std::make_pair(cell.x, cell.y)).second;
+	};
+
+	if (GetColumns() < 1 || !Place(exit) || !Place(settings))
+		return false;
+	if (bShowCameras)
+	{
+		for (const auto& cell : cameras)
+		{
+			if (!Place(cell))
+				return false;
+		}
+	}
+	return true;
+}
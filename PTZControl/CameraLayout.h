@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+/**
+* Position of the exit, settings and camera buttons right of the preset buttons. The
+* cells are counted in a raster that starts at the first camera button of the dialog
+* template. The template has two columns, cxDelta is the number of columns to add (or
+* to remove if negative).
+*
+* 0-1 cameras (dialog will shrink by one column)
+*		E
+*		S
+* 2 cameras
+*		S E
+*		- -
+*		1 2
+* 3 and more cameras, top down in columns of three, exit and settings right of them
+*		1 4 7 E
+*		2 5 8 S
+*		3 6
+*/
+class CameraLayout
+{
+public:
+	static constexpr int NUM_ROWS{ 3 };
+
+	struct Cell
+	{
+		int x, y;
+	};
+
+	int cxDelta;
+	Cell exit;
+	Cell settings;
+	bool bShowCameras;				// With one camera there is nothing to switch
+	std::vector<Cell> cameras;
+
+	/** Only depends on the camera count. */
+	static CameraLayout Compute(size_t nCameras);
+
+	/** Number of columns used, including the exit and settings column. */
+	int GetColumns() const
+	{
+		return 2 + cxDelta;
+	}
+	/** Every visible button in its own cell inside the raster. */
+	bool IsValid() const;
+};
@@ -0,0 +1,103 @@
+// DiagnosticsDlg.cpp : implementation file
+//
+
+#include "pch.h"
+#include "PTZControl.h"
+#include "DiagnosticsDlg.h"
+#include "TraceRecorder.h"
+#include "afxdialogex.h"
+
+
+// CDiagnosticsDlg dialog
+
+IMPLEMENT_DYNAMIC(CDiagnosticsDlg, CDialogEx)
+
+CDiagnosticsDlg::CDiagnosticsDlg(CWnd* pParent /*=nullptr*/)
+	: CDialogEx(IDD_DIAGNOSTICS, pParent)
+{
+}
+
+
+BEGIN_MESSAGE_MAP(CDiagnosticsDlg, CDialogEx)
+	ON_WM_TIMER()
+	ON_BN_CLICKED(IDC_BT_SAVE, &CDiagnosticsDlg::OnBtSave)
+	ON_BN_CLICKED(IDC_BT_SAVETRACE, &CDiagnosticsDlg::OnBtSaveTrace)
+END_MESSAGE_MAP()
+
+
+// CDiagnosticsDlg message handlers
+
+
+BOOL CDiagnosticsDlg::OnInitDialog()
+{
+	CDialogEx::OnInitDialog();
+
+	// The report is a table, so it needs a fixed font
+	m_fontFixed.CreatePointFont(90, _T("Consolas"));
+	GetDlgItem(IDC_ED_DIAGNOSTICS)->SetFont(&m_fontFixed);
+	// Only with -trace on the command line
+	GetDlgItem(IDC_BT_SAVETRACE)->EnableWindow(TraceRecorder::IsEnabled());
+
+	Refresh();
+	SetTimer(TIMER_REFRESH, REFRESH_INTERVAL, nullptr);
+
+	CenterWindow();
+	return TRUE;
+}
+
+
+void CDiagnosticsDlg::OnTimer(UINT_PTR nIDEvent)
+{
+	if (nIDEvent == TIMER_REFRESH)
+		Refresh();
+	else
+		CDialogEx::OnTimer(nIDEvent);
+}
+
+
+void CDiagnosticsDlg::Refresh()
+{
+	CString strReport = m_fnReport ? m_fnReport() : CString();
+	if (strReport == m_strReport)
+		return;
+	m_strReport = strReport;
+
+	// Keep the scroll position while the numbers change
+	CEdit* pEdit = static_cast<CEdit*>(GetDlgItem(IDC_ED_DIAGNOSTICS));
+	int iFirstLine = pEdit->GetFirstVisibleLine();
+	pEdit->SetWindowText(m_strReport);
+	pEdit->LineScroll(iFirstLine);
+}
+
+
+void CDiagnosticsDlg::OnBtSave()
+{
+	CFileDialog dlg(FALSE, _T("txt"), _T("PTZControl-Diagnostics.txt"), OFN_HIDEREADONLY | OFN_OVERWRITEPROMPT,
+					_T("Text Files (*.txt)|*.txt|All Files (*.*)|*.*||"), this);
+	if (dlg.DoModal() != IDOK)
+		return;
+
+	// Save what is shown, not a newer report
+	CStdioFile file;
+	CFileException ex;
+	if (!file.Open(dlg.GetPathName(), CFile::modeCreate | CFile::modeWrite | CFile::typeText, &ex))
+	{
+		ex.ReportError();
+		return;
+	}
+	CString strText = m_strReport;
+	strText.Replace(_T("\r\n"), _T("\n"));
+	file.WriteString(strText);
+}
+
+
+void CDiagnosticsDlg::OnBtSaveTrace()
+{
+	// The trace goes on recording, so it can be saved again later
+	CFileDialog dlg(FALSE, _T("json"), DEFAULT_TRACE_FILE, OFN_HIDEREADONLY | OFN_OVERWRITEPROMPT,
+					_T("Trace Files (*.json)|*.json|All Files (*.*)|*.*||"), this);
+	if (dlg.DoModal() != IDOK)
+		return;
+	if (!TraceRecorder::Write(dlg.GetPathName()))
+		AfxMessageBox(IDP_ERR_SAVETRACE, MB_ICONERROR);
+}
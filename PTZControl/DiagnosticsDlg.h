@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+
+// CDiagnosticsDlg dialog
+
+class CDiagnosticsDlg : public CDialogEx
+{
+	DECLARE_DYNAMIC(CDiagnosticsDlg)
+
+public:
+	CDiagnosticsDlg(CWnd* pParent = nullptr);
+	virtual ~CDiagnosticsDlg() {}
+
+	afx_msg void OnTimer(UINT_PTR nIDEvent);
+	afx_msg void OnBtSave();
+	afx_msg void OnBtSaveTrace();
+	virtual BOOL OnInitDialog();
+
+	// Builds the report. It is called again every second while the dialog is open.
+	std::function<CString()> m_fnReport;
+
+	// Dialog Data
+#ifdef AFX_DESIGN_TIME
+	enum { IDD = IDD_DIAGNOSTICS };
+#endif
+
+protected:
+	static constexpr UINT_PTR TIMER_REFRESH{ 1 };
+	static constexpr UINT REFRESH_INTERVAL{ 1000 };
+
+	void Refresh();
+
+	CFont m_fontFixed;
+	CString m_strReport;
+
+	DECLARE_MESSAGE_MAP()
+};
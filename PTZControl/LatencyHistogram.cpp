@@ -0,0 +1,113 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <intrin.h>
+
+#include "LatencyHistogram.h"
+#include "MotorPulseScheduler.h"
+
+//////////////////////////////////////////////////////////////////////////
+// LatencyHistogram
+
+int LatencyHistogram::BucketOf(ULONGLONG ullMicroseconds)
+{
+	// The first buckets are one usec wide. Above, every octave [2^n, 2^(n+1)) has
+	// SUB_BUCKETS buckets.
+	if (ullMicroseconds < SUB_BUCKETS)
+		return static_cast<int>(ullMicroseconds);
+
+	// _BitScanReverse64 only exists on 64 bit targets
+	unsigned long ulOctave;
+#ifdef _WIN64
+	_BitScanReverse64(&ulOctave, ullMicroseconds);
+#else
+	if (_BitScanReverse(&ulOctave, static_cast<unsigned long>(ullMicroseconds >> 32)))
+		ulOctave += 32;
+	else
+		_BitScanReverse(&ulOctave, static_cast<unsigned long>(ullMicroseconds));
+#endif
+	int iSub = static_cast<int>(ullMicroseconds >> (ulOctave - SUB_BUCKETS_LOG2)) & (SUB_BUCKETS - 1);
+	return std::min(static_cast<int>(ulOctave - SUB_BUCKETS_LOG2 + 1) * SUB_BUCKETS + iSub, NUM_BUCKETS - 1);
+}
+
+double LatencyHistogram::UpperBoundOf(int iBucket)
+{
+	if (iBucket < SUB_BUCKETS)
+		return iBucket + 1;
+
+	int iOctave = iBucket / SUB_BUCKETS + SUB_BUCKETS_LOG2 - 1;
+	double dWidth = static_cast<double>(1ULL << (iOctave - SUB_BUCKETS_LOG2));
+	return static_cast<double>(1ULL << iOctave) + (iBucket % SUB_BUCKETS + 1) * dWidth;
+}
+
+void LatencyHistogram::Record(LONGLONG llStart, LONGLONG llEnd, bool bFailed)
+{
+	LONGLONG llTicks = std::max(llEnd - llStart, 0LL);
+	ULONGLONG ullMicroseconds = static_cast<ULONGLONG>(MotorPulseScheduler::ToMilliseconds(llTicks) * 1000.0);
+	m_auBuckets[BucketOf(ullMicroseconds)].fetch_add(1, std::memory_order_relaxed);
+	if (bFailed)
+		m_uErrors.fetch_add(1, std::memory_order_relaxed);
+	m_llSumTicks.fetch_add(llTicks, std::memory_order_relaxed);
+
+	LONGLONG llMax = m_llMaxTicks.load(std::memory_order_relaxed);
+	while (llTicks > llMax && !m_llMaxTicks.compare_exchange_weak(llMax, llTicks, std::memory_order_relaxed))
+		;
+	LONGLONG llFirst = 0;
+	m_llFirstStart.compare_exchange_strong(llFirst, llStart, std::memory_order_relaxed);
+	m_llLastStart.store(llStart, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Summary LatencyHistogram::Summarize() const
+{
+	Summary summary{};
+	UINT auBuckets[NUM_BUCKETS];
+	for (int i = 0; i < NUM_BUCKETS; ++i)
+	{
+		auBuckets[i] = m_auBuckets[i].load(std::memory_order_relaxed);
+		summary.uCount += auBuckets[i];
+	}
+	if (summary.uCount == 0)
+		return summary;
+
+	summary.uErrors = m_uErrors;
+	summary.dMax = MotorPulseScheduler::ToMilliseconds(m_llMaxTicks);
+	summary.dMean = MotorPulseScheduler::ToMilliseconds(m_llSumTicks) / summary.uCount;
+	double dSeconds = MotorPulseScheduler::ToMilliseconds(m_llLastStart - m_llFirstStart) / 1000.0;
+	summary.dCallsPerSecond = dSeconds > 0 ? (summary.uCount - 1) / dSeconds : 0;
+
+	// The upper bound of the bucket that holds the percentile, but never more than the maximum
+	auto Percentile = [&](double dQuantile)
+	{
+		UINT uRank = std::max(1U, static_cast<UINT>(dQuantile * summary.uCount + 0.5));
+		UINT uSeen = 0;
+		for (int i = 0; i < NUM_BUCKETS; ++i)
+		{
+			uSeen += auBuckets[i];
+			if (uSeen >= uRank)
+				return std::min(UpperBoundOf(i) / 1000.0, summary.dMax);
+		}
+		return summary.dMax;
+	};
+	summary.dP50 = Percentile(0.50);
+	summary.dP95 = Percentile(0.95);
+	summary.dP99 = Percentile(0.99);
+	return summary;
+}
+
+CString LatencyHistogram::FormatHeader()
+{
+	CString str;
+	str.Format(_T("%-24s %8s %7s %8s %9s %9s %9s %9s %9s"),
+			   _T("Operation"), _T("Calls"), _T("Errors"), _T("Calls/s"), _T("Mean ms"), _T("p50 ms"), _T("p95 ms"), _T("p99 ms"), _T("Max ms"));
+	return str;
+}
+
+CString LatencyHistogram::Format(LPCTSTR pszName) const
+{
+	CString str;
+	Summary summary = Summarize();
+	if (summary.uCount)
+		str.Format(_T("%-24s %8u %7u %8.1f %9.3f %9.3f %9.3f %9.3f %9.3f"), pszName, summary.uCount, summary.uErrors,
+				   summary.dCallsPerSecond, summary.dMean, summary.dP50, summary.dP95, summary.dP99, summary.dMax);
+	return str;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+
+#include <afxstr.h>
+
+/**
+* Latencies of one operation in buckets of a quarter octave, from 1 usec to about nine minutes.
+* Record is lock free and may be called from any thread. A summary is taken while recording
+* goes on, so it may miss the calls that are recorded at the same time.
+* Times are QueryPerformanceCounter ticks, the summary is in msec.
+*/
+class LatencyHistogram
+{
+public:
+	struct Summary
+	{
+		UINT uCount;
+		UINT uErrors;
+		double dCallsPerSecond;		// Between the first and the last call
+		double dMean;
+		double dP50;
+		double dP95;
+		double dP99;
+		double dMax;
+	};
+
+	void Record(LONGLONG llStart, LONGLONG llEnd, bool bFailed);
+	Summary Summarize() const;
+
+	/** One line with the summary, or an empty string if nothing was recorded. */
+	CString Format(LPCTSTR pszName) const;
+	/** The header line for Format */
+	static CString FormatHeader();
+
+private:
+	static constexpr int SUB_BUCKETS_LOG2{ 2 };
+	static constexpr int SUB_BUCKETS{ 1 << SUB_BUCKETS_LOG2 };
+	static constexpr int NUM_BUCKETS{ 28 * SUB_BUCKETS };
+
+	static int BucketOf(ULONGLONG ullMicroseconds);
+	static double UpperBoundOf(int iBucket);
+
+	std::atomic<UINT> m_auBuckets[NUM_BUCKETS]{};
+	std::atomic<UINT> m_uErrors{ 0 };
+	std::atomic<LONGLONG> m_llSumTicks{ 0 };
+	std::atomic<LONGLONG> m_llMaxTicks{ 0 };
+	std::atomic<LONGLONG> m_llFirstStart{ 0 };
+	std::atomic<LONGLONG> m_llLastStart{ 0 };
+};
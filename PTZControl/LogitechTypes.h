@@ -74,7 +74,7 @@ enum LOGITECH_XU_PERIPHERAL_CONTROL
 	XU_PERIPHERAL_UNDEFINED_CONTROL = 0x00,
 	XU_PERIPHERALCONTROL_PANTILT_RELATIVE_CONTROL = 0x01,							// pan tilt
 	XU_PERIPHERALCONTROL_PANTILT_MODE_CONTROL = 0x02,								// Preset and recall position
-	XU_PERIPHERALCONTROL_MAXIMUM_RESOLUTION_SUPPORT_FOR_PANTILT_CONTROL = 0x03,		
+	XU_PERIPHERALCONTROL_MAXIMUM_RESOLUTION_SUPPORT_FOR_PANTILT_CONTROL = 0x03,		// Assumed: parts a step can be divided into, pan in the low, tilt in the high word
 	XU_PERIPHERALCONTROL_AF_MOTORCONTROL = 0x04,
 	XU_PERIPHERALCONTROL_AF_BLOB_CONTROL = 0x05,
 	XU_PERIPHERALCONTROL_AF_VCM_PARAMETERS = 0x06,
@@ -87,7 +87,7 @@ enum LOGITECH_XU_PERIPHERAL_CONTROL
 	XU_PERIPHERAL_CONTROL_SPEAKER = 0x0D,
 	XU_PERIPHERAL_CONTROL_MODE = 0x0E,
 	XU_AUDIO_LIBRARY_MODE_CONTROL = 0x0F,
-	XU_PERIPHERAL_MOTOR_STEPS_CONTROL = 0x10,
+	XU_PERIPHERAL_MOTOR_STEPS_CONTROL = 0x10,										// Assumed: parts of a step a relative value counts, packed the same way. Not checked on hardware.
 };
 
 enum LOGITECH_XU_PROPERTYSET
@@ -0,0 +1,93 @@
+// Portable, built without the precompiled header
+#include <algorithm>
+#include <cmath>
+
+#include "MotionEngine.h"
+
+//////////////////////////////////////////////////////////////////////////
+// MotionEngine
+
+MotionEngine::Curve MotionEngine::DefaultCurve(Axis axis)
+{
+	// Pan and tilt start at a quarter of the old auto repeat rate and end at twice of it.
+	// A zoom step is 1/150 of the range, so the whole range takes about two seconds.
+	if (axis == AxisZoom)
+		return Curve{ 10, 150, 1.5, 2 };
+	return Curve{ 5, 40, 1.5, 2 };
+}
+
+void MotionEngine::SetCurve(Axis axis, const Curve& curve)
+{
+	Curve& target = m_curve[axis];
+	target = curve;
+	target.dMinSpeed = std::max(target.dMinSpeed, 0.0);
+	target.dMaxSpeed = std::max(target.dMaxSpeed, target.dMinSpeed);
+	target.dRampTime = std::max(target.dRampTime, 0.0);
+	target.dExponent = std::max(target.dExponent, 0.1);
+}
+
+void MotionEngine::SetIntent(Axis axis, double dVelocity, double dNow)
+{
+	// Repeated inputs with the same direction don't restart the ramp
+	State& state = m_state[axis];
+	dVelocity = std::min(std::max(dVelocity, -1.0), 1.0);
+	bool bNewDirection = dVelocity != 0 && (state.dIntent == 0 || (dVelocity < 0) != (state.dIntent < 0));
+	Integrate(axis, dNow);
+	if (bNewDirection)
+	{
+		state.dPressed = dNow;
+		state.dLast = dNow;
+		state.dPending = std::copysign(1.0, dVelocity);
+	}
+	state.dIntent = dVelocity;
+}
+
+double MotionEngine::GetSpeed(Axis axis, double dNow) const
+{
+	const State& state = m_state[axis];
+	const Curve& curve = m_curve[axis];
+	if (state.dIntent == 0)
+		return 0;
+	double dRamp = curve.dRampTime > 0 ? std::min((dNow - state.dPressed) / curve.dRampTime, 1.0) : 1.0;
+	double dSpeed = curve.dMinSpeed + (curve.dMaxSpeed - curve.dMinSpeed) * std::pow(std::max(dRamp, 0.0), curve.dExponent);
+	return std::abs(state.dIntent) * dSpeed;
+}
+
+MotionEngine::Steps MotionEngine::Advance(double dNow)
+{
+	Steps steps{};
+	for (int i = 0; i < NUM_AXES; ++i)
+	{
+		State& state = m_state[i];
+		Integrate(static_cast<Axis>(i), dNow);
+		steps[i] = static_cast<int>(state.dPending);
+		state.dPending -= steps[i];
+		state.llEmitted += steps[i];
+		// A released axis stops at once. Only the step of a nudge is still sent.
+		if (state.dIntent == 0)
+			state.dPending = 0;
+	}
+	return steps;
+}
+
+void MotionEngine::Integrate(Axis axis, double dNow)
+{
+	// The speed at the middle of the interval, so a ramp isn't sent late
+	State& state = m_state[axis];
+	if (state.dIntent != 0)
+	{
+		double dMiddle = (state.dLast + dNow) / 2;
+		state.dPending += std::copysign(GetSpeed(axis, dMiddle), state.dIntent) * std::max(dNow - state.dLast, 0.0);
+	}
+	state.dLast = dNow;
+}
+
+bool MotionEngine::IsActive() const
+{
+	for (const State& state : m_state)
+	{
+		if (state.dIntent != 0 || std::abs(state.dPending) >= 1)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+
+/**
+* Turns held inputs into pan, tilt and zoom steps at a fixed control rate. Every input only sets
+* the intended velocity of an axis (-1..1); how often it does so doesn't matter. While an
+* axis is held its speed grows from a minimum to the full speed along the curve, so a short
+* press gives a fine nudge and a long one a fast sweep from the same control.
+*
+* Speeds are in steps per second, one step being what WebcamController::MovePan or Zoom moves.
+* Only uses the standard library and the caller passes the time in seconds.
+*/
+class MotionEngine
+{
+public:
+	enum Axis
+	{
+		AxisPan,
+		AxisTilt,
+		AxisZoom,
+		NUM_AXES
+	};
+
+	struct Curve
+	{
+		double dMinSpeed;		// Steps per second right after the press
+		double dMaxSpeed;		// Steps per second after the ramp time
+		double dRampTime;		// Seconds from the press to the full speed
+		double dExponent;		// 1 is a linear ramp, larger values stay slow longer
+	};
+	using Steps = std::array<int, NUM_AXES>;
+
+	static Curve DefaultCurve(Axis axis);
+
+	void SetCurve(Axis axis, const Curve& curve);
+	const Curve& GetCurve(Axis axis) const
+	{
+		return m_curve[axis];
+	}
+
+	/** A new direction starts slow and gives one step at once. 0 stops the axis. */
+	void SetIntent(Axis axis, double dVelocity, double dNow);
+	double GetIntent(Axis axis) const
+	{
+		return m_state[axis].dIntent;
+	}
+	/** Steps per second the axis is commanded to move with now. */
+	double GetSpeed(Axis axis, double dNow) const;
+	/** The whole steps of all axes since the last call. The remainder is kept for later. */
+	Steps Advance(double dNow);
+	/** An axis is held or there are steps left to send. */
+	bool IsActive() const;
+	/** All steps returned by Advance, with their sign. */
+	long long GetEmitted(Axis axis) const
+	{
+		return m_state[axis].llEmitted;
+	}
+
+private:
+	struct State
+	{
+		double dIntent;
+		double dPressed;		// Time the current direction started
+		double dLast;			// Time of the last Advance
+		double dPending;		// Steps not sent yet, with their sign
+		long long llEmitted;
+	};
+
+	void Integrate(Axis axis, double dNow);
+
+	std::array<Curve, NUM_AXES> m_curve{ { DefaultCurve(AxisPan), DefaultCurve(AxisTilt), DefaultCurve(AxisZoom) } };
+	std::array<State, NUM_AXES> m_state{};
+};
@@ -0,0 +1,193 @@
+#include "pch.h"
+
+#include <mmsystem.h>
+
+#pragma comment(lib, "winmm.lib")
+
+#include "MotorPulseScheduler.h"
+#include "TraceRecorder.h"
+
+// Available since Windows 10 1803. Older SDKs don't know it.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION	0x00000002
+#endif
+
+// The timer wakes us this time before the deadline. The rest is spent spinning.
+static constexpr double SPIN_HIGH_RESOLUTION{ 0.3 };	// msec
+static constexpr double SPIN_LOW_RESOLUTION{ 1.5 };		// msec
+
+//////////////////////////////////////////////////////////////////////////
+// MotorPulseScheduler
+
+std::shared_ptr<MotorPulseScheduler> MotorPulseScheduler::Get()
+{
+	static CCriticalSection s_cs;
+	static std::weak_ptr<MotorPulseScheduler> s_wpScheduler;
+
+	CSingleLock lock(&s_cs, TRUE);
+	auto spScheduler = s_wpScheduler.lock();
+	if (!spScheduler)
+	{
+		spScheduler.reset(new MotorPulseScheduler);
+		s_wpScheduler = spScheduler;
+	}
+	return spScheduler;
+}
+
+MotorPulseScheduler::MotorPulseScheduler()
+	: m_hTimer(NULL)
+	, m_bHighResolution(true)
+	, m_bTimePeriod(false)
+	, m_evChanged(FALSE, FALSE)
+	, m_evStop(FALSE, TRUE)
+	, m_pThread(nullptr)
+{
+	m_hTimer = ::CreateWaitableTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!m_hTimer)
+	{
+		// Fall back to a standard timer with the best system timer resolution.
+		m_bHighResolution = false;
+		m_hTimer = ::CreateWaitableTimerEx(NULL, NULL, 0, TIMER_ALL_ACCESS);
+		m_bTimePeriod = timeBeginPeriod(1) == TIMERR_NOERROR;
+	}
+
+	m_pThread = AfxBeginThread(&ThreadProc, this, THREAD_PRIORITY_TIME_CRITICAL, 0, CREATE_SUSPENDED);
+	if (m_pThread)
+	{
+		m_pThread->m_bAutoDelete = FALSE;
+		m_pThread->ResumeThread();
+	}
+}
+
+MotorPulseScheduler::~MotorPulseScheduler()
+{
+	m_evStop.SetEvent();
+	if (m_pThread)
+	{
+		::WaitForSingleObject(m_pThread->m_hThread, INFINITE);
+		delete m_pThread;
+	}
+	if (m_hTimer)
+		::CloseHandle(m_hTimer);
+	if (m_bTimePeriod)
+		timeEndPeriod(1);
+}
+
+void MotorPulseScheduler::Arm(UINT_PTR key, LONGLONG llDeadline, Callback fn)
+{
+	{
+		CSingleLock lock(&m_cs, TRUE);
+		m_deadlines[key] = std::make_pair(llDeadline, std::move(fn));
+	}
+	m_evChanged.SetEvent();
+}
+
+void MotorPulseScheduler::Cancel(UINT_PTR key)
+{
+	CSingleLock lock(&m_cs, TRUE);
+	m_deadlines.erase(key);
+}
+
+LONGLONG MotorPulseScheduler::Now()
+{
+	LARGE_INTEGER li;
+	::QueryPerformanceCounter(&li);
+	return li.QuadPart;
+}
+
+static LONGLONG PerformanceFrequency()
+{
+	static const LONGLONG s_llFrequency = []
+	{
+		LARGE_INTEGER li;
+		::QueryPerformanceFrequency(&li);
+		return li.QuadPart;
+	}();
+	return s_llFrequency;
+}
+
+LONGLONG MotorPulseScheduler::FromMilliseconds(double dMilliseconds)
+{
+	return static_cast<LONGLONG>(dMilliseconds * PerformanceFrequency() / 1000.0);
+}
+
+double MotorPulseScheduler::ToMilliseconds(LONGLONG llTicks)
+{
+	return llTicks * 1000.0 / PerformanceFrequency();
+}
+
+void MotorPulseScheduler::WaitUntil(LONGLONG llDeadline)
+{
+	// Sleep the coarse part and spin the rest
+	double dRemaining = ToMilliseconds(llDeadline - Now());
+	if (dRemaining > 2 * SPIN_LOW_RESOLUTION)
+		::Sleep(static_cast<DWORD>(dRemaining - SPIN_LOW_RESOLUTION));
+	while (Now() < llDeadline)
+		YieldProcessor();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	The scheduler thread
+
+UINT AFX_CDECL MotorPulseScheduler::ThreadProc(LPVOID p)
+{
+	TraceRecorder::NameThread(_T("Pulse scheduler"));
+	static_cast<MotorPulseScheduler*>(p)->Run();
+	return 0;
+}
+
+void MotorPulseScheduler::Run()
+{
+	const LONGLONG llSpin = FromMilliseconds(m_bHighResolution ? SPIN_HIGH_RESOLUTION : SPIN_LOW_RESOLUTION);
+
+	for (;;)
+	{
+		// Find the next deadline and fire all that are due.
+		LONGLONG llNext = 0;
+		Callback fnDue;
+		{
+			CSingleLock lock(&m_cs, TRUE);
+			auto itNext = m_deadlines.end();
+			for (auto it = m_deadlines.begin(); it != m_deadlines.end(); ++it)
+			{
+				if (itNext == m_deadlines.end() || it->second.first < itNext->second.first)
+					itNext = it;
+			}
+			if (itNext != m_deadlines.end())
+			{
+				llNext = itNext->second.first;
+				if (llNext - Now() <= llSpin)
+				{
+					fnDue = std::move(itNext->second.second);
+					m_deadlines.erase(itNext);
+				}
+			}
+		}
+
+		if (fnDue)
+		{
+			// Spin the last fraction of a millisecond, then fire.
+			while (Now() < llNext)
+				YieldProcessor();
+			fnDue();
+			continue;
+		}
+
+		HANDLE ahWait[] = { m_evStop, m_evChanged, m_hTimer };
+		DWORD dwCount = _countof(ahWait);
+		if (llNext)
+		{
+			// Relative due time in 100ns units
+			LARGE_INTEGER liDue;
+			liDue.QuadPart = -static_cast<LONGLONG>(ToMilliseconds(llNext - llSpin - Now()) * 10000.0);
+			if (liDue.QuadPart >= 0 || !::SetWaitableTimer(m_hTimer, &liDue, 0, NULL, NULL, FALSE))
+				continue;
+		}
+		else
+			// Nothing to do, just wait for a change
+			--dwCount;
+
+		if (::WaitForMultipleObjects(dwCount, ahWait, FALSE, INFINITE) == WAIT_OBJECT_0)
+			return;
+	}
+}
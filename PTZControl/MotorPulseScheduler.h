@@ -0,0 +1,56 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+
+#include <afxmt.h>
+
+/**
+* A single thread that ends motor pulses of all cameras. Deadlines are armed per key
+* (camera and axis) and waited for with a high resolution waitable timer. The callback
+* runs on the scheduler thread and must only hand the work over to the camera worker.
+* Times are QueryPerformanceCounter ticks.
+*/
+class MotorPulseScheduler
+{
+public:
+	using Callback = std::function<void()>;
+
+	/** The scheduler is shared by all cameras and lives as long as somebody holds it. */
+	static std::shared_ptr<MotorPulseScheduler> Get();
+	~MotorPulseScheduler();
+
+	MotorPulseScheduler(const MotorPulseScheduler&) = delete;
+	MotorPulseScheduler& operator=(const MotorPulseScheduler&) = delete;
+
+	/** Call fn at llDeadline. A pending deadline with the same key is replaced. */
+	void Arm(UINT_PTR key, LONGLONG llDeadline, Callback fn);
+	void Cancel(UINT_PTR key);
+
+	bool IsHighResolution() const
+	{
+		return m_bHighResolution;
+	}
+
+	static LONGLONG Now();
+	static LONGLONG FromMilliseconds(double dMilliseconds);
+	static double ToMilliseconds(LONGLONG llTicks);
+	/** Block the calling thread until llDeadline. Used when no scheduler is available. */
+	static void WaitUntil(LONGLONG llDeadline);
+
+private:
+	MotorPulseScheduler();
+
+	static UINT AFX_CDECL ThreadProc(LPVOID p); // AFX_THREADPROC
+	void Run();
+
+	HANDLE m_hTimer;
+	bool m_bHighResolution;
+	bool m_bTimePeriod;
+	CEvent m_evChanged;
+	CEvent m_evStop;
+	CCriticalSection m_cs;
+	std::map<UINT_PTR, std::pair<LONGLONG, Callback>> m_deadlines;
+	CWinThread* m_pThread;
+};
@@ -5,6 +5,8 @@
 #include "pch.h"
 #include "framework.h"
 #include "PTZControl.h"
+#include "Benchmark.h"
+#include "TraceRecorder.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -23,6 +25,9 @@ public:
 		: m_bNoReset(false)
 		, m_bNoGuard(false)
 		, m_bShowDevices(false)
+		, m_iSimulatedCameras(0)
+		, m_dwSimulatedLatency(0)
+		, m_iBenchmarkCount(0)
 	{
 	}
 
@@ -36,8 +41,13 @@ public:
 	// Data
 	CString m_strDevName;		// Device name from the command line to search for
 	bool	m_bNoReset;			// No Reset of web cam
-	bool	m_bNoGuard;			// Prevent a guard thread
+	bool	m_bNoGuard;			// No deadline for camera commands
 	bool	m_bShowDevices;		// SHow message box with devicenames on open.
+	int		m_iSimulatedCameras;	// Use simulated cameras instead of real devices
+	DWORD	m_dwSimulatedLatency;	// Delay in msec for every call to a simulated camera
+	CString m_strTraceFile;		// Record a trace and write it to this file on exit
+	CString m_strBenchmark;		// Run this benchmark instead of the dialog
+	int		m_iBenchmarkCount;	// Optional number of iterations for the benchmark
 
 	// Currently not used (may be used if we ant yes/no/undefined)
 	enum class Mode
@@ -74,10 +84,40 @@ void CPTZControlCommandLineInfo::ParseParam(const char* pszParam,BOOL bFlag,BOOL
 		{
 			m_bNoGuard = true;
 		}
+		else if (_stricmp(pszParam, "trace") == 0)
+		{
+			m_strTraceFile = DEFAULT_TRACE_FILE;
+		}
+		else if (_strnicmp(pszParam, "trace:", 6) == 0)
+		{
+			m_strTraceFile = pszParam + 6;
+			::PathUnquoteSpaces(CStrBuf(m_strTraceFile, 0));
+		}
 		else if (_stricmp(pszParam, "showdevices") == 0)
 		{
 			m_bShowDevices = true;
 		}
+		else if (_strnicmp(pszParam, "simulate:", 9) == 0)
+		{
+			m_iSimulatedCameras = std::max(0, atoi(pszParam + 9));
+		}
+		else if (_strnicmp(pszParam, "simlatency:", 11) == 0)
+		{
+			m_dwSimulatedLatency = static_cast<DWORD>(std::max(0, atoi(pszParam + 11)));
+		}
+		else if (_strnicmp(pszParam, "benchmark:", 10) == 0)
+		{
+			// Name and an optional count: benchmark:<name>[:<count>]
+			pszParam += 10;
+			const char* pszCount = strchr(pszParam, ':');
+			if (pszCount)
+			{
+				m_strBenchmark = CString(pszParam, static_cast<int>(pszCount - pszParam));
+				m_iBenchmarkCount = atoi(pszCount + 1);
+			}
+			else
+				m_strBenchmark = pszParam;
+		}
 		else
 			ParseParamFlag(pszParam);
 	}
@@ -103,6 +143,10 @@ CPTZControlApp::CPTZControlApp()
 	: m_bNoReset(false)
 	, m_bNoGuard(false)
 	, m_bShowDevices(false)
+	, m_iSimulatedCameras(0)
+	, m_dwSimulatedLatency(0)
+	, m_dwDeadline(0)
+	, m_iExitCode(0)
 	, m_pDlg(nullptr)
 {
 }
@@ -144,7 +188,27 @@ BOOL CPTZControlApp::InitInstance()
 	// Registry is overruled command line
 	m_bNoReset = GetProfileInt(REG_OPTIONS,REG_NORESET,FALSE)!=0 || cmdInfo.m_bNoReset;
 	m_bNoGuard = GetProfileInt(REG_OPTIONS,REG_NOGUARD,FALSE)!=0 || cmdInfo.m_bNoGuard;
+	m_dwDeadline = m_bNoGuard ? 0 : GetProfileInt(REG_OPTIONS,REG_DEADLINE,WebcamWorker::DEFAULT_DEADLINE);
 	m_bShowDevices = cmdInfo.m_bShowDevices;
+	m_iSimulatedCameras = cmdInfo.m_iSimulatedCameras;
+	m_dwSimulatedLatency = cmdInfo.m_dwSimulatedLatency;
+
+	// Tracing must be on before the first thread records
+	if (!cmdInfo.m_strTraceFile.IsEmpty() && TraceRecorder::Enable())
+	{
+		m_strTraceFile = cmdInfo.m_strTraceFile;
+		TraceRecorder::NameThread(_T("UI"));
+	}
+
+//-------------Benchmark -----------------------------------------------
+
+	// A benchmark runs without any UI and terminates the application. A failure shows in the exit code.
+	if (!cmdInfo.m_strBenchmark.IsEmpty())
+	{
+		if (!Benchmark::Run(cmdInfo.m_strBenchmark, cmdInfo.m_iBenchmarkCount, m_iSimulatedCameras, m_dwSimulatedLatency))
+			m_iExitCode = 1;
+		return FALSE;
+	}
 
 //-------------Main ----------------------------------------------------
 
@@ -166,6 +230,10 @@ int CPTZControlApp::ExitInstance()
 #if !defined(_AFXDLL) && !defined(_AFX_NO_MFC_CONTROLS_IN_DIALOGS)
 	ControlBarCleanUp();
 #endif
+	// The dialog and the camera workers are gone, so these are the last events.
+	if (!m_strTraceFile.IsEmpty())
+		TraceRecorder::Write(m_strTraceFile);
 	CoUninitialize();
-	return __super::ExitInstance();
+	int iExitCode = __super::ExitInstance();
+	return m_iExitCode ? m_iExitCode : iExitCode;
 }
@@ -17,15 +17,41 @@
 #define REG_WINDOW_POSX		_T("X")
 #define REG_WINDOW_POSY		_T("Y")
 #define REG_TOOLTIP			_T("Tooltip%d")
+#define REG_PRESETS			_T("Presets")		// Binary value with the software presets of a camera, see PresetStore
+#define REG_TRAVELTIMES		_T("TravelTimes")	// Binary value with the learned travel times of a camera, see TravelModel
+#define REG_PULSECALIBRATION	_T("PulseCalibration")	// Binary value with the measured motor pulses of a camera, see PulseCalibration
+#define REG_PRESETANCHORS	_T("PresetAnchors")	// Binary value with the estimated positions of the device presets, see PositionEstimator
 
 #define REG_DEVICE						_T("Device")
 #define REG_USELOGOTECHMOTIONCONTROL		_T("LogitechMotionControl")
 #define REG_MOTORINTERVALTIMER				_T("MotorIntervalTimer")
+#define REG_LOGITECHSTEPSIZE				_T("LogitechStepSize")	// Percent of a full step of the Logitech motion control
+#define REG_LOGITECHMOTORSTEPS				_T("LogitechMotorSteps")	// 1 switches the Logitech unit to parts of a step, see WebcamController
 #define REG_DEVICENAME						_T("DeviceName")
+#define REG_MOTIONMINSPEED					_T("MotionMinSpeed")	// Steps per second of held inputs, see MotionEngine
+#define REG_MOTIONMAXSPEED					_T("MotionMaxSpeed")
+#define REG_MOTIONRAMPTIME					_T("MotionRampTime")	// msec to the full speed
+#define REG_MOTIONRAMPCURVE					_T("MotionRampCurve")	// Exponent of the ramp in percent, 100 is linear
+#define REG_ZOOMSPEED						_T("ZoomSpeed")		// Percent of the fastest zoom motor speed
+#define REG_ZOOMSCALING						_T("ZoomScaling")	// Exponent of the pan/tilt step scaling with the zoom in percent, 0 is off
+
+#define REG_TOPOLOGY	_T("Topology")		// One binary value per device path
+
+#define REG_CAMERA		_T("Camera")		// One subkey per device path with the settings and tooltips
+
+#define REG_MODEL		_T("Model")			// One subkey per USB vendor and product ID with the pulse calibration of the model
 
 #define REG_OPTIONS	_T("Options")
 #define REG_NORESET		_T("NoReset")
 #define REG_NOGUARD		_T("NoGuard")
+#define REG_DEADLINE	_T("Deadline")		// msec for one camera command
+
+#define DEFAULT_TRACE_FILE	_T("PTZControl-trace.json")
+
+#define WM_CAMERA_COMPLETED			(WM_APP+1)	// A camera worker finished a command
+
+#define IDC_BT_WEBCAM_FIRST_CREATED	0x4000		// Buttons created for camera 4 and more
+#define IDC_BT_WEBCAM_LAST_CREATED	0x40FF
 
 #define TIMER_FOCUS_CHECK			4711
 #define TIMER_AUTO_REPEAT			4712
@@ -39,6 +65,8 @@
 #define COLOR_GREEN				RGB(0,240,0)
 #define COLOR_RED				RGB(240,0,0)
 #define COLOR_ORANGE			RGB(255,140,0)
+#define COLOR_GRAY				RGB(128,128,128)
+#define COLOR_YELLOW			RGB(240,240,0)
 
 //////////////////////////////////////////////////////////////////////////
 // CPTZControlApp:
@@ -57,8 +85,13 @@ public:
 	// command line flags
 	CString m_strDevName;		// Device name from the command line to search for
 	bool	m_bNoReset;			// No Reset of web cam
-	bool	m_bNoGuard;			// Prevent a guard thread
+	bool	m_bNoGuard;			// No deadline for camera commands
 	bool	m_bShowDevices;
+	int		m_iSimulatedCameras;	// Number of simulated cameras to use instead of real devices
+	DWORD	m_dwSimulatedLatency;	// Delay of every call to a simulated camera
+	DWORD	m_dwDeadline;			// A camera command running longer quarantines the camera, 0 for never
+	CString m_strTraceFile;			// Trace file written on exit, empty if tracing is off
+	int		m_iExitCode;			// Nonzero if a benchmark failed
 
 	DECLARE_MESSAGE_MAP()
 
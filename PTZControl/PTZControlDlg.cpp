@@ -4,9 +4,14 @@
 
 #include "pch.h"
 #include "framework.h"
+#include <algorithm>
+#include <Dbt.h>
 #include "PTZControl.h"
 #include "PTZControlDlg.h"
 #include "SettingsDlg.h"
+#include "SimulatedCamera.h"
+#include "CameraLayout.h"
+#include "TraceRecorder.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -27,76 +32,53 @@ static const LPCTSTR g_aCameras[] =
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////
-// We have several layouts for the Buttons
-// 0-1 cameras (dialog will shrink by one column)
-//		E |
-//		S |
-// 2 cameras
-//		S E 
-//		- -
-//		1 2
-// 3 cameras
-//		1 E 
-//		2 S
-//		3 
-
-struct SPosition
-{
-	UINT	nId;					// Id of button 
-	bool	bShow;					// Show or hide
-	int		x, y;					// outside raster, left two columns
-};
+//	Topology cache
+//		What WebcamController discovers on a device is stored with the device path as the
+//		value name. A different size means an old layout and is ignored.
 
-struct SLayout
+static bool LoadTopology(const CString& devicePath, WebcamController::Topology& topology)
 {
-	int cxDelta;					// Num to shrink / grow the dialog
-	const SPosition* pButtons;		// List of entries terminated with nId==0.
-};
+	LPBYTE pData = nullptr;
+	UINT uSize = 0;
+	if (!theApp.GetProfileBinary(REG_TOPOLOGY, devicePath, &pData, &uSize))
+		return false;
+
+	bool bValid = uSize == sizeof(topology);
+	if (bValid)
+		memcpy(&topology, pData, sizeof(topology));
+	delete[] pData;
+	return bValid;
+}
 
-static const SPosition layoutBtns1[]	// 0 or 1 camera (uses only 1 column)
+static void SaveTopology(const CString& devicePath, const WebcamController::Topology& topology)
 {
-	IDC_BT_EXIT,		true,  0, 0,	// one columns
-	IDC_BT_SETTINGS,	true,  0, 1,
-	// Invisible
-	IDC_BT_WEBCAM1,		false, 0, 0,
-	IDC_BT_WEBCAM2,		false, 0, 0,
-	IDC_BT_WEBCAM3,		false, 0, 0,
-	0
-};
+	theApp.WriteProfileBinary(REG_TOPOLOGY, devicePath, reinterpret_cast<LPBYTE>(const_cast<WebcamController::Topology*>(&topology)), sizeof(topology));
+}
 
-static const SPosition layoutBtns2[]	// 2 cameras (uses 2 columns)
-{
-	IDC_BT_SETTINGS,	true,	0, 0,	// Top row
-	IDC_BT_EXIT,		true,	1, 0,
-	IDC_BT_WEBCAM1,		true,	0, 2,	// bottom row
-	IDC_BT_WEBCAM2,		true,	1, 2,
-	// Invisible
-	IDC_BT_WEBCAM3,		false,  0, 0,
-	0
-};
+//////////////////////////////////////////////////////////////////////////////////////////
+//	Camera settings
+//		Every camera has its own registry section, named after the device path. The
+//		backslashes of the path would create more subkeys, so they are replaced.
 
-static const SPosition layoutBtns3[]	// 3 cameras
+static CString CameraSection(const CString& devicePath)
 {
-	IDC_BT_EXIT,		true,	1, 0,	// Outer left column
-	IDC_BT_SETTINGS,	true,	1, 1,
-	IDC_BT_WEBCAM1,		true,	0, 0,	// all in one column left (top down)
-	IDC_BT_WEBCAM2,		true,	0, 1,
-	IDC_BT_WEBCAM3,		true,   0, 2,
-	0
-};
+	CString strKey(devicePath);
+	strKey.Replace(_T('\\'), _T('#'));
+	return CString(REG_CAMERA) + _T("\\") + strKey;
+}
 
-const SLayout g_layout[CPTZControlDlg::NUM_MAX_WEBCAMS+1] = 
+/** Cameras of one model share its section. Empty for a path without USB IDs. */
+static CString ModelSection(const CString& devicePath)
 {
-	-1,	layoutBtns1,		// 0 or 1 camera (shrink dialog)
-	-1,	layoutBtns1,		// 0 or 1 camera (shrink dialog)
-	0,  layoutBtns2,		// 2 cameras	 (keep size)
-	0,  layoutBtns3,		// 3 cameras	 (keep size)
-};
-
+	CString strModel = WebcamController::DeviceModel(devicePath);
+	return strModel.IsEmpty() ? strModel : CString(REG_MODEL) + _T("\\") + strModel;
+}
 
 //////////////////////////////////////////////////////////////////////////////////////////
-//	Special new notification 
+//	Special new notifications
 
+#define ON_BN_PUSHED(id, memberFxn) \
+	ON_CONTROL(BN_PUSHED, id, memberFxn)
 #define ON_BN_UNPUSHED(id, memberFxn) \
 	ON_CONTROL(BN_UNPUSHED, id, memberFxn)
 
@@ -108,6 +90,8 @@ IMPLEMENT_DYNAMIC(CPTZButton,CMFCButton)
 CPTZButton::CPTZButton() 
 	: m_bAutoRepeat(false)
 	, m_uiSent(0)
+	, m_bHold(false)
+	, m_bHeld(false)
 {
 }
 
@@ -141,11 +125,22 @@ void CPTZButton::OnLButtonDown(UINT nFlags, CPoint point)
 		m_uiSent = 0;
 	}
 	__super::OnLButtonDown(nFlags, point);
+	if (m_bHold && GetCapture() == this)
+	{
+		m_bHeld = true;
+		GetParent()->SendMessage(WM_COMMAND, MAKELONG(GetDlgCtrlID(), BN_PUSHED), (LPARAM)m_hWnd);
+	}
 }
 
 void CPTZButton::OnLButtonUp(UINT nFlags, CPoint point)
 {
-	if (m_bAutoRepeat)
+	if (m_bHold)
+	{
+		// Releasing the capture sends BN_UNPUSHED. There is never a click.
+		if (GetCapture() == this)
+			ReleaseCapture();
+	}
+	else if (m_bAutoRepeat)
 	{
 		KillTimer(TIMER_AUTO_REPEAT);
 
@@ -165,6 +160,17 @@ void CPTZButton::OnLButtonUp(UINT nFlags, CPoint point)
 		__super::OnLButtonUp(nFlags, point);
 }
 
+void CPTZButton::OnCaptureChanged(CWnd* pWnd)
+{
+	// Also when another window takes the mouse, so a button is never held for ever
+	if (m_bHeld)
+	{
+		m_bHeld = false;
+		GetParent()->SendMessage(WM_COMMAND, MAKELONG(GetDlgCtrlID(), BN_UNPUSHED), (LPARAM)m_hWnd);
+	}
+	__super::OnCaptureChanged(pWnd);
+}
+
 void CPTZButton::OnTimer(UINT_PTR nIDEvent)
 {
 	if (nIDEvent==TIMER_AUTO_REPEAT)
@@ -175,6 +181,7 @@ void CPTZButton::OnTimer(UINT_PTR nIDEvent)
 				return;
 			++m_uiSent;
 			SetTimer(TIMER_AUTO_REPEAT, AUTO_REPEAT_DELAY, NULL);
+			TraceScope scope(_T("Auto repeat"), _T("ui"), -1, static_cast<int>(m_uiSent));
 			GetParent()->SendMessage(WM_COMMAND, MAKELONG(GetDlgCtrlID(), BN_CLICKED), (LPARAM)m_hWnd);
 		}
 	}
@@ -231,8 +238,7 @@ BOOL AdjustVisibleWindowRect(LPRECT lpRect, HWND hWndParent=NULL)
 CPTZControlDlg::CPTZControlDlg(CWnd* pParent /*=nullptr*/)
 	: CDialogEx(IDD_PTZCONTROL_DIALOG, pParent)
 	, m_hAccel(NULL)
-	, m_evTerminating(FALSE,TRUE)
-	, m_pGuardThread(nullptr)
+	, m_hDevNotify(NULL)
 	, m_currentCam(0)
 {
 	m_hIcon = AfxGetApp()->LoadIcon(IDR_MAINFRAME);
@@ -246,11 +252,8 @@ void CPTZControlDlg::PostNcDestroy()
 {
 	__super::PostNcDestroy();
 
-	// Cleanup the guard thread.
-	m_evTerminating.SetEvent();
-	if (m_pGuardThread)
-		::WaitForSingleObject(m_pGuardThread->m_hThread,INFINITE);
-	m_pGuardThread = nullptr;
+	if (m_hDevNotify)
+		::UnregisterDeviceNotification(m_hDevNotify);
 
 	// Finally delete the application.
 	delete this;
@@ -258,6 +261,14 @@ void CPTZControlDlg::PostNcDestroy()
 
 BOOL CPTZControlDlg::OnCommand(WPARAM wParam, LPARAM lParam)
 {
+	// The clicks and releases of the buttons, including those sent by the auto repeat
+	WORD wNotification = HIWORD(wParam);
+	std::unique_ptr<TraceScope> spScope;
+	if (TraceRecorder::IsEnabled() && lParam && (wNotification == BN_CLICKED || wNotification == BN_PUSHED || wNotification == BN_UNPUSHED))
+	{
+		spScope = std::make_unique<TraceScope>(wNotification == BN_CLICKED ? _T("BN_CLICKED") : wNotification == BN_PUSHED ? _T("BN_PUSHED") : _T("BN_UNPUSHED"),
+											   _T("ui"), static_cast<int>(m_currentCam), LOWORD(wParam));
+	}
 	return __super::OnCommand(wParam,lParam);
 }
 
@@ -266,6 +277,28 @@ BOOL CPTZControlDlg::PreTranslateMessage(MSG* pMsg)
 {
 	if (pMsg->message>=WM_KEYFIRST && pMsg->message<=WM_KEYLAST)
 	{
+		// The arrow and zoom keys are held inputs like the buttons. Two arrows at the same time
+		// move diagonal. The key repeat of Windows doesn't change anything, only presses and
+		// releases count. With ALT the keys are WM_SYSKEYDOWN and select a camera.
+		if ((pMsg->message==WM_KEYDOWN || pMsg->message==WM_KEYUP) && !m_cameras.empty())
+		{
+			switch (pMsg->wParam)
+			{
+			case VK_LEFT:
+			case VK_RIGHT:
+			case VK_UP:
+			case VK_DOWN:
+			case VK_ADD:
+			case VK_OEM_PLUS:
+			case VK_PRIOR:
+			case VK_NEXT:
+			case VK_OEM_MINUS:
+			case VK_SUBTRACT:
+				UpdateHeldInputs();
+				return TRUE;
+			}
+		}
+
 		if (m_hAccel)
 		{
 			if (::TranslateAccelerator(m_hWnd, m_hAccel, pMsg))
@@ -313,6 +346,7 @@ BEGIN_MESSAGE_MAP(CPTZControlDlg, CDialogEx)
 	ON_COMMAND_EX(IDC_BT_WEBCAM1, &CPTZControlDlg::OnBtWebCam)
 	ON_COMMAND_EX(IDC_BT_WEBCAM2, &CPTZControlDlg::OnBtWebCam)
 	ON_COMMAND_EX(IDC_BT_WEBCAM3, &CPTZControlDlg::OnBtWebCam)
+	ON_COMMAND_EX_RANGE(IDC_BT_WEBCAM_FIRST_CREATED, IDC_BT_WEBCAM_LAST_CREATED, &CPTZControlDlg::OnBtWebCam)
 	ON_COMMAND_EX(IDC_BT_PRESET1, &CPTZControlDlg::OnBtPreset)
 	ON_COMMAND_EX(IDC_BT_PRESET2, &CPTZControlDlg::OnBtPreset)
 	ON_COMMAND_EX(IDC_BT_PRESET3, &CPTZControlDlg::OnBtPreset)
@@ -329,11 +363,21 @@ BEGIN_MESSAGE_MAP(CPTZControlDlg, CDialogEx)
 	ON_BN_CLICKED(IDC_BT_HOME, &CPTZControlDlg::OnBtHome)
 	ON_BN_CLICKED(IDC_BT_RIGHT, &CPTZControlDlg::OnBtRight)
 	ON_BN_CLICKED(IDC_BT_SETTINGS, &CPTZControlDlg::OnBtSettings)
-	ON_BN_UNPUSHED(IDC_BT_UP, &CPTZControlDlg::OnBtUnpushed)
-	ON_BN_UNPUSHED(IDC_BT_DOWN, &CPTZControlDlg::OnBtUnpushed)
-	ON_BN_UNPUSHED(IDC_BT_LEFT, &CPTZControlDlg::OnBtUnpushed)
-	ON_BN_UNPUSHED(IDC_BT_RIGHT, &CPTZControlDlg::OnBtUnpushed)
+	ON_BN_PUSHED(IDC_BT_UP, &CPTZControlDlg::OnBtHeld)
+	ON_BN_PUSHED(IDC_BT_DOWN, &CPTZControlDlg::OnBtHeld)
+	ON_BN_PUSHED(IDC_BT_LEFT, &CPTZControlDlg::OnBtHeld)
+	ON_BN_PUSHED(IDC_BT_RIGHT, &CPTZControlDlg::OnBtHeld)
+	ON_BN_PUSHED(IDC_BT_ZOOM_IN, &CPTZControlDlg::OnBtHeld)
+	ON_BN_PUSHED(IDC_BT_ZOOM_OUT, &CPTZControlDlg::OnBtHeld)
+	ON_BN_UNPUSHED(IDC_BT_UP, &CPTZControlDlg::OnBtHeld)
+	ON_BN_UNPUSHED(IDC_BT_DOWN, &CPTZControlDlg::OnBtHeld)
+	ON_BN_UNPUSHED(IDC_BT_LEFT, &CPTZControlDlg::OnBtHeld)
+	ON_BN_UNPUSHED(IDC_BT_RIGHT, &CPTZControlDlg::OnBtHeld)
+	ON_BN_UNPUSHED(IDC_BT_ZOOM_IN, &CPTZControlDlg::OnBtHeld)
+	ON_BN_UNPUSHED(IDC_BT_ZOOM_OUT, &CPTZControlDlg::OnBtHeld)
 	ON_WM_TIMER()
+	ON_MESSAGE(WM_CAMERA_COMPLETED, &CPTZControlDlg::OnCameraCompleted)
+	ON_WM_DEVICECHANGE()
 END_MESSAGE_MAP()
 
 
@@ -342,19 +386,9 @@ END_MESSAGE_MAP()
 
 void CPTZControlDlg::ResetAllColors()
 {
-	for (CWnd* pWnd = GetWindow(GW_CHILD); pWnd; pWnd = pWnd->GetWindow(GW_HWNDNEXT))
-	{
-		auto *pButton = DYNAMIC_DOWNCAST(CPTZButton, pWnd);
-
-		// Don't reset color for web cam button
-		bool bIsWebCamBtn = false;
-		for (auto &btn : m_btWebCam)
-			bIsWebCamBtn |= pButton==&btn;
-
-		// Reset color for all other buttons
-		if (pButton && !bIsWebCamBtn)
-			pButton->SetFaceColor(COLORREF(-1), TRUE);
-	}
+	// Reset color for all buttons except the web cam buttons
+	for (auto* pButton : m_apControlButtons)
+		pButton->SetFaceColor(COLORREF(-1), TRUE);
 }
 
 void CPTZControlDlg::ResetMemButton()
@@ -365,79 +399,301 @@ void CPTZControlDlg::ResetMemButton()
 	m_btMemory.SetFaceColor(COLORREF(-1));
 }
 
-WebcamController& CPTZControlDlg::GetCurrentWebCam()
+WebcamWorker& CPTZControlDlg::GetCurrentWebCam()
 {
-	return m_webCams[m_currentCam];
+	ASSERT(!m_cameras.empty());
+	return *m_cameras[m_currentCam].spWebCam;
 }
 
 void CPTZControlDlg::SetActiveCam(size_t cam)
 {
-	if (cam < m_webCams.size())
+	if (cam < m_cameras.size())
 	{
 		// Clear mem button
 		ResetMemButton();
 
-		// Save the colors of the current buttons and set the old ones
-		for (CWnd* pWnd = GetWindow(GW_CHILD); pWnd; pWnd = pWnd->GetWindow(GW_HWNDNEXT))
+		// Save the color of the current buttons for the current web cam and get 
+		// the saved color from the map we have for the new cam.
+		auto& mapCurrent = m_cameras[m_currentCam].mapBtnColors;
+		auto& mapNew = m_cameras[cam].mapBtnColors;
+		for (auto* pButton : m_apControlButtons)
 		{
-			auto* pButton = DYNAMIC_DOWNCAST(CPTZButton, pWnd);
-			if (pButton)
-			{
-				// Save the color of the current buttons for the current web cam and get 
-				// the saved color from the map we have for the new cam.
-				auto nId = pButton->GetDlgCtrlID();
-				m_aMapBtnColors[m_currentCam][nId] = pButton->GetFaceColor();
-				auto it = m_aMapBtnColors[cam].find(nId);
-				if (it!=m_aMapBtnColors[cam].end())
-					pButton->SetFaceColor(it->second);
-			}
+			auto nId = pButton->GetDlgCtrlID();
+			mapCurrent[nId] = pButton->GetFaceColor();
+			auto it = mapNew.find(nId);
+			if (it!=mapNew.end())
+				pButton->SetFaceColor(it->second);
+		}
+
+		// Set the new webcam. Only the buttons of the old and the new cam change.
+		// A quarantined camera keeps its color.
+		auto Enable = [&](const CameraState& camera, bool bActive)
+		{
+			camera.pButton->SetCheck(bActive);
+			if (!camera.spWebCam->IsQuarantined())
+				camera.pButton->SetFaceColor(bActive ? COLOR_ORANGE : -1, TRUE);
+		};
+		// A held direction moves the new camera instead
+		if ((m_xHeld != 0 || m_yHeld != 0 || m_zHeld != 0) && cam != m_currentCam)
+		{
+			GetCurrentWebCam().SetVelocity(0, 0, 0);
+			m_cameras[cam].spWebCam->SetVelocity(m_xHeld, m_yHeld, m_zHeld);
 		}
+		Enable(m_cameras[m_currentCam], false);
+		m_currentCam = cam;
+		Enable(m_cameras[m_currentCam], true);
 
 		// Set the tooltips
-		for (int i=0; i<WebcamController::NUM_PRESETS; ++i)
-			m_btPreset[i].SetTooltip(m_strTooltips[cam][i]);
+		UpdatePresetTooltips();
+	}
+}
 
-		// Set the new webcam
-		m_currentCam = cam;
-		auto Enable = [&](CPTZButton &btn, bool bActive)
+void CPTZControlDlg::LoadCameraSettings(CameraState& camera)
+{
+	// A camera without own settings uses the settings that were common to all cameras
+	// and the tooltips that were stored by its index.
+	auto& webCam = camera.spWebCam->Camera();
+	webCam.useLogitechMotionControl = theApp.GetProfileInt(camera.strSection, REG_USELOGOTECHMOTIONCONTROL,
+		theApp.GetProfileInt(REG_DEVICE, REG_USELOGOTECHMOTIONCONTROL, FALSE)) != 0;
+	webCam.motorIntervalTime = theApp.GetProfileInt(camera.strSection, REG_MOTORINTERVALTIMER,
+		theApp.GetProfileInt(REG_DEVICE, REG_MOTORINTERVALTIMER, WebcamController::DEFAULT_MOTOR_INTERVAL));
+	webCam.logitechStepSize = theApp.GetProfileInt(camera.strSection, REG_LOGITECHSTEPSIZE,
+		theApp.GetProfileInt(REG_DEVICE, REG_LOGITECHSTEPSIZE, WebcamController::DEFAULT_LOGITECH_STEP_SIZE));
+	webCam.useLogitechMotorSteps = theApp.GetProfileInt(camera.strSection, REG_LOGITECHMOTORSTEPS,
+		theApp.GetProfileInt(REG_DEVICE, REG_LOGITECHMOTORSTEPS, FALSE)) != 0;
+	webCam.zoomSpeed = theApp.GetProfileInt(camera.strSection, REG_ZOOMSPEED,
+		theApp.GetProfileInt(REG_DEVICE, REG_ZOOMSPEED, WebcamController::DEFAULT_ZOOM_SPEED));
+	webCam.zoomScaling = theApp.GetProfileInt(camera.strSection, REG_ZOOMSCALING,
+		theApp.GetProfileInt(REG_DEVICE, REG_ZOOMSCALING, WebcamController::DEFAULT_ZOOM_SCALING));
+	auto GetCurveValue = [&](LPCTSTR pszEntry, double dDefault, double dUnit)
+	{
+		int iDefault = static_cast<int>(theApp.GetProfileInt(REG_DEVICE, pszEntry, static_cast<int>(dDefault * dUnit + 0.5)));
+		return theApp.GetProfileInt(camera.strSection, pszEntry, iDefault) / dUnit;
+	};
+	const auto curveDefault = MotionEngine::DefaultCurve(MotionEngine::AxisPan);
+	MotionEngine::Curve curve;
+	curve.dMinSpeed = GetCurveValue(REG_MOTIONMINSPEED, curveDefault.dMinSpeed, 1);
+	curve.dMaxSpeed = GetCurveValue(REG_MOTIONMAXSPEED, curveDefault.dMaxSpeed, 1);
+	curve.dRampTime = GetCurveValue(REG_MOTIONRAMPTIME, curveDefault.dRampTime, 1000);
+	curve.dExponent = GetCurveValue(REG_MOTIONRAMPCURVE, curveDefault.dExponent, 100);
+	camera.spWebCam->SetMotionCurve(curve);
+
+	size_t cam = camera.spWebCam->GetIndex();
+	for (int i = 0; i < WebcamController::NUM_PRESETS; ++i)
+	{
+		CString str, strDefault;
+		if (cam < NUM_TEMPLATE_WEBCAMS)
 		{
-			btn.SetCheck(bActive);
-			btn.SetFaceColor(bActive ? COLOR_ORANGE : -1, TRUE);
-		};
-		size_t iWebCam = 0;
-		for (auto &btn : m_btWebCam)
-			Enable(btn,m_currentCam==iWebCam++);
+			str.Format(REG_TOOLTIP, i + 1 + static_cast<int>(cam)*100);
+			strDefault = theApp.GetProfileString(REG_WINDOW, str);
+		}
+		str.Format(REG_TOOLTIP, i + 1);
+		camera.strTooltips[i] = theApp.GetProfileString(camera.strSection, str, strDefault);
+	}
+
+	// All software presets are one value, so there is one read however many there are
+	LPBYTE pData = nullptr;
+	UINT uSize = 0;
+	if (theApp.GetProfileBinary(camera.strSection, REG_PRESETS, &pData, &uSize))
+	{
+		if (!camera.spWebCam->Presets().Load(pData, uSize))
+			TRACE(__FUNCTION__ " presets of camera %u are invalid\n", static_cast<UINT>(cam + 1));
+		delete[] pData;
+	}
+	if (theApp.GetProfileBinary(camera.strSection, REG_TRAVELTIMES, &pData, &uSize))
+	{
+		if (!camera.spWebCam->Travel().Load(pData, uSize))
+			TRACE(__FUNCTION__ " travel times of camera %u are invalid\n", static_cast<UINT>(cam + 1));
+		delete[] pData;
+	}
+	// A camera that can't be measured uses the last calibration of the same model
+	const CString strModelSection = ModelSection(camera.strDevicePath);
+	if (theApp.GetProfileBinary(camera.strSection, REG_PULSECALIBRATION, &pData, &uSize) ||
+		(!strModelSection.IsEmpty() && theApp.GetProfileBinary(strModelSection, REG_PULSECALIBRATION, &pData, &uSize)))
+	{
+		if (!webCam.pulseCalibration.Load(pData, uSize))
+			TRACE(__FUNCTION__ " pulse calibration of camera %u is invalid\n", static_cast<UINT>(cam + 1));
+		delete[] pData;
+	}
+	if (theApp.GetProfileBinary(camera.strSection, REG_PRESETANCHORS, &pData, &uSize))
+	{
+		if (!webCam.positionEstimator.LoadPresets(pData, uSize))
+			TRACE(__FUNCTION__ " preset anchors of camera %u are invalid\n", static_cast<UINT>(cam + 1));
+		delete[] pData;
+	}
+}
+
+void CPTZControlDlg::SaveCameraSettings(const CameraState& camera)
+{
+	auto& webCam = camera.spWebCam->Camera();
+	theApp.WriteProfileInt(camera.strSection, REG_USELOGOTECHMOTIONCONTROL, webCam.useLogitechMotionControl);
+	theApp.WriteProfileInt(camera.strSection, REG_MOTORINTERVALTIMER, webCam.motorIntervalTime);
+	theApp.WriteProfileInt(camera.strSection, REG_LOGITECHSTEPSIZE, webCam.logitechStepSize);
+	theApp.WriteProfileInt(camera.strSection, REG_LOGITECHMOTORSTEPS, webCam.useLogitechMotorSteps);
+	theApp.WriteProfileInt(camera.strSection, REG_ZOOMSPEED, webCam.zoomSpeed);
+	theApp.WriteProfileInt(camera.strSection, REG_ZOOMSCALING, webCam.zoomScaling);
+	const auto curve = camera.spWebCam->GetMotionCurve();
+	theApp.WriteProfileInt(camera.strSection, REG_MOTIONMINSPEED, static_cast<int>(curve.dMinSpeed + 0.5));
+	theApp.WriteProfileInt(camera.strSection, REG_MOTIONMAXSPEED, static_cast<int>(curve.dMaxSpeed + 0.5));
+	theApp.WriteProfileInt(camera.strSection, REG_MOTIONRAMPTIME, static_cast<int>(curve.dRampTime * 1000 + 0.5));
+	theApp.WriteProfileInt(camera.strSection, REG_MOTIONRAMPCURVE, static_cast<int>(curve.dExponent * 100 + 0.5));
+	for (int i = 0; i < WebcamController::NUM_PRESETS; ++i)
+	{
+		CString str;
+		str.Format(REG_TOOLTIP, i + 1);
+		theApp.WriteProfileString(camera.strSection, str, camera.strTooltips[i]);
+	}
+	SavePresets(camera);
+	SaveTravelTimes(camera);
+	// Only a camera that was calibrated has one
+	if (webCam.pulseCalibration.IsValid())
+	{
+		auto calibration = webCam.pulseCalibration.Save();
+		theApp.WriteProfileBinary(camera.strSection, REG_PULSECALIBRATION, calibration.data(), static_cast<UINT>(calibration.size()));
 	}
 }
 
-//////////////////////////////////////////////////////////////////////////
-//	It seams that in some cases a camera my block.
-//	This thread should help that the blocking thread is detected. and the
-//	application terminates.
+void CPTZControlDlg::SavePresets(const CameraState& camera)
+{
+	// The presets in the device are anchors of the position estimate
+	auto anchors = camera.spWebCam->Camera().positionEstimator.SavePresets();
+	theApp.WriteProfileBinary(camera.strSection, REG_PRESETANCHORS, anchors.data(), static_cast<UINT>(anchors.size()));
+
+	// Cameras with presets in the device don't need the value
+	auto& presets = camera.spWebCam->Presets();
+	if (presets.GetCount() == 0)
+		return;
+	auto data = presets.Save();
+	theApp.WriteProfileBinary(camera.strSection, REG_PRESETS, data.data(), static_cast<UINT>(data.size()));
+}
 
-UINT AFX_CDECL CPTZControlDlg::GuardThread(LPVOID p)
+void CPTZControlDlg::SaveTravelTimes(const CameraState& camera)
 {
-	auto *pWnd = static_cast<CPTZControlDlg*>(p);
+	auto travel = camera.spWebCam->Travel().Save();
+	theApp.WriteProfileBinary(camera.strSection, REG_TRAVELTIMES, travel.data(), static_cast<UINT>(travel.size()));
+}
 
-	// This thread end when the application exists.
-	// For ever all 2000 seconds check if the application still runs and accepts messages.
-	for (;;)
+void CPTZControlDlg::UpdatePresetTooltips()
+{
+	// Called after every command of the current camera, so the tooltip is only set when it changed
+	auto& camera = m_cameras[m_currentCam];
+	for (int i = 0; i < WebcamController::NUM_PRESETS; ++i)
 	{
-		// Check if we have an event, wait for 1 sec
-		CSingleLock lock(&pWnd->m_evTerminating,FALSE);
-		if (lock.Lock(1000))
-			// Event is set.
-			return 0;
-		
-		// Check if the application is blocking
-		if (::SendMessageTimeout(pWnd->GetSafeHwnd(), WM_NULL, 0, 0, SMTO_ABORTIFHUNG | SMTO_NORMAL, 1000, NULL)==0)
+		CString str = camera.strTooltips[i];
+		double dTravel = camera.spWebCam->PredictTravel(i);
+		if (dTravel >= 0)
 		{
-			// Exit the current process
-			::ExitProcess(10);
-		}			
+			CString strTravel;
+			strTravel.Format(str.IsEmpty() ? _T("Ready in %.1f s") : _T(" - ready in %.1f s"), dTravel / 1000);
+			str += strTravel;
+		}
+		if (str != m_strShownTooltips[i])
+		{
+			m_btPreset[i].SetTooltip(str);
+			m_strShownTooltips[i] = str;
+		}
 	}
 }
 
+CPTZButton* CPTZControlDlg::CreateWebCamButton(size_t cam)
+{
+	if (cam < NUM_TEMPLATE_WEBCAMS)
+		return &m_btWebCam[cam];
+
+	UINT nId = IDC_BT_WEBCAM_FIRST_CREATED + static_cast<UINT>(cam - NUM_TEMPLATE_WEBCAMS);
+	if (nId > IDC_BT_WEBCAM_LAST_CREATED)
+		return nullptr;
+
+	// Same size, style and font as the first camera button. There is no image, just the number.
+	CRect rect;
+	m_btWebCam[0].GetWindowRect(rect);
+	ScreenToClient(rect);
+	CString strText;
+	strText.Format(_T("%u"), static_cast<UINT>(cam + 1));
+
+	auto spButton = std::make_unique<CPTZButton>();
+	if (!spButton->Create(strText, m_btWebCam[0].GetStyle() & ~WS_VISIBLE, rect, this, nId))
+		return nullptr;
+	spButton->SetFont(m_btWebCam[0].GetFont());
+	spButton->SetCheckStyle();
+	m_btMoreWebCams.push_back(std::move(spButton));
+	return m_btMoreWebCams.back().get();
+}
+
+void CPTZControlDlg::OpenWebCam(CameraState& camera, const WebcamDevice& device)
+{
+	//	Load the settings of this camera
+	camera.strName = device.deviceName;
+	camera.strSection = CameraSection(device.devicePath);
+	camera.strDevicePath = device.devicePath;
+	camera.strIdentity = WebcamController::DeviceIdentity(device.devicePath);
+	LoadCameraSettings(camera);
+	WebcamWorker& webCam = *camera.spWebCam;
+
+	// A topology from an earlier start saves the discovery, if the device is still the same.
+	WebcamController::Topology topology;
+	if (LoadTopology(device.devicePath, topology))
+		webCam.Camera().SetCachedTopology(topology);
+
+	// The device is opened on the worker thread, so it lives in the apartment of the worker.
+	// The moniker of the enumeration is used, so the devices are not enumerated again.
+	// The result is reported with WM_CAMERA_COMPLETED.
+	WORD wCamera = webCam.GetIndex();
+	LONGLONG llStart = MotorPulseScheduler::Now();
+	webCam.Post(CameraCommand::Open, [device, wCamera, llStart](WebcamController& camera)
+	{
+		HRESULT hr = camera.OpenDevice(device);
+		if (FAILED(hr))
+			return hr;
+
+		bool bCached = camera.IsTopologyFromCache();
+		TRACE("Camera %d opened after %.1f msec with %s topology\n", wCamera + 1,
+			  MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart), bCached ? "cached" : "discovered");
+		if (!bCached)
+			SaveTopology(device.devicePath, camera.GetTopology());
+		return hr;
+	});
+}
+
+void CPTZControlDlg::ReconnectWebCam(CameraState& camera, const WebcamDevice& device, LONGLONG llArrival)
+{
+	// The worker of a quarantined camera is gone. The camera gets a new one with the same settings.
+	if (camera.spWebCam->IsQuarantined())
+	{
+		const auto& oldCamera = camera.spWebCam->Camera();
+		auto spWebCam = std::make_unique<WebcamWorker>(GetSafeHwnd(), WM_CAMERA_COMPLETED, camera.spWebCam->GetIndex());
+		spWebCam->SetDeadline(theApp.m_dwDeadline);
+		spWebCam->Camera().useLogitechMotionControl = oldCamera.useLogitechMotionControl.load();
+		spWebCam->Camera().motorIntervalTime = oldCamera.motorIntervalTime.load();
+		spWebCam->Camera().logitechStepSize = oldCamera.logitechStepSize.load();
+		spWebCam->Camera().useLogitechMotorSteps = oldCamera.useLogitechMotorSteps.load();
+		spWebCam->Camera().zoomSpeed = oldCamera.zoomSpeed.load();
+		spWebCam->Camera().zoomScaling = oldCamera.zoomScaling.load();
+		spWebCam->SetMotionCurve(camera.spWebCam->GetMotionCurve());
+		WebcamController::Topology topology;
+		if (LoadTopology(camera.strDevicePath, topology))
+			spWebCam->Camera().SetCachedTopology(topology);
+		auto presets = camera.spWebCam->Presets().Save();
+		spWebCam->Presets().Load(presets.data(), presets.size());
+		auto travel = camera.spWebCam->Travel().Save();
+		spWebCam->Travel().Load(travel.data(), travel.size());
+		auto calibration = oldCamera.pulseCalibration.Save();
+		spWebCam->Camera().pulseCalibration.Load(calibration.data(), calibration.size());
+		auto anchors = oldCamera.positionEstimator.SavePresets();
+		spWebCam->Camera().positionEstimator.LoadPresets(anchors.data(), anchors.size());
+		if (!spWebCam->Start())
+			return;
+		camera.spWebCam = std::move(spWebCam);
+		camera.pButton->SetFaceColor(COLORREF(-1), TRUE);
+	}
+
+	// The settings stay in the section of the first path, the identity is the same.
+	camera.strDevicePath = device.devicePath;
+	camera.bConnected = true;
+	camera.llArrival = llArrival;
+	camera.spWebCam->Reconnect(device, camera.iLastPreset);
+}
+
 BOOL CPTZControlDlg::OnInitDialog()
 {
 	__super::OnInitDialog();
@@ -456,8 +712,8 @@ BOOL CPTZControlDlg::OnInitDialog()
 		images.SetImageSize(CSize(16, 16));
 		images.Load(IDB_BUTTONS);
 
-		int iImage = 0;
-		CPTZButton* apButtons[] =
+		// The control buttons first, in the order of the images
+		m_apControlButtons =
 		{
 			&m_btDown,
 			&m_btLeft,
@@ -477,10 +733,12 @@ BOOL CPTZControlDlg::OnInitDialog()
 			&m_btPreset[7],
 			&m_btExit,
 			&m_btSettings,
-			&m_btWebCam[0],
-			&m_btWebCam[1],
-			&m_btWebCam[2],
 		};
+		std::vector<CPTZButton*> apButtons(m_apControlButtons);
+		for (auto &btn : m_btWebCam)
+			apButtons.push_back(&btn);
+
+		int iImage = 0;
 		for (auto* pBtn : apButtons)
 		{
 			HICON hIcon = images.ExtractIcon(iImage++);
@@ -490,13 +748,13 @@ BOOL CPTZControlDlg::OnInitDialog()
 		}
 	}
 
-	// Set auto repeat buttons
-	m_btLeft.SetAutoRepeat(true);
-	m_btRight.SetAutoRepeat(true);
-	m_btDown.SetAutoRepeat(true);
-	m_btUp.SetAutoRepeat(true);
-	m_btZoomIn.SetAutoRepeat(true);
-	m_btZoomOut.SetAutoRepeat(true);
+	// The direction and zoom buttons only tell when they are pressed and released, see UpdateHeldInputs
+	m_btLeft.SetHold(true);
+	m_btRight.SetHold(true);
+	m_btDown.SetHold(true);
+	m_btUp.SetHold(true);
+	m_btZoomIn.SetHold(true);
+	m_btZoomOut.SetHold(true);
 
 	// This is a check box style
 	m_btMemory.SetCheckStyle();
@@ -518,32 +776,29 @@ BOOL CPTZControlDlg::OnInitDialog()
 	if (!theApp.m_strDevName.IsEmpty())
 		deviceNameFilters.push_back(theApp.m_strDevName);
 
-	auto aDevices{ WebcamController::CompatibleDevices(deviceNameFilters) };
-
-	auto OpenWebCam = [](WebcamController& webCam, CString strDevToken)->bool
-	{
-		HRESULT hr = webCam.OpenDevice(strDevToken);
-		if (FAILED(hr))
-		{
-			AfxMessageBox(IDP_ERR_OPENFAILED);
-			return false;
-		}
-
-		//	Load the default setting
-		webCam.useLogitechMotionControl = theApp.GetProfileInt(REG_DEVICE, REG_USELOGOTECHMOTIONCONTROL, FALSE) != 0;
-		webCam.motorIntervalTime = theApp.GetProfileInt(REG_DEVICE, REG_MOTORINTERVALTIMER, WebcamController::DEFAULT_MOTOR_INTERVAL);
-		return true;
-	};
-
-	for (auto device : aDevices) {
-		m_webCams.emplace_back();
-		if (!OpenWebCam(m_webCams.back(), device.devicePath)) {
-			m_webCams.pop_back();
-		}
+	// Simulated cameras replace the real devices for testing.
+	auto aDevices{ theApp.m_iSimulatedCameras > 0 ?
+		SimulatedCamera::Devices(theApp.m_iSimulatedCameras, theApp.m_dwSimulatedLatency) :
+		WebcamController::CompatibleDevices(deviceNameFilters) };
+
+	// All cameras are opened at the same time on their worker threads. The dialog doesn't
+	// wait for them, a camera button is enabled when its camera is ready.
+	m_cameras.reserve(aDevices.size());
+	for (const auto& device : aDevices) {
+		CameraState camera;
+		camera.spWebCam = std::make_unique<WebcamWorker>(GetSafeHwnd(), WM_CAMERA_COMPLETED, static_cast<WORD>(m_cameras.size()));
+		camera.spWebCam->SetDeadline(theApp.m_dwDeadline);
+		if (!camera.spWebCam->Start())
+			continue;
+		camera.pButton = CreateWebCamButton(m_cameras.size());
+		if (!camera.pButton)
+			continue;
+		OpenWebCam(camera, device);
+		m_cameras.push_back(std::move(camera));
 	}
 
 	// Check how many web cams we found
-	if (m_webCams.empty())
+	if (m_cameras.empty())
 	{
 		// If we have no cam, show message
 		AfxMessageBox(IDP_ERR_NO_CAMERA, MB_ICONERROR);
@@ -565,18 +820,28 @@ BOOL CPTZControlDlg::OnInitDialog()
 	CSize sizeRaster { rectBtn21.left-rectBtn11.left, rectBtn12.top-rectBtn11.top };
 
 	// Get the required layout
-	const auto &layout = g_layout[m_webCams.size()];
+	const auto layout = CameraLayout::Compute(m_cameras.size());
+	ASSERT(layout.IsValid());
 
-	for (const auto* pLayoutBtn = layout.pButtons; pLayoutBtn->nId; ++pLayoutBtn)
+	auto Place = [&](CWnd &wnd, const CameraLayout::Cell& cell, bool bShow)
 	{
-		CWnd *pWnd = GetDlgItem(pLayoutBtn->nId);
 		// Move the button and hide or show the button
-		pWnd->SetWindowPos(nullptr, 
-						   pointBase.x + pLayoutBtn->x * sizeRaster.cx, pointBase.y + pLayoutBtn->y * sizeRaster.cy, 
-						   0, 0, SWP_NOSIZE|SWP_NOZORDER|(pLayoutBtn->bShow ? SWP_SHOWWINDOW : SWP_HIDEWINDOW)			
+		wnd.SetWindowPos(nullptr, 
+						 pointBase.x + cell.x * sizeRaster.cx, pointBase.y + cell.y * sizeRaster.cy, 
+						 0, 0, SWP_NOSIZE|SWP_NOZORDER|(bShow ? SWP_SHOWWINDOW : SWP_HIDEWINDOW)			
 		);
-		pWnd->EnableWindow(pLayoutBtn->bShow);
+		wnd.EnableWindow(bShow);
+	};
+	Place(m_btExit, layout.exit, true);
+	Place(m_btSettings, layout.settings, true);
+	for (size_t i = 0; i < m_cameras.size(); ++i)
+	{
+		// The camera buttons stay disabled until the camera is open
+		Place(*m_cameras[i].pButton, layout.cameras[i], layout.bShowCameras);
+		m_cameras[i].pButton->EnableWindow(FALSE);
 	}
+	for (size_t i = m_cameras.size(); i < NUM_TEMPLATE_WEBCAMS; ++i)
+		Place(m_btWebCam[i], CameraLayout::Cell{ 0, 0 }, false);
 
 	// First Center
 	CenterWindow();
@@ -584,6 +849,7 @@ BOOL CPTZControlDlg::OnInitDialog()
 	// Adjust the window
 	CRect rect;
 	GetWindowRect(rect);
+	rect.right += layout.cxDelta*sizeRaster.cx;
 	CPoint pt = rect.TopLeft();
 	rect.OffsetRect(-pt);
 	pt.x = theApp.GetProfileInt(REG_WINDOW, REG_WINDOW_POSX, pt.x);
@@ -592,44 +858,32 @@ BOOL CPTZControlDlg::OnInitDialog()
 	AdjustVisibleWindowRect(rect);
 
 	// Move it
-	SetWindowPos(&CWnd::wndTopMost, rect.left, rect.top, rect.Width()+layout.cxDelta*sizeRaster.cx, rect.Height(), 0);
-
-	// Set the tooltips for all presets
-	for (int i = 0; i < WebcamController::NUM_PRESETS; ++i)
-	{
-		for (int j = 0; j < CPTZControlDlg::NUM_MAX_WEBCAMS; ++j)
-		{
-			CString str;
-			str.Format(REG_TOOLTIP, i + 1 + j*100);
-			m_strTooltips[j][i] = theApp.GetProfileString(REG_WINDOW, str);
-		}
-	}
+	SetWindowPos(&CWnd::wndTopMost, rect.left, rect.top, rect.Width(), rect.Height(), 0);
 
 	EnableToolTips(TRUE);
 
-	// Start a guard thread that takes care about a blocking app.
-	if (!theApp.m_bNoGuard)
-		m_pGuardThread = AfxBeginThread(&GuardThread,this);
+	// Get notified when a camera is unplugged or plugged in again
+	DEV_BROADCAST_DEVICEINTERFACE filter{};
+	filter.dbcc_size = sizeof(filter);
+	filter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+	filter.dbcc_classguid = KSCATEGORY_CAPTURE;
+	m_hDevNotify = ::RegisterDeviceNotification(GetSafeHwnd(), &filter, DEVICE_NOTIFY_WINDOW_HANDLE);
 
 	// Set a time to move the focus to the parent window
 	SetTimer(TIMER_FOCUS_CHECK,FOCUS_CHECK_DELAY,nullptr);
 	SetFocus();
 
-	// Move all cams to home position. And WebCam 0 will be the active one.
-	if (theApp.m_bNoReset)
-	{
-		// Activate camera 0.
-		if (!m_webCams.empty())
-			SetActiveCam(0);
-	}
-	else
+	// WebCam 0 will be the active one. Move all cams to home position, each camera
+	// does it as soon as it is open.
+	if (!m_cameras.empty())
 	{
-		// Reset the cameras to home position. and leave the first camera 
-		// (index 0) the active one ((loop backwards).
-		for (size_t i = m_webCams.size(); i > 0; --i)
+		SetActiveCam(0);
+		if (!theApp.m_bNoReset)
 		{
-			SetActiveCam(i - 1);
-			OnBtHome();
+			ResetAllColors();
+			for (auto& camera : m_cameras)
+				camera.spWebCam->GotoHome();
+			m_btHome.SetFaceColor(COLOR_GREEN, TRUE);
 		}
 	}
 
@@ -688,6 +942,10 @@ void CPTZControlDlg::OnClose()
 	theApp.WriteProfileInt(REG_WINDOW,REG_WINDOW_POSX,rect.left);
 	theApp.WriteProfileInt(REG_WINDOW,REG_WINDOW_POSY,rect.top);
 
+	// The travel times are learned with every arrival, so they are written once at the end
+	for (const auto& camera : m_cameras)
+		SaveTravelTimes(camera);
+
 	DestroyWindow();
 }
 
@@ -729,11 +987,15 @@ BEGIN_MESSAGE_MAP(CPTZButton, CMFCButton)
 	ON_WM_LBUTTONDOWN()
 	ON_WM_TIMER()
 	ON_WM_LBUTTONUP()
+	ON_WM_CAPTURECHANGED()
 END_MESSAGE_MAP()
 
 
 BOOL CPTZControlDlg::OnBtPreset(UINT nId)
 {
+	if (m_cameras.empty())
+		return TRUE;
+
 	UINT uiPreset = 0;
 	while (uiPreset<WebcamController::NUM_PRESETS)
 	{
@@ -746,6 +1008,7 @@ BOOL CPTZControlDlg::OnBtPreset(UINT nId)
 	{
 		ResetAllColors();
 		bool bStore = m_btMemory.GetCheck();
+		m_cameras[m_currentCam].iLastPreset = static_cast<int>(uiPreset);
 		if (bStore)
 		{
 			// Save as new preset
@@ -755,29 +1018,38 @@ BOOL CPTZControlDlg::OnBtPreset(UINT nId)
 		else
 			GetCurrentWebCam().GotoPreset(uiPreset);
 
-		// Set color
-		STATIC_DOWNCAST(CPTZButton,GetDlgItem(nId))->SetFaceColor(COLOR_GREEN,TRUE);
+		// Set color, yellow until the camera arrived
+		STATIC_DOWNCAST(CPTZButton,GetDlgItem(nId))->SetFaceColor(bStore ? COLOR_GREEN : COLOR_YELLOW,TRUE);
 	}
 	return TRUE;
 }
 
 BOOL CPTZControlDlg::OnBtWebCam(UINT nId)
 {
-	SetActiveCam(nId==IDC_BT_WEBCAM1 ? 0 :
+	SetActiveCam(nId>=IDC_BT_WEBCAM_FIRST_CREATED ? NUM_TEMPLATE_WEBCAMS + (nId - IDC_BT_WEBCAM_FIRST_CREATED) :
+				 nId==IDC_BT_WEBCAM1 ? 0 :
 				 nId==IDC_BT_WEBCAM2 ? 1 : 2);
 	return 1;
 }
 
 void CPTZControlDlg::OnBtHome()
 {
+	if (m_cameras.empty())
+		return;
+
 	ResetAllColors();
 	GetCurrentWebCam().GotoHome();
-	m_btHome.SetFaceColor(COLOR_GREEN,TRUE);
+	m_cameras[m_currentCam].iLastPreset = -1;
+	m_btHome.SetFaceColor(COLOR_YELLOW,TRUE);
 }
 
 
 void CPTZControlDlg::OnBtZoomIn()
 {
+	if (m_cameras.empty())
+		return;
+
+	// A single step. Held buttons and zoom keys go through UpdateHeldInputs.
 	ResetAllColors();
 	GetCurrentWebCam().Zoom(1);
 }
@@ -785,6 +1057,9 @@ void CPTZControlDlg::OnBtZoomIn()
 
 void CPTZControlDlg::OnBtZoomOut()
 {
+	if (m_cameras.empty())
+		return;
+
 	ResetAllColors();
 	GetCurrentWebCam().Zoom(-1);
 }
@@ -792,40 +1067,41 @@ void CPTZControlDlg::OnBtZoomOut()
 
 void CPTZControlDlg::OnBtDown()
 {
+	if (m_cameras.empty())
+		return;
+
+	// A single step. Held buttons and arrow keys go through UpdateHeldInputs.
 	ResetAllColors();
-	if (m_btDown.InAutoRepeat())
-		GetCurrentWebCam().Tilt(-1);
-	else
-		GetCurrentWebCam().MoveTilt(-1);
+	GetCurrentWebCam().MoveTilt(-1);
 }
 
 void CPTZControlDlg::OnBtUp()
 {
+	if (m_cameras.empty())
+		return;
+
 	ResetAllColors();
-	if (m_btUp.InAutoRepeat())
-		GetCurrentWebCam().Tilt(1);
-	else
-		GetCurrentWebCam().MoveTilt(1);
+	GetCurrentWebCam().MoveTilt(1);
 }
 
 
 void CPTZControlDlg::OnBtLeft()
 {
+	if (m_cameras.empty())
+		return;
+
 	ResetAllColors();
-	if (m_btLeft.InAutoRepeat())
-		GetCurrentWebCam().Pan(-1);
-	else
-		GetCurrentWebCam().MovePan(-1);
+	GetCurrentWebCam().MovePan(-1);
 }
 
 
 void CPTZControlDlg::OnBtRight()
 {
+	if (m_cameras.empty())
+		return;
+
 	ResetAllColors();
-	if (m_btRight.InAutoRepeat())
-		GetCurrentWebCam().Pan(1);
-	else
-		GetCurrentWebCam().MovePan(1);
+	GetCurrentWebCam().MovePan(1);
 }
 
 
@@ -847,6 +1123,9 @@ void CPTZControlDlg::OnTimer(UINT_PTR nIDEvent)
 			(GetAsyncKeyState(VK_LBUTTON) & 0x8000)==0)
 			// only move the focus, when a button has the focus and the mouse is not down.
 			SetFocus();
+		// A key released while another window had the focus
+		if (m_xHeld != 0 || m_yHeld != 0 || m_zHeld != 0)
+			UpdateHeldInputs(true);
 	}
 	else if (nIDEvent == TIMER_CLEAR_MEMORY)
 	{
@@ -857,51 +1136,284 @@ void CPTZControlDlg::OnTimer(UINT_PTR nIDEvent)
 	__super::OnTimer(nIDEvent);
 }
 
-void CPTZControlDlg::OnBtUnpushed()
+void CPTZControlDlg::OnBtHeld()
 {
-	GetCurrentWebCam().Pan(0);
-	GetCurrentWebCam().Tilt(0);
+	UpdateHeldInputs();
+}
+
+void CPTZControlDlg::UpdateHeldInputs(bool bAsync)
+{
+	if (m_cameras.empty())
+		return;
+
+	// Buttons and keys add up, so the mouse and the keyboard can be used together
+	auto IsDown = [bAsync](int nVirtKey) { return ((bAsync ? ::GetAsyncKeyState(nVirtKey) : ::GetKeyState(nVirtKey)) & 0x8000)!=0; };
+	int xDirection = (m_btRight.IsHeld() || IsDown(VK_RIGHT) ? 1 : 0) - (m_btLeft.IsHeld() || IsDown(VK_LEFT) ? 1 : 0);
+	int yDirection = (m_btUp.IsHeld() || IsDown(VK_UP) ? 1 : 0) - (m_btDown.IsHeld() || IsDown(VK_DOWN) ? 1 : 0);
+	// Page up and down with ALT select a camera
+	bool bZoomKeys = !IsDown(VK_MENU);
+	bool bZoomIn = bZoomKeys && (IsDown(VK_ADD) || IsDown(VK_OEM_PLUS) || IsDown(VK_PRIOR));
+	bool bZoomOut = bZoomKeys && (IsDown(VK_SUBTRACT) || IsDown(VK_OEM_MINUS) || IsDown(VK_NEXT));
+	int zDirection = (m_btZoomIn.IsHeld() || bZoomIn ? 1 : 0) - (m_btZoomOut.IsHeld() || bZoomOut ? 1 : 0);
+	if (xDirection == m_xHeld && yDirection == m_yHeld && zDirection == m_zHeld)
+		return;
+
+	if (xDirection != 0 || yDirection != 0 || zDirection != 0)
+		ResetAllColors();
+	m_xHeld = xDirection;
+	m_yHeld = yDirection;
+	m_zHeld = zDirection;
+	GetCurrentWebCam().SetVelocity(xDirection, yDirection, zDirection);
 }
 
 void CPTZControlDlg::OnBtSettings()
 {
+	if (m_cameras.empty())
+		return;
+
+	// The settings of the current camera
+	auto &camera = m_cameras[m_currentCam];
 	CSettingsDlg dlg;
-	dlg.m_strCameraName = m_strCameraDeviceNames;
-	dlg.m_strCameraName.Replace(_T("\r\n"), _T(", "));
-	dlg.m_bLogitechCameraControl = GetCurrentWebCam().useLogitechMotionControl;
-	dlg.m_iMotorIntervalTimer = GetCurrentWebCam().motorIntervalTime;
+	dlg.m_iCamera = static_cast<int>(m_currentCam) + 1;
+	dlg.m_strCameraName = camera.strName;
+	dlg.m_bLogitechCameraControl = camera.spWebCam->Camera().useLogitechMotionControl;
+	dlg.m_iMotorIntervalTimer = camera.spWebCam->Camera().motorIntervalTime;
 
 	// Get a copy of the tooltips
 	for (int i = 0; i < WebcamController::NUM_PRESETS; ++i)
+		dlg.m_strTooltip[i] = camera.strTooltips[i];
+	dlg.m_fnDiagnostics = [this]() { return DiagnosticsReport(); };
+	// A reconnect replaces the worker while the dialog is open, it is looked up on the click
+	const size_t cam = m_currentCam;
+	dlg.m_fnCalibrate = [this, cam]()
 	{
-		for (int j = 0; j < CPTZControlDlg::NUM_MAX_WEBCAMS; ++j)
-		{
-			dlg.m_strTooltip[j][i] = m_strTooltips[j][i];
-		}
-	}
+		// A quarantined camera drops the command and never reports it
+		if (m_cameras[cam].spWebCam->IsQuarantined())
+			return false;
+		m_cameras[cam].spWebCam->CalibratePulses();
+		return true;
+	};
 
-	if (dlg.DoModal()!=IDOK)
+	// A calibration is kept, even if the dialog is cancelled
+	m_pSettingsDlg = &dlg;
+	INT_PTR iResult = dlg.DoModal();
+	m_pSettingsDlg = nullptr;
+	if (iResult!=IDOK)
 		return;
 
 	// Copy back and save
 	for (int i = 0; i < WebcamController::NUM_PRESETS; ++i)
-	{
-		for (int j = 0; j < CPTZControlDlg::NUM_MAX_WEBCAMS; ++j)
-		{
-			m_strTooltips[j][i] = dlg.m_strTooltip[j][i];
-			CString str;
-			str.Format(REG_TOOLTIP, i + 1 + j*100);
-			theApp.WriteProfileString(REG_WINDOW, str, m_strTooltips[j][i]);
-		}
-	}
+		camera.strTooltips[i] = dlg.m_strTooltip[i];
 
 	// Camera control
-	GetCurrentWebCam().useLogitechMotionControl = dlg.m_bLogitechCameraControl!=0;
-	theApp.WriteProfileInt(REG_DEVICE, REG_USELOGOTECHMOTIONCONTROL, dlg.m_bLogitechCameraControl);
-	GetCurrentWebCam().motorIntervalTime = dlg.m_iMotorIntervalTimer;
-	theApp.WriteProfileInt(REG_DEVICE, REG_USELOGOTECHMOTIONCONTROL, dlg.m_bLogitechCameraControl);
+	camera.spWebCam->Camera().useLogitechMotionControl = dlg.m_bLogitechCameraControl!=0;
+	camera.spWebCam->Camera().motorIntervalTime = dlg.m_iMotorIntervalTimer;
+	SaveCameraSettings(camera);
 
 	// Set tooltips again
 	SetActiveCam(m_currentCam);
 }
 
+CString CPTZControlDlg::DiagnosticsReport() const
+{
+	CString strReport, str;
+	for (size_t cam = 0; cam < m_cameras.size(); ++cam)
+	{
+		const auto &camera = m_cameras[cam];
+		const WebcamWorker &worker = *camera.spWebCam;
+		str.Format(_T("Camera %u: %s%s%s\r\n"), static_cast<UINT>(cam) + 1, camera.strName.GetString(),
+				   camera.bConnected ? _T("") : _T(" (disconnected)"),
+				   worker.IsQuarantined() ? _T(" (quarantined)") : _T(""));
+		strReport += str;
+
+		// Only the operations that were used
+		strReport += LatencyHistogram::FormatHeader() + _T("\r\n");
+		for (int i = 0; i < WebcamController::NUM_DEVICE_CALLS; ++i)
+		{
+			auto call = static_cast<WebcamController::DeviceCall>(i);
+			str = worker.Camera().GetCallLatency(call).Format(WebcamController::CallName(call));
+			if (!str.IsEmpty())
+				strReport += str + _T("\r\n");
+		}
+		for (int i = 0; i < static_cast<int>(CameraCommand::NUM_COMMANDS); ++i)
+		{
+			auto cmd = static_cast<CameraCommand>(i);
+			CString strName = CString(_T("Command ")) + WebcamWorker::CommandName(cmd);
+			str = worker.GetCommandLatency(cmd).Format(strName);
+			if (!str.IsEmpty())
+				strReport += str + _T("\r\n");
+		}
+		for (int i = 0; i < WebcamWorker::NUM_TARGETS; ++i)
+		{
+			CString strName;
+			if (i == WebcamWorker::TARGET_HOME)
+				strName = _T("Arrival home");
+			else if (i == WebcamWorker::TARGET_POSITION)
+				strName = _T("Arrival position");
+			else
+				strName.Format(_T("Arrival preset %d"), i + 1);
+			str = worker.GetArrivalLatency(i).Format(strName);
+			if (!str.IsEmpty())
+				strReport += str + _T("\r\n");
+		}
+
+		// The motor model and where it thinks the camera is
+		const auto& calibration = worker.Camera().pulseCalibration;
+		if (calibration.IsValid())
+		{
+			str.Format(_T("Pulse calibration: minimum %.1f msec, %.4f units/msec\r\n"), calibration.GetMinimumPulse(), calibration.GetSpeed());
+			strReport += str;
+		}
+		const auto pan = worker.Camera().positionEstimator.Get(PositionEstimator::AxisPan);
+		const auto tilt = worker.Camera().positionEstimator.Get(PositionEstimator::AxisTilt);
+		if (pan.bKnown || tilt.bKnown)
+		{
+			auto Format = [](const PositionEstimator::Estimate& estimate)
+			{
+				CString str(_T("unknown"));
+				if (estimate.bKnown)
+					str.Format(_T("%.1f +/- %.1f"), estimate.dPosition, estimate.dUncertainty);
+				return str;
+			};
+			str.Format(_T("Estimated position: pan %s, tilt %s\r\n"), Format(pan).GetString(), Format(tilt).GetString());
+			strReport += str;
+		}
+		strReport += _T("\r\n");
+	}
+	if (TraceRecorder::IsEnabled())
+	{
+		str.Format(_T("Trace: %I64u events recorded, %I64u overwritten\r\n"), TraceRecorder::GetRecorded(), TraceRecorder::GetOverwritten());
+		strReport += str;
+	}
+	return strReport;
+}
+
+LRESULT CPTZControlDlg::OnCameraCompleted(WPARAM wParam, LPARAM lParam)
+{
+	size_t cam = LOWORD(wParam);
+	auto cmd = static_cast<CameraCommand>(HIWORD(wParam));
+	HRESULT hr = static_cast<HRESULT>(lParam);
+	if (FAILED(hr))
+		TRACE(__FUNCTION__ " camera %u command %u failed (0x%08x)\n", static_cast<UINT>(cam), static_cast<UINT>(HIWORD(wParam)), hr);
+
+	// A camera with a failing command gets a red button until a command succeeds again.
+	if (cam < m_cameras.size())
+	{
+		auto &btn = *m_cameras[cam].pButton;
+		if (m_cameras[cam].spWebCam->IsQuarantined())
+		{
+			// The camera hangs and stays gray and disabled. All others can still be used.
+			btn.EnableWindow(FALSE);
+			btn.SetFaceColor(COLOR_GRAY, TRUE);
+			// A calibration that hung or waited behind the hung command never completes
+			if (m_pSettingsDlg && static_cast<size_t>(m_pSettingsDlg->m_iCamera) == cam + 1)
+				m_pSettingsDlg->OnCalibrated(false, 0);
+			return 0;
+		}
+		if (cmd == CameraCommand::Open)
+		{
+			// The camera is ready now. Hidden buttons stay disabled.
+			btn.EnableWindow(SUCCEEDED(hr) && (btn.GetStyle() & WS_VISIBLE) != 0);
+			if (m_cameras[cam].llArrival)
+			{
+				// No message box during a livestream, the button stays red.
+				TRACE("Camera %u reconnected %.1f msec after the device arrived\n", static_cast<UINT>(cam + 1),
+					  MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - m_cameras[cam].llArrival));
+				m_cameras[cam].llArrival = 0;
+			}
+			else if (FAILED(hr))
+				AfxMessageBox(IDP_ERR_OPENFAILED);
+		}
+		// The camera arrived, the button of its preset turns green. It turns red if the
+		// recall failed or the camera didn't settle. The colors of an inactive camera are
+		// kept in its map.
+		bool bRecall = cmd == CameraCommand::GotoPreset || cmd == CameraCommand::GotoHome ||
+					   cmd == CameraCommand::GotoPosition || cmd == CameraCommand::Settle;
+		if ((cmd == CameraCommand::Settle && hr == S_OK) || (bRecall && FAILED(hr)))
+		{
+			COLORREF color = FAILED(hr) ? COLOR_RED : COLOR_GREEN;
+			if (cam == m_currentCam)
+			{
+				for (auto* pButton : m_apControlButtons)
+				{
+					if (pButton->GetFaceColor() == COLOR_YELLOW)
+						pButton->SetFaceColor(color, TRUE);
+				}
+			}
+			else
+			{
+				for (auto& entry : m_cameras[cam].mapBtnColors)
+				{
+					if (entry.second == COLOR_YELLOW)
+						entry.second = color;
+				}
+			}
+		}
+		// The measured pulses and the interval are stored at once
+		if (cmd == CameraCommand::Calibrate)
+		{
+			if (SUCCEEDED(hr))
+			{
+				SaveCameraSettings(m_cameras[cam]);
+				// For cameras of the same model that can't measure themselves
+				const CString strModelSection = ModelSection(m_cameras[cam].strDevicePath);
+				auto calibration = m_cameras[cam].spWebCam->Camera().pulseCalibration.Save();
+				if (!strModelSection.IsEmpty())
+					theApp.WriteProfileBinary(strModelSection, REG_PULSECALIBRATION, calibration.data(), static_cast<UINT>(calibration.size()));
+			}
+			if (m_pSettingsDlg && static_cast<size_t>(m_pSettingsDlg->m_iCamera) == cam + 1)
+				m_pSettingsDlg->OnCalibrated(SUCCEEDED(hr), m_cameras[cam].spWebCam->Camera().motorIntervalTime);
+		}
+		// Software presets are written as soon as they change
+		if (SUCCEEDED(hr) && (cmd == CameraCommand::SavePreset || cmd == CameraCommand::SavePosition))
+			SavePresets(m_cameras[cam]);
+		if ((btn.GetFaceColor() == COLOR_RED) != FAILED(hr))
+			btn.SetFaceColor(FAILED(hr) ? COLOR_RED : cam == m_currentCam ? COLOR_ORANGE : COLORREF(-1), TRUE);
+		// The predicted travel changes with every arrival and every manual move
+		if (cam == m_currentCam)
+			UpdatePresetTooltips();
+	}
+	return 0;
+}
+
+BOOL CPTZControlDlg::OnDeviceChange(UINT nEventType, DWORD_PTR dwData)
+{
+	auto* pHeader = reinterpret_cast<PDEV_BROADCAST_HDR>(dwData);
+	if ((nEventType != DBT_DEVICEARRIVAL && nEventType != DBT_DEVICEREMOVECOMPLETE) ||
+		!pHeader || pHeader->dbch_devicetype != DBT_DEVTYP_DEVICEINTERFACE)
+		return TRUE;
+	CString devicePath(reinterpret_cast<PDEV_BROADCAST_DEVICEINTERFACE>(pHeader)->dbcc_name);
+
+	if (nEventType == DBT_DEVICEREMOVECOMPLETE)
+	{
+		// The identity of a removed device can't be read anymore, but we know its path.
+		for (auto& camera : m_cameras)
+		{
+			if (camera.bConnected && camera.strDevicePath.CompareNoCase(devicePath) == 0)
+			{
+				camera.bConnected = false;
+				camera.spWebCam->Disconnect();
+				camera.pButton->EnableWindow(FALSE);
+				camera.pButton->SetFaceColor(COLOR_RED, TRUE);
+			}
+		}
+	}
+	else
+	{
+		// Only the camera that was removed before is opened again. All others are not touched.
+		LONGLONG llArrival = MotorPulseScheduler::Now();
+		CString strIdentity = WebcamController::DeviceIdentity(devicePath);
+		auto itCamera = std::find_if(m_cameras.begin(), m_cameras.end(), [&](const CameraState& camera)
+		{
+			return !camera.bConnected && camera.strIdentity == strIdentity;
+		});
+		if (itCamera == m_cameras.end())
+			return TRUE;
+
+		// The audio interface of the camera arrives as well. Only the video input device is used.
+		// It is opened by its path, the other devices are not enumerated again.
+		if (WebcamController::IsVideoInput(devicePath))
+			ReconnectWebCam(*itCamera, WebcamDevice{ CString(), devicePath, CString() }, llArrival);
+	}
+	return TRUE;
+}
@@ -5,9 +5,15 @@
 #pragma once
 
 #include <stddef.h>
+#include <map>
+#include <memory>
+#include <vector>
 
 #include "resource.h"
 #include "WebcamControl.h"
+#include "WebcamWorker.h"
+
+class CSettingsDlg;
 
 //////////////////////////////////////////////////////////////////////////////////////////
 // CPTZButton
@@ -31,6 +37,15 @@ public:
 	{
 		return m_uiSent!=0;
 	}
+	// The parent gets BN_PUSHED when the button is pressed and BN_UNPUSHED when it is released
+	void SetHold(bool bVal)
+	{
+		m_bHold = bVal;
+	}
+	bool IsHeld()
+	{
+		return m_bHeld;
+	}
 	COLORREF GetFaceColor()
 	{
 		return m_clrFace;
@@ -40,6 +55,8 @@ protected:
 // Data
 	bool	m_bAutoRepeat;
 	UINT	m_uiSent;
+	bool	m_bHold;
+	bool	m_bHeld;
 
 protected:
 	void PreSubclassWindow() override;
@@ -51,6 +68,7 @@ public:
 	afx_msg void OnLButtonDown(UINT nFlags, CPoint point);
 	afx_msg void OnTimer(UINT_PTR nIDEvent);
 	afx_msg void OnLButtonUp(UINT nFlags, CPoint point);
+	afx_msg void OnCaptureChanged(CWnd* pWnd);
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -65,7 +83,8 @@ public:
 // Dialog Data
 	enum { IDD = IDD_PTZCONTROL_DIALOG };
 
-	static constexpr size_t NUM_MAX_WEBCAMS{ 3 };
+	// The dialog template has buttons for three cameras, the others are created.
+	static constexpr size_t NUM_TEMPLATE_WEBCAMS{ 3 };
 
 protected:
 	CPTZButton m_btZoomIn;
@@ -79,30 +98,59 @@ protected:
 	CPTZButton m_btPreset[WebcamController::NUM_PRESETS];
 	CPTZButton m_btExit;
 	CPTZButton m_btSettings;
-	CPTZButton m_btWebCam[NUM_MAX_WEBCAMS];
+	CPTZButton m_btWebCam[NUM_TEMPLATE_WEBCAMS];
+	std::vector<std::unique_ptr<CPTZButton>> m_btMoreWebCams;
 
-	std::vector<WebcamController> m_webCams;
+// All buttons except the camera buttons. Their colors belong to the current camera.
+	std::vector<CPTZButton*> m_apControlButtons;
 
 // Map to save the colors of the buttons per Webcam
 	typedef std::map<UINT,COLORREF> TMAP_BTNCOLORS;
-	TMAP_BTNCOLORS m_aMapBtnColors[NUM_MAX_WEBCAMS];
 
-// Tooltips per WebCam
-	CString m_strTooltips[NUM_MAX_WEBCAMS][WebcamController::NUM_PRESETS];
+// Everything we have per WebCam
+	struct CameraState
+	{
+		std::unique_ptr<WebcamWorker> spWebCam;
+		CString strName;						// Device name
+		CString strSection;						// Registry section of this camera
+		CPTZButton* pButton = nullptr;			// Template button or one of m_btMoreWebCams
+		TMAP_BTNCOLORS mapBtnColors;			// Colors of the control buttons while inactive
+		CString strTooltips[WebcamController::NUM_PRESETS];
+		CString strDevicePath;					// Changes if the camera is plugged into another port
+		CString strIdentity;					// See WebcamController::DeviceIdentity
+		bool bConnected = true;
+		int iLastPreset = -1;					// Restored after a reconnect, -1 for none
+		LONGLONG llArrival = 0;					// Time of the device arrival until the camera is open again
+	};
+	std::vector<CameraState> m_cameras;
 
 	HACCEL m_hAccel;
-	CString m_strCameraDeviceNames;
+	HDEVNOTIFY m_hDevNotify;
 
 	size_t m_currentCam;
 
 	void ResetAllColors();
-	WebcamController &GetCurrentWebCam();
+	WebcamWorker &GetCurrentWebCam();
 	void SetActiveCam(size_t cam);
-
-	// Guard thread
-	CEvent	m_evTerminating;
-	CWinThread* m_pGuardThread;
-	static UINT AFX_CDECL GuardThread(LPVOID hWnd); // AFX_THREADPROC
+	void OpenWebCam(CameraState& camera, const WebcamDevice& device);
+	void ReconnectWebCam(CameraState& camera, const WebcamDevice& device, LONGLONG llArrival);
+	CPTZButton* CreateWebCamButton(size_t cam);
+	static void LoadCameraSettings(CameraState& camera);
+	static void SaveCameraSettings(const CameraState& camera);
+	static void SavePresets(const CameraState& camera);
+	static void SaveTravelTimes(const CameraState& camera);
+	/** The names of the presets of the current camera with the time it needs to get there. */
+	void UpdatePresetTooltips();
+	CString m_strShownTooltips[WebcamController::NUM_PRESETS];
+	/** Combine the held buttons, arrow and zoom keys into the velocity of the current camera. */
+	void UpdateHeldInputs(bool bAsync = false);
+	int m_xHeld = 0;
+	int m_yHeld = 0;
+	int m_zHeld = 0;
+	/** Latencies of the driver calls and commands of all cameras, as text for the diagnostics. */
+	CString DiagnosticsReport() const;
+	// The open settings dialog, it is told when a calibration is done
+	CSettingsDlg* m_pSettingsDlg = nullptr;
 
 // Implementation
 
@@ -137,6 +185,8 @@ protected:
 	afx_msg void OnBtRight();
 	afx_msg void OnBtDown();
 	afx_msg void OnTimer(UINT_PTR nIDEvent);
-	afx_msg void OnBtUnpushed();
+	afx_msg void OnBtHeld();
 	afx_msg void OnBtSettings();
+	afx_msg LRESULT OnCameraCompleted(WPARAM wParam, LPARAM lParam);
+	afx_msg BOOL OnDeviceChange(UINT nEventType, DWORD_PTR dwData);
 };
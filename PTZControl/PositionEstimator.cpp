@@ -0,0 +1,125 @@
+#include "pch.h"
+
+#include <cmath>
+
+#include "BinaryFormat.h"
+#include "PositionEstimator.h"
+
+//////////////////////////////////////////////////////////////////////////
+//	Binary form
+//	DWORD version, DWORD number of presets, then per preset and axis a DWORD
+//	that is 1 if it is known, the double position and the double uncertainty.
+
+//////////////////////////////////////////////////////////////////////////
+// PositionEstimator
+
+PositionEstimator::PositionEstimator(size_t nPresets)
+	: m_presets(nPresets * NUM_AXES)
+{
+}
+
+void PositionEstimator::Anchor(Axis axis, double dPosition, double dUncertainty)
+{
+	CSingleLock lock(&m_cs, TRUE);
+	m_aEstimates[axis] = Estimate{ true, dPosition, dUncertainty };
+}
+
+void PositionEstimator::AddRun(Axis axis, int iDirection, double dMilliseconds, const PulseCalibration& calibration)
+{
+	if (iDirection == 0)
+		return;
+
+	// A run shorter than the minimum pulse doesn't move the camera, but the bound grows with
+	// the time the on-time may be off at full speed
+	const bool bCalibrated = calibration.IsValid();
+	const double dWay = calibration.WayOf(dMilliseconds);
+	const double dError = dWay * RELATIVE_ERROR + TIMING_ERROR * calibration.GetSpeed();
+
+	CSingleLock lock(&m_cs, TRUE);
+	Estimate& estimate = m_aEstimates[axis];
+	if (!bCalibrated)
+	{
+		estimate.bKnown = false;
+		return;
+	}
+	estimate.dPosition += iDirection < 0 ? -dWay : dWay;
+	estimate.dUncertainty += dError;
+}
+
+void PositionEstimator::Lose(Axis axis)
+{
+	CSingleLock lock(&m_cs, TRUE);
+	m_aEstimates[axis].bKnown = false;
+}
+
+PositionEstimator::Estimate PositionEstimator::Get(Axis axis) const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	return m_aEstimates[axis];
+}
+
+void PositionEstimator::SavePreset(size_t nPreset)
+{
+	CSingleLock lock(&m_cs, TRUE);
+	if ((nPreset + 1) * NUM_AXES > m_presets.size())
+		return;
+	for (int i = 0; i < NUM_AXES; ++i)
+		m_presets[nPreset * NUM_AXES + i] = m_aEstimates[i];
+}
+
+bool PositionEstimator::RecallPreset(size_t nPreset)
+{
+	// The camera drives to the preset by itself, so the error doesn't grow on the way
+	CSingleLock lock(&m_cs, TRUE);
+	bool bKnown = true;
+	for (int i = 0; i < NUM_AXES; ++i)
+	{
+		if ((nPreset + 1) * NUM_AXES <= m_presets.size())
+			m_aEstimates[i] = m_presets[nPreset * NUM_AXES + i];
+		else
+			m_aEstimates[i].bKnown = false;
+		bKnown &= m_aEstimates[i].bKnown;
+	}
+	return bKnown;
+}
+
+std::vector<BYTE> PositionEstimator::SavePresets() const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	std::vector<BYTE> data;
+	data.reserve(2 * sizeof(DWORD) + m_presets.size() * (sizeof(DWORD) + 2 * sizeof(double)));
+	BinaryFormat::Append(data, FORMAT_VERSION);
+	BinaryFormat::Append(data, static_cast<DWORD>(m_presets.size() / NUM_AXES));
+	for (const Estimate& estimate : m_presets)
+	{
+		BinaryFormat::Append(data, static_cast<DWORD>(estimate.bKnown ? 1 : 0));
+		BinaryFormat::Append(data, estimate.dPosition);
+		BinaryFormat::Append(data, estimate.dUncertainty);
+	}
+	return data;
+}
+
+bool PositionEstimator::LoadPresets(const BYTE* pData, size_t nSize)
+{
+	const BYTE* p = pData;
+	const BYTE* pEnd = pData + nSize;
+	DWORD dwVersion = 0, dwPresets = 0;
+	CSingleLock lock(&m_cs, TRUE);
+	if (!pData || !BinaryFormat::Extract(p, pEnd, dwVersion) || dwVersion != FORMAT_VERSION ||
+		!BinaryFormat::Extract(p, pEnd, dwPresets) || dwPresets * NUM_AXES != m_presets.size())
+		return false;
+
+	std::vector<Estimate> presets(m_presets.size());
+	for (Estimate& estimate : presets)
+	{
+		DWORD dwKnown = 0;
+		if (!BinaryFormat::Extract(p, pEnd, dwKnown) || !BinaryFormat::Extract(p, pEnd, estimate.dPosition) ||
+			!BinaryFormat::Extract(p, pEnd, estimate.dUncertainty))
+			return false;
+		estimate.bKnown = dwKnown != 0 && std::isfinite(estimate.dPosition) && estimate.dUncertainty >= 0;
+	}
+	if (p != pEnd)
+		return false;
+	m_presets.swap(presets);
+	return true;
+}
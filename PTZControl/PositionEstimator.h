@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include <afxmt.h>
+
+#include "PulseCalibration.h"
+
+/**
+* Where the pan and tilt of a camera with motors point, by dead reckoning: the way of every
+* motor run is taken from the pulse calibration and added to the last anchor, a position the
+* camera is known to be at (home, a recalled preset, a read of the device). Every run adds to
+* the uncertainty, a bound of the error, and an anchor resets it. Positions are in the units
+* of the calibration. All functions may be called from any thread.
+*/
+class PositionEstimator
+{
+public:
+	enum Axis
+	{
+		AxisPan,
+		AxisTilt,
+		NUM_AXES
+	};
+
+	struct Estimate
+	{
+		bool bKnown;
+		double dPosition;
+		double dUncertainty;	// The error is at most this, in units
+	};
+
+	explicit PositionEstimator(size_t nPresets);
+
+	/** The camera is at dPosition, e.g. at home after it was recalled. */
+	void Anchor(Axis axis, double dPosition, double dUncertainty = 0);
+	/** A motor ran for dMilliseconds in iDirection. Without a calibration the position is lost. */
+	void AddRun(Axis axis, int iDirection, double dMilliseconds, const PulseCalibration& calibration);
+	/** The camera moved by an unknown way */
+	void Lose(Axis axis);
+	Estimate Get(Axis axis) const;
+
+	/** Remember the estimate a preset of the camera is saved with, so its recall is an anchor. */
+	void SavePreset(size_t nPreset);
+	/** Anchor at a recalled preset. False and the position is lost if it wasn't saved with an estimate. */
+	bool RecallPreset(size_t nPreset);
+
+	/** The binary form of the preset anchors, see LoadPresets. The position itself isn't saved. */
+	std::vector<BYTE> SavePresets() const;
+	/** Replace the preset anchors with saved ones. False and nothing changed if the data is invalid. */
+	bool LoadPresets(const BYTE* pData, size_t nSize);
+
+	static constexpr double RELATIVE_ERROR{ 0.1 };	// Part of the way of a run it may be off
+	static constexpr double TIMING_ERROR{ 2 };		// msec the on-time of a run may be off
+
+private:
+	static constexpr DWORD FORMAT_VERSION{ 1 };
+
+	mutable CCriticalSection m_cs;
+	Estimate m_aEstimates[NUM_AXES]{};
+	std::vector<Estimate> m_presets;		// Pan and tilt per preset
+};
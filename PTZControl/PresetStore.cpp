@@ -0,0 +1,130 @@
+#include "pch.h"
+
+#include <algorithm>
+
+#include "BinaryFormat.h"
+#include "PresetStore.h"
+
+//////////////////////////////////////////////////////////////////////////
+//	Binary form
+//	DWORD version, DWORD count, then per preset: DWORD ID, LONG pan, tilt
+//	and zoom, WORD name length and the UTF-16 name without a terminator.
+//	About 20 bytes per preset plus its name.
+
+namespace
+{
+	const size_t MIN_RECORD_SIZE = sizeof(DWORD) + 3 * sizeof(LONG) + sizeof(WORD);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PresetStore
+
+bool PresetStore::Find(UINT uId, Preset& preset) const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	auto it = m_presets.find(uId);
+	if (it == m_presets.end())
+		return false;
+	preset = it->second;
+	return true;
+}
+
+void PresetStore::Put(UINT uId, const CString& strName, const WebcamController::AbsolutePosition& position)
+{
+	CSingleLock lock(&m_cs, TRUE);
+	Preset& preset = m_presets[uId];
+	if (!strName.IsEmpty())
+		preset.strName = strName;
+	preset.position = position;
+}
+
+bool PresetStore::Remove(UINT uId)
+{
+	CSingleLock lock(&m_cs, TRUE);
+	return m_presets.erase(uId) != 0;
+}
+
+size_t PresetStore::GetCount() const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	return m_presets.size();
+}
+
+std::vector<UINT> PresetStore::GetIds() const
+{
+	std::vector<UINT> ids;
+	{
+		CSingleLock lock(&m_cs, TRUE);
+		ids.reserve(m_presets.size());
+		for (const auto& entry : m_presets)
+			ids.push_back(entry.first);
+	}
+	std::sort(ids.begin(), ids.end());
+	return ids;
+}
+
+std::vector<BYTE> PresetStore::Save() const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	std::vector<BYTE> data;
+	data.reserve(2 * sizeof(DWORD) + m_presets.size() * (MIN_RECORD_SIZE + 16 * sizeof(WCHAR)));
+	BinaryFormat::Append(data, FORMAT_VERSION);
+	BinaryFormat::Append(data, static_cast<DWORD>(m_presets.size()));
+	for (const auto& entry : m_presets)
+	{
+		const Preset& preset = entry.second;
+		BinaryFormat::Append(data, static_cast<DWORD>(entry.first));
+		BinaryFormat::Append(data, static_cast<LONG>(preset.position.lPan));
+		BinaryFormat::Append(data, static_cast<LONG>(preset.position.lTilt));
+		BinaryFormat::Append(data, static_cast<LONG>(preset.position.lZoom));
+		CStringW strName(preset.strName.Left(USHRT_MAX));
+		BinaryFormat::Append(data, static_cast<WORD>(strName.GetLength()));
+		const BYTE* pName = reinterpret_cast<const BYTE*>(strName.GetString());
+		data.insert(data.end(), pName, pName + strName.GetLength() * sizeof(WCHAR));
+	}
+	return data;
+}
+
+bool PresetStore::Load(const BYTE* pData, size_t nSize)
+{
+	const BYTE* p = pData;
+	const BYTE* pEnd = pData + nSize;
+	DWORD dwVersion = 0, dwCount = 0;
+	if (!pData || !BinaryFormat::Extract(p, pEnd, dwVersion) || dwVersion != FORMAT_VERSION ||
+		!BinaryFormat::Extract(p, pEnd, dwCount))
+		return false;
+	// A damaged count must not reserve more presets than the data can hold, even without names
+	if (dwCount > static_cast<size_t>(pEnd - p) / MIN_RECORD_SIZE)
+		return false;
+
+	// Parse everything first, so a damaged block doesn't leave half of the presets
+	std::unordered_map<UINT, Preset> presets;
+	presets.reserve(dwCount);
+	for (DWORD i = 0; i < dwCount; ++i)
+	{
+		DWORD dwId;
+		LONG lPan, lTilt, lZoom;
+		WORD wLength;
+		if (!BinaryFormat::Extract(p, pEnd, dwId) || !BinaryFormat::Extract(p, pEnd, lPan) ||
+			!BinaryFormat::Extract(p, pEnd, lTilt) || !BinaryFormat::Extract(p, pEnd, lZoom) ||
+			!BinaryFormat::Extract(p, pEnd, wLength) || static_cast<size_t>(pEnd - p) < wLength * sizeof(WCHAR))
+			return false;
+
+		Preset& preset = presets[dwId];
+		CStringW strName;
+		if (wLength)
+		{
+			memcpy(strName.GetBufferSetLength(wLength), p, wLength * sizeof(WCHAR));
+			strName.ReleaseBuffer(wLength);
+		}
+		p += wLength * sizeof(WCHAR);
+		preset.strName = strName;
+		preset.position = WebcamController::AbsolutePosition{ lPan, lTilt, lZoom };
+	}
+	if (p != pEnd)
+		return false;
+
+	CSingleLock lock(&m_cs, TRUE);
+	m_presets.swap(presets);
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <afxstr.h>
+#include <afxmt.h>
+
+#include "WebcamControl.h"
+
+/**
+* Software presets of one camera: named absolute positions, any number of them. A preset is
+* found by its ID in constant time. All functions may be called from any thread.
+* The store is saved as one compact binary block, so loading hundreds of presets is a single
+* registry read.
+*/
+class PresetStore
+{
+public:
+	struct Preset
+	{
+		CString strName;
+		WebcamController::AbsolutePosition position;
+	};
+
+	bool Find(UINT uId, Preset& preset) const;
+	/** Add the preset or replace the one with the same ID. An empty name keeps the old one. */
+	void Put(UINT uId, const CString& strName, const WebcamController::AbsolutePosition& position);
+	bool Remove(UINT uId);
+	size_t GetCount() const;
+	/** All IDs in ascending order */
+	std::vector<UINT> GetIds() const;
+
+	/** The binary form of all presets, see Load. */
+	std::vector<BYTE> Save() const;
+	/** Replace all presets with the saved ones. False and nothing changed if the data is invalid. */
+	bool Load(const BYTE* pData, size_t nSize);
+
+private:
+	static constexpr DWORD FORMAT_VERSION{ 1 };
+
+	mutable CCriticalSection m_cs;
+	std::unordered_map<UINT, Preset> m_presets;
+};
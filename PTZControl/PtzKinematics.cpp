@@ -0,0 +1,157 @@
+// Portable, built without the precompiled header
+#include <algorithm>
+#include <cmath>
+
+#include "PtzKinematics.h"
+
+//////////////////////////////////////////////////////////////////////////
+// PtzKinematics
+
+PtzKinematics::Limits PtzKinematics::DefaultLimits()
+{
+	return Limits
+	{ {
+		{ -170, 170, 0, 60, 300 },
+		{ -30, 90, 0, 60, 300 },
+		{ 100, 500, 100, 400, 2000 },
+	} };
+}
+
+PtzKinematics::PtzKinematics(const Limits& limits, double dNow)
+	: m_limits(limits)
+	, m_dStart(dNow)
+{
+	for (int i = 0; i < NUM_AXES; ++i)
+		m_state[i].dPosition = Clamp(static_cast<Axis>(i), m_limits[i].dHome);
+}
+
+double PtzKinematics::Clamp(Axis axis, double dValue) const
+{
+	return std::min(std::max(dValue, m_limits[axis].dMin), m_limits[axis].dMax);
+}
+
+void PtzKinematics::Drive(Axis axis, double dVelocity, double dNow)
+{
+	Advance(dNow);
+	State& state = m_state[axis];
+	state.bTarget = false;
+	state.dDrive = std::min(std::max(dVelocity, -1.0), 1.0);
+}
+
+void PtzKinematics::MoveTo(Axis axis, double dTarget, double dNow)
+{
+	Advance(dNow);
+	State& state = m_state[axis];
+	state.bTarget = true;
+	state.dTarget = Clamp(axis, dTarget);
+	state.dDrive = 0;
+}
+
+void PtzKinematics::MoveBy(Axis axis, double dDelta, double dNow)
+{
+	Advance(dNow);
+	const State& state = m_state[axis];
+	MoveTo(axis, (state.bTarget ? state.dTarget : state.dPosition) + dDelta, dNow);
+}
+
+void PtzKinematics::Offset(Axis axis, double dDelta, double dNow)
+{
+	Advance(dNow);
+	State& state = m_state[axis];
+	state.dPosition = Clamp(axis, state.dPosition + dDelta);
+}
+
+double PtzKinematics::GetPosition(Axis axis, double dNow)
+{
+	Advance(dNow);
+	return m_state[axis].dPosition;
+}
+
+double PtzKinematics::GetVelocity(Axis axis, double dNow)
+{
+	Advance(dNow);
+	return m_state[axis].dVelocity;
+}
+
+double PtzKinematics::GetDrive(Axis axis) const
+{
+	return m_state[axis].dDrive;
+}
+
+bool PtzKinematics::IsMoving(double dNow)
+{
+	Advance(dNow);
+	for (int i = 0; i < NUM_AXES; ++i)
+	{
+		if (IsActive(static_cast<Axis>(i)))
+			return true;
+	}
+	return false;
+}
+
+double PtzKinematics::TravelTime(Axis axis, double dFrom, double dTo) const
+{
+	// Accelerate, run at full speed and brake, or only accelerate and brake on a short way
+	const AxisLimits& limits = m_limits[axis];
+	double dDistance = std::abs(Clamp(axis, dTo) - Clamp(axis, dFrom));
+	double dRamp = limits.dSpeed * limits.dSpeed / limits.dAcceleration;
+	if (dDistance >= dRamp)
+		return dDistance / limits.dSpeed + limits.dSpeed / limits.dAcceleration;
+	return 2 * std::sqrt(dDistance / limits.dAcceleration);
+}
+
+bool PtzKinematics::IsActive(Axis axis) const
+{
+	const State& state = m_state[axis];
+	return state.bTarget || state.dDrive != 0 || state.dVelocity != 0;
+}
+
+void PtzKinematics::Advance(double dNow)
+{
+	// Whole steps counted from the start, so the result doesn't depend on how often it is read
+	long long llSteps = static_cast<long long>(std::floor((dNow - m_dStart) / STEP));
+	while (m_llSteps < llSteps)
+	{
+		bool bActive = false;
+		for (int i = 0; i < NUM_AXES; ++i)
+		{
+			if (IsActive(static_cast<Axis>(i)))
+			{
+				Step(static_cast<Axis>(i));
+				bActive = true;
+			}
+		}
+		// Nothing moves, skip the rest
+		m_llSteps = bActive ? m_llSteps + 1 : llSteps;
+	}
+}
+
+void PtzKinematics::Step(Axis axis)
+{
+	const double dStep = STEP;
+	const AxisLimits& limits = m_limits[axis];
+	State& state = m_state[axis];
+
+	// The velocity we want: full speed, less when the target is so near that we must brake
+	double dWanted = state.dDrive * limits.dSpeed;
+	if (state.bTarget)
+	{
+		double dDistance = state.dTarget - state.dPosition;
+		dWanted = std::copysign(std::min(limits.dSpeed, std::sqrt(2 * limits.dAcceleration * std::abs(dDistance))), dDistance);
+	}
+	double dChange = limits.dAcceleration * dStep;
+	state.dVelocity += std::min(std::max(dWanted - state.dVelocity, -dChange), dChange);
+
+	double dPosition = state.dPosition + state.dVelocity * dStep;
+	if (state.bTarget && (dPosition - state.dTarget) * (state.dPosition - state.dTarget) <= 0)
+	{
+		// Arrived or passed it within this step
+		state.dPosition = state.dTarget;
+		state.dVelocity = 0;
+		state.bTarget = false;
+		return;
+	}
+	state.dPosition = Clamp(axis, dPosition);
+	if (state.dPosition != dPosition)
+		state.dVelocity = 0;			// End stop
+}
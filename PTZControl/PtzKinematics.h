@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+
+/**
+* Motion of the pan, tilt and zoom axes of a PTZ camera: every axis accelerates to its
+* speed, runs and brakes, so it arrives at a target without overshooting. An axis is either
+* driven with a velocity (a motor switched on) or moved to a target (a preset or an absolute
+* position). Positions are in the units of the camera properties.
+*
+* Only uses the standard library and the caller passes the time in seconds, so the same
+* commands at the same times always give the same positions, on any platform. The motion is
+* integrated in whole steps of a millisecond from the construction time.
+*/
+class PtzKinematics
+{
+public:
+	enum Axis
+	{
+		AxisPan,
+		AxisTilt,
+		AxisZoom,
+		NUM_AXES
+	};
+
+	struct AxisLimits
+	{
+		double dMin;
+		double dMax;
+		double dHome;
+		double dSpeed;			// Units per second at full speed
+		double dAcceleration;	// Units per second squared, braking too
+	};
+	using Limits = std::array<AxisLimits, NUM_AXES>;
+
+	/** A PTZ Pro 2 like camera: degrees for pan and tilt, 100 to 500 for zoom. */
+	static Limits DefaultLimits();
+
+	explicit PtzKinematics(const Limits& limits = DefaultLimits(), double dNow = 0);
+
+	/** Run the axis with a fraction of its speed (-1..1). 0 brakes to a stop. */
+	void Drive(Axis axis, double dVelocity, double dNow);
+	/** Move to an absolute position and stop there. The target is clamped to the limits. */
+	void MoveTo(Axis axis, double dTarget, double dNow);
+	/** Move the target of a moving axis, or the position of a resting one, by dDelta. */
+	void MoveBy(Axis axis, double dDelta, double dNow);
+	/** Shift the axis without a command and without motion, e.g. a camera moved by hand. */
+	void Offset(Axis axis, double dDelta, double dNow);
+
+	double GetPosition(Axis axis, double dNow);
+	double GetVelocity(Axis axis, double dNow);
+	/** The fraction of the speed the axis is driven with, 0 if it is moved to a target. */
+	double GetDrive(Axis axis) const;
+	bool IsMoving(double dNow);
+
+	/** Time from rest at dFrom to rest at dTo in seconds */
+	double TravelTime(Axis axis, double dFrom, double dTo) const;
+	const AxisLimits& GetLimits(Axis axis) const
+	{
+		return m_limits[axis];
+	}
+
+private:
+	static constexpr double STEP{ 0.001 };		// Integration step in seconds
+
+	struct State
+	{
+		double dPosition;
+		double dVelocity;
+		double dDrive;			// Used if there is no target
+		bool bTarget;
+		double dTarget;
+	};
+
+	bool IsActive(Axis axis) const;
+	void Advance(double dNow);
+	void Step(Axis axis);
+	double Clamp(Axis axis, double dValue) const;
+
+	Limits m_limits;
+	std::array<State, NUM_AXES> m_state{};
+	double m_dStart;
+	long long m_llSteps{ 0 };		// Steps integrated since m_dStart
+};
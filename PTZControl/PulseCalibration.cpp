@@ -0,0 +1,165 @@
+#include "pch.h"
+
+#include <algorithm>
+
+#include "BinaryFormat.h"
+#include "PulseCalibration.h"
+
+//////////////////////////////////////////////////////////////////////////
+//	Binary form
+//	DWORD version, the double minimum pulse and speed, DWORD number of
+//	points, then per point the double pulse in msec and the double way.
+
+//////////////////////////////////////////////////////////////////////////
+// PulseCalibration
+
+std::vector<double> PulseCalibration::Pulses()
+{
+	// From below the default interval to where a motor surely runs at full speed
+	return { 30, 60, 100, 150, 220, 300 };
+}
+
+bool PulseCalibration::Fit(std::vector<Sample> samples)
+{
+	if (samples.size() < 2)
+		return false;
+
+	// The line through all samples gives the speed and where it crosses no way
+	double dSumX = 0, dSumY = 0, dSumXX = 0, dSumXY = 0, dMaxWay = 0;
+	for (const Sample& sample : samples)
+	{
+		dSumX += sample.dPulse;
+		dSumY += sample.dWay;
+		dSumXX += sample.dPulse * sample.dPulse;
+		dSumXY += sample.dPulse * sample.dWay;
+		dMaxWay = std::max(dMaxWay, sample.dWay);
+	}
+	const double n = static_cast<double>(samples.size());
+	const double dVariance = n * dSumXX - dSumX * dSumX;
+	if (dVariance <= 0 || dMaxWay < MIN_WAY)
+		return false;
+	const double dSpeed = (n * dSumXY - dSumX * dSumY) / dVariance;
+	if (dSpeed <= 0)
+		return false;
+	double dMinimumPulse = std::max(0.0, -(dSumY - dSpeed * dSumX) / n / dSpeed);
+
+	// The curve starts there, or before the shortest pulse that moved, and never goes back
+	std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.dPulse < b.dPulse; });
+	for (const Sample& sample : samples)
+	{
+		if (sample.dWay > 0)
+		{
+			dMinimumPulse = std::min(dMinimumPulse, sample.dPulse * 0.9);
+			break;
+		}
+	}
+	std::vector<Sample> curve{ { dMinimumPulse, 0 } };
+	for (const Sample& sample : samples)
+	{
+		if (sample.dPulse > curve.back().dPulse && sample.dWay > curve.back().dWay)
+			curve.push_back(sample);
+	}
+	if (curve.size() < 2)
+		return false;
+
+	CSingleLock lock(&m_cs, TRUE);
+	m_dMinimumPulse = dMinimumPulse;
+	m_dSpeed = dSpeed;
+	m_curve.swap(curve);
+	return true;
+}
+
+bool PulseCalibration::IsValid() const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	return m_curve.size() >= 2;
+}
+
+double PulseCalibration::GetMinimumPulse() const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	return m_dMinimumPulse;
+}
+
+double PulseCalibration::GetSpeed() const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	return m_dSpeed;
+}
+
+double PulseCalibration::WayOf(double dPulse) const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	if (m_curve.size() < 2 || dPulse <= m_curve.front().dPulse)
+		return 0;
+
+	// Beyond the last point the last segment goes on
+	size_t i = 1;
+	while (i + 1 < m_curve.size() && dPulse > m_curve[i].dPulse)
+		++i;
+	const Sample& a = m_curve[i - 1];
+	const Sample& b = m_curve[i];
+	return a.dWay + (dPulse - a.dPulse) * (b.dWay - a.dWay) / (b.dPulse - a.dPulse);
+}
+
+double PulseCalibration::PulseFor(double dWay) const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	if (m_curve.size() < 2 || dWay <= 0)
+		return 0;
+
+	size_t i = 1;
+	while (i + 1 < m_curve.size() && dWay > m_curve[i].dWay)
+		++i;
+	const Sample& a = m_curve[i - 1];
+	const Sample& b = m_curve[i];
+	return a.dPulse + (dWay - a.dWay) * (b.dPulse - a.dPulse) / (b.dWay - a.dWay);
+}
+
+std::vector<BYTE> PulseCalibration::Save() const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	std::vector<BYTE> data;
+	data.reserve(2 * sizeof(DWORD) + (2 + 2 * m_curve.size()) * sizeof(double));
+	BinaryFormat::Append(data, FORMAT_VERSION);
+	BinaryFormat::Append(data, m_dMinimumPulse);
+	BinaryFormat::Append(data, m_dSpeed);
+	BinaryFormat::Append(data, static_cast<DWORD>(m_curve.size()));
+	for (const Sample& point : m_curve)
+	{
+		BinaryFormat::Append(data, point.dPulse);
+		BinaryFormat::Append(data, point.dWay);
+	}
+	return data;
+}
+
+bool PulseCalibration::Load(const BYTE* pData, size_t nSize)
+{
+	const BYTE* p = pData;
+	const BYTE* pEnd = pData + nSize;
+	DWORD dwVersion = 0, dwPoints = 0;
+	double dMinimumPulse = 0, dSpeed = 0;
+	if (!pData || !BinaryFormat::Extract(p, pEnd, dwVersion) || dwVersion != FORMAT_VERSION ||
+		!BinaryFormat::Extract(p, pEnd, dMinimumPulse) || !BinaryFormat::Extract(p, pEnd, dSpeed) ||
+		!BinaryFormat::Extract(p, pEnd, dwPoints) ||
+		dwPoints < 2 || dwPoints > static_cast<size_t>(pEnd - p) / (2 * sizeof(double)))
+		return false;
+
+	// Only a rising curve can be inverted
+	std::vector<Sample> curve(dwPoints);
+	for (size_t i = 0; i < curve.size(); ++i)
+	{
+		if (!BinaryFormat::Extract(p, pEnd, curve[i].dPulse) || !BinaryFormat::Extract(p, pEnd, curve[i].dWay))
+			return false;
+		if (i > 0 && !(curve[i].dPulse > curve[i - 1].dPulse && curve[i].dWay > curve[i - 1].dWay))
+			return false;
+	}
+	if (p != pEnd)
+		return false;
+
+	CSingleLock lock(&m_cs, TRUE);
+	m_dMinimumPulse = dMinimumPulse;
+	m_dSpeed = dSpeed;
+	m_curve.swap(curve);
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include <afxmt.h>
+
+/**
+* The way a motor pulse of a given width moves the camera, measured per camera. A pulse
+* shorter than the minimum doesn't move it, a longer one moves it along the measured curve.
+* A line fitted to the samples gives the minimum pulse and the speed in units per msec;
+* between the samples the curve is interpolated. All functions may be called from any thread.
+*/
+class PulseCalibration
+{
+public:
+	struct Sample
+	{
+		double dPulse;		// Achieved on-time in msec
+		double dWay;		// Units of the absolute pan, without sign
+	};
+
+	/** The pulse widths a calibration measures, in msec. Each one is sent in both directions. */
+	static std::vector<double> Pulses();
+
+	/** Replace the curve with one fitted to the samples. False and nothing changed if the camera didn't move. */
+	bool Fit(std::vector<Sample> samples);
+	bool IsValid() const;
+	/** Pulses up to this width (msec) don't move the camera */
+	double GetMinimumPulse() const;
+	/** Slope of the fitted line in units per msec */
+	double GetSpeed() const;
+	/** Way of a pulse in units, 0 if nothing is known */
+	double WayOf(double dPulse) const;
+	/** Width in msec of the pulse that moves dWay units, 0 if nothing is known */
+	double PulseFor(double dWay) const;
+
+	/** The binary form of the curve, see Load. */
+	std::vector<BYTE> Save() const;
+	/** Replace the curve with a saved one. False and nothing changed if the data is invalid. */
+	bool Load(const BYTE* pData, size_t nSize);
+
+private:
+	static constexpr DWORD FORMAT_VERSION{ 1 };
+	static constexpr double MIN_WAY{ 0.5 };		// Units a calibration must see at least
+
+	mutable CCriticalSection m_cs;
+	double m_dMinimumPulse{ 0 };
+	double m_dSpeed{ 0 };
+	std::vector<Sample> m_curve;	// Starts at the minimum pulse, way and pulse rising
+};
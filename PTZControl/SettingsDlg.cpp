@@ -4,6 +4,7 @@
 #include "pch.h"
 #include "PTZControl.h"
 #include "SettingsDlg.h"
+#include "DiagnosticsDlg.h"
 #include "afxdialogex.h"
 
 
@@ -13,6 +14,7 @@ IMPLEMENT_DYNAMIC(CSettingsDlg, CDialogEx)
 
 CSettingsDlg::CSettingsDlg(CWnd* pParent /*=nullptr*/)
 	: CDialogEx(IDD_SETTINGS, pParent)
+	, m_iCamera(1)
 	, m_bLogitechCameraControl(FALSE)
 	, m_iMotorIntervalTimer(0)
 {
@@ -28,30 +30,14 @@ void CSettingsDlg::DoDataExchange(CDataExchange* pDX)
 	DDX_Control(pDX, IDC_CH_LOGITECHCONTROL, m_chLogitechControl);
 	
 	// Tooltips
-	DDX_Text(pDX, IDC_ED_TOOLTIP_1_1, m_strTooltip[0][0]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_1_2, m_strTooltip[0][1]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_1_3, m_strTooltip[0][2]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_1_4, m_strTooltip[0][3]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_1_5, m_strTooltip[0][4]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_1_6, m_strTooltip[0][5]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_1_7, m_strTooltip[0][6]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_1_8, m_strTooltip[0][7]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_2_1, m_strTooltip[1][0]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_2_2, m_strTooltip[1][1]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_2_3, m_strTooltip[1][2]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_2_4, m_strTooltip[1][3]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_2_5, m_strTooltip[1][4]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_2_6, m_strTooltip[1][5]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_2_7, m_strTooltip[1][6]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_2_8, m_strTooltip[1][7]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_3_1, m_strTooltip[2][0]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_3_2, m_strTooltip[2][1]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_3_3, m_strTooltip[2][2]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_3_4, m_strTooltip[2][3]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_3_5, m_strTooltip[2][4]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_3_6, m_strTooltip[2][5]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_3_7, m_strTooltip[2][6]);
-	DDX_Text(pDX, IDC_ED_TOOLTIP_3_8, m_strTooltip[2][7]);
+	DDX_Text(pDX, IDC_ED_TOOLTIP_1_1, m_strTooltip[0]);
+	DDX_Text(pDX, IDC_ED_TOOLTIP_1_2, m_strTooltip[1]);
+	DDX_Text(pDX, IDC_ED_TOOLTIP_1_3, m_strTooltip[2]);
+	DDX_Text(pDX, IDC_ED_TOOLTIP_1_4, m_strTooltip[3]);
+	DDX_Text(pDX, IDC_ED_TOOLTIP_1_5, m_strTooltip[4]);
+	DDX_Text(pDX, IDC_ED_TOOLTIP_1_6, m_strTooltip[5]);
+	DDX_Text(pDX, IDC_ED_TOOLTIP_1_7, m_strTooltip[6]);
+	DDX_Text(pDX, IDC_ED_TOOLTIP_1_8, m_strTooltip[7]);
 
 	if (pDX->m_bSaveAndValidate)
 		m_iMotorIntervalTimer = std::min(std::max(10,m_iMotorIntervalTimer),1000);
@@ -60,6 +46,8 @@ void CSettingsDlg::DoDataExchange(CDataExchange* pDX)
 
 BEGIN_MESSAGE_MAP(CSettingsDlg, CDialogEx)
 	ON_BN_CLICKED(IDC_CH_LOGITECHCONTROL, &CSettingsDlg::OnChLogitechcontrol)
+	ON_BN_CLICKED(IDC_BT_DIAGNOSTICS, &CSettingsDlg::OnBtDiagnostics)
+	ON_BN_CLICKED(IDC_BT_CALIBRATE, &CSettingsDlg::OnBtCalibrate)
 END_MESSAGE_MAP()
 
 
@@ -72,11 +60,48 @@ void CSettingsDlg::OnChLogitechcontrol()
 }
 
 
+void CSettingsDlg::OnBtDiagnostics()
+{
+	CDiagnosticsDlg dlg(this);
+	dlg.m_fnReport = m_fnDiagnostics;
+	dlg.DoModal();
+}
+
+
+void CSettingsDlg::OnBtCalibrate()
+{
+	// The camera moves for a few seconds, the button is enabled again when it is done
+	GetDlgItem(IDC_BT_CALIBRATE)->EnableWindow(FALSE);
+	if (!m_fnCalibrate())
+		OnCalibrated(false, 0);
+}
+
+
+void CSettingsDlg::OnCalibrated(bool bSuccess, int iMotorInterval)
+{
+	if (GetDlgItem(IDC_BT_CALIBRATE)->IsWindowEnabled())
+		return;
+	GetDlgItem(IDC_BT_CALIBRATE)->EnableWindow(TRUE);
+	if (bSuccess)
+		SetDlgItemInt(IDC_ED_MOTORTIME, iMotorInterval);
+	else
+		AfxMessageBox(IDP_ERR_CALIBRATION);
+}
+
+
 BOOL CSettingsDlg::OnInitDialog()
 {
 	CDialogEx::OnInitDialog();
 
 	OnChLogitechcontrol();
+	GetDlgItem(IDC_BT_DIAGNOSTICS)->EnableWindow(m_fnDiagnostics != nullptr);
+	GetDlgItem(IDC_BT_CALIBRATE)->EnableWindow(m_fnCalibrate != nullptr);
+
+	// The group box text is the format for the camera number
+	CString strFormat, str;
+	GetDlgItemText(IDC_ST_CAMERA, strFormat);
+	str.Format(strFormat, m_iCamera);
+	SetDlgItemText(IDC_ST_CAMERA, str);
 
 	CenterWindow();
 	return TRUE;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "PTZControlDlg.h"
 
 // CSettingsDlg dialog
@@ -13,14 +15,24 @@ public:
 	virtual ~CSettingsDlg() {}
 
 	afx_msg void OnChLogitechcontrol();
+	afx_msg void OnBtDiagnostics();
+	afx_msg void OnBtCalibrate();
+	/** The calibration started by the button is done. On success the interval is shown. Without a
+	 *  running calibration nothing happens. */
+	void OnCalibrated(bool bSuccess, int iMotorInterval);
 	virtual BOOL OnInitDialog();
 
+	int m_iCamera;					// Number of the camera shown in the group box
 	CString m_strCameraName;
-	CString m_strTooltip[CPTZControlDlg::NUM_MAX_WEBCAMS][WebcamController::NUM_PRESETS];
+	CString m_strTooltip[WebcamController::NUM_PRESETS];
 	BOOL m_bLogitechCameraControl;
 	int m_iMotorIntervalTimer;
 	CEdit m_edMotorInterval;
 	CButton m_chLogitechControl;
+	// Report for the diagnostics of all cameras
+	std::function<CString()> m_fnDiagnostics;
+	// Starts the calibration of the camera, false if the camera takes no commands. The button is disabled without it.
+	std::function<bool()> m_fnCalibrate;
 
 	// Dialog Data
 #ifdef AFX_DESIGN_TIME
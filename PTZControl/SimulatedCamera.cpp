@@ -0,0 +1,723 @@
+#include "pch.h"
+
+#define NO_DSHOW_STRSAFE	// Avoid more C4995 warnings in intrin.h
+#include <DShow.h>
+#include <Ks.h>
+#include <KsMedia.h>
+
+#include "SimulatedCamera.h"
+#include "MotorPulseScheduler.h"
+
+//////////////////////////////////////////////////////////////////////////
+//	Simulated devices are identified by their device path. The latency of
+//	each call is part of the path, so every device can have its own value.
+
+#define SIMULATED_DEVICE_PREFIX		L"\\\\?\\sim#"
+#define SIMULATED_DEVICE_FORMAT		L"\\\\?\\sim#ptz&lat_%u&drift_%u#%d"
+
+// Node layout of the simulated filter: one node per Logitech XU and a camera terminal.
+static const GUID* const g_aXUNodes[] =
+{
+	&LOGITECH_XU_DEVICE_INFORMATION,
+	&LOGITECH_XU_VIDEOPIPE_CONTROL,
+	&LOGITECH_XU_TEST_DEBUG,
+	&LOGITECH_XU_PERIPHERAL_CONTROL,
+};
+static constexpr DWORD NUM_NODES{ _countof(g_aXUNodes) + 1 };
+
+// Degrees per Logitech relative step and the parts it can be divided into
+static constexpr double XU_STEP{ 2 };
+static constexpr WORD XU_RESOLUTION{ 8 };
+
+// Reported by the device information XU
+static constexpr DWORD FIRMWARE_VERSION{ 0x02000101 };
+
+// Every call into an unplugged device and an injected timeout
+static const HRESULT E_UNPLUGGED{ HRESULT_FROM_WIN32(ERROR_DEVICE_NOT_CONNECTED) };
+static const HRESULT E_TRANSFER_TIMEOUT{ HRESULT_FROM_WIN32(ERROR_SEM_TIMEOUT) };
+
+const SimulatedCamera::Range SimulatedCamera::MOTOR_RANGE{ -1, 1, 1, 0 };
+const SimulatedCamera::Range SimulatedCamera::ZOOM_MOTOR_RANGE{ -7, 7, 1, 0 };
+
+static const PtzKinematics::Axis PAN{ PtzKinematics::AxisPan };
+static const PtzKinematics::Axis TILT{ PtzKinematics::AxisTilt };
+static const PtzKinematics::Axis ZOOM{ PtzKinematics::AxisZoom };
+
+static int Sign(long lValue)
+{
+	return lValue < 0 ? -1 : lValue > 0 ? 1 : 0;
+}
+
+// Opens the simulated paths for WebcamController, they have no moniker.
+static const bool g_bBackendRegistered = (WebcamController::RegisterBackend(SIMULATED_DEVICE_PREFIX,
+	[](const CString& devicePath, CComPtr<IKsControl>& pKsControl)
+	{
+		pKsControl = SimulatedCamera::Create(devicePath);
+		return pKsControl ? S_OK : E_UNPLUGGED;
+	}), true);
+
+//////////////////////////////////////////////////////////////////////////
+
+CCriticalSection SimulatedCamera::s_csRegistry;
+std::map<CString, SimulatedCamera::Registration> SimulatedCamera::s_registry;
+
+std::vector<WebcamDevice> SimulatedCamera::Devices(int iCount, DWORD dwLatency, DWORD dwDrift)
+{
+	std::vector<WebcamDevice> devices;
+	for (int i = 0; i < iCount; ++i)
+	{
+		CString strName, strPath;
+		strName.Format(L"Simulated PTZ Camera %d", i + 1);
+		strPath.Format(SIMULATED_DEVICE_FORMAT, dwLatency, dwDrift, i + 1);
+		devices.emplace_back(WebcamDevice{ strName, strPath });
+	}
+	return devices;
+}
+
+bool SimulatedCamera::IsSimulatedDevice(const CString& devicePath)
+{
+	return devicePath.Left(_countof(SIMULATED_DEVICE_PREFIX) - 1).CompareNoCase(SIMULATED_DEVICE_PREFIX) == 0;
+}
+
+CComPtr<IKsControl> SimulatedCamera::Create(const CString& devicePath)
+{
+	DWORD dwLatency = 0, dwDrift = 0;
+	int iIndex = 0;
+	if (swscanf_s(devicePath, SIMULATED_DEVICE_FORMAT, &dwLatency, &dwDrift, &iIndex) != 3)
+		return nullptr;
+	if (!SharedOf(devicePath)->bConnected)
+		return nullptr;
+
+	CComPtr<IKsControl> spKsControl;
+	spKsControl.Attach(new SimulatedCamera(KeyOf(devicePath), dwLatency, dwDrift));
+	return spKsControl;
+}
+
+CString SimulatedCamera::KeyOf(const CString& devicePath)
+{
+	CString strKey(devicePath);
+	return strKey.MakeLower();
+}
+
+SimulatedCamera::CallCounts SimulatedCamera::GetCallCounts(const CString& devicePath)
+{
+	CSingleLock lock(&s_csRegistry, TRUE);
+	auto it = s_registry.find(KeyOf(devicePath));
+	if (it == s_registry.end())
+		return CallCounts{};
+	const auto& counters = *it->second.spShared;
+	return CallCounts{ counters.uKsProperty, counters.uGetRange, counters.uGet, counters.uSet };
+}
+
+void SimulatedCamera::WatchNextTransfer(const CString& devicePath)
+{
+	auto spShared = SharedOf(devicePath);
+	spShared->llWatchedTransfer = 0;
+	spShared->bWatchTransfer = true;
+}
+
+LONGLONG SimulatedCamera::GetWatchedTransfer(const CString& devicePath)
+{
+	return SharedOf(devicePath)->llWatchedTransfer;
+}
+
+bool SimulatedCamera::GetPosition(const CString& devicePath, Position& position)
+{
+	CSingleLock lock(&s_csRegistry, TRUE);
+	auto it = s_registry.find(KeyOf(devicePath));
+	if (it == s_registry.end() || !it->second.pCamera)
+		return false;
+
+	auto* pCamera = it->second.pCamera;
+	CSingleLock lockCamera(&pCamera->m_cs, TRUE);
+	position = pCamera->CurrentPosition(Now());
+	return true;
+}
+
+double SimulatedCamera::GetExactPosition(const CString& devicePath, PtzKinematics::Axis axis)
+{
+	CSingleLock lock(&s_csRegistry, TRUE);
+	auto it = s_registry.find(KeyOf(devicePath));
+	if (it == s_registry.end() || !it->second.pCamera)
+		return 0;
+
+	auto* pCamera = it->second.pCamera;
+	CSingleLock lockCamera(&pCamera->m_cs, TRUE);
+	double dNow = Now();
+	pCamera->UpdateDrift(dNow);
+	return pCamera->m_kinematics.GetPosition(axis, dNow);
+}
+
+bool SimulatedCamera::IsMoving(const CString& devicePath)
+{
+	CSingleLock lock(&s_csRegistry, TRUE);
+	auto it = s_registry.find(KeyOf(devicePath));
+	if (it == s_registry.end() || !it->second.pCamera)
+		return false;
+
+	auto* pCamera = it->second.pCamera;
+	CSingleLock lockCamera(&pCamera->m_cs, TRUE);
+	return pCamera->m_kinematics.IsMoving(Now());
+}
+
+void SimulatedCamera::SetKinematics(const CString& devicePath, const PtzKinematics::Limits& limits)
+{
+	SharedOf(devicePath)->limits = limits;
+}
+
+void SimulatedCamera::SetZoomMotor(const CString& devicePath, bool bZoomMotor)
+{
+	SharedOf(devicePath)->bZoomMotor = bZoomMotor;
+}
+
+void SimulatedCamera::SetRelativeOnly(const CString& devicePath, bool bRelativeOnly)
+{
+	SharedOf(devicePath)->bRelativeOnly = bRelativeOnly;
+}
+
+void SimulatedCamera::SetMotorNoise(const CString& devicePath, DWORD dwPercent)
+{
+	SharedOf(devicePath)->dwMotorNoise = std::min<DWORD>(dwPercent, 50);
+}
+
+std::shared_ptr<SimulatedCamera::Shared> SimulatedCamera::SharedOf(const CString& devicePath)
+{
+	CSingleLock lock(&s_csRegistry, TRUE);
+	auto& registration = s_registry[KeyOf(devicePath)];
+	if (!registration.spShared)
+		registration.spShared = std::make_shared<Shared>();
+	return registration.spShared;
+}
+
+void SimulatedCamera::BlockProperty(const CString& devicePath, long lProperty)
+{
+	auto spShared = SharedOf(devicePath);
+	spShared->evRelease.ResetEvent();
+	spShared->lBlockedProperty = lProperty;
+}
+
+void SimulatedCamera::ReleaseBlocked(const CString& devicePath)
+{
+	auto spShared = SharedOf(devicePath);
+	spShared->lBlockedProperty = NO_PROPERTY;
+	spShared->evRelease.SetEvent();
+}
+
+void SimulatedCamera::SetConnected(const CString& devicePath, bool bConnected)
+{
+	SharedOf(devicePath)->bConnected = bConnected;
+}
+
+void SimulatedCamera::InjectFaults(const CString& devicePath, const Faults& faults)
+{
+	auto spShared = SharedOf(devicePath);
+	CSingleLock lock(&spShared->csFaults, TRUE);
+	spShared->faults = faults;
+	spShared->uTransfers = 0;
+}
+
+SimulatedCamera::SimulatedCamera(const CString& strKey, DWORD dwLatency, DWORD dwDrift)
+	: m_strKey(strKey)
+	, m_dwLatency(dwLatency)
+	, m_dwDrift(dwDrift)
+	, m_spShared(SharedOf(strKey))
+	, m_bZoomMotor(m_spShared->bZoomMotor)
+	, m_bRelativeOnly(m_spShared->bRelativeOnly)
+	, m_dwMotorNoise(m_spShared->dwMotorNoise)
+	, m_kinematics(m_spShared->limits, Now())
+	, m_dDriftStart(Now())
+{
+	CSingleLock lock(&s_csRegistry, TRUE);
+	s_registry[m_strKey].pCamera = this;
+}
+
+SimulatedCamera::~SimulatedCamera()
+{
+	CSingleLock lock(&s_csRegistry, TRUE);
+	auto& registration = s_registry[m_strKey];
+	if (registration.pCamera == this)
+		registration.pCamera = nullptr;
+}
+
+double SimulatedCamera::Now()
+{
+	return MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now()) / 1000.0;
+}
+
+HRESULT SimulatedCamera::SimulateTransfer(long lProperty) const
+{
+	// The request is on the bus now, the latency is the time the device needs for it
+	if (m_spShared->bWatchTransfer.exchange(false))
+		m_spShared->llWatchedTransfer = MotorPulseScheduler::Now();
+	if (m_dwLatency)
+		::Sleep(m_dwLatency);
+
+	// A hanging driver, the call never returns by itself
+	if (lProperty != NO_PROPERTY && lProperty == m_spShared->lBlockedProperty)
+		::WaitForSingleObject(m_spShared->evRelease, INFINITE);
+
+	DWORD dwTimeoutDelay = 0;
+	{
+		CSingleLock lock(&m_spShared->csFaults, TRUE);
+		const Faults& faults = m_spShared->faults;
+		UINT uTransfer = ++m_spShared->uTransfers;
+		if (faults.uUnplugAfter && uTransfer > faults.uUnplugAfter)
+			m_spShared->bConnected = false;
+		if (faults.uTimeoutEvery && uTransfer % faults.uTimeoutEvery == 0)
+			dwTimeoutDelay = std::max<DWORD>(faults.dwTimeoutDelay, 1);
+	}
+	if (!m_spShared->bConnected)
+		return E_UNPLUGGED;
+	if (dwTimeoutDelay)
+	{
+		::Sleep(dwTimeoutDelay);
+		return E_TRANSFER_TIMEOUT;
+	}
+	return S_OK;
+}
+
+void SimulatedCamera::UpdateDrift(double dNow)
+{
+	// Pan and zoom move by themselves and turn around at the limits
+	if (!m_dwDrift)
+		return;
+	long lDrift = static_cast<long>((dNow - m_dDriftStart) * m_dwDrift);
+	if (lDrift == 0)
+		return;
+
+	bool bTurn = false;
+	for (auto axis : { PAN, ZOOM })
+	{
+		const auto& limits = m_kinematics.GetLimits(axis);
+		double dPosition = m_kinematics.GetPosition(axis, dNow);
+		double dDrifted = dPosition + m_iDriftDirection * lDrift;
+		bTurn |= dDrifted < limits.dMin || dDrifted > limits.dMax;
+		m_kinematics.Offset(axis, dDrifted - dPosition, dNow);
+	}
+	if (bTurn)
+		m_iDriftDirection = -m_iDriftDirection;
+	m_dDriftStart = dNow;
+}
+
+long SimulatedCamera::PositionOf(PtzKinematics::Axis axis, double dNow)
+{
+	UpdateDrift(dNow);
+	return std::lround(m_kinematics.GetPosition(axis, dNow));
+}
+
+SimulatedCamera::Position SimulatedCamera::CurrentPosition(double dNow)
+{
+	return Position{ PositionOf(PAN, dNow), PositionOf(TILT, dNow), PositionOf(ZOOM, dNow) };
+}
+
+void SimulatedCamera::DriveMotor(PtzKinematics::Axis axis, long lValue, double dNow)
+{
+	// A motor that starts or turns gets its own speed, a running one keeps it
+	double dDrive = Sign(lValue);
+	double dRunning = m_kinematics.GetDrive(axis);
+	if (dDrive != 0 && m_dwMotorNoise)
+	{
+		if (dRunning * dDrive > 0)
+			dDrive = dRunning;
+		else
+			dDrive *= 1 - std::uniform_real_distribution<double>(0, m_dwMotorNoise / 100.0)(m_random);
+	}
+	m_kinematics.Drive(axis, dDrive, dNow);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// IUnknown
+
+STDMETHODIMP SimulatedCamera::QueryInterface(REFIID riid, void** ppvObject)
+{
+	if (!ppvObject)
+		return E_POINTER;
+
+	if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, __uuidof(IKsControl)))
+		*ppvObject = static_cast<IKsControl*>(this);
+	else if (IsEqualIID(riid, __uuidof(IKsTopologyInfo)))
+		*ppvObject = static_cast<IKsTopologyInfo*>(this);
+	else if (IsEqualIID(riid, __uuidof(IAMCameraControl)))
+		*ppvObject = static_cast<IAMCameraControl*>(this);
+	else
+	{
+		*ppvObject = nullptr;
+		return E_NOINTERFACE;
+	}
+	AddRef();
+	return S_OK;
+}
+
+STDMETHODIMP_(ULONG) SimulatedCamera::AddRef()
+{
+	return ++m_cRef;
+}
+
+STDMETHODIMP_(ULONG) SimulatedCamera::Release()
+{
+	ULONG cRef = --m_cRef;
+	if (cRef == 0)
+		delete this;
+	return cRef;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// IKsControl
+
+STDMETHODIMP SimulatedCamera::KsProperty(PKSPROPERTY Property, ULONG PropertyLength, LPVOID PropertyData, ULONG DataLength, ULONG* BytesReturned)
+{
+	if (!Property || PropertyLength < sizeof(KSPROPERTY))
+		return E_INVALIDARG;
+
+	++m_spShared->uKsProperty;
+	HRESULT hr = SimulateTransfer();
+	if (FAILED(hr))
+		return hr;
+
+	if (BytesReturned)
+		*BytesReturned = 0;
+
+	// The two value camera controls are not reachable with IAMCameraControl
+	if (IsEqualGUID(Property->Set, PROPSETID_VIDCAP_CAMERACONTROL))
+		return SetPanTilt(Property, PropertyData, DataLength);
+
+	if (PropertyLength < sizeof(KSP_NODE))
+		return E_INVALIDARG;
+
+	const auto* pNode = reinterpret_cast<const KSP_NODE*>(Property);
+	if (pNode->NodeId >= _countof(g_aXUNodes) || !IsEqualGUID(Property->Set, *g_aXUNodes[pNode->NodeId]))
+		return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+
+	if (Property->Flags & KSPROPERTY_TYPE_SETSUPPORT)
+		return S_OK;
+	if (Property->Flags & KSPROPERTY_TYPE_SET)
+		return SetXUProperty(pNode->NodeId, Property->Id, PropertyData, DataLength);
+	if (Property->Flags & KSPROPERTY_TYPE_GET)
+		return GetXUProperty(pNode->NodeId, Property->Id, PropertyData, DataLength, BytesReturned);
+	return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+}
+
+STDMETHODIMP SimulatedCamera::KsMethod(PKSMETHOD, ULONG, LPVOID, ULONG, ULONG*)
+{
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP SimulatedCamera::KsEvent(PKSEVENT, ULONG, LPVOID, ULONG, ULONG*)
+{
+	return E_NOTIMPL;
+}
+
+HRESULT SimulatedCamera::SetPanTilt(PKSPROPERTY Property, LPVOID PropertyData, ULONG DataLength)
+{
+	if ((Property->Id != KSPROPERTY_CAMERACONTROL_PANTILT && Property->Id != KSPROPERTY_CAMERACONTROL_PANTILT_RELATIVE) ||
+		(Property->Flags & KSPROPERTY_TYPE_SET) == 0)
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	if (!PropertyData || DataLength < sizeof(KSPROPERTY_CAMERACONTROL_S2))
+		return E_INVALIDARG;
+
+	// Both axes change at the same moment
+	const auto* pControl = static_cast<const KSPROPERTY_CAMERACONTROL_S2*>(PropertyData);
+	CSingleLock lock(&m_cs, TRUE);
+	double dNow = Now();
+	UpdateDrift(dNow);
+	if (Property->Id == KSPROPERTY_CAMERACONTROL_PANTILT)
+	{
+		if (m_bRelativeOnly)
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+		m_kinematics.MoveTo(PAN, pControl->Value1, dNow);
+		m_kinematics.MoveTo(TILT, pControl->Value2, dNow);
+	}
+	else
+	{
+		DriveMotor(PAN, pControl->Value1, dNow);
+		DriveMotor(TILT, pControl->Value2, dNow);
+	}
+	return S_OK;
+}
+
+HRESULT SimulatedCamera::GetXUProperty(ULONG ulNodeId, ULONG ulPropertyId, void* pValue, ULONG ulSize, ULONG* pulBytesReturned)
+{
+	if (!pValue || ulSize < sizeof(DWORD))
+		return E_INVALIDARG;
+
+	if (g_aXUNodes[ulNodeId] == &LOGITECH_XU_DEVICE_INFORMATION && ulPropertyId == XU_FIRMWARE_VERSION_CONTROL)
+	{
+		*static_cast<DWORD*>(pValue) = FIRMWARE_VERSION;
+		if (pulBytesReturned)
+			*pulBytesReturned = sizeof(DWORD);
+		return S_OK;
+	}
+	if (g_aXUNodes[ulNodeId] == &LOGITECH_XU_PERIPHERAL_CONTROL && ulPropertyId == XU_PERIPHERAL_CONTROL_PERIPHERAL_STATUS)
+	{
+		// Bit 0 while any axis moves
+		CSingleLock lock(&m_cs, TRUE);
+		double dNow = Now();
+		UpdateDrift(dNow);
+		*static_cast<DWORD*>(pValue) = m_kinematics.IsMoving(dNow) ? 1 : 0;
+		if (pulBytesReturned)
+			*pulBytesReturned = sizeof(DWORD);
+		return S_OK;
+	}
+	if (g_aXUNodes[ulNodeId] == &LOGITECH_XU_PERIPHERAL_CONTROL &&
+		(ulPropertyId == XU_PERIPHERALCONTROL_MAXIMUM_RESOLUTION_SUPPORT_FOR_PANTILT_CONTROL || ulPropertyId == XU_PERIPHERAL_MOTOR_STEPS_CONTROL))
+	{
+		CSingleLock lock(&m_cs, TRUE);
+		*static_cast<DWORD*>(pValue) = ulPropertyId == XU_PERIPHERAL_MOTOR_STEPS_CONTROL ? m_dwMotorSteps : MAKELONG(XU_RESOLUTION, XU_RESOLUTION);
+		if (pulBytesReturned)
+			*pulBytesReturned = sizeof(DWORD);
+		return S_OK;
+	}
+	return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+}
+
+HRESULT SimulatedCamera::SetXUProperty(ULONG ulNodeId, ULONG ulPropertyId, const void* pValue, ULONG ulSize)
+{
+	if (!pValue || ulSize < sizeof(DWORD))
+		return E_INVALIDARG;
+
+	DWORD dwValue = *static_cast<const DWORD*>(pValue);
+	CSingleLock lock(&m_cs, TRUE);
+	double dNow = Now();
+	UpdateDrift(dNow);
+
+	if (g_aXUNodes[ulNodeId] == &LOGITECH_XU_VIDEOPIPE_CONTROL && ulPropertyId == XU_VIDEO_FW_ZOOM_CONTROL)
+	{
+		m_kinematics.MoveTo(ZOOM, m_kinematics.GetLimits(ZOOM).dMin + dwValue, dNow);
+		return S_OK;
+	}
+
+	if (g_aXUNodes[ulNodeId] != &LOGITECH_XU_PERIPHERAL_CONTROL)
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+	switch (ulPropertyId)
+	{
+	case XU_PERIPHERALCONTROL_PANTILT_RELATIVE_CONTROL:
+		{
+			// Pan and tilt are signed bytes in the high byte of each word, counted in the
+			// parts of a step set with the motor steps control
+			auto cPan = static_cast<signed char>(HIBYTE(LOWORD(dwValue)));
+			auto cTilt = static_cast<signed char>(HIBYTE(HIWORD(dwValue)));
+			if (cPan)
+				m_kinematics.MoveBy(PAN, cPan * XU_STEP / LOWORD(m_dwMotorSteps), dNow);
+			if (cTilt)
+				m_kinematics.MoveBy(TILT, -cTilt * XU_STEP / HIWORD(m_dwMotorSteps), dNow);
+		}
+		return S_OK;
+
+	case XU_PERIPHERAL_MOTOR_STEPS_CONTROL:
+		if (LOWORD(dwValue) < 1 || LOWORD(dwValue) > XU_RESOLUTION || HIWORD(dwValue) < 1 || HIWORD(dwValue) > XU_RESOLUTION)
+			return E_INVALIDARG;
+		m_dwMotorSteps = dwValue;
+		return S_OK;
+
+	case XU_PERIPHERALCONTROL_PANTILT_MODE_CONTROL:
+		// See WebcamController::GotoHome for the values
+		if (dwValue == 3)
+		{
+			m_kinematics.MoveTo(PAN, m_kinematics.GetLimits(PAN).dHome, dNow);
+			m_kinematics.MoveTo(TILT, m_kinematics.GetLimits(TILT).dHome, dNow);
+		}
+		else if (dwValue >= 4 && dwValue < 4 + WebcamController::NUM_PRESETS)
+			m_spShared->presets[dwValue - 4] = CurrentPosition(dNow);
+		else if (dwValue >= 12 && dwValue < 12 + WebcamController::NUM_PRESETS)
+		{
+			// All axes start together, each takes its own travel time. An unset preset has zoom 0.
+			const auto& preset = m_spShared->presets[dwValue - 12];
+			m_kinematics.MoveTo(PAN, preset.lPan, dNow);
+			m_kinematics.MoveTo(TILT, preset.lTilt, dNow);
+			m_kinematics.MoveTo(ZOOM, preset.lZoom, dNow);
+		}
+		return S_OK;
+
+	default:
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// IKsTopologyInfo
+
+STDMETHODIMP SimulatedCamera::get_NumCategories(DWORD* pdwNumCategories)
+{
+	if (!pdwNumCategories)
+		return E_POINTER;
+	*pdwNumCategories = 0;
+	return S_OK;
+}
+
+STDMETHODIMP SimulatedCamera::get_Category(DWORD, GUID*)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP SimulatedCamera::get_NumConnections(DWORD* pdwNumConnections)
+{
+	if (!pdwNumConnections)
+		return E_POINTER;
+	*pdwNumConnections = 0;
+	return S_OK;
+}
+
+STDMETHODIMP SimulatedCamera::get_ConnectionInfo(DWORD, KSTOPOLOGY_CONNECTION*)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP SimulatedCamera::get_NodeName(DWORD, WCHAR*, DWORD, DWORD*)
+{
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP SimulatedCamera::get_NumNodes(DWORD* pdwNumNodes)
+{
+	if (!pdwNumNodes)
+		return E_POINTER;
+	HRESULT hr = SimulateTransfer();
+	if (FAILED(hr))
+		return hr;
+	*pdwNumNodes = NUM_NODES;
+	return S_OK;
+}
+
+STDMETHODIMP SimulatedCamera::get_NodeType(DWORD dwNodeId, GUID* pNodeType)
+{
+	if (!pNodeType)
+		return E_POINTER;
+	if (dwNodeId >= NUM_NODES)
+		return E_INVALIDARG;
+	*pNodeType = dwNodeId < _countof(g_aXUNodes) ? KSNODETYPE_DEV_SPECIFIC : KSNODETYPE_VIDEO_CAMERA_TERMINAL;
+	return S_OK;
+}
+
+STDMETHODIMP SimulatedCamera::CreateNodeInstance(DWORD, REFIID, void**)
+{
+	return E_NOTIMPL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// IAMCameraControl
+
+STDMETHODIMP SimulatedCamera::GetRange(long Property, long* pMin, long* pMax, long* pSteppingDelta, long* pDefault, long* pCapsFlags)
+{
+	if (!pMin || !pMax || !pSteppingDelta || !pDefault || !pCapsFlags)
+		return E_POINTER;
+
+	++m_spShared->uGetRange;
+	HRESULT hr = SimulateTransfer(Property);
+	if (FAILED(hr))
+		return hr;
+
+	auto RangeOf = [this](PtzKinematics::Axis axis)
+	{
+		const auto& limits = m_kinematics.GetLimits(axis);
+		return Range{ std::lround(limits.dMin), std::lround(limits.dMax), 1, std::lround(limits.dHome) };
+	};
+	Range range{};
+	const Range* pRange = &range;
+	if (Property == CameraControl_Pan && !m_bRelativeOnly)
+		range = RangeOf(PAN);
+	else if (Property == CameraControl_Tilt && !m_bRelativeOnly)
+		range = RangeOf(TILT);
+	else if (Property == CameraControl_Zoom)
+		range = RangeOf(ZOOM);
+	else if (Property == KSPROPERTY_CAMERACONTROL_PANTILT && !m_bRelativeOnly)
+		range = RangeOf(PAN);		// Only tells that both can be set together
+	else if (Property == KSPROPERTY_CAMERACONTROL_PANTILT_RELATIVE)
+		pRange = &MOTOR_RANGE;
+	else if (Property == KSPROPERTY_CAMERACONTROL_ZOOM_RELATIVE && m_bZoomMotor)
+		pRange = &ZOOM_MOTOR_RANGE;
+	else
+		return E_PROP_ID_UNSUPPORTED;
+
+	*pMin = pRange->lMin;
+	*pMax = pRange->lMax;
+	*pSteppingDelta = pRange->lStep;
+	*pDefault = pRange->lDefault;
+	*pCapsFlags = CameraControl_Flags_Manual;
+	return S_OK;
+}
+
+STDMETHODIMP SimulatedCamera::Set(long Property, long lValue, long Flags)
+{
+	UNUSED_ALWAYS(Flags);
+	++m_spShared->uSet;
+	HRESULT hr = SimulateTransfer(Property);
+	if (FAILED(hr))
+		return hr;
+
+	CSingleLock lock(&m_cs, TRUE);
+	double dNow = Now();
+	UpdateDrift(dNow);
+	// A relative only device has no absolute pan and tilt
+	if (m_bRelativeOnly && (Property == CameraControl_Pan || Property == CameraControl_Tilt))
+		return E_PROP_ID_UNSUPPORTED;
+	switch (Property)
+	{
+	case CameraControl_Pan:
+		m_kinematics.MoveTo(PAN, lValue, dNow);
+		return S_OK;
+	case CameraControl_Tilt:
+		m_kinematics.MoveTo(TILT, lValue, dNow);
+		return S_OK;
+	case CameraControl_Zoom:
+		m_kinematics.MoveTo(ZOOM, lValue, dNow);
+		return S_OK;
+	case KSPROPERTY_CAMERACONTROL_PAN_RELATIVE:
+		DriveMotor(PAN, lValue, dNow);
+		return S_OK;
+	case KSPROPERTY_CAMERACONTROL_TILT_RELATIVE:
+		DriveMotor(TILT, lValue, dNow);
+		return S_OK;
+	case KSPROPERTY_CAMERACONTROL_ZOOM_RELATIVE:
+		if (!m_bZoomMotor)
+			return E_PROP_ID_UNSUPPORTED;
+		// The value is the speed
+		lValue = std::min(std::max(lValue, ZOOM_MOTOR_RANGE.lMin), ZOOM_MOTOR_RANGE.lMax);
+		m_kinematics.Drive(ZOOM, static_cast<double>(lValue) / ZOOM_MOTOR_RANGE.lMax, dNow);
+		return S_OK;
+	default:
+		return E_PROP_ID_UNSUPPORTED;
+	}
+}
+
+STDMETHODIMP SimulatedCamera::Get(long Property, long* lValue, long* Flags)
+{
+	if (!lValue || !Flags)
+		return E_POINTER;
+
+	++m_spShared->uGet;
+	HRESULT hr = SimulateTransfer(Property);
+	if (FAILED(hr))
+		return hr;
+
+	CSingleLock lock(&m_cs, TRUE);
+	double dNow = Now();
+	*Flags = CameraControl_Flags_Manual;
+	if (m_bRelativeOnly && (Property == CameraControl_Pan || Property == CameraControl_Tilt))
+		return E_PROP_ID_UNSUPPORTED;
+	switch (Property)
+	{
+	case CameraControl_Pan:
+		*lValue = PositionOf(PAN, dNow);
+		return S_OK;
+	case CameraControl_Tilt:
+		*lValue = PositionOf(TILT, dNow);
+		return S_OK;
+	case CameraControl_Zoom:
+		*lValue = PositionOf(ZOOM, dNow);
+		return S_OK;
+	case KSPROPERTY_CAMERACONTROL_PAN_RELATIVE:
+		*lValue = Sign(std::lround(m_kinematics.GetDrive(PAN)));
+		return S_OK;
+	case KSPROPERTY_CAMERACONTROL_TILT_RELATIVE:
+		*lValue = Sign(std::lround(m_kinematics.GetDrive(TILT)));
+		return S_OK;
+	case KSPROPERTY_CAMERACONTROL_ZOOM_RELATIVE:
+		if (!m_bZoomMotor)
+			return E_PROP_ID_UNSUPPORTED;
+		*lValue = std::lround(m_kinematics.GetDrive(ZOOM) * ZOOM_MOTOR_RANGE.lMax);
+		return S_OK;
+	default:
+		return E_PROP_ID_UNSUPPORTED;
+	}
+}
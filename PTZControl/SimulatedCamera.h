@@ -0,0 +1,203 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <Ks.h>
+#include <KsProxy.h>		// For IKsControl
+#include <vidcap.h>			// For IKsTopologyInfo
+#include <strmif.h>			// For IAMCameraControl
+
+#include <afxstr.h>
+#include <afxmt.h>
+
+#include "WebcamControl.h"
+#include "PtzKinematics.h"
+
+/**
+* A software PTZ camera that implements the interfaces WebcamController uses on a real
+* device (IKsControl, IKsTopologyInfo, IAMCameraControl). Every call can be delayed by a
+* configurable latency, so the UI can be tested without any camera attached.
+* The axes move with the speed and acceleration of PtzKinematics, so presets and absolute
+* positions take their travel time and a motor pulse moves less than its width suggests.
+* The peripheral status of the Logitech unit tells whether an axis still moves. Its relative
+* steps can be divided into 8 parts.
+* The zoom has a motor with speeds like a UVC relative zoom control, unless it is switched off.
+* A device can be relative only: pan and tilt have motors but no absolute position. Its motors
+* can be noisy, i.e. every start runs with its own random part of the full speed.
+* The calls of each device are counted, so the number of transfers can be checked, and the
+* time of a call can be taken to measure the latency from an input to the bus.
+* A device can drift, i.e. pan and zoom change slowly without any command.
+* A device can hang, i.e. every IAMCameraControl call for one property blocks until released.
+* A device can be unplugged, every call fails until it is plugged in again. The presets are
+* kept in the device, so they survive that.
+* Faults can be injected: calls that time out and an unplug after a number of calls.
+*/
+class SimulatedCamera : public IKsControl, public IKsTopologyInfo, public IAMCameraControl
+{
+public:
+	/**
+	* Create the given number of simulated devices. Every call is delayed by dwLatency msec.
+	* Pan and zoom of a drifting device move by dwDrift units per second, reversing at the limits.
+	*/
+	static std::vector<WebcamDevice> Devices(int iCount, DWORD dwLatency, DWORD dwDrift = 0);
+	static bool IsSimulatedDevice(const CString& devicePath);
+	static CComPtr<IKsControl> Create(const CString& devicePath);
+
+	/** Calls into a device since the program started, summed over all opens of the path */
+	struct CallCounts
+	{
+		UINT uKsProperty;
+		UINT uGetRange;
+		UINT uGet;
+		UINT uSet;
+
+		UINT Total() const
+		{
+			return uKsProperty + uGetRange + uGet + uSet;
+		}
+	};
+	static CallCounts GetCallCounts(const CString& devicePath);
+	/** Remember the time the next call reaches the device, i.e. the time a command hits the bus. */
+	static void WatchNextTransfer(const CString& devicePath);
+	/** MotorPulseScheduler time of the watched call, 0 if it didn't happen yet */
+	static LONGLONG GetWatchedTransfer(const CString& devicePath);
+
+	struct Position
+	{
+		long lPan, lTilt, lZoom;
+	};
+	/** The real position of an open device, for comparisons. Doesn't count as a call. */
+	static bool GetPosition(const CString& devicePath, Position& position);
+	/** The same for one axis without rounding, for ways below one unit. 0 if the device isn't open. */
+	static double GetExactPosition(const CString& devicePath, PtzKinematics::Axis axis);
+	/** Whether any axis of an open device is still moving */
+	static bool IsMoving(const CString& devicePath);
+	/** Speeds, accelerations and ranges of the axes. Used by the next open of the device. */
+	static void SetKinematics(const CString& devicePath, const PtzKinematics::Limits& limits);
+	/** Whether the zoom has a relative (motor) control. Used by the next open of the device. */
+	static void SetZoomMotor(const CString& devicePath, bool bZoomMotor);
+	/** Whether pan and tilt only have motors, without an absolute position. Used by the next open. */
+	static void SetRelativeOnly(const CString& devicePath, bool bRelativeOnly);
+	/** Every start of a pan or tilt motor runs with 100 to 100-dwPercent percent of the speed (at most 50). */
+	static void SetMotorNoise(const CString& devicePath, DWORD dwPercent);
+
+	/** Let all IAMCameraControl calls for lProperty block, until ReleaseBlocked is called. */
+	static void BlockProperty(const CString& devicePath, long lProperty);
+	static void ReleaseBlocked(const CString& devicePath);
+
+	/** Unplug the device or plug it in again. An open device fails until it is opened again. */
+	static void SetConnected(const CString& devicePath, bool bConnected);
+
+	/** Faults counted over all calls into the device. 0 switches a fault off. */
+	struct Faults
+	{
+		UINT uTimeoutEvery;		// Every n-th call fails with ERROR_SEM_TIMEOUT after dwTimeoutDelay
+		DWORD dwTimeoutDelay;	// msec
+		UINT uUnplugAfter;		// The device is unplugged after n more calls
+	};
+	static void InjectFaults(const CString& devicePath, const Faults& faults);
+
+	// IUnknown
+	STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) override;
+	STDMETHOD_(ULONG, AddRef)() override;
+	STDMETHOD_(ULONG, Release)() override;
+
+	// IKsControl
+	STDMETHOD(KsProperty)(PKSPROPERTY Property, ULONG PropertyLength, LPVOID PropertyData, ULONG DataLength, ULONG* BytesReturned) override;
+	STDMETHOD(KsMethod)(PKSMETHOD Method, ULONG MethodLength, LPVOID MethodData, ULONG DataLength, ULONG* BytesReturned) override;
+	STDMETHOD(KsEvent)(PKSEVENT Event, ULONG EventLength, LPVOID EventData, ULONG DataLength, ULONG* BytesReturned) override;
+
+	// IKsTopologyInfo
+	STDMETHOD(get_NumCategories)(DWORD* pdwNumCategories) override;
+	STDMETHOD(get_Category)(DWORD dwIndex, GUID* pCategory) override;
+	STDMETHOD(get_NumConnections)(DWORD* pdwNumConnections) override;
+	STDMETHOD(get_ConnectionInfo)(DWORD dwIndex, KSTOPOLOGY_CONNECTION* pConnectionInfo) override;
+	STDMETHOD(get_NodeName)(DWORD dwNodeId, WCHAR* pwchNodeName, DWORD dwBufSize, DWORD* pdwNameLen) override;
+	STDMETHOD(get_NumNodes)(DWORD* pdwNumNodes) override;
+	STDMETHOD(get_NodeType)(DWORD dwNodeId, GUID* pNodeType) override;
+	STDMETHOD(CreateNodeInstance)(DWORD dwNodeId, REFIID iid, void** ppvObject) override;
+
+	// IAMCameraControl
+	STDMETHOD(GetRange)(long Property, long* pMin, long* pMax, long* pSteppingDelta, long* pDefault, long* pCapsFlags) override;
+	STDMETHOD(Set)(long Property, long lValue, long Flags) override;
+	STDMETHOD(Get)(long Property, long* lValue, long* Flags) override;
+
+private:
+	static constexpr long NO_PROPERTY{ -1 };
+
+	// Everything that belongs to the path and outlives one open of it
+	struct Shared
+	{
+		std::atomic<UINT> uKsProperty{ 0 };
+		std::atomic<UINT> uGetRange{ 0 };
+		std::atomic<UINT> uGet{ 0 };
+		std::atomic<UINT> uSet{ 0 };
+		std::atomic<bool> bWatchTransfer{ false };
+		std::atomic<LONGLONG> llWatchedTransfer{ 0 };
+		std::atomic<long> lBlockedProperty{ NO_PROPERTY };
+		CEvent evRelease{ FALSE, TRUE };
+		std::atomic<bool> bConnected{ true };
+		Position presets[WebcamController::NUM_PRESETS]{};	// Guarded by the m_cs of the open device
+		PtzKinematics::Limits limits{ PtzKinematics::DefaultLimits() };	// Set before the device is opened
+		std::atomic<bool> bZoomMotor{ true };	// The same
+		std::atomic<bool> bRelativeOnly{ false };
+		std::atomic<DWORD> dwMotorNoise{ 0 };
+
+		CCriticalSection csFaults;
+		Faults faults{};
+		UINT uTransfers{ 0 };		// Since the faults were injected
+	};
+
+	// Every path ever created and the device that is currently open
+	struct Registration
+	{
+		std::shared_ptr<Shared> spShared;
+		SimulatedCamera* pCamera;
+	};
+
+	SimulatedCamera(const CString& strKey, DWORD dwLatency, DWORD dwDrift);
+	virtual ~SimulatedCamera();
+
+	static CString KeyOf(const CString& devicePath);
+	static std::shared_ptr<Shared> SharedOf(const CString& devicePath);
+	static CCriticalSection s_csRegistry;
+	static std::map<CString, Registration> s_registry;
+
+	struct Range
+	{
+		long lMin, lMax, lStep, lDefault;
+	};
+
+	static const Range MOTOR_RANGE;			// Relative motor speed
+	static const Range ZOOM_MOTOR_RANGE;	// Relative zoom speed
+
+	static double Now();
+	HRESULT SimulateTransfer(long lProperty = NO_PROPERTY) const;
+	void UpdateDrift(double dNow);
+	long PositionOf(PtzKinematics::Axis axis, double dNow);
+	Position CurrentPosition(double dNow);
+	HRESULT SetPanTilt(PKSPROPERTY Property, LPVOID PropertyData, ULONG DataLength);
+	void DriveMotor(PtzKinematics::Axis axis, long lValue, double dNow);
+	HRESULT GetXUProperty(ULONG ulNodeId, ULONG ulPropertyId, void* pValue, ULONG ulSize, ULONG* pulBytesReturned);
+	HRESULT SetXUProperty(ULONG ulNodeId, ULONG ulPropertyId, const void* pValue, ULONG ulSize);
+
+	std::atomic<ULONG> m_cRef{ 1 };
+	const CString m_strKey;
+	const DWORD m_dwLatency;
+	const DWORD m_dwDrift;
+	std::shared_ptr<Shared> m_spShared;
+	const bool m_bZoomMotor;
+	const bool m_bRelativeOnly;
+	const DWORD m_dwMotorNoise;
+
+	CCriticalSection m_cs;
+	PtzKinematics m_kinematics;
+	double m_dDriftStart{ 0 };
+	int m_iDriftDirection{ 1 };
+	DWORD m_dwMotorSteps{ MAKELONG(1, 1) };	// Parts of a Logitech step, pan in the low word
+	std::minstd_rand m_random;				// Motor noise, the same for every open
+};
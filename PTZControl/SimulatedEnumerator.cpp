@@ -0,0 +1,288 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "SimulatedEnumerator.h"
+#include "SimulatedCamera.h"
+
+static std::atomic<UINT> g_uPropertyReads{ 0 };
+
+//////////////////////////////////////////////////////////////////////////
+//	Reference counting for objects with a single interface
+
+template <typename I>
+class SimulatedUnknown : public I
+{
+public:
+	STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) override
+	{
+		if (!ppvObject)
+			return E_POINTER;
+		if (!IsEqualIID(riid, IID_IUnknown) && !IsEqualIID(riid, __uuidof(I)))
+		{
+			*ppvObject = nullptr;
+			return E_NOINTERFACE;
+		}
+		*ppvObject = static_cast<I*>(this);
+		AddRef();
+		return S_OK;
+	}
+	STDMETHOD_(ULONG, AddRef)() override
+	{
+		return ++m_cRef;
+	}
+	STDMETHOD_(ULONG, Release)() override
+	{
+		ULONG cRef = --m_cRef;
+		if (cRef == 0)
+			delete this;
+		return cRef;
+	}
+
+protected:
+	virtual ~SimulatedUnknown() {}
+
+private:
+	std::atomic<ULONG> m_cRef{ 1 };
+};
+
+struct SimulatedEntry
+{
+	CString strName;
+	CString strDevicePath;		// What the property bag reports
+	CString strCameraPath;		// The SimulatedCamera behind it, also the display name
+};
+
+//////////////////////////////////////////////////////////////////////////
+//	Property bag
+
+class SimulatedPropertyBag : public SimulatedUnknown<IPropertyBag>
+{
+public:
+	explicit SimulatedPropertyBag(const SimulatedEntry& entry)
+		: m_entry(entry)
+	{}
+
+	STDMETHOD(Read)(LPCOLESTR pszPropName, VARIANT* pVar, IErrorLog*) override
+	{
+		if (!pszPropName || !pVar)
+			return E_POINTER;
+
+		++g_uPropertyReads;
+		const CString* pstr = wcscmp(pszPropName, L"FriendlyName") == 0 ? &m_entry.strName :
+							  wcscmp(pszPropName, L"DevicePath") == 0 ? &m_entry.strDevicePath : nullptr;
+		if (!pstr)
+			return E_INVALIDARG;
+		V_VT(pVar) = VT_BSTR;
+		V_BSTR(pVar) = pstr->AllocSysString();
+		return S_OK;
+	}
+	STDMETHOD(Write)(LPCOLESTR, VARIANT*) override
+	{
+		return E_NOTIMPL;
+	}
+
+private:
+	const SimulatedEntry m_entry;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//	Moniker
+
+class SimulatedMoniker : public SimulatedUnknown<IMoniker>
+{
+public:
+	explicit SimulatedMoniker(const SimulatedEntry& entry)
+		: m_entry(entry)
+	{}
+
+	// IPersist, IPersistStream
+	STDMETHOD(GetClassID)(CLSID*) override { return E_NOTIMPL; }
+	STDMETHOD(IsDirty)() override { return S_FALSE; }
+	STDMETHOD(Load)(IStream*) override { return E_NOTIMPL; }
+	STDMETHOD(Save)(IStream*, BOOL) override { return E_NOTIMPL; }
+	STDMETHOD(GetSizeMax)(ULARGE_INTEGER*) override { return E_NOTIMPL; }
+
+	// IMoniker
+	STDMETHOD(BindToObject)(IBindCtx*, IMoniker*, REFIID riidResult, void** ppvResult) override
+	{
+		if (!ppvResult)
+			return E_POINTER;
+		*ppvResult = nullptr;
+		CComPtr<IKsControl> spCamera = SimulatedCamera::Create(m_entry.strCameraPath);
+		if (!spCamera)
+			return E_FAIL;
+		return spCamera->QueryInterface(riidResult, ppvResult);
+	}
+	STDMETHOD(BindToStorage)(IBindCtx*, IMoniker*, REFIID riid, void** ppvObj) override
+	{
+		if (!ppvObj)
+			return E_POINTER;
+		*ppvObj = nullptr;
+		if (!IsEqualIID(riid, __uuidof(IPropertyBag)))
+			return E_NOINTERFACE;
+		*ppvObj = static_cast<IPropertyBag*>(new SimulatedPropertyBag(m_entry));
+		return S_OK;
+	}
+	STDMETHOD(GetDisplayName)(IBindCtx*, IMoniker*, LPOLESTR* ppszDisplayName) override
+	{
+		if (!ppszDisplayName)
+			return E_POINTER;
+		size_t nSize = (m_entry.strCameraPath.GetLength() + 1) * sizeof(WCHAR);
+		*ppszDisplayName = static_cast<LPOLESTR>(CoTaskMemAlloc(nSize));
+		if (!*ppszDisplayName)
+			return E_OUTOFMEMORY;
+		memcpy(*ppszDisplayName, m_entry.strCameraPath.GetString(), nSize);
+		return S_OK;
+	}
+	STDMETHOD(IsSystemMoniker)(DWORD* pdwMksys) override
+	{
+		if (!pdwMksys)
+			return E_POINTER;
+		*pdwMksys = MKSYS_NONE;
+		return S_FALSE;
+	}
+
+	STDMETHOD(Reduce)(IBindCtx*, DWORD, IMoniker**, IMoniker**) override { return E_NOTIMPL; }
+	STDMETHOD(ComposeWith)(IMoniker*, BOOL, IMoniker**) override { return E_NOTIMPL; }
+	STDMETHOD(Enum)(BOOL, IEnumMoniker**) override { return E_NOTIMPL; }
+	STDMETHOD(IsEqual)(IMoniker*) override { return E_NOTIMPL; }
+	STDMETHOD(Hash)(DWORD*) override { return E_NOTIMPL; }
+	STDMETHOD(IsRunning)(IBindCtx*, IMoniker*, IMoniker*) override { return E_NOTIMPL; }
+	STDMETHOD(GetTimeOfLastChange)(IBindCtx*, IMoniker*, FILETIME*) override { return E_NOTIMPL; }
+	STDMETHOD(Inverse)(IMoniker**) override { return E_NOTIMPL; }
+	STDMETHOD(CommonPrefixWith)(IMoniker*, IMoniker**) override { return E_NOTIMPL; }
+	STDMETHOD(RelativePathTo)(IMoniker*, IMoniker**) override { return E_NOTIMPL; }
+	STDMETHOD(ParseDisplayName)(IBindCtx*, IMoniker*, LPOLESTR, ULONG*, IMoniker**) override { return E_NOTIMPL; }
+
+private:
+	const SimulatedEntry m_entry;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//	Moniker enumerator
+
+using SimulatedEntries = std::vector<SimulatedEntry>;
+
+class SimulatedEnumMoniker : public SimulatedUnknown<IEnumMoniker>
+{
+public:
+	explicit SimulatedEnumMoniker(std::shared_ptr<const SimulatedEntries> spEntries)
+		: m_spEntries(std::move(spEntries))
+	{}
+
+	STDMETHOD(Next)(ULONG celt, IMoniker** rgelt, ULONG* pceltFetched) override
+	{
+		if (!rgelt)
+			return E_POINTER;
+		ULONG celtFetched = 0;
+		for (; celtFetched < celt && m_nNext < m_spEntries->size(); ++celtFetched)
+			rgelt[celtFetched] = new SimulatedMoniker((*m_spEntries)[m_nNext++]);
+		if (pceltFetched)
+			*pceltFetched = celtFetched;
+		return celtFetched == celt ? S_OK : S_FALSE;
+	}
+	STDMETHOD(Skip)(ULONG celt) override
+	{
+		m_nNext = std::min(m_nNext + celt, m_spEntries->size());
+		return m_nNext < m_spEntries->size() ? S_OK : S_FALSE;
+	}
+	STDMETHOD(Reset)() override
+	{
+		m_nNext = 0;
+		return S_OK;
+	}
+	STDMETHOD(Clone)(IEnumMoniker** ppenum) override
+	{
+		if (!ppenum)
+			return E_POINTER;
+		auto* pClone = new SimulatedEnumMoniker(m_spEntries);
+		pClone->m_nNext = m_nNext;
+		*ppenum = pClone;
+		return S_OK;
+	}
+
+private:
+	const std::shared_ptr<const SimulatedEntries> m_spEntries;
+	size_t m_nNext{ 0 };
+};
+
+//////////////////////////////////////////////////////////////////////////
+// SimulatedEnumerator
+
+// The devices that are plugged in, in the order of the enumeration. A device that is
+// plugged in again is enumerated last, as with a real device enumerator.
+static CCriticalSection g_csPresent;
+static SimulatedEntries g_present;
+static SimulatedEntries g_unplugged;
+
+WebcamController::DeviceSource SimulatedEnumerator::Source(int iCount, DWORD dwLatency)
+{
+	{
+		CSingleLock lock(&g_csPresent, TRUE);
+		g_present.clear();
+		g_unplugged.clear();
+		for (const auto& device : SimulatedCamera::Devices(iCount, dwLatency))
+		{
+			CString strDevicePath;
+			strDevicePath.Format(L"\\\\?\\usb#vid_046d&pid_0853&mi_00#sim&%u#{65e8773d-8f56-11d0-a3b9-00a0c9223196}\\global",
+								 static_cast<UINT>(g_present.size() + 1));
+			SimulatedCamera::SetConnected(device.devicePath, true);
+			g_present.push_back(SimulatedEntry{ device.deviceName, strDevicePath, device.devicePath });
+		}
+	}
+
+	WebcamController::DeviceSource source;
+	source.enumerate = [](CComPtr<IEnumMoniker>& pEnum)
+	{
+		CSingleLock lock(&g_csPresent, TRUE);
+		pEnum.Attach(new SimulatedEnumMoniker(std::make_shared<const SimulatedEntries>(g_present)));
+		return S_OK;
+	};
+	source.parseDisplayName = [](const CString& displayName, CComPtr<IMoniker>& pMoniker)
+	{
+		CSingleLock lock(&g_csPresent, TRUE);
+		auto it = std::find_if(g_present.begin(), g_present.end(), [&](const SimulatedEntry& entry) { return entry.strCameraPath == displayName; });
+		if (it == g_present.end())
+			return MK_E_SYNTAX;
+		pMoniker.Attach(new SimulatedMoniker(*it));
+		return S_OK;
+	};
+	return source;
+}
+
+bool SimulatedEnumerator::Unplug(const CString& devicePath)
+{
+	CSingleLock lock(&g_csPresent, TRUE);
+	auto it = std::find_if(g_present.begin(), g_present.end(), [&](const SimulatedEntry& entry) { return entry.strDevicePath.CompareNoCase(devicePath) == 0; });
+	if (it == g_present.end())
+		return false;
+	SimulatedCamera::SetConnected(it->strCameraPath, false);
+	g_unplugged.push_back(*it);
+	g_present.erase(it);
+	return true;
+}
+
+bool SimulatedEnumerator::Plug(const CString& devicePath)
+{
+	CSingleLock lock(&g_csPresent, TRUE);
+	auto it = std::find_if(g_unplugged.begin(), g_unplugged.end(), [&](const SimulatedEntry& entry) { return entry.strDevicePath.CompareNoCase(devicePath) == 0; });
+	if (it == g_unplugged.end())
+		return false;
+	SimulatedCamera::SetConnected(it->strCameraPath, true);
+	g_present.push_back(*it);
+	g_unplugged.erase(it);
+	return true;
+}
+
+UINT SimulatedEnumerator::GetPropertyReads()
+{
+	return g_uPropertyReads;
+}
+
+void SimulatedEnumerator::ResetPropertyReads()
+{
+	g_uPropertyReads = 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "WebcamControl.h"
+
+/**
+* Simulated video input devices as the system device enumerator delivers them: monikers
+* with a property bag (FriendlyName, DevicePath) that bind to a SimulatedCamera. The device
+* paths look like USB paths, so the devices are found by enumeration like real ones.
+* All property bag reads are counted. Devices can be unplugged and plugged in again.
+*/
+class SimulatedEnumerator
+{
+public:
+	/** A device source with iCount devices. Every camera call is delayed by dwLatency msec. */
+	static WebcamController::DeviceSource Source(int iCount, DWORD dwLatency);
+
+	/** Remove the device with this path from the enumeration, calls into the open device fail. */
+	static bool Unplug(const CString& devicePath);
+	/** Add an unplugged device again. It is enumerated after all others. */
+	static bool Plug(const CString& devicePath);
+
+	static UINT GetPropertyReads();
+	static void ResetPropertyReads();
+};
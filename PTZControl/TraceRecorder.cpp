@@ -0,0 +1,214 @@
+#include "pch.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <afxmt.h>
+
+#include "TraceRecorder.h"
+#include "MotorPulseScheduler.h"
+
+//////////////////////////////////////////////////////////////////////////
+//	The ring
+//	Every slot carries the sequence number of its event. A writer clears it
+//	before and sets it after the other fields, so Write can drop a slot that
+//	is overwritten while it is copied.
+
+namespace
+{
+	struct TraceEvent
+	{
+		std::atomic<ULONGLONG> ullSequence;		// Index of the event + 1, 0 while it is written
+		LPCTSTR pszName;
+		LPCTSTR pszCategory;
+		LONGLONG llStart;
+		LONGLONG llEnd;
+		DWORD dwThread;
+		int iCamera;
+		int iValue;
+		bool bInstant;
+	};
+}
+
+static std::unique_ptr<TraceEvent[]> g_pEvents;
+static ULONGLONG g_ullMask{ 0 };
+static std::atomic<ULONGLONG> g_ullNext{ 0 };
+static LONGLONG g_llEnabled{ 0 };				// Time 0 of the trace
+
+static CCriticalSection g_csThreads;
+static std::vector<std::pair<DWORD, CString>> g_threadNames;
+
+static void Record(LPCTSTR pszName, LPCTSTR pszCategory, LONGLONG llStart, LONGLONG llEnd, int iCamera, int iValue, bool bInstant)
+{
+	if (!g_pEvents)
+		return;
+
+	ULONGLONG ullIndex = g_ullNext.fetch_add(1, std::memory_order_relaxed);
+	TraceEvent& event = g_pEvents[ullIndex & g_ullMask];
+	event.ullSequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	event.pszName = pszName;
+	event.pszCategory = pszCategory;
+	event.llStart = llStart;
+	event.llEnd = llEnd;
+	event.dwThread = ::GetCurrentThreadId();
+	event.iCamera = iCamera;
+	event.iValue = iValue;
+	event.bInstant = bInstant;
+	event.ullSequence.store(ullIndex + 1, std::memory_order_release);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TraceRecorder
+
+bool TraceRecorder::Enable(UINT uCapacity)
+{
+	if (g_pEvents)
+		return true;
+
+	ULONGLONG ullCapacity = 1;
+	while (ullCapacity < uCapacity)
+		ullCapacity <<= 1;
+	g_pEvents.reset(new (std::nothrow) TraceEvent[static_cast<size_t>(ullCapacity)]());
+	if (!g_pEvents)
+		return false;
+	g_ullMask = ullCapacity - 1;
+	g_llEnabled = MotorPulseScheduler::Now();
+	return true;
+}
+
+bool TraceRecorder::IsEnabled()
+{
+	return g_pEvents != nullptr;
+}
+
+void TraceRecorder::Span(LPCTSTR pszName, LPCTSTR pszCategory, LONGLONG llStart, LONGLONG llEnd, int iCamera, int iValue)
+{
+	Record(pszName, pszCategory, llStart, llEnd, iCamera, iValue, false);
+}
+
+void TraceRecorder::Instant(LPCTSTR pszName, LPCTSTR pszCategory, int iCamera, int iValue)
+{
+	if (!g_pEvents)
+		return;
+	LONGLONG llNow = MotorPulseScheduler::Now();
+	Record(pszName, pszCategory, llNow, llNow, iCamera, iValue, true);
+}
+
+void TraceRecorder::NameThread(LPCTSTR pszName)
+{
+	if (!g_pEvents)
+		return;
+	CSingleLock lock(&g_csThreads, TRUE);
+	g_threadNames.emplace_back(::GetCurrentThreadId(), pszName);
+}
+
+ULONGLONG TraceRecorder::GetRecorded()
+{
+	return g_ullNext;
+}
+
+ULONGLONG TraceRecorder::GetOverwritten()
+{
+	ULONGLONG ullRecorded = g_ullNext;
+	return g_pEvents && ullRecorded > g_ullMask + 1 ? ullRecorded - (g_ullMask + 1) : 0;
+}
+
+bool TraceRecorder::Write(const CString& strFile)
+{
+	if (!g_pEvents)
+		return false;
+
+	// Copy the events first, the ring goes on while the file is written.
+	std::vector<TraceEvent> events(static_cast<size_t>(g_ullMask + 1));
+	size_t nEvents = 0;
+	const ULONGLONG ullEnd = g_ullNext.load(std::memory_order_acquire);
+	for (ULONGLONG ullIndex = ullEnd > g_ullMask + 1 ? ullEnd - (g_ullMask + 1) : 0; ullIndex < ullEnd; ++ullIndex)
+	{
+		const TraceEvent& event = g_pEvents[ullIndex & g_ullMask];
+		if (event.ullSequence.load(std::memory_order_acquire) != ullIndex + 1)
+			continue;
+		TraceEvent& copy = events[nEvents];
+		copy.pszName = event.pszName;
+		copy.pszCategory = event.pszCategory;
+		copy.llStart = event.llStart;
+		copy.llEnd = event.llEnd;
+		copy.dwThread = event.dwThread;
+		copy.iCamera = event.iCamera;
+		copy.iValue = event.iValue;
+		copy.bInstant = event.bInstant;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (event.ullSequence.load(std::memory_order_relaxed) == ullIndex + 1)
+			++nEvents;
+	}
+
+	auto Microseconds = [](LONGLONG llTicks)
+	{
+		return MotorPulseScheduler::ToMilliseconds(llTicks) * 1000.0;
+	};
+
+	const DWORD dwProcess = ::GetCurrentProcessId();
+	CStringA strJson = "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n";
+	CStringA str;
+	{
+		CSingleLock lock(&g_csThreads, TRUE);
+		for (const auto& thread : g_threadNames)
+		{
+			str.Format("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%lu,\"args\":{\"name\":\"%s\"}},\n",
+					   dwProcess, thread.first, CT2A(thread.second).m_psz);
+			strJson += str;
+		}
+	}
+	for (size_t i = 0; i < nEvents; ++i)
+	{
+		const TraceEvent& event = events[i];
+		CStringA strArgs;
+		if (event.iCamera >= 0)
+			strArgs.Format(",\"args\":{\"camera\":%d,\"value\":%d}", event.iCamera + 1, event.iValue);
+		else
+			strArgs.Format(",\"args\":{\"value\":%d}", event.iValue);
+
+		if (event.bInstant)
+			str.Format("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu%s}",
+					   CT2A(event.pszName).m_psz, CT2A(event.pszCategory).m_psz, Microseconds(event.llStart - g_llEnabled),
+					   dwProcess, event.dwThread, strArgs.GetString());
+		else
+			str.Format("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu%s}",
+					   CT2A(event.pszName).m_psz, CT2A(event.pszCategory).m_psz, Microseconds(event.llStart - g_llEnabled),
+					   Microseconds(event.llEnd - event.llStart), dwProcess, event.dwThread, strArgs.GetString());
+		strJson += str;
+		strJson += i + 1 < nEvents ? ",\n" : "\n";
+	}
+	// The metadata rows end with a comma, so an empty trace needs one event
+	if (nEvents == 0)
+	{
+		str.Format("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"args\":{\"name\":\"PTZControl\"}}\n", dwProcess);
+		strJson += str;
+	}
+	strJson += "]\n}\n";
+
+	CFile file;
+	if (!file.Open(strFile, CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite))
+		return false;
+	file.Write(strJson.GetString(), strJson.GetLength());
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TraceScope
+
+TraceScope::TraceScope(LPCTSTR pszName, LPCTSTR pszCategory, int iCamera, int iValue)
+	: m_pszName(pszName)
+	, m_pszCategory(pszCategory)
+	, m_iCamera(iCamera)
+	, m_iValue(iValue)
+	, m_llStart(TraceRecorder::IsEnabled() ? MotorPulseScheduler::Now() : 0)
+{
+}
+
+TraceScope::~TraceScope()
+{
+	if (m_llStart)
+		TraceRecorder::Span(m_pszName, m_pszCategory, m_llStart, MotorPulseScheduler::Now(), m_iCamera, m_iValue);
+}
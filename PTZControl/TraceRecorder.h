@@ -0,0 +1,52 @@
+#pragma once
+
+#include <afxstr.h>
+
+/**
+* Records spans of the UI, the camera commands and the driver calls into a ring buffer
+* and writes them as a Chrome trace-event file (chrome://tracing or https://ui.perfetto.dev).
+* Off by default. Enable allocates the ring once, recording itself never allocates and never
+* locks, so tracing may stay on for a whole session. When the ring is full, the oldest events
+* are overwritten. Names must be string literals or other strings that live for ever.
+* Times are QueryPerformanceCounter ticks.
+*/
+class TraceRecorder
+{
+public:
+	static constexpr UINT DEFAULT_CAPACITY{ 1 << 16 };
+
+	/** Allocate a ring for uCapacity events (rounded up to a power of two). Call before any thread records. */
+	static bool Enable(UINT uCapacity = DEFAULT_CAPACITY);
+	static bool IsEnabled();
+
+	/** A span from llStart to llEnd. iCamera is shown in the arguments if it isn't negative. */
+	static void Span(LPCTSTR pszName, LPCTSTR pszCategory, LONGLONG llStart, LONGLONG llEnd, int iCamera = -1, int iValue = 0);
+	/** An event without duration */
+	static void Instant(LPCTSTR pszName, LPCTSTR pszCategory, int iCamera = -1, int iValue = 0);
+	/** Name the calling thread in the trace. Called once when a thread starts. */
+	static void NameThread(LPCTSTR pszName);
+
+	/** Write all events in the ring. Events recorded while writing may be missing. */
+	static bool Write(const CString& strFile);
+	/** Number of events recorded and number of them that were overwritten */
+	static ULONGLONG GetRecorded();
+	static ULONGLONG GetOverwritten();
+};
+
+/** Records a span from the construction to the destruction of the scope. */
+class TraceScope
+{
+public:
+	TraceScope(LPCTSTR pszName, LPCTSTR pszCategory, int iCamera = -1, int iValue = 0);
+	~TraceScope();
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	LPCTSTR m_pszName;
+	LPCTSTR m_pszCategory;
+	int m_iCamera;
+	int m_iValue;
+	LONGLONG m_llStart;
+};
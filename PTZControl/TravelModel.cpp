@@ -0,0 +1,99 @@
+#include "pch.h"
+
+#include "BinaryFormat.h"
+#include "TravelModel.h"
+
+//////////////////////////////////////////////////////////////////////////
+//	Binary form
+//	DWORD version, DWORD number of targets, then per origin (the unknown
+//	origin last) and target: DWORD count and the double mean in msec.
+
+//////////////////////////////////////////////////////////////////////////
+// TravelModel
+
+TravelModel::TravelModel(int iTargets)
+	: m_iTargets(iTargets)
+	, m_cells(static_cast<size_t>(iTargets + 1) * iTargets)
+{
+}
+
+void TravelModel::Learn(int iFrom, int iTo, double dMilliseconds)
+{
+	if (!IsTarget(iTo) || (iFrom != UNKNOWN && !IsTarget(iFrom)) || dMilliseconds < 0)
+		return;
+
+	// A move from a known origin counts for the unknown origin too
+	CSingleLock lock(&m_cs, TRUE);
+	for (size_t nIndex : { Index(iFrom, iTo), Index(UNKNOWN, iTo) })
+	{
+		Cell& cell = m_cells[nIndex];
+		if (cell.uCount < UINT_MAX)
+			++cell.uCount;
+		double dWeight = cell.uCount < AVERAGED_MOVES ? 1.0 / cell.uCount : 1.0 / AVERAGED_MOVES;
+		cell.dMean += (dMilliseconds - cell.dMean) * dWeight;
+		if (iFrom == UNKNOWN)
+			break;
+	}
+}
+
+double TravelModel::Predict(int iFrom, int iTo) const
+{
+	if (!IsTarget(iTo) || (iFrom != UNKNOWN && !IsTarget(iFrom)))
+		return -1;
+
+	CSingleLock lock(&m_cs, TRUE);
+	const Cell& cell = m_cells[Index(iFrom, iTo)];
+	if (cell.uCount)
+		return cell.dMean;
+	const Cell& any = m_cells[Index(UNKNOWN, iTo)];
+	return any.uCount ? any.dMean : -1;
+}
+
+UINT TravelModel::GetCount(int iFrom, int iTo) const
+{
+	if (!IsTarget(iTo) || (iFrom != UNKNOWN && !IsTarget(iFrom)))
+		return 0;
+	CSingleLock lock(&m_cs, TRUE);
+	return m_cells[Index(iFrom, iTo)].uCount;
+}
+
+std::vector<BYTE> TravelModel::Save() const
+{
+	CSingleLock lock(&m_cs, TRUE);
+	std::vector<BYTE> data;
+	data.reserve(2 * sizeof(DWORD) + m_cells.size() * (sizeof(DWORD) + sizeof(double)));
+	BinaryFormat::Append(data, FORMAT_VERSION);
+	BinaryFormat::Append(data, static_cast<DWORD>(m_iTargets));
+	for (const Cell& cell : m_cells)
+	{
+		BinaryFormat::Append(data, static_cast<DWORD>(cell.uCount));
+		BinaryFormat::Append(data, cell.dMean);
+	}
+	return data;
+}
+
+bool TravelModel::Load(const BYTE* pData, size_t nSize)
+{
+	// A model for another number of targets is thrown away
+	const BYTE* p = pData;
+	const BYTE* pEnd = pData + nSize;
+	DWORD dwVersion = 0, dwTargets = 0;
+	if (!pData || !BinaryFormat::Extract(p, pEnd, dwVersion) || dwVersion != FORMAT_VERSION ||
+		!BinaryFormat::Extract(p, pEnd, dwTargets) || dwTargets != static_cast<DWORD>(m_iTargets))
+		return false;
+
+	std::vector<Cell> cells(m_cells.size());
+	for (Cell& cell : cells)
+	{
+		DWORD dwCount;
+		if (!BinaryFormat::Extract(p, pEnd, dwCount) || !BinaryFormat::Extract(p, pEnd, cell.dMean) || !(cell.dMean >= 0))
+			return false;
+		cell.uCount = dwCount;
+	}
+	if (p != pEnd)
+		return false;
+
+	CSingleLock lock(&m_cs, TRUE);
+	m_cells.swap(cells);
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include <afxmt.h>
+
+/**
+* Learned travel times of one camera: for every pair of recall targets the time from the
+* recall until the camera stood still. Moves that didn't start at a known target are learned
+* as well and predict a target that was never reached from the current origin.
+* Learning and predicting take constant time. All functions may be called from any thread.
+*/
+class TravelModel
+{
+public:
+	static constexpr int UNKNOWN{ -1 };		// Origin after a manual move or an unfinished recall
+
+	explicit TravelModel(int iTargets);
+
+	/** Add one measured move. The first moves are averaged, later ones weigh a quarter. */
+	void Learn(int iFrom, int iTo, double dMilliseconds);
+	/** Expected travel time in msec, negative if nothing is known about the target yet. */
+	double Predict(int iFrom, int iTo) const;
+	/** Number of moves learned from iFrom to iTo */
+	UINT GetCount(int iFrom, int iTo) const;
+
+	/** The binary form of the model, see Load. */
+	std::vector<BYTE> Save() const;
+	/** Replace the model with a saved one. False and nothing changed if the data is invalid. */
+	bool Load(const BYTE* pData, size_t nSize);
+
+private:
+	static constexpr DWORD FORMAT_VERSION{ 1 };
+	static constexpr UINT AVERAGED_MOVES{ 4 };
+
+	struct Cell
+	{
+		UINT uCount;
+		double dMean;
+	};
+
+	// The last row is the unknown origin
+	size_t Index(int iFrom, int iTo) const
+	{
+		return static_cast<size_t>(iFrom == UNKNOWN ? m_iTargets : iFrom) * m_iTargets + iTo;
+	}
+	bool IsTarget(int iTarget) const
+	{
+		return iTarget >= 0 && iTarget < m_iTargets;
+	}
+
+	const int m_iTargets;
+	mutable CCriticalSection m_cs;
+	std::vector<Cell> m_cells;
+};
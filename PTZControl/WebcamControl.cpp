@@ -1,15 +1,21 @@
 #include "pch.h"
 
+#include <cmath>
 #include <initguid.h>
 #include <comdef.h>
 #define NO_DSHOW_STRSAFE	// Avoid more C4995 warnings in intrin.h
 #include <DShow.h>
 #include <Ks.h>
 #include <KsMedia.h>
+#include <SetupAPI.h>
+#include <devpkey.h>
 
 #pragma comment(lib, "strmiids.lib")
+#pragma comment(lib, "setupapi.lib")
 
 #include "WebcamControl.h"
+#include "MotorPulseScheduler.h"
+#include "TraceRecorder.h"
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -70,8 +76,7 @@ static bool DeviceMatches(CComPtr<IMoniker> pMoniker, const CString devicePath)
 		&& (devicePathMoniker == devicePath);
 }
 
-template <typename T>
-static HRESULT GetDeviceMoniker(T deviceMatch, CComPtr<IMoniker>& pMoniker)
+static HRESULT SystemEnumerateDevices(CComPtr<IEnumMoniker>& pEnumCat)
 {
 	// Create the System Device Enumerator
 	CComPtr<ICreateDevEnum> pSysDevEnum;
@@ -79,9 +84,71 @@ static HRESULT GetDeviceMoniker(T deviceMatch, CComPtr<IMoniker>& pMoniker)
 	if (FAILED(hr))
 		return hr;
 
-	// Obtain a class enumerator for the video input device category
-	CComPtr<IEnumMoniker> pEnumCat;
+	// Obtain a class enumerator for the video input device category. S_FALSE means no devices.
 	hr = pSysDevEnum->CreateClassEnumerator(CLSID_VideoInputDeviceCategory, &pEnumCat, 0);
+	if (hr == S_FALSE)
+		hr = HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND);
+	return hr;
+}
+
+static HRESULT SystemParseDisplayName(const CString& displayName, CComPtr<IMoniker>& pMoniker)
+{
+	CComPtr<IBindCtx> pBindCtx;
+	HRESULT hr = CreateBindCtx(0, &pBindCtx);
+	if (FAILED(hr))
+		return hr;
+
+	ULONG ulEaten = 0;
+	return MkParseDisplayName(pBindCtx, displayName, &ulEaten, &pMoniker);
+}
+
+static WebcamController::DeviceSource g_deviceSource{ &SystemEnumerateDevices, &SystemParseDisplayName };
+
+void WebcamController::SetDeviceSource(const DeviceSource& source)
+{
+	g_deviceSource = source;
+}
+
+// Filled during the static initialization, so it needs no lock
+static std::vector<std::pair<CString, WebcamController::DeviceBackend>>& Backends()
+{
+	static std::vector<std::pair<CString, WebcamController::DeviceBackend>> s_backends;
+	return s_backends;
+}
+
+void WebcamController::RegisterBackend(LPCWSTR pszPathPrefix, DeviceBackend backend)
+{
+	Backends().emplace_back(pszPathPrefix, std::move(backend));
+}
+
+LPCTSTR WebcamController::CallName(DeviceCall call)
+{
+	static const LPCTSTR s_apszNames[NUM_DEVICE_CALLS] =
+	{
+		_T("XU get"), _T("XU set"), _T("XU support"),
+		_T("CameraControl get"), _T("CameraControl set"), _T("CameraControl KsProperty"),
+		_T("GetRange"), _T("Topology"),
+	};
+	return call >= 0 && call < NUM_DEVICE_CALLS ? s_apszNames[call] : _T("?");
+}
+
+template <typename Fn>
+HRESULT WebcamController::Timed(DeviceCall call, Fn fn)
+{
+	// Two counter reads and a few relaxed increments, small against any transfer to the device
+	LONGLONG llStart = MotorPulseScheduler::Now();
+	HRESULT hr = fn();
+	LONGLONG llEnd = MotorPulseScheduler::Now();
+	m_aCallLatency[call].Record(llStart, llEnd, FAILED(hr));
+	TraceRecorder::Span(CallName(call), _T("driver"), llStart, llEnd);
+	return hr;
+}
+
+template <typename T>
+static HRESULT GetDeviceMoniker(T deviceMatch, CComPtr<IMoniker>& pMoniker)
+{
+	CComPtr<IEnumMoniker> pEnumCat;
+	HRESULT hr = g_deviceSource.enumerate(pEnumCat);
 	if (FAILED(hr))
 		return hr;
 
@@ -100,8 +167,32 @@ static HRESULT GetDeviceMoniker(T deviceMatch, CComPtr<IMoniker>& pMoniker)
 	return HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND);
 }
 
+HRESULT WebcamController::OpenDevice(const WebcamDevice& device)
+{
+	// The moniker can't be used in another apartment, but its display name can be parsed
+	// again in ours. That needs no enumeration.
+	if (!device.displayName.IsEmpty())
+	{
+		CComPtr<IMoniker> pMoniker;
+		if (SUCCEEDED(g_deviceSource.parseDisplayName(device.displayName, pMoniker)) && pMoniker
+			&& SUCCEEDED(OpenDevice(pMoniker)))
+			return S_OK;
+	}
+	return OpenDevice(device.devicePath);
+}
+
 HRESULT WebcamController::OpenDevice(const CString &devicePath)
 {
+	for (const auto& backend : Backends())
+	{
+		if (devicePath.Left(backend.first.GetLength()).CompareNoCase(backend.first) == 0)
+		{
+			CComPtr<IKsControl> pKsControl;
+			HRESULT hr = backend.second(devicePath, pKsControl);
+			return FAILED(hr) ? hr : OpenDevice(pKsControl);
+		}
+	}
+
 	CComPtr<IMoniker> pMoniker;
 	HRESULT hr = GetDeviceMoniker(devicePath, pMoniker);
 	if (FAILED(hr) || !pMoniker)
@@ -122,12 +213,32 @@ void WebcamController::CloseDevice()
 {
 	m_spKsControl.Release();;
 	m_spAMCameraControl.Release();
+	m_spAMVideoProcAmp.Release();
+	m_capabilities = Capabilities{};
+	m_topology = Topology{};
+	m_bTopologyFromCache = false;
+	m_bMechanicalPanTilt = false;
+	m_bPanTiltRelative = false;
+	m_bPanTiltAbsolute = false;
+	m_bPeripheralStatus = false;
+	m_bZoomRelative = false;
+	m_lZoomMotor = 0;
+	m_bMotorStepsSet = false;
+	m_lScaleZoom = 0;
+	InvalidatePositions();
 
 	m_dwXUDeviceInformationNodeId = NONODE;
 	m_dwXUVideoPipeControlNodeId = NONODE;
 	m_dwXUTestDebugNodeId = NONODE;
 	m_dwXUPeripheralControlNodeId = NONODE;
 
+	for (auto& pulse : m_aPulses)
+		pulse.bActive = false;
+	for (auto& run : m_aMotorRuns)
+		run.iDirection = 0;
+	// Nobody knows what happens to a closed camera
+	positionEstimator.Lose(PositionEstimator::AxisPan);
+	positionEstimator.Lose(PositionEstimator::AxisTilt);
 	motorIntervalTime = DEFAULT_MOTOR_INTERVAL;
 }
 
@@ -143,21 +254,12 @@ HRESULT WebcamController::IsPeripheralPropertySetSupported()
 	extProp.NodeId = m_dwXUPeripheralControlNodeId;
 	extProp.Reserved = 0;
 	ULONG ulBytesReturned = 0;
-	return m_spKsControl->KsProperty((PKSPROPERTY)&extProp, sizeof(extProp), NULL, 0, &ulBytesReturned);
+	return Timed(CallXUSupport, [&] { return m_spKsControl->KsProperty((PKSPROPERTY)&extProp, sizeof(extProp), NULL, 0, &ulBytesReturned); });
 }
 
 
-HRESULT WebcamController::SetProperty(LOGITECH_XU_PROPERTYSET lPropertySet, ULONG ulPropertyId, ULONG ulSize, VOID* pValue)
+bool WebcamController::SelectXUNode(LOGITECH_XU_PROPERTYSET lPropertySet, KSP_NODE& extprop) const
 {
-	if (!m_spKsControl)
-		return -1;
-
-	ASSERT(pValue != 0 && ulSize != 0);
-
-	KSP_NODE extprop{};
-	extprop.Property.Id = ulPropertyId;
-	extprop.Property.Flags = KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_TOPOLOGY;
-
 	switch (lPropertySet)
 	{
 	case XU_DEVICE_INFORMATION:
@@ -176,16 +278,65 @@ HRESULT WebcamController::SetProperty(LOGITECH_XU_PROPERTYSET lPropertySet, ULON
 		extprop.NodeId = m_dwXUPeripheralControlNodeId;
 		extprop.Property.Set = LOGITECH_XU_PERIPHERAL_CONTROL;
 		break;
+	default:
+		return false;
 	}
+	return extprop.NodeId != NONODE;
+}
+
+HRESULT WebcamController::GetProperty(LOGITECH_XU_PROPERTYSET lPropertySet, ULONG ulPropertyId, ULONG ulSize, VOID* pValue)
+{
+	if (!m_spKsControl)
+		return -1;
+
+	ASSERT(pValue != 0 && ulSize != 0);
+
+	KSP_NODE extprop{};
+	extprop.Property.Id = ulPropertyId;
+	extprop.Property.Flags = KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_TOPOLOGY;
+	if (!SelectXUNode(lPropertySet, extprop))
+		return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+
+	ULONG ulBytesReturned = 0;
+	HRESULT hr = Timed(CallXUGet, [&]
+	{
+		return m_spKsControl->KsProperty(
+			(PKSPROPERTY)&extprop,
+			sizeof(extprop),
+			pValue,
+			ulSize,
+			&ulBytesReturned
+		);
+	});
+	if (SUCCEEDED(hr) && ulBytesReturned != ulSize)
+		hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+	return hr;
+}
+
+HRESULT WebcamController::SetProperty(LOGITECH_XU_PROPERTYSET lPropertySet, ULONG ulPropertyId, ULONG ulSize, VOID* pValue)
+{
+	if (!m_spKsControl)
+		return -1;
+
+	ASSERT(pValue != 0 && ulSize != 0);
+
+	KSP_NODE extprop{};
+	extprop.Property.Id = ulPropertyId;
+	extprop.Property.Flags = KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_TOPOLOGY;
+	SelectXUNode(lPropertySet, extprop);
 
 	ULONG ulBytesReturned;
-	HRESULT hr = m_spKsControl->KsProperty(
-		(PKSPROPERTY)&extprop,
-		sizeof(extprop),
-		pValue,
-		ulSize,
-		&ulBytesReturned
-	);
+	HRESULT hr = Timed(CallXUSet, [&]
+	{
+		return m_spKsControl->KsProperty(
+			(PKSPROPERTY)&extprop,
+			sizeof(extprop),
+			pValue,
+			ulSize,
+			&ulBytesReturned
+		);
+	});
 
 
 	return hr;
@@ -200,21 +351,75 @@ HRESULT WebcamController::OpenDevice(CComPtr<IMoniker> pMoniker)
 	if (FAILED(hr))
 		return hr;
 
+	return OpenDevice(pKsControl);
+}
+
+HRESULT WebcamController::OpenDevice(CComPtr<IKsControl> pKsControl)
+{
 	if (!pKsControl)
 		return E_POINTER;
 
+	m_spAMCameraControl = pKsControl;
+	if (!m_spAMCameraControl)
+		return E_NOINTERFACE;
+	m_spAMVideoProcAmp = pKsControl;
+	m_spKsControl = pKsControl;
+
+	// The discovery needs dozens of calls into the driver. A cached topology needs one.
+	LONGLONG llStart = MotorPulseScheduler::Now();
+	m_bTopologyFromCache = ValidateCachedTopology(pKsControl);
+	if (!m_bTopologyFromCache)
+	{
+		HRESULT hr = DiscoverTopology(pKsControl);
+		if (FAILED(hr))
+		{
+			CloseDevice();
+			return hr;
+		}
+	}
+	TRACE(__FUNCTION__ " topology %s in %.1f msec\n", m_bTopologyFromCache ? "cached" : "discovered",
+		  MotorPulseScheduler::ToMilliseconds(MotorPulseScheduler::Now() - llStart));
+	m_bPanTiltRelative = m_bMechanicalPanTilt && m_capabilities.cameraControl[KSPROPERTY_CAMERACONTROL_PANTILT_RELATIVE].bSupported;
+	m_bPanTiltAbsolute = m_capabilities.cameraControl[KSPROPERTY_CAMERACONTROL_PANTILT].bSupported &&
+		m_capabilities.cameraControl[CameraControl_Pan].bSupported && m_capabilities.cameraControl[CameraControl_Tilt].bSupported;
+	m_bPeripheralStatus = m_dwXUPeripheralControlNodeId != NONODE;
+	m_bZoomRelative = m_capabilities.cameraControl[KSPROPERTY_CAMERACONTROL_ZOOM_RELATIVE].bSupported &&
+		m_capabilities.cameraControl[KSPROPERTY_CAMERACONTROL_ZOOM_RELATIVE].lMax > 0;
+	m_lZoomMotor = 0;
+	m_alResolution[AxisPan] = std::max(1L, static_cast<long>(LOWORD(m_topology.dwPanTiltResolution)));
+	m_alResolution[AxisTilt] = std::max(1L, static_cast<long>(HIWORD(m_topology.dwPanTiltResolution)));
+	m_bMotorStepsSet = false;
+	m_adStepRemainder[AxisPan] = m_adStepRemainder[AxisTilt] = 0;
+	m_lScaleZoom = 0;
+
+	// Seed the position model
+	InvalidatePositions();
+	for (long lProperty : { CameraControl_Pan, CameraControl_Tilt, CameraControl_Zoom })
+	{
+		long lValue;
+		if (m_capabilities.cameraControl[lProperty].bSupported)
+			ReadPosition(lProperty, lValue);
+	}
+	return S_OK;
+}
+
+void WebcamController::SetCachedTopology(const Topology& topology)
+{
+	m_cachedTopology = topology;
+}
+
+HRESULT WebcamController::DiscoverTopology(CComPtr<IKsControl> pKsControl)
+{
+	m_topology = Topology{};
+
 	// Find the H.264 XU node
-	hr = InitializeXUNodesArray(pKsControl);
+	HRESULT hr = InitializeXUNodesArray(pKsControl);
 	if (FAILED(hr))
 		return hr;
 
-	// save the pointer, we succeeded
-	m_spKsControl = pKsControl;
-	m_spAMCameraControl = pKsControl;
-
 	long lValue;
 	long lFlags;
-	hr = m_spAMCameraControl->Get(KSPROPERTY_CAMERACONTROL_PAN_RELATIVE, &lValue, &lFlags);
+	hr = Timed(CallCameraControlGet, [&] { return m_spAMCameraControl->Get(KSPROPERTY_CAMERACONTROL_PAN_RELATIVE, &lValue, &lFlags); });
 	m_bMechanicalPanTilt = SUCCEEDED(hr);
 
 #ifdef _DEBUG
@@ -226,27 +431,195 @@ HRESULT WebcamController::OpenDevice(CComPtr<IMoniker> pMoniker)
 	}
 #endif // _DEBUG
 
-	long lMin;
-	long lMax;
-	long lSteppingSize;
-	long lDefaults;
+	ReadCapabilities();
+
+	// The firmware version tells us on the next start whether the cache is still valid
+	m_topology.dwVersion = TOPOLOGY_VERSION;
+	m_topology.bFirmware = SUCCEEDED(GetProperty(XU_DEVICE_INFORMATION, XU_FIRMWARE_VERSION_CONTROL, sizeof(DWORD), &m_topology.dwFirmware));
+	m_topology.dwXUDeviceInformationNodeId = m_dwXUDeviceInformationNodeId;
+	m_topology.dwXUVideoPipeControlNodeId = m_dwXUVideoPipeControlNodeId;
+	m_topology.dwXUTestDebugNodeId = m_dwXUTestDebugNodeId;
+	m_topology.dwXUPeripheralControlNodeId = m_dwXUPeripheralControlNodeId;
+	m_topology.bMechanicalPanTilt = m_bMechanicalPanTilt;
+	// Units that can't divide a step don't answer
+	if (FAILED(GetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_MAXIMUM_RESOLUTION_SUPPORT_FOR_PANTILT_CONTROL, sizeof(DWORD), &m_topology.dwPanTiltResolution)))
+		m_topology.dwPanTiltResolution = 0;
+	m_topology.capabilities = m_capabilities;
+	return S_OK;
+}
+
+bool WebcamController::ValidateCachedTopology(CComPtr<IKsControl> pKsControl)
+{
+	const auto& cached = m_cachedTopology;
+	if (cached.dwVersion != TOPOLOGY_VERSION)
+		return false;
 
-	hr = m_spAMCameraControl->GetRange(CameraControl_Pan, &lMin, &lMax, &lSteppingSize, &lDefaults, &lFlags);
-	if (SUCCEEDED(hr)) {
-		m_lDigitalPanMin = lMin;
-		m_lDigitalPanMax = lMax;
+	// One probe: the firmware version if the device has one, else the number of nodes
+	if (cached.bFirmware)
+	{
+		DWORD dwFirmware = 0;
+		m_dwXUDeviceInformationNodeId = cached.dwXUDeviceInformationNodeId;
+		if (FAILED(GetProperty(XU_DEVICE_INFORMATION, XU_FIRMWARE_VERSION_CONTROL, sizeof(DWORD), &dwFirmware)) || dwFirmware != cached.dwFirmware)
+		{
+			m_dwXUDeviceInformationNodeId = NONODE;
+			return false;
+		}
+	}
+	else
+	{
+		CComQIPtr<IKsTopologyInfo> pKsTopologyInfo = pKsControl;
+		DWORD dwNumNodes = 0;
+		if (!pKsTopologyInfo || FAILED(Timed(CallTopology, [&] { return pKsTopologyInfo->get_NumNodes(&dwNumNodes); })) || dwNumNodes != cached.dwNumNodes)
+			return false;
 	}
 
-	hr = m_spAMCameraControl->GetRange(CameraControl_Tilt, &lMin, &lMax, &lSteppingSize, &lDefaults, &lFlags);
-	if (SUCCEEDED(hr)) {
-		m_lDigitalTiltMin = lMin;
-		m_lDigitalTiltMax = lMax;
+	m_dwXUDeviceInformationNodeId = cached.dwXUDeviceInformationNodeId;
+	m_dwXUVideoPipeControlNodeId = cached.dwXUVideoPipeControlNodeId;
+	m_dwXUTestDebugNodeId = cached.dwXUTestDebugNodeId;
+	m_dwXUPeripheralControlNodeId = cached.dwXUPeripheralControlNodeId;
+	m_bMechanicalPanTilt = cached.bMechanicalPanTilt;
+	m_capabilities = cached.capabilities;
+	m_topology = cached;
+	return true;
+}
+
+/*
+* Reads the range of every camera control and video proc amp property once.
+* Motion paths use the cached values and don't ask the device again.
+*/
+void WebcamController::ReadCapabilities()
+{
+	m_capabilities = Capabilities{};
+	for (long lProperty = 0; lProperty < NUM_CAMERACONTROL_PROPERTIES; ++lProperty)
+	{
+		auto& range = m_capabilities.cameraControl[lProperty];
+		range.bSupported = SUCCEEDED(Timed(CallGetRange, [&] { return m_spAMCameraControl->GetRange(lProperty, &range.lMin, &range.lMax, &range.lStep, &range.lDefault, &range.lFlags); }));
 	}
 
-	return S_OK;
+	if (!m_spAMVideoProcAmp)
+		return;
+	for (long lProperty = 0; lProperty < NUM_VIDEOPROCAMP_PROPERTIES; ++lProperty)
+	{
+		auto& range = m_capabilities.videoProcAmp[lProperty];
+		range.bSupported = SUCCEEDED(Timed(CallGetRange, [&] { return m_spAMVideoProcAmp->GetRange(lProperty, &range.lMin, &range.lMax, &range.lStep, &range.lDefault, &range.lFlags); }));
+	}
+}
+
+const WebcamController::PropertyRange& WebcamController::GetCameraControlRange(long lProperty) const
+{
+	static const PropertyRange s_unsupported{};
+	if (lProperty < 0 || lProperty >= NUM_CAMERACONTROL_PROPERTIES)
+		return s_unsupported;
+	return m_capabilities.cameraControl[lProperty];
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Position model
+//	Pan, tilt and zoom are remembered when they are read or written, so a
+//	relative step doesn't need a Get before its Set. The model is dropped when
+//	the camera moves by itself (home, preset) or a Set fails, and it is
+//	compared with the device when it is older than POSITION_RESYNC_INTERVAL.
+
+WebcamController::Shadow* WebcamController::ShadowOf(long lProperty)
+{
+	switch (lProperty)
+	{
+	case CameraControl_Pan:
+		return &m_shadowPan;
+	case CameraControl_Tilt:
+		return &m_shadowTilt;
+	case CameraControl_Zoom:
+		return &m_shadowZoom;
+	default:
+		return nullptr;
+	}
+}
+
+HRESULT WebcamController::ReadPosition(long lProperty, long& lValue)
+{
+	Shadow* pShadow = ShadowOf(lProperty);
+	if (!pShadow || !m_spAMCameraControl)
+		return E_INVALIDARG;
+
+	ULONGLONG ullNow = ::GetTickCount64();
+	if (pShadow->bValid && ullNow - pShadow->ullSynced < POSITION_RESYNC_INTERVAL)
+	{
+		lValue = pShadow->lValue;
+		CSingleLock lock(&m_csStatistics, TRUE);
+		++m_positionStatistics.uReadsAvoided;
+		return S_OK;
+	}
+
+	long lFlags = 0;
+	HRESULT hr = Timed(CallCameraControlGet, [&] { return m_spAMCameraControl->Get(lProperty, &lValue, &lFlags); });
+	{
+		CSingleLock lock(&m_csStatistics, TRUE);
+		++m_positionStatistics.uReads;
+		if (pShadow->bValid)
+			++m_positionStatistics.uResyncs;
+	}
+	if (FAILED(hr))
+	{
+		pShadow->bValid = false;
+		return hr;
+	}
+#ifdef _DEBUG
+	if (pShadow->bValid && pShadow->lValue != lValue)
+		TRACE(__FUNCTION__ " property %d drifted from %d to %d\n", lProperty, pShadow->lValue, lValue);
+#endif
+	*pShadow = Shadow{ true, lValue, ullNow };
+
+	// A read is the best anchor. While the motor runs its way is added when it stops.
+	if (lProperty == CameraControl_Pan && !m_aMotorRuns[AxisPan].iDirection)
+		positionEstimator.Anchor(PositionEstimator::AxisPan, lValue);
+	if (lProperty == CameraControl_Tilt && !m_aMotorRuns[AxisTilt].iDirection)
+		positionEstimator.Anchor(PositionEstimator::AxisTilt, lValue);
+	return hr;
+}
+
+HRESULT WebcamController::WritePosition(long lProperty, long lValue)
+{
+	Shadow* pShadow = ShadowOf(lProperty);
+	if (!pShadow || !m_spAMCameraControl)
+		return E_INVALIDARG;
+
+	HRESULT hr = Timed(CallCameraControlSet, [&] { return m_spAMCameraControl->Set(lProperty, lValue, CameraControl_Flags_Manual); });
+	if (SUCCEEDED(hr))
+	{
+		// Keep the time of the last read, a Set doesn't tell us where the camera really is
+		pShadow->lValue = lValue;
+		return hr;
+	}
+
+	pShadow->bValid = false;
+	CSingleLock lock(&m_csStatistics, TRUE);
+	++m_positionStatistics.uRejectedWrites;
+	return hr;
+}
+
+void WebcamController::InvalidatePositions()
+{
+	m_shadowPan.bValid = false;
+	m_shadowTilt.bValid = false;
+	m_shadowZoom.bValid = false;
+}
+
+bool WebcamController::GetKnownPosition(long lProperty, long& lValue)
+{
+	const Shadow* pShadow = ShadowOf(lProperty);
+	if (!pShadow || !pShadow->bValid)
+		return false;
+	lValue = pShadow->lValue;
+	return true;
 }
 
-void WebcamController::GotoHome()
+WebcamController::PositionStatistics WebcamController::GetPositionStatistics()
+{
+	CSingleLock lock(&m_csStatistics, TRUE);
+	return m_positionStatistics;
+}
+
+HRESULT WebcamController::GotoHome()
 {
 	// Zoom to Home
 	{
@@ -262,17 +635,25 @@ void WebcamController::GotoHome()
 	// Preset 1-8 = 4-11, 
 	// Goto Preset 1-8 = 12-19
 	// Test 22 
+	InvalidatePositions();
+	DWORD dwValue(3);
+	HRESULT hr = SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_MODE_CONTROL, sizeof(DWORD), &dwValue);
+
+	// Home is the default of the absolute position, or the middle of a camera without one
+	const auto& pan = m_capabilities.cameraControl[CameraControl_Pan];
+	const auto& tilt = m_capabilities.cameraControl[CameraControl_Tilt];
+	if (SUCCEEDED(hr))
 	{
-		DWORD dwValue(3);
-		SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_MODE_CONTROL, sizeof(DWORD), &dwValue);
+		positionEstimator.Anchor(PositionEstimator::AxisPan, pan.bSupported ? pan.lDefault : 0);
+		positionEstimator.Anchor(PositionEstimator::AxisTilt, tilt.bSupported ? tilt.lDefault : 0);
 	}
-	return;
+	return hr;
 }
 
-void WebcamController::SavePreset(int iNum)
+HRESULT WebcamController::SavePreset(int iNum)
 {
 	if (iNum < 0 || iNum >= NUM_PRESETS)
-		return;
+		return E_INVALIDARG;
 
 	// Zoom to Home
 	// Home = No Action
@@ -284,13 +665,16 @@ void WebcamController::SavePreset(int iNum)
 	// Goto Preset 1-8 = 12-19
 	// Test 22 
 	DWORD dwValue(iNum + 4);
-	SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_MODE_CONTROL, sizeof(DWORD), &dwValue);
+	HRESULT hr = SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_MODE_CONTROL, sizeof(DWORD), &dwValue);
+	if (SUCCEEDED(hr))
+		positionEstimator.SavePreset(iNum);
+	return hr;
 }
 
-void WebcamController::GotoPreset(int iNum)
+HRESULT WebcamController::GotoPreset(int iNum)
 {
 	if (iNum < 0 || iNum >= NUM_PRESETS)
-		return;
+		return E_INVALIDARG;
 
 	// Zoom to Home
 	// Home = No Action
@@ -301,8 +685,148 @@ void WebcamController::GotoPreset(int iNum)
 	// Preset 1-8 = 4-11, 
 	// Goto Preset 1-8 = 12-19
 	// Test 22 
+	InvalidatePositions();
 	DWORD dwValue(iNum + 12);
-	SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_MODE_CONTROL, sizeof(DWORD), &dwValue);
+	HRESULT hr = SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_MODE_CONTROL, sizeof(DWORD), &dwValue);
+
+	// The camera drives there by itself. A failed recall may have moved it anyway.
+	if (FAILED(hr) || !positionEstimator.RecallPreset(iNum))
+	{
+		positionEstimator.Lose(PositionEstimator::AxisPan);
+		positionEstimator.Lose(PositionEstimator::AxisTilt);
+	}
+	return hr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Absolute positions
+//	Software presets don't need the Logitech peripheral unit. They are taken
+//	from the absolute pan, tilt and zoom properties and recalled with as few
+//	writes as the device allows.
+
+HRESULT WebcamController::GetAbsolutePosition(AbsolutePosition& position)
+{
+	if (!m_spAMCameraControl)
+		return E_POINTER;
+
+	// The motors move the camera without the model knowing it, so the device is asked
+	InvalidatePositions();
+	HRESULT hr = S_OK;
+	const std::pair<long, long*> aAxes[] =
+	{
+		{ CameraControl_Pan, &position.lPan },
+		{ CameraControl_Tilt, &position.lTilt },
+		{ CameraControl_Zoom, &position.lZoom },
+	};
+	for (const auto& axis : aAxes)
+	{
+		if (!m_capabilities.cameraControl[axis.first].bSupported)
+			continue;
+		HRESULT hrRead = ReadPosition(axis.first, *axis.second);
+		if (FAILED(hrRead))
+			hr = hrRead;
+	}
+
+	// Motors without a position to read report the estimate
+	if (m_bMechanicalPanTilt)
+	{
+		const std::pair<PositionEstimator::Axis, long*> aEstimated[] =
+		{
+			{ PositionEstimator::AxisPan, m_capabilities.cameraControl[CameraControl_Pan].bSupported ? nullptr : &position.lPan },
+			{ PositionEstimator::AxisTilt, m_capabilities.cameraControl[CameraControl_Tilt].bSupported ? nullptr : &position.lTilt },
+		};
+		for (const auto& axis : aEstimated)
+		{
+			auto estimate = positionEstimator.Get(axis.first);
+			if (axis.second && estimate.bKnown)
+				*axis.second = std::lround(estimate.dPosition);
+		}
+	}
+	return hr;
+}
+
+HRESULT WebcamController::SetAbsolutePosition(const AbsolutePosition& position)
+{
+	if (!m_spAMCameraControl)
+		return E_POINTER;
+
+	auto Clamp = [this](long lProperty, long lValue)
+	{
+		const auto& range = m_capabilities.cameraControl[lProperty];
+		return std::min(std::max(lValue, range.lMin), range.lMax);
+	};
+	const bool bPan = m_capabilities.cameraControl[CameraControl_Pan].bSupported;
+	const bool bTilt = m_capabilities.cameraControl[CameraControl_Tilt].bSupported;
+
+	HRESULT hrPanTilt = S_OK;
+	bool bPanTiltDone = false;
+	if (m_bPanTiltAbsolute)
+	{
+		// Both positions with one transfer. IAMCameraControl only knows single values.
+		KSPROPERTY_CAMERACONTROL_S2 control{};
+		control.Property.Set = PROPSETID_VIDCAP_CAMERACONTROL;
+		control.Property.Id = KSPROPERTY_CAMERACONTROL_PANTILT;
+		control.Property.Flags = KSPROPERTY_TYPE_SET;
+		control.Value1 = Clamp(CameraControl_Pan, position.lPan);
+		control.Value2 = Clamp(CameraControl_Tilt, position.lTilt);
+		control.Flags = KSPROPERTY_CAMERACONTROL_FLAGS_MANUAL | KSPROPERTY_CAMERACONTROL_FLAGS_ABSOLUTE;
+
+		ULONG ulBytesReturned = 0;
+		HRESULT hr = Timed(CallCameraControlKs, [&] { return m_spKsControl->KsProperty(&control.Property, sizeof(control), &control, sizeof(control), &ulBytesReturned); });
+		if (SUCCEEDED(hr))
+		{
+			// As WritePosition does it, the model keeps the time of the last read
+			m_shadowPan.lValue = control.Value1;
+			m_shadowTilt.lValue = control.Value2;
+			bPanTiltDone = true;
+		}
+		else
+		{
+			TRACE(__FUNCTION__ " pan/tilt absolute failed (0x%08x), using single axes\n", hr);
+			m_bPanTiltAbsolute = false;
+		}
+	}
+	if (!bPanTiltDone)
+	{
+		HRESULT hrPan = bPan ? WritePosition(CameraControl_Pan, Clamp(CameraControl_Pan, position.lPan)) : S_OK;
+		HRESULT hrTilt = bTilt ? WritePosition(CameraControl_Tilt, Clamp(CameraControl_Tilt, position.lTilt)) : S_OK;
+		hrPanTilt = FAILED(hrPan) ? hrPan : hrTilt;
+	}
+	if (m_bMechanicalPanTilt && (!bPan || !bTilt) && SUCCEEDED(hrPanTilt))
+		hrPanTilt = MoveEstimated(position, !bPan, !bTilt);
+
+	HRESULT hrZoom = S_OK;
+	if (m_capabilities.cameraControl[CameraControl_Zoom].bSupported)
+		hrZoom = WritePosition(CameraControl_Zoom, Clamp(CameraControl_Zoom, position.lZoom));
+	return FAILED(hrPanTilt) ? hrPanTilt : hrZoom;
+}
+
+HRESULT WebcamController::SampleMotion(MotionSample& sample)
+{
+	sample = MotionSample{};
+	// A running pulse is motion without a transfer
+	if (m_aPulses[AxisPan].bActive || m_aPulses[AxisTilt].bActive)
+	{
+		sample.bMoving = true;
+		return S_OK;
+	}
+	if (m_bPeripheralStatus)
+	{
+		// One transfer instead of three while the motors run
+		DWORD dwStatus = 0;
+		HRESULT hr = GetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERAL_CONTROL_PERIPHERAL_STATUS, sizeof(dwStatus), &dwStatus);
+		if (SUCCEEDED(hr) && (dwStatus & PERIPHERAL_STATUS_MOVING))
+		{
+			sample.bMoving = true;
+			return hr;
+		}
+		if (FAILED(hr))
+		{
+			TRACE(__FUNCTION__ " peripheral status failed (0x%08x), using positions only\n", hr);
+			m_bPeripheralStatus = false;
+		}
+	}
+	return GetAbsolutePosition(sample.position);
 }
 
 int WebcamController::GetCurrentZoom()
@@ -310,9 +834,10 @@ int WebcamController::GetCurrentZoom()
 	if (!m_spAMCameraControl)
 		return -1;
 
-	long oldZoom = 0, oldFlags = 0;
-	oldFlags = CameraControl_Flags_Manual;
-	m_spAMCameraControl->Get(CameraControl_Zoom, &oldZoom, &oldFlags);
+	// Always ask the device
+	m_shadowZoom.bValid = false;
+	long oldZoom = 0;
+	ReadPosition(CameraControl_Zoom, oldZoom);
 	return oldZoom;
 }
 
@@ -321,130 +846,558 @@ int WebcamController::Zoom(int direction)
 	if (!m_spAMCameraControl)
 		return -1;
 
-	long lZoomMin;
-	long lZoomMax;
-	long lZoomDefault;
-	long lZoomStep;
-	long lFlags = CameraControl_Flags_Manual;
-	m_spAMCameraControl->GetRange(CameraControl_Zoom, &lZoomMin, &lZoomMax, &lZoomStep, &lZoomDefault, &lFlags);
+	const auto& range = m_capabilities.cameraControl[CameraControl_Zoom];
+	if (!range.bSupported)
+		return -1;
 
-	long lOldZoom = GetCurrentZoom();
-	if (lOldZoom<lZoomMin || lOldZoom>lZoomMax)
-		lOldZoom = lZoomDefault;
+	long lOldZoom = range.lDefault;
+	if (FAILED(ReadPosition(CameraControl_Zoom, lOldZoom)) || lOldZoom<range.lMin || lOldZoom>range.lMax)
+		lOldZoom = range.lDefault;
 
 	// Zoom in 150 steps
-	long step = std::max((long)1, (lZoomMax - lZoomMin) / 150);
+	long step = std::max((long)1, (range.lMax - range.lMin) / 150);
 
-	// calculate new zoom
-	long lNewZoom = std::min(lZoomMax, lOldZoom + lZoomStep * direction * step);
+	// calculate new zoom, direction may contain several steps
+	long lNewZoom = std::max(range.lMin, std::min(range.lMax, lOldZoom + range.lStep * direction * step));
 
-	m_spAMCameraControl->Set(CameraControl_Zoom, lNewZoom, CameraControl_Flags_Manual);
+	WritePosition(CameraControl_Zoom, lNewZoom);
 	return lNewZoom;
 }
 
-void WebcamController::Tilt(int yDirection)
+static int Sign(int iValue)
 {
-	if (m_spAMCameraControl)
-		m_spAMCameraControl->Set(KSPROPERTY_CAMERACONTROL_TILT_RELATIVE, yDirection != 0 ? (yDirection < 0 ? -1 : 1) : 0, 0);
+	return iValue != 0 ? (iValue < 0 ? -1 : 1) : 0;
 }
 
-void WebcamController::MoveTilt(int yDirection)
+HRESULT WebcamController::ZoomContinuous(int iDirection)
 {
-	if (useLogitechMotionControl && m_dwXUPeripheralControlNodeId != NONODE)
+	if (!m_spAMCameraControl)
+		return E_POINTER;
+	if (!m_bZoomRelative)
+		return E_NOTIMPL;
+
+	// The sign is the direction, the value the speed up to the maximum of the range
+	const auto& range = m_capabilities.cameraControl[KSPROPERTY_CAMERACONTROL_ZOOM_RELATIVE];
+	long lSpeed = 0;
+	if (iDirection != 0)
 	{
-		DWORD dwValue = MAKELONG(MAKEWORD(0, 0), MAKEWORD(0, yDirection < 0 ? 1 : -1));
-		SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_RELATIVE_CONTROL, sizeof(DWORD), &dwValue);
+		long lPercent = std::min(std::max(static_cast<long>(zoomSpeed), 1L), 100L);
+		lSpeed = Sign(iDirection) * std::max(1L, (range.lMax * lPercent + 50) / 100);
 	}
-	else
+	if (lSpeed == m_lZoomMotor)
+		return S_FALSE;
+
+	HRESULT hr = Timed(CallCameraControlSet, [&] { return m_spAMCameraControl->Set(KSPROPERTY_CAMERACONTROL_ZOOM_RELATIVE, lSpeed, 0); });
+	if (FAILED(hr))
 	{
-		if (!m_spAMCameraControl)
-			return;
+		if (m_lZoomMotor == 0)
+		{
+			// The range was reported, but the device doesn't take it. Zoom in steps.
+			TRACE(__FUNCTION__ " zoom relative failed (0x%08x), using steps\n", hr);
+			m_bZoomRelative = false;
+		}
+		return hr;
+	}
+	// The zoom moves without us, the model doesn't know where it is
+	m_lZoomMotor = lSpeed;
+	m_shadowZoom.bValid = false;
+	return hr;
+}
 
-		if (m_bMechanicalPanTilt)
+HRESULT WebcamController::SetMotor(MotorAxis axis, int iDirection)
+{
+	if (!m_spAMCameraControl)
+		return E_POINTER;
+	long lProperty = axis == AxisPan ? KSPROPERTY_CAMERACONTROL_PAN_RELATIVE : KSPROPERTY_CAMERACONTROL_TILT_RELATIVE;
+	HRESULT hr = Timed(CallCameraControlSet, [&] { return m_spAMCameraControl->Set(lProperty, Sign(iDirection), 0); });
+	TrackMotor(axis, iDirection, hr);
+	return hr;
+}
+
+HRESULT WebcamController::SetMotors(int xDirection, int yDirection)
+{
+	if (!m_spAMCameraControl)
+		return E_POINTER;
+
+	if (m_bPanTiltRelative)
+	{
+		// Both motors with one transfer. IAMCameraControl only knows single values.
+		KSPROPERTY_CAMERACONTROL_S2 control{};
+		control.Property.Set = PROPSETID_VIDCAP_CAMERACONTROL;
+		control.Property.Id = KSPROPERTY_CAMERACONTROL_PANTILT_RELATIVE;
+		control.Property.Flags = KSPROPERTY_TYPE_SET;
+		control.Value1 = Sign(xDirection);
+		control.Value2 = Sign(yDirection);
+		control.Flags = KSPROPERTY_CAMERACONTROL_FLAGS_MANUAL | KSPROPERTY_CAMERACONTROL_FLAGS_RELATIVE;
+
+		ULONG ulBytesReturned = 0;
+		HRESULT hr = Timed(CallCameraControlKs, [&] { return m_spKsControl->KsProperty(&control.Property, sizeof(control), &control, sizeof(control), &ulBytesReturned); });
+		if (SUCCEEDED(hr))
 		{
-			if (yDirection != 0)
-			{
-				MMRESULT res = timeBeginPeriod(2);
-				Tilt(yDirection);
-				Sleep(motorIntervalTime);
-				Tilt(0);
-				if (res == TIMERR_NOERROR)
-					timeEndPeriod(2);
-			}
+			TrackMotor(AxisPan, xDirection, hr);
+			TrackMotor(AxisTilt, yDirection, hr);
+			return hr;
 		}
-		else
+
+		// The range was reported, but the device doesn't take it. Use one transfer per axis.
+		TRACE(__FUNCTION__ " pan/tilt relative failed (0x%08x), using single axes\n", hr);
+		m_bPanTiltRelative = false;
+	}
+
+	HRESULT hrPan = SetMotor(AxisPan, xDirection);
+	HRESULT hrTilt = SetMotor(AxisTilt, yDirection);
+	return FAILED(hrPan) ? hrPan : hrTilt;
+}
+
+void WebcamController::TrackMotor(MotorAxis axis, int iDirection, HRESULT hr)
+{
+	// The way of a run is added when the motor stops or turns. After a failed transfer
+	// nobody knows whether it runs.
+	auto& run = m_aMotorRuns[axis];
+	auto estimated = axis == AxisPan ? PositionEstimator::AxisPan : PositionEstimator::AxisTilt;
+	if (FAILED(hr))
+	{
+		positionEstimator.Lose(estimated);
+		run.iDirection = 0;
+		return;
+	}
+	int iSign = Sign(iDirection);
+	if (iSign == run.iDirection)
+		return;
+	LONGLONG llNow = MotorPulseScheduler::Now();
+	if (run.iDirection)
+		positionEstimator.AddRun(estimated, run.iDirection, MotorPulseScheduler::ToMilliseconds(llNow - run.llOn), pulseCalibration);
+	run.iDirection = iSign;
+	run.llOn = llNow;
+}
+
+HRESULT WebcamController::StartPulse(MotorAxis axis, int iDirection)
+{
+	auto& pulse = m_aPulses[axis];
+
+	// A running pulse in the same direction is just extended. Merged steps give a longer pulse.
+	HRESULT hr = S_OK;
+	if (!pulse.bActive || pulse.iDirection != Sign(iDirection))
+	{
+		hr = SetMotor(axis, iDirection);
+		if (FAILED(hr))
+			return hr;
+	}
+	ArmPulse(axis, iDirection, PulseWidth(iDirection));
+	if (!schedulePulseEnd)
+		WaitForPulses();
+	return hr;
+}
+
+HRESULT WebcamController::StartPulses(int xDirection, int yDirection)
+{
+	// Both motors are switched on together. A motor that already runs in this direction
+	// is just set again, so it is still a single transfer.
+	const auto& pan = m_aPulses[AxisPan];
+	const auto& tilt = m_aPulses[AxisTilt];
+	HRESULT hr = S_OK;
+	if (!pan.bActive || pan.iDirection != Sign(xDirection) || !tilt.bActive || tilt.iDirection != Sign(yDirection))
+	{
+		hr = SetMotors(xDirection, yDirection);
+		if (FAILED(hr))
+			return hr;
+	}
+	ArmPulse(AxisPan, xDirection, PulseWidth(xDirection));
+	ArmPulse(AxisTilt, yDirection, PulseWidth(yDirection));
+	if (!schedulePulseEnd)
+		WaitForPulses();
+	return hr;
+}
+
+void WebcamController::ArmPulse(MotorAxis axis, int iDirection, double dWidth)
+{
+	auto& pulse = m_aPulses[axis];
+	int iSign = Sign(iDirection);
+	if (!pulse.bActive || pulse.iDirection != iSign)
+	{
+		pulse.bActive = true;
+		pulse.iDirection = iSign;
+		pulse.llStart = MotorPulseScheduler::Now();
+	}
+	pulse.llDeadline = MotorPulseScheduler::Now() + MotorPulseScheduler::FromMilliseconds(dWidth);
+
+	if (schedulePulseEnd)
+		schedulePulseEnd(axis, pulse.llDeadline);
+}
+
+void WebcamController::WaitForPulses()
+{
+	// Without a scheduler the caller blocks until all motors are off again
+	for (;;)
+	{
+		const Pulse* pNext = nullptr;
+		MotorAxis axisNext = AxisPan;
+		for (int i = 0; i < NUM_AXES; ++i)
 		{
-			
-			if (yDirection != 0)
+			const auto& pulse = m_aPulses[i];
+			if (pulse.bActive && (!pNext || pulse.llDeadline < pNext->llDeadline))
 			{
-				long lValue;
-				long lFlags;
-				HRESULT hResult = m_spAMCameraControl->Get(CameraControl_Tilt, &lValue, &lFlags);
-				if (S_OK == hResult)
-				{
-					lValue += yDirection;
-					if (yDirection > 0 && lValue > m_lDigitalTiltMax)
-						lValue = m_lDigitalTiltMax;
-					if (yDirection < 0 && lValue < m_lDigitalTiltMin)
-						lValue = m_lDigitalTiltMin;
-					hResult = m_spAMCameraControl->Set(CameraControl_Tilt, lValue, lFlags);
-				}
+				pNext = &pulse;
+				axisNext = static_cast<MotorAxis>(i);
 			}
 		}
+		if (!pNext)
+			return;
+		MotorPulseScheduler::WaitUntil(pNext->llDeadline);
+		EndPulse(axisNext);
+	}
+}
+
+HRESULT WebcamController::MoveEstimated(const AbsolutePosition& position, bool bPan, bool bTilt)
+{
+	// Every axis gets the pulse for the way from its estimate to the target. Both motors
+	// start with one transfer and each one stops at its own deadline.
+	const long alTarget[NUM_AXES]{ position.lPan, position.lTilt };
+	const bool abMove[NUM_AXES]{ bPan, bTilt };
+	int aiDirection[NUM_AXES]{};
+	double adWidth[NUM_AXES]{};
+	for (int i = 0; i < NUM_AXES; ++i)
+	{
+		if (!abMove[i])
+			continue;
+		auto estimate = positionEstimator.Get(i == AxisPan ? PositionEstimator::AxisPan : PositionEstimator::AxisTilt);
+		if (!estimate.bKnown || !pulseCalibration.IsValid())
+			return HRESULT_FROM_WIN32(ERROR_NOT_READY);
+		double dWay = alTarget[i] - estimate.dPosition;
+		if (std::abs(dWay) < ESTIMATE_TOLERANCE)
+			continue;
+		aiDirection[i] = dWay < 0 ? -1 : 1;
+		adWidth[i] = pulseCalibration.PulseFor(std::abs(dWay));
+	}
+	if (!aiDirection[AxisPan] && !aiDirection[AxisTilt])
+		return S_OK;
+
+	// Like a continuous move it replaces running pulses
+	HRESULT hr = SetMotors(aiDirection[AxisPan], aiDirection[AxisTilt]);
+	m_aPulses[AxisPan].bActive = false;
+	m_aPulses[AxisTilt].bActive = false;
+	if (FAILED(hr))
+		return hr;
+	for (int i = 0; i < NUM_AXES; ++i)
+	{
+		if (aiDirection[i])
+			ArmPulse(static_cast<MotorAxis>(i), aiDirection[i], adWidth[i]);
+	}
+	if (!schedulePulseEnd)
+		WaitForPulses();
+	return hr;
+}
+
+HRESULT WebcamController::EndPulse(MotorAxis axis)
+{
+	auto& pulse = m_aPulses[axis];
+	const LONGLONG llTolerance = MotorPulseScheduler::FromMilliseconds(1);
+
+	// The pulse was stopped or extended in the meantime.
+	if (!pulse.bActive || MotorPulseScheduler::Now() < pulse.llDeadline - llTolerance)
+		return S_FALSE;
+
+	// A pulse of the other motor that is due too is stopped with the same transfer.
+	MotorAxis axisOther = axis == AxisPan ? AxisTilt : AxisPan;
+	const auto& other = m_aPulses[axisOther];
+	bool bBoth = other.bActive && MotorPulseScheduler::Now() >= other.llDeadline - llTolerance;
+
+	HRESULT hr = bBoth ? SetMotors(0, 0) : SetMotor(axis, 0);
+	LONGLONG llEnd = MotorPulseScheduler::Now();
+	FinishPulse(axis, llEnd);
+	if (bBoth)
+		FinishPulse(axisOther, llEnd);
+	return hr;
+}
+
+void WebcamController::FinishPulse(MotorAxis axis, LONGLONG llEnd)
+{
+	auto& pulse = m_aPulses[axis];
+	pulse.bActive = false;
+
+	double dRequested = MotorPulseScheduler::ToMilliseconds(pulse.llDeadline - pulse.llStart);
+	double dAchieved = MotorPulseScheduler::ToMilliseconds(llEnd - pulse.llStart);
+	double dError = dAchieved - dRequested;
+	{
+		CSingleLock lock(&m_csStatistics, TRUE);
+		auto& stat = m_pulseStatistics;
+		++stat.uCount;
+		stat.dLastRequested = dRequested;
+		stat.dLastAchieved = dAchieved;
+		stat.dSumError += dError;
+		stat.dSumSquaredError += dError * dError;
+		stat.dMaxError = std::max(stat.dMaxError, std::abs(dError));
+	}
+	TRACE(__FUNCTION__ " axis %d requested %.2f msec, achieved %.2f msec\n", axis, dRequested, dAchieved);
+
+	if (pulseObserver)
+		pulseObserver(axis, dRequested, dAchieved);
+}
+
+WebcamController::PulseStatistics WebcamController::GetPulseStatistics()
+{
+	CSingleLock lock(&m_csStatistics, TRUE);
+	return m_pulseStatistics;
+}
+
+HRESULT WebcamController::MeasurePulses(std::vector<PulseCalibration::Sample>& samples)
+{
+	samples.clear();
+	if (!m_spAMCameraControl)
+		return E_POINTER;
+	long lProperty = m_capabilities.cameraControl[CameraControl_Pan].bSupported ? CameraControl_Pan : CameraControl_Tilt;
+	if (!m_bMechanicalPanTilt || !m_capabilities.cameraControl[lProperty].bSupported)
+		return E_NOTIMPL;
+	MotorAxis axis = lProperty == CameraControl_Pan ? AxisPan : AxisTilt;
+
+	// Running pulses are ended first, the motor is switched by the measurement alone
+	if (m_aPulses[AxisPan].bActive || m_aPulses[AxisTilt].bActive)
+	{
+		HRESULT hr = SetMotors(0, 0);
+		if (FAILED(hr))
+			return hr;
+		m_aPulses[AxisPan].bActive = m_aPulses[AxisTilt].bActive = false;
+	}
+
+	long lLast;
+	HRESULT hr = ReadResting(lProperty, lLast);
+	if (FAILED(hr))
+		return hr;
+
+	// Every width goes there and back, so the camera ends where it started. It starts
+	// towards the middle, so it doesn't hit a limit.
+	const auto& range = m_capabilities.cameraControl[lProperty];
+	int iDirection = lLast > (range.lMin + range.lMax) / 2 ? -1 : 1;
+	for (double dPulse : PulseCalibration::Pulses())
+	{
+		for (int iRun = 0; iRun < 2; ++iRun, iDirection = -iDirection)
+		{
+			LONGLONG llOn = MotorPulseScheduler::Now();
+			hr = SetMotor(axis, iDirection);
+			if (FAILED(hr))
+				return hr;
+			MotorPulseScheduler::WaitUntil(llOn + MotorPulseScheduler::FromMilliseconds(dPulse));
+			LONGLONG llOff = MotorPulseScheduler::Now();
+			hr = SetMotor(axis, 0);
+			if (FAILED(hr))
+				return hr;
+
+			long lValue;
+			hr = ReadResting(lProperty, lValue);
+			if (FAILED(hr))
+				return hr;
+			samples.push_back({ MotorPulseScheduler::ToMilliseconds(llOff - llOn), static_cast<double>(std::abs(lValue - lLast)) });
+			TRACE(__FUNCTION__ " pulse %.1f msec moved %d\n", samples.back().dPulse, lValue - lLast);
+			lLast = lValue;
+		}
 	}
-	return;
+	return S_OK;
 }
 
+HRESULT WebcamController::ReadResting(long lProperty, long& lValue)
+{
+	// The motor still runs out after it was switched off. A camera that keeps changing
+	// (e.g. drift) is taken as it is after the last read.
+	HRESULT hr = S_OK;
+	long lPrevious = 0;
+	for (int i = 0; i < CALIBRATION_READS; ++i)
+	{
+		ShadowOf(lProperty)->bValid = false;
+		hr = ReadPosition(lProperty, lValue);
+		if (FAILED(hr) || (i > 0 && lValue == lPrevious))
+			break;
+		lPrevious = lValue;
+		::Sleep(CALIBRATION_POLL);
+	}
+	return hr;
+}
 
-void WebcamController::Pan(int xDirection)
+HRESULT WebcamController::StepPosition(long lProperty, int iDirection)
 {
-	if (m_spAMCameraControl)
-		m_spAMCameraControl->Set(KSPROPERTY_CAMERACONTROL_PAN_RELATIVE, xDirection != 0 ? (xDirection < 0 ? -1 : 1) : 0, 0);
+	// Digital pan/tilt: one step relative to the known position
+	if (iDirection == 0)
+		return S_OK;
+
+	long lValue;
+	HRESULT hResult = ReadPosition(lProperty, lValue);
+	if (S_OK == hResult)
+	{
+		lValue += iDirection;
+		const auto& range = m_capabilities.cameraControl[lProperty];
+		if (iDirection > 0 && lValue > range.lMax)
+			lValue = range.lMax;
+		if (iDirection < 0 && lValue < range.lMin)
+			lValue = range.lMin;
+		hResult = WritePosition(lProperty, lValue);
+	}
+	return hResult;
 }
 
-void WebcamController::MovePan(int xDirection)
+/*
+* Zoomed in, the same step sweeps a larger part of the picture. The zoom the model knows is
+* used, so the scale costs no transfer. While the zoom is unknown (e.g. a running zoom motor)
+* the zoom known last is used.
+*/
+double WebcamController::PanTiltScale()
+{
+	if (m_shadowZoom.bValid)
+		m_lScaleZoom = m_shadowZoom.lValue;
+
+	const auto& range = m_capabilities.cameraControl[CameraControl_Zoom];
+	int iScaling = zoomScaling;
+	if (iScaling <= 0 || !range.bSupported || range.lMin <= 0 || m_lScaleZoom <= range.lMin)
+		return 1;
+	return std::pow(static_cast<double>(range.lMin) / m_lScaleZoom, std::min(iScaling, 400) / 100.0);
+}
+
+/*
+* A motor accelerates first, so a pulse of twice the width moves more than twice as far.
+* With a calibration the pulse is the one that moves the way of motorIntervalTime times the
+* steps and the zoom scale. Without one the width itself is scaled.
+*/
+double WebcamController::PulseWidth(int iDirection)
 {
-	if (useLogitechMotionControl)
+	const double dInterval = motorIntervalTime;
+	const double dFactor = std::abs(iDirection) * PanTiltScale();
+	double dWay = pulseCalibration.WayOf(dInterval);
+	if (dWay > 0)
+		return pulseCalibration.PulseFor(dWay * dFactor);
+	return dInterval * dFactor;
+}
+
+HRESULT WebcamController::SendLogitechSteps(int xSteps, int ySteps)
+{
+	// When the setting is on, a unit that can divide a step is switched to its finest parts.
+	// If it refuses, whole steps are sent as before. Switched off, it counts whole steps again.
+	const bool bMotorSteps = useLogitechMotorSteps && (m_alResolution[AxisPan] > 1 || m_alResolution[AxisTilt] > 1);
+	if (bMotorSteps != m_bMotorStepsSet)
 	{
-		DWORD dwValue = MAKELONG(MAKEWORD(0, xDirection), MAKEWORD(0, 0));
-		SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_RELATIVE_CONTROL, sizeof(DWORD), &dwValue);
+		DWORD dwParts = bMotorSteps ? MAKELONG(m_alResolution[AxisPan], m_alResolution[AxisTilt]) : MAKELONG(1, 1);
+		HRESULT hr = SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERAL_MOTOR_STEPS_CONTROL, sizeof(DWORD), &dwParts);
+		if (FAILED(hr) && bMotorSteps)
+		{
+			TRACE(__FUNCTION__ " motor steps rejected, using whole steps\n");
+			m_alResolution[AxisPan] = m_alResolution[AxisTilt] = 1;
+		}
+		m_bMotorStepsSet = bMotorSteps && SUCCEEDED(hr);
+		m_adStepRemainder[AxisPan] = m_adStepRemainder[AxisTilt] = 0;
 	}
+
+	// A step is logitechStepSize percent of a full one. Parts that don't make a whole one are
+	// kept for the next step in the same direction. The value is a signed byte per axis.
+	const double dStepSize = std::min(std::max(static_cast<int>(logitechStepSize), 1), 1000) / 100.0 * PanTiltScale();
+	auto Parts = [&](MotorAxis axis, int iSteps)
+	{
+		double& dRemainder = m_adStepRemainder[axis];
+		if (iSteps == 0)
+			return 0;
+		if (dRemainder * iSteps < 0)
+			dRemainder = 0;
+		double dParts = iSteps * dStepSize * (m_bMotorStepsSet ? m_alResolution[axis] : 1) + dRemainder;
+		int iParts = static_cast<int>(std::min(std::max(std::trunc(dParts), -127.0), 127.0));
+		dRemainder = std::abs(dParts - iParts) < 1 ? dParts - iParts : 0;
+		return iParts;
+	};
+	int xParts = Parts(AxisPan, xSteps);
+	int yParts = Parts(AxisTilt, ySteps);
+	if (xParts == 0 && yParts == 0)
+		return S_FALSE;
+
+	// Pan and tilt are packed into the same value. The XU tilts down for positive values.
+	// The way of a step isn't known in the units of the position, the estimate is lost.
+	DWORD dwValue = MAKELONG(MAKEWORD(0, xParts), MAKEWORD(0, -yParts));
+	if (xParts)
+		positionEstimator.Lose(PositionEstimator::AxisPan);
+	if (yParts)
+		positionEstimator.Lose(PositionEstimator::AxisTilt);
+	return SetProperty(XU_PERIPHERAL_CONTROL, XU_PERIPHERALCONTROL_PANTILT_RELATIVE_CONTROL, sizeof(DWORD), &dwValue);
+}
+
+HRESULT WebcamController::Tilt(int yDirection)
+{
+	// A continuous move replaces a running pulse
+	m_aPulses[AxisTilt].bActive = false;
+	return SetMotor(AxisTilt, yDirection);
+}
+
+HRESULT WebcamController::MoveTilt(int yDirection)
+{
+	if (useLogitechMotionControl && m_dwXUPeripheralControlNodeId != NONODE)
+		return SendLogitechSteps(0, yDirection);
 	else
 	{
 		if (!m_spAMCameraControl)
-			return;
+			return E_POINTER;
 
+		HRESULT hResult = S_OK;
 		if (m_bMechanicalPanTilt)
 		{
-			if (xDirection != 0)
-			{
-				MMRESULT res = timeBeginPeriod(2);
-				Pan(xDirection);
-				Sleep(motorIntervalTime);
-				Pan(0);
-				if (res == TIMERR_NOERROR)
-					timeEndPeriod(2);
-			}
+			if (yDirection != 0)
+				hResult = StartPulse(AxisTilt, yDirection);
 		}
 		else
+			hResult = StepPosition(CameraControl_Tilt, yDirection);
+		return hResult;
+	}
+}
+
+
+HRESULT WebcamController::Pan(int xDirection)
+{
+	// A continuous move replaces a running pulse
+	m_aPulses[AxisPan].bActive = false;
+	return SetMotor(AxisPan, xDirection);
+}
+
+HRESULT WebcamController::MovePan(int xDirection)
+{
+	if (useLogitechMotionControl && m_dwXUPeripheralControlNodeId != NONODE)
+		return SendLogitechSteps(xDirection, 0);
+	else
+	{
+		if (!m_spAMCameraControl)
+			return E_POINTER;
+
+		HRESULT hResult = S_OK;
+		if (m_bMechanicalPanTilt)
 		{
-			long lValue(0), lFlags(0);
 			if (xDirection != 0)
-			{
-				HRESULT hResult = m_spAMCameraControl->Get(CameraControl_Pan, &lValue, &lFlags);
-				if (S_OK == hResult)
-				{
-					lValue += xDirection;
-					if (xDirection > 0 && lValue > m_lDigitalPanMax)
-						lValue = m_lDigitalPanMax;
-					if (xDirection < 0 && lValue < m_lDigitalPanMin)
-						lValue = m_lDigitalPanMin;
-					hResult = m_spAMCameraControl->Set(CameraControl_Pan, lValue, lFlags);
-				}
-			}
+				hResult = StartPulse(AxisPan, xDirection);
 		}
+		else
+			hResult = StepPosition(CameraControl_Pan, xDirection);
+		return hResult;
 	}
-	return;
+}
+
+HRESULT WebcamController::PanTilt(int xDirection, int yDirection)
+{
+	// A continuous move replaces running pulses
+	m_aPulses[AxisPan].bActive = false;
+	m_aPulses[AxisTilt].bActive = false;
+	return SetMotors(xDirection, yDirection);
+}
+
+HRESULT WebcamController::MovePanTilt(int xDirection, int yDirection)
+{
+	// Only one axis, nothing to combine
+	if (yDirection == 0)
+		return MovePan(xDirection);
+	if (xDirection == 0)
+		return MoveTilt(yDirection);
+
+	if (useLogitechMotionControl && m_dwXUPeripheralControlNodeId != NONODE)
+		return SendLogitechSteps(xDirection, yDirection);
+
+	if (!m_spAMCameraControl)
+		return E_POINTER;
+	if (m_bMechanicalPanTilt)
+		return StartPulses(xDirection, yDirection);
+
+	// Digital pan/tilt has no combined property. With the known position it is one write per axis.
+	HRESULT hResult = StepPosition(CameraControl_Pan, xDirection);
+	HRESULT hResultTilt = StepPosition(CameraControl_Tilt, yDirection);
+	return FAILED(hResult) ? hResult : hResultTilt;
 }
 
 
@@ -460,9 +1413,10 @@ HRESULT WebcamController::InitializeXUNodesArray(CComPtr<IKsControl> pKsControl)
 
 	// Retrieve the number of nodes in the filter
 	DWORD dwNumNodes = 0;
-	HRESULT hr = pKsTopologyInfo->get_NumNodes(&dwNumNodes);
+	HRESULT hr = Timed(CallTopology, [&] { return pKsTopologyInfo->get_NumNodes(&dwNumNodes); });
 	if (FAILED(hr))
 		return hr;
+	m_topology.dwNumNodes = dwNumNodes;
 
 	// Go through all extension unit nodes and try to find the required XU node
 	hr = E_FAIL;
@@ -472,7 +1426,7 @@ HRESULT WebcamController::InitializeXUNodesArray(CComPtr<IKsControl> pKsControl)
 	for (unsigned int nodeId = 0; nodeId < dwNumNodes; nodeId++)
 	{
 		GUID guidNodeType;
-		hr = pKsTopologyInfo->get_NodeType(nodeId, &guidNodeType);
+		hr = Timed(CallTopology, [&] { return pKsTopologyInfo->get_NodeType(nodeId, &guidNodeType); });
 		if (FAILED(hr))
 			continue;
 
@@ -529,11 +1483,90 @@ bool WebcamController::IsExtensionUnitSupported(CComPtr<IKsControl> pKsControl,
 	extProp.NodeId = nodeId;
 	extProp.Reserved = 0;
 	ULONG ulBytesReturned = 0;
-	HRESULT hr = pKsControl->KsProperty((PKSPROPERTY)&extProp, sizeof(extProp), NULL, 0, &ulBytesReturned);
+	HRESULT hr = Timed(CallXUSupport, [&] { return pKsControl->KsProperty((PKSPROPERTY)&extProp, sizeof(extProp), NULL, 0, &ulBytesReturned); });
 	return SUCCEEDED(hr);
 }
 
 
+static bool ContainerIdOf(const CString& devicePath, GUID& guidContainer)
+{
+	HDEVINFO hDevInfo = ::SetupDiCreateDeviceInfoList(NULL, NULL);
+	if (hDevInfo == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool bFound = false;
+	SP_DEVICE_INTERFACE_DATA interfaceData{ sizeof(interfaceData) };
+	SP_DEVINFO_DATA devInfoData{ sizeof(devInfoData) };
+	if (::SetupDiOpenDeviceInterface(hDevInfo, devicePath, 0, &interfaceData))
+	{
+		// Fails for the missing buffer, but delivers the device
+		::SetupDiGetDeviceInterfaceDetail(hDevInfo, &interfaceData, NULL, 0, NULL, &devInfoData);
+		DEVPROPTYPE propType = 0;
+		bFound = ::SetupDiGetDeviceProperty(hDevInfo, &devInfoData, &DEVPKEY_Device_ContainerId, &propType,
+											reinterpret_cast<PBYTE>(&guidContainer), sizeof(guidContainer), NULL, 0)
+				 && propType == DEVPROP_TYPE_GUID;
+	}
+	::SetupDiDestroyDeviceInfoList(hDevInfo);
+	return bFound;
+}
+
+CString WebcamController::DeviceIdentity(const CString& devicePath)
+{
+	// \\?\usb#vid_046d&pid_0853&mi_00#7&2ab0c1f&0&0000#{65e8773d-8f56-11d0-a3b9-00a0c9223196}\global
+	CString strPath(devicePath);
+	strPath.MakeLower();
+	CString strIdentity = DeviceModel(devicePath);
+	if (strIdentity.IsEmpty())
+		return strPath;
+	int iPid = strPath.Find(_T("&pid_"), strPath.Find(_T("vid_")));
+
+	// The interfaces of a device share the container, with a serial number also on another port.
+	GUID guidContainer;
+	if (ContainerIdOf(devicePath, guidContainer))
+	{
+		wchar_t szGuid[40];
+		::StringFromGUID2(guidContainer, szGuid, _countof(szGuid));
+		return strIdentity + _T("#") + CString(szGuid).MakeLower();
+	}
+
+	int iInstance = strPath.Find(_T('#'), iPid);
+	int iInstanceEnd = iInstance < 0 ? -1 : strPath.Find(_T('#'), iInstance + 1);
+	if (iInstanceEnd < 0)
+		return strPath;
+	return strIdentity + strPath.Mid(iInstance, iInstanceEnd - iInstance);
+}
+
+bool WebcamController::IsVideoInput(const CString& devicePath)
+{
+	// The capture interface of the camera has an alias in the video category, the one of its
+	// microphone doesn't. Paths the system doesn't know, like simulated ones, are taken as
+	// they are. Opening them fails if they aren't video inputs.
+	HDEVINFO hDevInfo = ::SetupDiCreateDeviceInfoList(NULL, NULL);
+	if (hDevInfo == INVALID_HANDLE_VALUE)
+		return true;
+
+	bool bVideo = true;
+	SP_DEVICE_INTERFACE_DATA interfaceData{ sizeof(interfaceData) };
+	if (::SetupDiOpenDeviceInterface(hDevInfo, devicePath, 0, &interfaceData))
+	{
+		SP_DEVICE_INTERFACE_DATA aliasData{ sizeof(aliasData) };
+		bVideo = ::SetupDiGetDeviceInterfaceAlias(hDevInfo, &interfaceData, &KSCATEGORY_VIDEO, &aliasData) != FALSE;
+	}
+	::SetupDiDestroyDeviceInfoList(hDevInfo);
+	return bVideo;
+}
+
+CString WebcamController::DeviceModel(const CString& devicePath)
+{
+	CString strPath(devicePath);
+	strPath.MakeLower();
+	int iVid = strPath.Find(_T("vid_"));
+	int iPid = iVid < 0 ? -1 : strPath.Find(_T("&pid_"), iVid);
+	if (iPid < 0)
+		return CString();
+	return strPath.Mid(iVid, iPid + 9 - iVid);
+}
+
 std::vector<WebcamDevice> WebcamController::CompatibleDevices(std::vector<CString> deviceNameFilters)
 {
 	std::vector<WebcamDevice> devices;
@@ -556,41 +1589,45 @@ std::vector<WebcamDevice> WebcamController::CompatibleDevices(std::vector<CStrin
 	};
 
 	// Get a device list
-	CComPtr<ICreateDevEnum> pSysDevEnum;
-	HRESULT hr;
-	hr = CoCreateInstance(CLSID_SystemDeviceEnum, NULL, CLSCTX_INPROC_SERVER, IID_ICreateDevEnum, (void**)&pSysDevEnum);
+	CComPtr<IEnumMoniker> pIEnumMoniker;
+	HRESULT hr = g_deviceSource.enumerate(pIEnumMoniker);
+	CComPtr<IBindCtx> pBindCtx;
+	if (SUCCEEDED(hr))
+		hr = CreateBindCtx(0, &pBindCtx);
 	if (SUCCEEDED(hr))
 	{
-		//create a device class enumerator
-		CComPtr<IEnumMoniker> pIEnumMoniker;
-		hr = pSysDevEnum->CreateClassEnumerator(CLSID_VideoInputDeviceCategory, &pIEnumMoniker, 0);
-		if (SUCCEEDED(hr))
+		ULONG	pFetched = NULL;
+		CComPtr<IMoniker> pImoniker;
+		while (S_OK == pIEnumMoniker->Next(1, &pImoniker, &pFetched))
 		{
-			ULONG	pFetched = NULL;
-			CComPtr<IMoniker> pImoniker;
-			while (S_OK == pIEnumMoniker->Next(1, &pImoniker, &pFetched))
+			CComPtr<IPropertyBag> pPropBag;
+			hr = pImoniker->BindToStorage(0, 0, IID_PPV_ARGS(&pPropBag));
+			if (SUCCEEDED(hr) && pPropBag)
 			{
-				CComPtr<IPropertyBag> pPropBag;
-				hr = pImoniker->BindToStorage(0, 0, IID_PPV_ARGS(&pPropBag));
-				if (SUCCEEDED(hr) && pPropBag)
+				CComVariant varCameraName;
+				CComVariant varDevicePath;
+				pPropBag->Read(L"FriendlyName", &varCameraName, 0);
+				pPropBag->Read(L"DevicePath", &varDevicePath, 0);
+
+				if (SUCCEEDED(varCameraName.ChangeType(VT_BSTR)) &&
+					SUCCEEDED(varDevicePath.ChangeType(VT_BSTR)))
 				{
-					CComVariant varCameraName;
-					CComVariant varDevicePath;
-					pPropBag->Read(L"FriendlyName", &varCameraName, 0);
-					pPropBag->Read(L"DevicePath", &varDevicePath, 0);
-
-					if (SUCCEEDED(varCameraName.ChangeType(VT_BSTR)) &&
-						SUCCEEDED(varDevicePath.ChangeType(VT_BSTR)))
-					{
-						CString strCameraName(varCameraName.bstrVal);
-						CString strDevicePath(varDevicePath.bstrVal);
-						if (not_filtered || deviceNameMatch(strCameraName)) {
-							devices.emplace_back(WebcamDevice{ strCameraName, strDevicePath });
+					CString strCameraName(varCameraName.bstrVal);
+					CString strDevicePath(varDevicePath.bstrVal);
+					if (not_filtered || deviceNameMatch(strCameraName)) {
+						// Keep the display name, so the device can be opened without enumerating again
+						CString strDisplayName;
+						LPOLESTR pszDisplayName = nullptr;
+						if (SUCCEEDED(pImoniker->GetDisplayName(pBindCtx, NULL, &pszDisplayName)) && pszDisplayName)
+						{
+							strDisplayName = pszDisplayName;
+							CoTaskMemFree(pszDisplayName);
 						}
+						devices.emplace_back(WebcamDevice{ strCameraName, strDevicePath, strDisplayName });
 					}
 				}
-				pImoniker.Release();
 			}
+			pImoniker.Release();
 		}
 	}
 	return devices;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <vector>
 
 #include <Ks.h>
@@ -7,13 +9,20 @@
 #include <vidcap.h>			// For IKsNodeControl
 
 #include <afxstr.h>
+#include <afxmt.h>
 
 #include "LogitechTypes.h"
+#include "LatencyHistogram.h"
+#include "PulseCalibration.h"
+#include "PositionEstimator.h"
 
 struct WebcamDevice
 {
 	const CString deviceName;
 	const CString devicePath;
+	// Display name of the moniker found by the enumeration. It is parsed again in the
+	// apartment that opens the device. Empty for devices that can only be opened by path.
+	const CString displayName;
 };
 
 struct UsbIdentifier
@@ -30,43 +39,336 @@ class WebcamController
 public:
 	static constexpr size_t NUM_PRESETS{ 8 };
 	static constexpr int DEFAULT_MOTOR_INTERVAL{ 70 };
+	static constexpr int DEFAULT_ZOOM_SPEED{ 50 };
+	static constexpr int DEFAULT_LOGITECH_STEP_SIZE{ 100 };
+	static constexpr int DEFAULT_ZOOM_SCALING{ 100 };
+
+	/** Motor axes that can be pulsed */
+	enum MotorAxis
+	{
+		AxisPan,
+		AxisTilt,
+		NUM_AXES
+	};
+
+	/** Requested and measured motor on-time of all pulses (msec) */
+	struct PulseStatistics
+	{
+		UINT uCount;
+		double dLastRequested;
+		double dLastAchieved;
+		double dSumError;
+		double dSumSquaredError;
+		double dMaxError;
+	};
+
+	/** Range of a camera property as reported by GetRange once when the device is opened */
+	struct PropertyRange
+	{
+		bool bSupported;
+		long lMin;
+		long lMax;
+		long lStep;
+		long lDefault;
+		long lFlags;
+	};
+
+	// KSPROPERTY_CAMERACONTROL_PAN .. KSPROPERTY_CAMERACONTROL_FOCUS_RELATIVE
+	static constexpr long NUM_CAMERACONTROL_PROPERTIES{ 20 };
+	// VideoProcAmp_Brightness .. VideoProcAmp_Gain
+	static constexpr long NUM_VIDEOPROCAMP_PROPERTIES{ 10 };
+
+	/** All ranges of the device. Filled by OpenDevice, unsupported properties are marked. */
+	struct Capabilities
+	{
+		PropertyRange cameraControl[NUM_CAMERACONTROL_PROPERTIES];
+		PropertyRange videoProcAmp[NUM_VIDEOPROCAMP_PROPERTIES];
+	};
+
+	/**
+	* Everything OpenDevice discovers on the filter. It is stored per device, so the next
+	* start can skip the discovery. Changes of the layout need a new TOPOLOGY_VERSION.
+	*/
+	struct Topology
+	{
+		DWORD dwVersion;
+		DWORD dwNumNodes;
+		bool bFirmware;			// The firmware version could be read
+		DWORD dwFirmware;
+		DWORD dwXUDeviceInformationNodeId;
+		DWORD dwXUVideoPipeControlNodeId;
+		DWORD dwXUTestDebugNodeId;
+		DWORD dwXUPeripheralControlNodeId;
+		bool bMechanicalPanTilt;
+		DWORD dwPanTiltResolution;	// Of the peripheral unit, packed like the XU value. 0 if it has none.
+		Capabilities capabilities;
+	};
+	static constexpr DWORD TOPOLOGY_VERSION{ 2 };
+
+	/** Position reads answered by the local model and those that needed a transfer */
+	struct PositionStatistics
+	{
+		UINT uReads;			// Get sent to the device
+		UINT uReadsAvoided;		// Answered by the model
+		UINT uResyncs;			// Reads of a valid model because it was too old
+		UINT uRejectedWrites;	// Set failed, the model was dropped
+	};
+
+	/** Pan, tilt and zoom in the units of the camera properties, e.g. a software preset */
+	struct AbsolutePosition
+	{
+		long lPan;
+		long lTilt;
+		long lZoom;
+	};
+
+	/** One look at a moving camera, see SampleMotion */
+	struct MotionSample
+	{
+		bool bMoving;				// The peripheral status says so, the position wasn't read
+		AbsolutePosition position;
+	};
+
+	// A valid model is compared with the device after this time (msec)
+	static constexpr ULONGLONG POSITION_RESYNC_INTERVAL{ 2000 };
+
+	/** The kinds of driver calls. Every call to the device is timed in one of them. */
+	enum DeviceCall
+	{
+		CallXUGet,				// KsProperty get of a Logitech extension unit
+		CallXUSet,
+		CallXUSupport,			// KsProperty probe of an extension unit
+		CallCameraControlGet,	// IAMCameraControl
+		CallCameraControlSet,
+		CallCameraControlKs,	// Camera control through KsProperty (pan and tilt together)
+		CallGetRange,
+		CallTopology,			// IKsTopologyInfo
+		NUM_DEVICE_CALLS
+	};
+	static LPCTSTR CallName(DeviceCall call);
+
+	/** Where the video input devices come from. The default is the system device enumerator. */
+	struct DeviceSource
+	{
+		std::function<HRESULT(CComPtr<IEnumMoniker>& pEnum)> enumerate;
+		std::function<HRESULT(const CString& displayName, CComPtr<IMoniker>& pMoniker)> parseDisplayName;
+	};
+	/** Replace the device source. Only used for tests before any device is enumerated. */
+	static void SetDeviceSource(const DeviceSource& source);
+
+	/**
+	* Opens devices that have no moniker, like the simulated cameras. OpenDevice with a path
+	* that starts with the prefix uses the backend instead of the device source. Backends
+	* register themselves while the program is initialized.
+	*/
+	using DeviceBackend = std::function<HRESULT(const CString& devicePath, CComPtr<IKsControl>& pKsControl)>;
+	static void RegisterBackend(LPCWSTR pszPathPrefix, DeviceBackend backend);
 
 	/** Retrieve compatible devices, optionally filtering by name */
 	static std::vector<WebcamDevice> CompatibleDevices(std::vector<CString> deviceNameFilters = {});
+	/**
+	* The same for a camera on any USB port and in any enumeration order: VID/PID and the
+	* container ID, or the instance part of the path (the serial number of a device with
+	* one interface). Other paths are their own identity. Only valid while the device is present.
+	*/
+	static CString DeviceIdentity(const CString& devicePath);
+	/** The USB vendor and product ID of the path (vid_046d&pid_0853), empty if it has none. */
+	static CString DeviceModel(const CString& devicePath);
+	/** False for another interface of the device, like its microphone. Doesn't enumerate. */
+	static bool IsVideoInput(const CString& devicePath);
 
 	WebcamController() {}
+	WebcamController(const WebcamController&) = delete;
+	WebcamController& operator=(const WebcamController&) = delete;
 
+	/** Binds the moniker of the enumeration without enumerating again. Falls back to the path. */
+	HRESULT OpenDevice(const WebcamDevice& device);
 	HRESULT OpenDevice(const CString &devicePath);
 	HRESULT OpenDevice(const UsbIdentifier usbId);
+	HRESULT OpenDevice(CComPtr<IKsControl> pKsControl);
 	void CloseDevice();
 	HRESULT IsPeripheralPropertySetSupported();
 
+	/**
+	* A topology stored by an earlier run. The next OpenDevice uses it if one probe shows that
+	* the device is still the same (firmware version or node count). Otherwise it discovers again.
+	*/
+	void SetCachedTopology(const Topology& topology);
+	/** The topology of the open device and whether it was taken from the cache. */
+	const Topology& GetTopology() const
+	{
+		return m_topology;
+	}
+	bool IsTopologyFromCache() const
+	{
+		return m_bTopologyFromCache;
+	}
+
+	/** Only valid after the device was opened. Doesn't change until it is closed. */
+	const Capabilities& GetCapabilities() const
+	{
+		return m_capabilities;
+	}
+	const PropertyRange& GetCameraControlRange(long lProperty) const;
+
+	/** Pan, tilt or zoom as the model knows it, without a transfer. False if it is unknown. */
+	bool GetKnownPosition(long lProperty, long& lValue);
+	PositionStatistics GetPositionStatistics();
+	/** Latencies and errors of the driver calls since the controller was created. */
+	const LatencyHistogram& GetCallLatency(DeviceCall call) const
+	{
+		return m_aCallLatency[call];
+	}
+
 	int GetCurrentZoom();
 	int Zoom(int direction);
-	void MoveTilt(int yDirection);
-	void MovePan(int xDirection);
-	void Tilt(int yDirection);
-	void Pan(int xDirection);
+	/** The device runs the zoom with a relative (motor) control, see ZoomContinuous. */
+	bool HasZoomMotor() const
+	{
+		return m_bZoomRelative;
+	}
+	/** Run the zoom at zoomSpeed in the direction until it is called with 0. S_FALSE if nothing changed. */
+	HRESULT ZoomContinuous(int iDirection);
+	HRESULT MoveTilt(int yDirection);
+	HRESULT MovePan(int xDirection);
+	/** A diagonal step. Pan and tilt are sent with one transfer where the device allows it. */
+	HRESULT MovePanTilt(int xDirection, int yDirection);
+	HRESULT Tilt(int yDirection);
+	HRESULT Pan(int xDirection);
+	/** Switch both motors on or off, with one transfer where the device allows it. */
+	HRESULT PanTilt(int xDirection, int yDirection);
+
+	HRESULT GotoHome();
+	HRESULT SavePreset(int iNum);
+	HRESULT GotoPreset(int iNum);
+	/** The presets above are kept in the Logitech peripheral unit. Other cameras have none. */
+	bool HasPresetUnit() const
+	{
+		return m_dwXUPeripheralControlNodeId != NONODE;
+	}
+
+	/**
+	* Read all axes the device supports from the device. The others keep their value. A camera
+	* with motors but without an absolute pan or tilt reports the estimate, if it is known.
+	*/
+	HRESULT GetAbsolutePosition(AbsolutePosition& position);
+	/**
+	* Move all axes at once: pan and tilt with one transfer where the device allows it, and zoom.
+	* Motors without an absolute position get the pulse for the way from the estimate.
+	*/
+	HRESULT SetAbsolutePosition(const AbsolutePosition& position);
+	/**
+	* Whether the camera still moves: the peripheral status of the Logitech unit if the device
+	* reports it, and the positions when it doesn't say it is moving. The caller compares them.
+	*/
+	HRESULT SampleMotion(MotionSample& sample);
 
-	void GotoHome();
-	void SavePreset(int iNum);
-	void GotoPreset(int iNum);
+	/** Switch the motor off when the pulse deadline is reached. */
+	HRESULT EndPulse(MotorAxis axis);
+	PulseStatistics GetPulseStatistics();
+	/**
+	* Measure the way of motor pulses of the widths of PulseCalibration::Pulses, each one in
+	* both directions, with the absolute pan (the tilt if the pan can't be read). Blocks for a
+	* few seconds. E_NOTIMPL for a camera without motors or without a position to read.
+	*/
+	HRESULT MeasurePulses(std::vector<PulseCalibration::Sample>& samples);
 
-	int motorIntervalTime{ DEFAULT_MOTOR_INTERVAL };
-	bool useLogitechMotionControl{ false };
+	// The settings may be changed from the UI thread while a worker uses the device.
+	std::atomic<int> motorIntervalTime{ DEFAULT_MOTOR_INTERVAL };
+	std::atomic<bool> useLogitechMotionControl{ false };
+	// Percent of the fastest speed of the zoom motor
+	std::atomic<int> zoomSpeed{ DEFAULT_ZOOM_SPEED };
+	// Percent of a full step of the Logitech peripheral unit that one step moves
+	std::atomic<int> logitechStepSize{ DEFAULT_LOGITECH_STEP_SIZE };
+	// Switch the peripheral unit to the parts of a step its resolution control reports. The
+	// meaning of both controls is assumed and not checked on a real camera yet, so it is off
+	// by default. Without it parts of a step are collected until they make a whole one.
+	std::atomic<bool> useLogitechMotorSteps{ false };
+	// Pan/tilt steps and pulses are scaled with (widest zoom / zoom) ^ (zoomScaling / 100).
+	// 100 keeps the step the same part of the picture, 0 switches the scaling off.
+	std::atomic<int> zoomScaling{ DEFAULT_ZOOM_SCALING };
+	// Way of the motor pulses of this camera, see MeasurePulses. Pulses are taken from its
+	// curve when it is valid.
+	PulseCalibration pulseCalibration;
+	// Pan and tilt of a camera with motors, integrated over the motor runs with the calibration.
+	// Anchored by home, by the presets of the Logitech unit and by every read of the position.
+	PositionEstimator positionEstimator{ NUM_PRESETS };
+
+	// Arms the end of a motor pulse (QPC deadline). Without it, a pulse blocks the caller.
+	std::function<void(MotorAxis axis, LONGLONG llDeadline)> schedulePulseEnd;
+	// Gets every finished pulse with the requested and the achieved on-time in msec.
+	std::function<void(MotorAxis axis, double dRequested, double dAchieved)> pulseObserver;
 
 private:
 	static constexpr DWORD NONODE{ 0xFFFFFF };
+	// Peripheral status bit of running pan/tilt motors. Only trusted to say "moving", a
+	// resting camera is confirmed by its positions.
+	static constexpr DWORD PERIPHERAL_STATUS_MOVING{ 0x01 };
+	// A target of an estimated axis that is nearer than this (units) is reached
+	static constexpr double ESTIMATE_TOLERANCE{ 0.5 };
+	// A calibration reads the resting position this often (msec) until two reads are the same
+	static constexpr DWORD CALIBRATION_POLL{ 50 };
+	static constexpr int CALIBRATION_READS{ 40 };
+
+	// Local copy of an absolute position, written with every Set
+	struct Shadow
+	{
+		bool bValid;
+		long lValue;
+		ULONGLONG ullSynced;	// Tick count of the last Get
+	};
+
+	struct Pulse
+	{
+		bool bActive;
+		int iDirection;
+		LONGLONG llStart;
+		LONGLONG llDeadline;
+	};
+
+	// A motor that was switched on, for the position estimate
+	struct MotorRun
+	{
+		int iDirection;			// 0 while it is off
+		LONGLONG llOn;
+	};
 
 	HRESULT OpenDevice(CComPtr<IMoniker> pMoniker);
+	void ReadCapabilities();
+	HRESULT DiscoverTopology(CComPtr<IKsControl> pKsControl);
+	bool ValidateCachedTopology(CComPtr<IKsControl> pKsControl);
+	bool SelectXUNode(LOGITECH_XU_PROPERTYSET lPropertySet, KSP_NODE& extprop) const;
+	Shadow* ShadowOf(long lProperty);
+	HRESULT ReadPosition(long lProperty, long& lValue);
+	HRESULT WritePosition(long lProperty, long lValue);
+	void InvalidatePositions();
+	HRESULT StepPosition(long lProperty, int iDirection);
+	HRESULT SendLogitechSteps(int xSteps, int ySteps);
+	double PanTiltScale();
+	double PulseWidth(int iDirection);
+	HRESULT ReadResting(long lProperty, long& lValue);
+	HRESULT SetMotor(MotorAxis axis, int iDirection);
+	HRESULT SetMotors(int xDirection, int yDirection);
+	void TrackMotor(MotorAxis axis, int iDirection, HRESULT hr);
+	HRESULT StartPulse(MotorAxis axis, int iDirection);
+	HRESULT StartPulses(int xDirection, int yDirection);
+	void ArmPulse(MotorAxis axis, int iDirection, double dWidth);
+	HRESULT MoveEstimated(const AbsolutePosition& position, bool bPan, bool bTilt);
+	void WaitForPulses();
+	void FinishPulse(MotorAxis axis, LONGLONG llEnd);
 	HRESULT InitializeXUNodesArray(CComPtr<IKsControl> pKsControl);
 	bool IsExtensionUnitSupported(CComPtr<IKsControl> pKsControl, const GUID& guidExtension, unsigned int nodeId);
 
-	//HRESULT GetProperty(LOGITECH_XU_PROPERTYSET lPropertySet, ULONG ulPropertyId, ULONG ulSize, VOID* pValue);
+	// Runs one driver call and records its time and result
+	template <typename Fn>
+	HRESULT Timed(DeviceCall call, Fn fn);
+
+	HRESULT GetProperty(LOGITECH_XU_PROPERTYSET lPropertySet, ULONG ulPropertyId, ULONG ulSize, VOID* pValue);
 	HRESULT SetProperty(LOGITECH_XU_PROPERTYSET lPropertySet, ULONG ulPropertyId, ULONG ulSize, VOID* pValue);
 
 	CComPtr<IKsControl> m_spKsControl{};
 	CComQIPtr<IAMCameraControl> m_spAMCameraControl{};
+	CComQIPtr<IAMVideoProcAmp> m_spAMVideoProcAmp{};
 
 	DWORD m_dwXUDeviceInformationNodeId{ NONODE };
 	DWORD m_dwXUVideoPipeControlNodeId{ NONODE };
@@ -74,8 +376,27 @@ private:
 	DWORD m_dwXUPeripheralControlNodeId{ NONODE };
 
 	bool m_bMechanicalPanTilt{ false };
-	long m_lDigitalTiltMin{ -1 };
-	long m_lDigitalTiltMax{ -1 };
-	long m_lDigitalPanMin{ -1 };
-	long m_lDigitalPanMax{ -1 };
+	bool m_bPanTiltRelative{ false };		// Both motors with one transfer, cleared when the device rejects it
+	bool m_bPanTiltAbsolute{ false };		// Both positions with one transfer, the same
+	bool m_bPeripheralStatus{ false };		// The peripheral unit reports its motion, the same
+	bool m_bZoomRelative{ false };			// Zoom motor, cleared when the device rejects it
+	long m_lZoomMotor{ 0 };					// The speed the zoom motor runs with
+	long m_alResolution[NUM_AXES]{};		// Parts of a Logitech step, 1 if the unit can't divide it
+	bool m_bMotorStepsSet{ false };			// The unit counts in these parts, see useLogitechMotorSteps
+	double m_adStepRemainder[NUM_AXES]{};	// Parts that didn't make a whole one yet
+	long m_lScaleZoom{ 0 };					// The last known zoom, 0 if there was none
+	Capabilities m_capabilities{};
+	Topology m_topology{};
+	Topology m_cachedTopology{};
+	bool m_bTopologyFromCache{ false };
+	Shadow m_shadowPan{};
+	Shadow m_shadowTilt{};
+	Shadow m_shadowZoom{};
+
+	Pulse m_aPulses[NUM_AXES]{};
+	MotorRun m_aMotorRuns[NUM_AXES]{};
+	CCriticalSection m_csStatistics;
+	PulseStatistics m_pulseStatistics{};
+	PositionStatistics m_positionStatistics{};
+	LatencyHistogram m_aCallLatency[NUM_DEVICE_CALLS];
 };
@@ -0,0 +1,707 @@
+#include "pch.h"
+
+#include <algorithm>
+
+#include "WebcamWorker.h"
+#include "TraceRecorder.h"
+
+//////////////////////////////////////////////////////////////////////////
+// WebcamWorker
+
+WebcamWorker::WebcamWorker(HWND hWndNotify, UINT uMsgNotify, WORD wCamera)
+	: m_spState(std::make_shared<State>(hWndNotify, uMsgNotify, wCamera))
+	, m_pThread(nullptr)
+{
+	// Motor pulses are ended by the shared scheduler. It hands the motor off command back 
+	// to this worker, because the device may only be used from this apartment.
+	std::weak_ptr<State> wpState{ m_spState };
+	m_spState->camera.schedulePulseEnd = [wpState](WebcamController::MotorAxis axis, LONGLONG llDeadline)
+	{
+		auto spState = wpState.lock();
+		if (!spState || !spState->pScheduler)
+			return;
+		UINT_PTR key = reinterpret_cast<UINT_PTR>(&spState->camera) + axis;
+		spState->pScheduler->Arm(key, llDeadline, [wpState, axis]()
+		{
+			if (auto spState = wpState.lock())
+				Post(*spState, CameraCommand::EndPulse, [axis](WebcamController& camera) { return camera.EndPulse(axis); }, true);
+		});
+	};
+}
+
+WebcamWorker::~WebcamWorker()
+{
+	Stop(STOP_TIMEOUT);
+}
+
+LPCTSTR WebcamWorker::CommandName(CameraCommand cmd)
+{
+	static const LPCTSTR s_apszNames[] =
+	{
+		_T("Open"), _T("GotoHome"), _T("SavePreset"), _T("GotoPreset"), _T("Zoom"),
+		_T("Pan"), _T("Tilt"), _T("MovePan"), _T("MoveTilt"), _T("PanTilt"), _T("MovePanTilt"),
+		_T("Close"), _T("EndPulse"), _T("Sync"), _T("SavePosition"), _T("GotoPosition"), _T("Settle"),
+		_T("Velocity"), _T("Calibrate"),
+	};
+	static_assert(_countof(s_apszNames) == static_cast<size_t>(CameraCommand::NUM_COMMANDS), "One name per command");
+	return cmd < CameraCommand::NUM_COMMANDS ? s_apszNames[static_cast<int>(cmd)] : _T("?");
+}
+
+bool WebcamWorker::Start()
+{
+	if (m_pThread)
+		return true;
+
+	// The thread gets its own reference to the state.
+	auto* pState = new std::shared_ptr<State>(m_spState);
+	m_pThread = AfxBeginThread(&ThreadProc, pState, THREAD_PRIORITY_NORMAL, 0, CREATE_SUSPENDED);
+	if (!m_pThread)
+	{
+		delete pState;
+		return false;
+	}
+	m_pThread->m_bAutoDelete = FALSE;
+	m_pThread->ResumeThread();
+	return true;
+}
+
+void WebcamWorker::Stop(DWORD dwTimeout)
+{
+	if (!m_pThread)
+		return;
+
+	m_spState->evStop.SetEvent();
+	if (!m_spState->bQuarantined && ::WaitForSingleObject(m_pThread->m_hThread, dwTimeout) == WAIT_OBJECT_0)
+		delete m_pThread;
+	else
+		// The thread hangs in the driver. Leave it, it still owns the shared state.
+		TRACE(__FUNCTION__ " camera %u does not terminate\n", m_spState->wCamera);
+	m_pThread = nullptr;
+}
+
+void WebcamWorker::Post(CameraCommand cmd, Command fn, bool bUrgent)
+{
+	Post(*m_spState, cmd, std::move(fn), bUrgent);
+}
+
+void WebcamWorker::Post(State& state, CameraCommand cmd, Command fn, bool bUrgent)
+{
+	{
+		CSingleLock lock(&state.cs, TRUE);
+		// Nobody would execute it. A recall that never runs must not leave the camera moving.
+		if (state.bClosed)
+		{
+			state.evSettled.SetEvent();
+			return;
+		}
+		Entry entry{ cmd, std::move(fn), CameraAxis::None, 0, nullptr, 0, nullptr };
+		if (bUrgent)
+			state.queue.push_front(std::move(entry));
+		else
+			state.queue.push_back(std::move(entry));
+	}
+	state.evQueue.SetEvent();
+}
+
+void WebcamWorker::PostStep(CameraCommand cmd, CameraAxis axis, int iSteps, ValueCommand fn)
+{
+	PostAxis(*m_spState, Entry{ cmd, nullptr, axis, iSteps, std::move(fn), 0, nullptr }, true);
+}
+
+void WebcamWorker::PostTarget(CameraCommand cmd, CameraAxis axis, int iTarget, ValueCommand fn)
+{
+	PostAxis(*m_spState, Entry{ cmd, nullptr, axis, iTarget, std::move(fn), 0, nullptr }, false);
+}
+
+void WebcamWorker::PostStep(CameraCommand cmd, int xSteps, int ySteps, PairCommand fn)
+{
+	PostAxis(*m_spState, Entry{ cmd, nullptr, CameraAxis::PanTilt, xSteps, nullptr, ySteps, std::move(fn) }, true);
+}
+
+void WebcamWorker::PostTarget(CameraCommand cmd, int xTarget, int yTarget, PairCommand fn)
+{
+	PostAxis(*m_spState, Entry{ cmd, nullptr, CameraAxis::PanTilt, xTarget, nullptr, yTarget, std::move(fn) }, false);
+}
+
+void WebcamWorker::PostAxis(State& state, Entry entry, bool bSum)
+{
+	if (state.bQuarantined)
+		return;
+	// The camera leaves the target it rested at
+	++state.uManualMoves;
+	state.iOrigin = TravelModel::UNKNOWN;
+	{
+		CSingleLock lock(&state.cs, TRUE);
+		if (state.bClosed)
+			return;
+
+		// Merge into the last waiting command for this axis, if it is the same kind of command.
+		// So an axis never has more than the running and one waiting command. A combined
+		// pan/tilt command is in the way of a later command for pan or tilt alone.
+		if (state.bCoalesce)
+		{
+			auto Overlaps = [](CameraAxis a, CameraAxis b)
+			{
+				return a == b || (a == CameraAxis::PanTilt && (b == CameraAxis::Pan || b == CameraAxis::Tilt)) ||
+					   (b == CameraAxis::PanTilt && (a == CameraAxis::Pan || a == CameraAxis::Tilt));
+			};
+			auto it = std::find_if(state.queue.rbegin(), state.queue.rend(), [&](const Entry& waiting) { return Overlaps(waiting.axis, entry.axis); });
+			if (it != state.queue.rend() && it->axis == entry.axis && it->cmd == entry.cmd)
+			{
+				auto Merge = [bSum](int iWaiting, int iValue) { return bSum ? std::min(std::max(iWaiting + iValue, -MAX_STEPS), MAX_STEPS) : iValue; };
+				it->iValue = Merge(it->iValue, entry.iValue);
+				it->iValue2 = Merge(it->iValue2, entry.iValue2);
+				return;
+			}
+		}
+		state.queue.push_back(std::move(entry));
+	}
+	state.evQueue.SetEvent();
+}
+
+size_t WebcamWorker::GetQueueDepth()
+{
+	CSingleLock lock(&m_spState->cs, TRUE);
+	return m_spState->queue.size();
+}
+
+HRESULT WebcamWorker::Send(CameraCommand cmd, Command fn)
+{
+	struct Result
+	{
+		CEvent evDone;
+		HRESULT hr{ E_ABORT };
+	};
+	auto spResult = std::make_shared<Result>();
+	Post(cmd, [spResult, fn](WebcamController& camera)
+	{
+		spResult->hr = fn(camera);
+		spResult->evDone.SetEvent();
+		return spResult->hr;
+	});
+
+	// Wait for the result, but stop waiting if the worker is terminated.
+	HANDLE ahWait[] = { spResult->evDone, m_spState->evStop };
+	::WaitForMultipleObjects(_countof(ahWait), ahWait, FALSE, INFINITE);
+	return spResult->hr;
+}
+
+HRESULT WebcamWorker::Open(const CString& devicePath)
+{
+	return Send(CameraCommand::Open, [devicePath](WebcamController& camera) { return camera.OpenDevice(devicePath); });
+}
+
+void WebcamWorker::Disconnect()
+{
+	Post(CameraCommand::Close, [](WebcamController& camera)
+	{
+		// The next open validates the topology with one call instead of discovering it again.
+		if (camera.GetTopology().dwVersion == WebcamController::TOPOLOGY_VERSION)
+			camera.SetCachedTopology(camera.GetTopology());
+		int iMotorInterval = camera.motorIntervalTime;
+		camera.CloseDevice();
+		camera.motorIntervalTime = iMotorInterval;
+		return S_OK;
+	});
+}
+
+void WebcamWorker::Reconnect(const WebcamDevice& device, int iPreset)
+{
+	Post(CameraCommand::Open, [device](WebcamController& camera) { return camera.OpenDevice(device); });
+	if (iPreset >= 0)
+		GotoPreset(iPreset);
+}
+
+HRESULT WebcamWorker::Sync()
+{
+	return Send(CameraCommand::Sync, [](WebcamController&) { return S_OK; });
+}
+
+void WebcamWorker::GotoHome()
+{
+	Post(CameraCommand::GotoHome, Recall(TARGET_HOME, [](WebcamController& camera) { return camera.GotoHome(); }));
+}
+
+void WebcamWorker::SavePreset(int iNum)
+{
+	// The command runs on the thread that owns the state, so the store is still there
+	PresetStore* pPresets = &m_spState->presets;
+	Post(CameraCommand::SavePreset, [iNum, pPresets](WebcamController& camera)
+	{
+		if (camera.HasPresetUnit() || iNum < 0)
+			return camera.SavePreset(iNum);
+		return SavePosition(camera, *pPresets, static_cast<UINT>(iNum), CString());
+	});
+}
+
+void WebcamWorker::GotoPreset(int iNum)
+{
+	PresetStore* pPresets = &m_spState->presets;
+	int iTarget = iNum >= 0 && iNum < WebcamController::NUM_PRESETS ? iNum : TARGET_POSITION;
+	Post(CameraCommand::GotoPreset, Recall(iTarget, [iNum, pPresets](WebcamController& camera)
+	{
+		if (camera.HasPresetUnit() || iNum < 0)
+			return camera.GotoPreset(iNum);
+		return GotoPosition(camera, *pPresets, static_cast<UINT>(iNum));
+	}));
+}
+
+void WebcamWorker::SavePosition(UINT uId, const CString& strName)
+{
+	PresetStore* pPresets = &m_spState->presets;
+	Post(CameraCommand::SavePosition, [uId, strName, pPresets](WebcamController& camera)
+	{
+		return SavePosition(camera, *pPresets, uId, strName);
+	});
+}
+
+bool WebcamWorker::GotoPosition(UINT uId)
+{
+	PresetStore::Preset preset;
+	if (!m_spState->presets.Find(uId, preset))
+		return false;
+	Post(CameraCommand::GotoPosition, Recall(TARGET_POSITION, [preset](WebcamController& camera) { return camera.SetAbsolutePosition(preset.position); }));
+	return true;
+}
+
+HRESULT WebcamWorker::SavePosition(WebcamController& camera, PresetStore& presets, UINT uId, const CString& strName)
+{
+	// A preset that was already there keeps the axes the camera doesn't report
+	PresetStore::Preset preset{};
+	presets.Find(uId, preset);
+	HRESULT hr = camera.GetAbsolutePosition(preset.position);
+	if (SUCCEEDED(hr))
+		presets.Put(uId, strName, preset.position);
+	return hr;
+}
+
+HRESULT WebcamWorker::GotoPosition(WebcamController& camera, const PresetStore& presets, UINT uId)
+{
+	PresetStore::Preset preset;
+	if (!presets.Find(uId, preset))
+		return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+	return camera.SetAbsolutePosition(preset.position);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Settling
+//	After a recall the camera is polled until two samples without motion
+//	show the same position. The first of them is the arrival. The polls
+//	start fast and get slower, so a long travel costs only a few transfers.
+
+WebcamWorker::Command WebcamWorker::Recall(int iTarget, Command fn)
+{
+	// A client that waits right after the post must see the camera moving
+	m_spState->evSettled.ResetEvent();
+	std::weak_ptr<State> wpState{ m_spState };
+	return [wpState, iTarget, fn](WebcamController& camera)
+	{
+		LONGLONG llStart = MotorPulseScheduler::Now();
+		HRESULT hr = fn(camera);
+		if (auto spState = wpState.lock())
+		{
+			if (SUCCEEDED(hr))
+				BeginMotion(spState, iTarget, llStart);
+			else if (!spState->motion.bActive)
+				spState->evSettled.SetEvent();
+		}
+		return hr;
+	};
+}
+
+void WebcamWorker::BeginMotion(const std::shared_ptr<State>& spState, int iTarget, LONGLONG llStart)
+{
+	// A recall that replaces a moving one is not measured. Its travel is learned as one
+	// from an unknown origin.
+	Motion& motion = spState->motion;
+	int iOrigin = spState->iOrigin.exchange(TravelModel::UNKNOWN);
+	motion.iOrigin = motion.bActive ? TravelModel::UNKNOWN : iOrigin;
+	motion.uManualMoves = spState->uManualMoves;
+	++motion.uMotion;
+	motion.bActive = true;
+	motion.iTarget = iTarget;
+	motion.llStart = llStart;
+	motion.dwInterval = FIRST_POLL_INTERVAL;
+	motion.bSampled = false;
+	spState->evSettled.ResetEvent();
+	SchedulePoll(spState);
+}
+
+void WebcamWorker::SchedulePoll(const std::shared_ptr<State>& spState)
+{
+	// The key follows the key of the deadline
+	std::weak_ptr<State> wpState{ spState };
+	UINT uMotion = spState->motion.uMotion;
+	UINT_PTR key = reinterpret_cast<UINT_PTR>(&spState->camera) + WebcamController::NUM_AXES + 1;
+	LONGLONG llPoll = MotorPulseScheduler::Now() + MotorPulseScheduler::FromMilliseconds(spState->motion.dwInterval);
+	spState->pScheduler->Arm(key, llPoll, [wpState, uMotion]()
+	{
+		if (auto spState = wpState.lock())
+		{
+			Post(*spState, CameraCommand::Settle, [wpState, uMotion](WebcamController& camera)
+			{
+				auto spState = wpState.lock();
+				return spState ? PollMotion(spState, camera, uMotion) : E_ABORT;
+			}, false);
+		}
+	});
+}
+
+HRESULT WebcamWorker::PollMotion(const std::shared_ptr<State>& spState, WebcamController& camera, UINT uMotion)
+{
+	Motion& motion = spState->motion;
+	if (!motion.bActive || motion.uMotion != uMotion)
+		return S_FALSE;
+
+	LONGLONG llNow = MotorPulseScheduler::Now();
+	WebcamController::MotionSample sample;
+	HRESULT hr = camera.SampleMotion(sample);
+	if (SUCCEEDED(hr))
+	{
+		bool bArrived = !sample.bMoving && motion.bSampled && sample.position.lPan == motion.last.lPan &&
+			sample.position.lTilt == motion.last.lTilt && sample.position.lZoom == motion.last.lZoom;
+		if (!bArrived && MotorPulseScheduler::ToMilliseconds(llNow - motion.llStart) < SETTLE_TIMEOUT)
+		{
+			motion.bSampled = !sample.bMoving;
+			motion.last = sample.position;
+			motion.llLast = llNow;
+			motion.dwInterval = std::min(motion.dwInterval * 3 / 2, MAX_POLL_INTERVAL);
+			SchedulePoll(spState);
+			return S_FALSE;
+		}
+		if (!bArrived)
+			hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+	}
+
+	LONGLONG llArrival = SUCCEEDED(hr) ? motion.llLast : llNow;
+	spState->aArrivalLatency[motion.iTarget].Record(motion.llStart, llArrival, FAILED(hr));
+	TraceRecorder::Span(_T("Arrival"), _T("motion"), motion.llStart, llArrival, spState->wCamera, motion.iTarget);
+	motion.bActive = false;
+
+	// Only a move that no axis command disturbed is learned. Software positions differ
+	// from recall to recall, so the camera doesn't rest at a known target after them.
+	if (SUCCEEDED(hr) && motion.uManualMoves == spState->uManualMoves && motion.iTarget != TARGET_POSITION)
+	{
+		spState->travel.Learn(motion.iOrigin, motion.iTarget, MotorPulseScheduler::ToMilliseconds(llArrival - motion.llStart));
+		spState->iOrigin = motion.iTarget;
+		if (motion.uManualMoves != spState->uManualMoves)
+			spState->iOrigin = TravelModel::UNKNOWN;		// Posted meanwhile
+	}
+	spState->evSettled.SetEvent();
+	return hr;
+}
+
+void WebcamWorker::Zoom(int direction)
+{
+	PostStep(CameraCommand::Zoom, CameraAxis::Zoom, direction, [](WebcamController& camera, int iSteps) { return camera.Zoom(iSteps) < 0 ? E_FAIL : S_OK; });
+}
+
+void WebcamWorker::Pan(int xDirection)
+{
+	// The motor state is a target. Only the last one counts.
+	PostTarget(CameraCommand::Pan, CameraAxis::Pan, xDirection, [](WebcamController& camera, int iDirection) { return camera.Pan(iDirection); });
+}
+
+void WebcamWorker::Tilt(int yDirection)
+{
+	PostTarget(CameraCommand::Tilt, CameraAxis::Tilt, yDirection, [](WebcamController& camera, int iDirection) { return camera.Tilt(iDirection); });
+}
+
+void WebcamWorker::MovePan(int xDirection)
+{
+	PostStep(CameraCommand::MovePan, CameraAxis::Pan, xDirection, [](WebcamController& camera, int iSteps) { return camera.MovePan(iSteps); });
+}
+
+void WebcamWorker::MoveTilt(int yDirection)
+{
+	PostStep(CameraCommand::MoveTilt, CameraAxis::Tilt, yDirection, [](WebcamController& camera, int iSteps) { return camera.MoveTilt(iSteps); });
+}
+
+void WebcamWorker::PanTilt(int xDirection, int yDirection)
+{
+	PostTarget(CameraCommand::PanTilt, xDirection, yDirection, [](WebcamController& camera, int xDir, int yDir) { return camera.PanTilt(xDir, yDir); });
+}
+
+void WebcamWorker::MovePanTilt(int xDirection, int yDirection)
+{
+	PostStep(CameraCommand::MovePanTilt, xDirection, yDirection, [](WebcamController& camera, int xSteps, int ySteps) { return camera.MovePanTilt(xSteps, ySteps); });
+}
+
+void WebcamWorker::CalibratePulses()
+{
+	// The camera moves, it doesn't rest at a target anymore
+	++m_spState->uManualMoves;
+	m_spState->iOrigin = TravelModel::UNKNOWN;
+	Post(CameraCommand::Calibrate, [](WebcamController& camera)
+	{
+		std::vector<PulseCalibration::Sample> samples;
+		HRESULT hr = camera.MeasurePulses(samples);
+		if (FAILED(hr))
+			return hr;
+		if (!camera.pulseCalibration.Fit(samples))
+			return E_FAIL;
+
+		// A step is a bit longer than the shortest pulse that moves the camera at all
+		double dInterval = camera.pulseCalibration.GetMinimumPulse() * CALIBRATED_INTERVAL_FACTOR;
+		camera.motorIntervalTime = std::min(std::max(static_cast<int>(dInterval + 0.5), MIN_MOTOR_INTERVAL), MAX_MOTOR_INTERVAL);
+		return S_OK;
+	});
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	Held inputs
+//	The first control step is posted when an input starts, the next ones are
+//	armed at a fixed rate until the engine has nothing left to send. A camera
+//	that is slower than the rate gets the steps of the time it needed.
+
+static double Seconds(LONGLONG llTime)
+{
+	return MotorPulseScheduler::ToMilliseconds(llTime) / 1000;
+}
+
+void WebcamWorker::SetVelocity(double dPan, double dTilt, double dZoom)
+{
+	State& state = *m_spState;
+	if (state.bQuarantined)
+		return;
+	if (dPan != 0 || dTilt != 0 || dZoom != 0)
+	{
+		++state.uManualMoves;
+		state.iOrigin = TravelModel::UNKNOWN;
+	}
+
+	bool bStart = false;
+	{
+		CSingleLock lock(&state.csMotion, TRUE);
+		double dNow = Seconds(MotorPulseScheduler::Now());
+		state.engine.SetIntent(MotionEngine::AxisPan, dPan, dNow);
+		state.engine.SetIntent(MotionEngine::AxisTilt, dTilt, dNow);
+		state.engine.SetIntent(MotionEngine::AxisZoom, dZoom, dNow);
+		if (!state.bControlling && state.engine.IsActive())
+			bStart = state.bControlling = true;
+	}
+	if (bStart)
+		PostControl(m_spState);
+}
+
+void WebcamWorker::SetMotionCurve(const MotionEngine::Curve& curve)
+{
+	CSingleLock lock(&m_spState->csMotion, TRUE);
+	m_spState->engine.SetCurve(MotionEngine::AxisPan, curve);
+	m_spState->engine.SetCurve(MotionEngine::AxisTilt, curve);
+}
+
+MotionEngine::Curve WebcamWorker::GetMotionCurve() const
+{
+	CSingleLock lock(&m_spState->csMotion, TRUE);
+	return m_spState->engine.GetCurve(MotionEngine::AxisPan);
+}
+
+long long WebcamWorker::GetVelocitySteps(MotionEngine::Axis axis) const
+{
+	CSingleLock lock(&m_spState->csMotion, TRUE);
+	return m_spState->engine.GetEmitted(axis);
+}
+
+void WebcamWorker::PostControl(const std::shared_ptr<State>& spState)
+{
+	std::weak_ptr<State> wpState{ spState };
+	Post(*spState, CameraCommand::Velocity, [wpState](WebcamController& camera)
+	{
+		auto spState = wpState.lock();
+		return spState ? Control(spState, camera) : E_ABORT;
+	}, false);
+}
+
+HRESULT WebcamWorker::Control(const std::shared_ptr<State>& spState, WebcamController& camera)
+{
+	LONGLONG llNow = MotorPulseScheduler::Now();
+	MotionEngine::Steps steps;
+	double dZoom;
+	bool bActive;
+	{
+		CSingleLock lock(&spState->csMotion, TRUE);
+		steps = spState->engine.Advance(Seconds(llNow));
+		dZoom = spState->engine.GetIntent(MotionEngine::AxisZoom);
+		bActive = spState->engine.IsActive();
+		spState->bControlling = bActive;
+	}
+
+	HRESULT hr = S_OK;
+	auto Clamp = [](int iSteps) { return std::min(std::max(iSteps, -MAX_STEPS), MAX_STEPS); };
+	if (steps[MotionEngine::AxisPan] != 0 || steps[MotionEngine::AxisTilt] != 0)
+		hr = camera.MovePanTilt(Clamp(steps[MotionEngine::AxisPan]), Clamp(steps[MotionEngine::AxisTilt]));
+
+	// A zoom motor only gets a transfer when the direction changes. Without one the steps
+	// of the engine grow while the zoom is held.
+	HRESULT hrZoom = S_OK;
+	if (camera.HasZoomMotor())
+		hrZoom = camera.ZoomContinuous(dZoom > 0 ? 1 : dZoom < 0 ? -1 : 0);
+	else if (steps[MotionEngine::AxisZoom] != 0 && camera.Zoom(Clamp(steps[MotionEngine::AxisZoom])) < 0)
+		hrZoom = E_FAIL;
+	if (SUCCEEDED(hr))
+		hr = hrZoom;
+	if (!bActive)
+		return hr;
+
+	// The rate doesn't drift with the time the steps took, unless the camera is slower
+	const LONGLONG llInterval = MotorPulseScheduler::FromMilliseconds(CONTROL_INTERVAL);
+	LONGLONG& llNext = spState->llNextControl;
+	llNext = llNext + llInterval > llNow ? llNext + llInterval : llNow + llInterval;
+	std::weak_ptr<State> wpState{ spState };
+	UINT_PTR key = reinterpret_cast<UINT_PTR>(&spState->camera) + WebcamController::NUM_AXES + 2;
+	spState->pScheduler->Arm(key, llNext, [wpState]()
+	{
+		if (auto spState = wpState.lock())
+			PostControl(spState);
+	});
+	return hr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	The worker thread. It owns a single threaded apartment, so the device
+//	is bound and used on the same thread. While waiting for commands we
+//	pump messages as every STA thread must do.
+
+UINT AFX_CDECL WebcamWorker::ThreadProc(LPVOID p)
+{
+	std::unique_ptr<std::shared_ptr<State>> pState(static_cast<std::shared_ptr<State>*>(p));
+	State& state = **pState;
+	const std::shared_ptr<State>& spState = *pState;
+
+	if (TraceRecorder::IsEnabled())
+	{
+		CString strName;
+		strName.Format(_T("Camera %u"), state.wCamera + 1);
+		TraceRecorder::NameThread(strName);
+	}
+
+	HRESULT hr = ::CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+	if (FAILED(hr))
+	{
+		// Nobody should wait for us
+		state.evStop.SetEvent();
+		return 1;
+	}
+
+	// Only this thread arms deadlines, so it holds the scheduler. The scheduler thread
+	// may release the state last and must not end itself with it.
+	const std::shared_ptr<MotorPulseScheduler> spScheduler = MotorPulseScheduler::Get();
+	state.pScheduler = spScheduler.get();
+
+	for (;;)
+	{
+		HANDLE ahWait[] = { state.evStop, state.evQueue };
+		DWORD dwWait = ::MsgWaitForMultipleObjects(_countof(ahWait), ahWait, FALSE, INFINITE, QS_ALLINPUT);
+		if (dwWait == WAIT_OBJECT_0)
+			break;
+		else if (dwWait == WAIT_OBJECT_0 + 1)
+			RunCommands(spState);
+		else
+		{
+			MSG msg;
+			while (::PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+				::DispatchMessage(&msg);
+		}
+	}
+
+	// Drop all pending commands and release the device in this apartment.
+	DropCommands(state);
+	state.camera.CloseDevice();
+	state.pScheduler = nullptr;
+	::CoUninitialize();
+	return 0;
+}
+
+void WebcamWorker::RunCommands(const std::shared_ptr<State>& spState)
+{
+	State& state = *spState;
+	for (;;)
+	{
+		Entry entry;
+		{
+			CSingleLock lock(&state.cs, TRUE);
+			if (state.queue.empty())
+				return;
+			entry = std::move(state.queue.front());
+			state.queue.pop_front();
+		}
+
+		LONGLONG llStart = MotorPulseScheduler::Now();
+		UINT uCommand = ArmDeadline(spState, entry.cmd, llStart);
+		HRESULT hr = entry.fnPair ? entry.fnPair(state.camera, entry.iValue, entry.iValue2) :
+					 entry.fnValue ? entry.fnValue(state.camera, entry.iValue) : entry.fn(state.camera);
+		// Too late, the command was already reported and the thread is abandoned.
+		if (!DisarmDeadline(state, uCommand))
+			return;
+		LONGLONG llEnd = MotorPulseScheduler::Now();
+		state.aCommandLatency[static_cast<int>(entry.cmd)].Record(llStart, llEnd, FAILED(hr));
+		TraceRecorder::Span(CommandName(entry.cmd), _T("command"), llStart, llEnd, state.wCamera, entry.iValue);
+		if (state.hWndNotify)
+			::PostMessage(state.hWndNotify, state.uMsgNotify, MAKEWPARAM(state.wCamera, static_cast<WORD>(entry.cmd)), static_cast<LPARAM>(hr));
+
+		// Terminate as fast as possible
+		if (::WaitForSingleObject(state.evStop, 0) == WAIT_OBJECT_0)
+			return;
+	}
+}
+
+UINT WebcamWorker::ArmDeadline(const std::shared_ptr<State>& spState, CameraCommand cmd, LONGLONG llStart)
+{
+	UINT uCommand = ++spState->uStarted;
+	DWORD dwDeadline = spState->dwDeadline;
+	if (!dwDeadline || !spState->pScheduler)
+		return uCommand;
+	if (cmd == CameraCommand::Open)
+		dwDeadline *= OPEN_DEADLINE_FACTOR;
+	if (cmd == CameraCommand::Calibrate)
+		dwDeadline *= CALIBRATE_DEADLINE_FACTOR;
+
+	// The key follows the keys of the motor axes of this camera.
+	spState->uRunning = uCommand;
+	std::weak_ptr<State> wpState{ spState };
+	UINT_PTR key = reinterpret_cast<UINT_PTR>(&spState->camera) + WebcamController::NUM_AXES;
+	spState->pScheduler->Arm(key, llStart + MotorPulseScheduler::FromMilliseconds(dwDeadline), [wpState, uCommand, cmd, llStart]()
+	{
+		auto spState = wpState.lock();
+		if (!spState)
+			return;
+		// Either the worker or the scheduler resets uRunning. Who does it first decides.
+		UINT uExpected = uCommand;
+		if (!spState->uRunning.compare_exchange_strong(uExpected, QUARANTINED))
+			return;
+
+		TRACE(__FUNCTION__ " camera %u command %u passed its deadline\n", spState->wCamera, static_cast<UINT>(cmd));
+		LONGLONG llNow = MotorPulseScheduler::Now();
+		spState->aCommandLatency[static_cast<int>(cmd)].Record(llStart, llNow, true);
+		TraceRecorder::Span(CommandName(cmd), _T("deadline"), llStart, llNow, spState->wCamera);
+		spState->bQuarantined = true;
+		spState->evStop.SetEvent();
+		DropCommands(*spState);
+		if (spState->hWndNotify)
+			::PostMessage(spState->hWndNotify, spState->uMsgNotify, MAKEWPARAM(spState->wCamera, static_cast<WORD>(cmd)), static_cast<LPARAM>(HRESULT_FROM_WIN32(ERROR_TIMEOUT)));
+	});
+	return uCommand;
+}
+
+void WebcamWorker::DropCommands(State& state)
+{
+	// A dropped recall or poll never sets the settled event, so it is set here. Commands
+	// posted later are dropped at once.
+	CSingleLock lock(&state.cs, TRUE);
+	state.bClosed = true;
+	state.queue.clear();
+	state.evSettled.SetEvent();
+}
+
+bool WebcamWorker::DisarmDeadline(State& state, UINT uCommand)
+{
+	UINT uExpected = uCommand;
+	if (state.uRunning.compare_exchange_strong(uExpected, 0))
+	{
+		state.pScheduler->Cancel(reinterpret_cast<UINT_PTR>(&state.camera) + WebcamController::NUM_AXES);
+		return true;
+	}
+	// Either no deadline was armed or the scheduler was first
+	return uExpected != QUARANTINED;
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include <afxmt.h>
+
+#include "WebcamControl.h"
+#include "MotorPulseScheduler.h"
+#include "MotionEngine.h"
+#include "PresetStore.h"
+#include "TravelModel.h"
+
+/** Commands executed by a WebcamWorker. Reported back with the completion message. */
+enum class CameraCommand : WORD
+{
+	Open,
+	GotoHome,
+	SavePreset,
+	GotoPreset,
+	Zoom,
+	Pan,
+	Tilt,
+	MovePan,
+	MoveTilt,
+	PanTilt,
+	MovePanTilt,
+	Close,
+	EndPulse,
+	Sync,			// Does nothing, just waits for all commands before
+	SavePosition,	// Software presets
+	GotoPosition,
+	Settle,			// Polls a moving camera until it stands still
+	Velocity,		// Steps of the motion engine at the control rate
+	Calibrate,		// Measures the motor pulses, see WebcamController::MeasurePulses
+	NUM_COMMANDS
+};
+
+/** Commands for the same axis are merged while they wait in the queue. */
+enum class CameraAxis
+{
+	None,
+	Pan,
+	Tilt,
+	Zoom,
+	PanTilt,		// Both axes at once, with one value per axis
+};
+
+/**
+* Owns a WebcamController and runs every call into it on a dedicated thread with its own
+* COM apartment. The UI thread only posts commands. When a command is done the notify
+* window receives uMsgNotify with WPARAM=MAKEWPARAM(camera, CameraCommand) and LPARAM=HRESULT.
+*
+* After a preset, home or position recall the worker polls the camera until it stands still,
+* first fast, then less often. The settled event is reset while the camera moves and the last
+* poll is reported as CameraCommand::Settle with S_OK (S_FALSE while it still moves).
+* The travel time from the target the camera rested at is learned for the next prediction.
+*
+* Held inputs only set a velocity. While one is set, the steps of the MotionEngine are sent
+* every CONTROL_INTERVAL msec, however often the input repeats. A held zoom runs the zoom motor
+* of the camera instead, if it has one, and stops it with the first control step after the release.
+*
+* Every command has a deadline. A command that is still running when it passes is abandoned
+* together with the thread. The worker is quarantined then: the command is reported with
+* HRESULT_FROM_WIN32(ERROR_TIMEOUT) and all further commands are dropped.
+*/
+class WebcamWorker
+{
+public:
+	using Command = std::function<HRESULT(WebcamController&)>;
+	using ValueCommand = std::function<HRESULT(WebcamController&, int iValue)>;
+	using PairCommand = std::function<HRESULT(WebcamController&, int xValue, int yValue)>;
+
+	WebcamWorker(HWND hWndNotify, UINT uMsgNotify, WORD wCamera);
+	~WebcamWorker();
+
+	WebcamWorker(const WebcamWorker&) = delete;
+	WebcamWorker& operator=(const WebcamWorker&) = delete;
+
+	bool Start();
+	void Stop(DWORD dwTimeout);
+
+	/** Queue a command and return immediately. Urgent commands are executed next. */
+	void Post(CameraCommand cmd, Command fn, bool bUrgent = false);
+	/** Queue a command and wait for its result. Only used while the dialog is initialized. */
+	HRESULT Send(CameraCommand cmd, Command fn);
+	/** Queue a relative step. Steps of a waiting command for the same axis are summed. */
+	void PostStep(CameraCommand cmd, CameraAxis axis, int iSteps, ValueCommand fn);
+	/** Queue an absolute target. It replaces the value of a waiting command for the same axis. */
+	void PostTarget(CameraCommand cmd, CameraAxis axis, int iTarget, ValueCommand fn);
+	/** The same for pan and tilt together. Waiting combined steps are summed per axis. */
+	void PostStep(CameraCommand cmd, int xSteps, int ySteps, PairCommand fn);
+	void PostTarget(CameraCommand cmd, int xTarget, int yTarget, PairCommand fn);
+
+	HRESULT Open(const CString& devicePath);
+	/** The device was removed. It is closed, but its topology and motion settings are kept. */
+	void Disconnect();
+	/** Open the device again after it arrived and move it to iPreset, if it isn't negative. */
+	void Reconnect(const WebcamDevice& device, int iPreset);
+	HRESULT Sync();
+	void GotoHome();
+	/** A camera without the Logitech peripheral unit uses the software preset with the same number. */
+	void SavePreset(int iNum);
+	void GotoPreset(int iNum);
+	/** Store the current position as a software preset. An empty name keeps the name it had. */
+	void SavePosition(UINT uId, const CString& strName);
+	/** Recall a software preset with one batch of writes. False if there is none with the ID. */
+	bool GotoPosition(UINT uId);
+	/** Single steps and motor runs. Waiting commands of the same axis are merged, see EnableCoalescing. Held inputs use SetVelocity. */
+	void Zoom(int direction);
+	void Pan(int xDirection);
+	void Tilt(int yDirection);
+	void MovePan(int xDirection);
+	void MoveTilt(int yDirection);
+	void PanTilt(int xDirection, int yDirection);
+	void MovePanTilt(int xDirection, int yDirection);
+	/**
+	* Measure the motor pulses of the camera and fit its pulse calibration. A success sets
+	* motorIntervalTime from the minimum pulse. Reported as CameraCommand::Calibrate.
+	*/
+	void CalibratePulses();
+	/** The velocity of held inputs, -1..1 per axis, any thread. 0 for all stops after the last step. */
+	void SetVelocity(double dPan, double dTilt, double dZoom = 0);
+	/** The curve of pan and tilt. The zoom keeps its own. */
+	void SetMotionCurve(const MotionEngine::Curve& curve);
+	MotionEngine::Curve GetMotionCurve() const;
+	/** All steps the engine emitted for held inputs, with their sign. Not sent for a zoom motor. */
+	long long GetVelocitySteps(MotionEngine::Axis axis) const;
+
+	/** Direct access to the controller. Only the atomic settings may be used from another thread. */
+	WebcamController& Camera()
+	{
+		return m_spState->camera;
+	}
+	const WebcamController& Camera() const
+	{
+		return m_spState->camera;
+	}
+	WORD GetIndex() const
+	{
+		return m_spState->wCamera;
+	}
+	/** The software presets of the camera. May be used from any thread. */
+	PresetStore& Presets()
+	{
+		return m_spState->presets;
+	}
+
+	/** Number of commands waiting in the queue and number of commands started so far. */
+	size_t GetQueueDepth();
+	UINT GetStartedCount() const
+	{
+		return m_spState->uStarted;
+	}
+	/** Deadline for one command in milliseconds, 0 waits for ever. Opening gets a multiple of it. */
+	void SetDeadline(DWORD dwMilliseconds)
+	{
+		m_spState->dwDeadline = dwMilliseconds;
+	}
+	/** A command passed its deadline. The thread is abandoned and nothing is executed anymore. */
+	bool IsQuarantined() const
+	{
+		return m_spState->bQuarantined;
+	}
+	/** Time from the start of a command to its end, or to its deadline when it hung. */
+	const LatencyHistogram& GetCommandLatency(CameraCommand cmd) const
+	{
+		return m_spState->aCommandLatency[static_cast<int>(cmd)];
+	}
+	static LPCTSTR CommandName(CameraCommand cmd);
+
+	/** Targets with their own arrival latency: the presets, home and all software positions */
+	static constexpr int TARGET_HOME{ WebcamController::NUM_PRESETS };
+	static constexpr int TARGET_POSITION{ WebcamController::NUM_PRESETS + 1 };
+	static constexpr int NUM_TARGETS{ WebcamController::NUM_PRESETS + 2 };
+	/** Set while the camera rests. Any thread may wait on it, it is reset by the recall commands. */
+	HANDLE GetSettledEvent() const
+	{
+		return m_spState->evSettled;
+	}
+	/** Time from the start of a recall until the camera stood still. A recall that didn't settle is an error. */
+	const LatencyHistogram& GetArrivalLatency(int iTarget) const
+	{
+		return m_spState->aArrivalLatency[iTarget];
+	}
+	/** Learned travel times between the presets and home. May be used from any thread. */
+	TravelModel& Travel()
+	{
+		return m_spState->travel;
+	}
+	/** Expected msec until the camera rests at iTarget if it is recalled now, negative if unknown. */
+	double PredictTravel(int iTarget) const
+	{
+		return m_spState->travel.Predict(m_spState->iOrigin, iTarget);
+	}
+	/** Merging of axis commands is on by default. It is switched off for comparisons only. */
+	void EnableCoalescing(bool bEnable)
+	{
+		m_spState->bCoalesce = bEnable;
+	}
+
+	static constexpr DWORD DEFAULT_DEADLINE{ 3000 };
+	static constexpr DWORD CONTROL_INTERVAL{ 20 };		// msec between the steps of held inputs
+
+private:
+	static constexpr DWORD STOP_TIMEOUT{ 2000 };
+	static constexpr DWORD OPEN_DEADLINE_FACTOR{ 10 };	// Opening runs dozens of calls
+	static constexpr DWORD CALIBRATE_DEADLINE_FACTOR{ 10 };	// A calibration waits for a dozen pulses
+	static constexpr double CALIBRATED_INTERVAL_FACTOR{ 1.6 };	// Of the minimum pulse
+	static constexpr int MIN_MOTOR_INTERVAL{ 10 };		// msec, the range of the settings
+	static constexpr int MAX_MOTOR_INTERVAL{ 1000 };
+	static constexpr UINT QUARANTINED{ UINT_MAX };		// uRunning after a passed deadline
+	static constexpr int MAX_STEPS{ 127 };		// Steps are sent as a signed byte to the Logitech XU
+	static constexpr DWORD FIRST_POLL_INTERVAL{ 20 };	// msec after a recall, growing by half per poll
+	static constexpr DWORD MAX_POLL_INTERVAL{ 200 };
+	static constexpr DWORD SETTLE_TIMEOUT{ 20000 };		// A camera that still moves then is given up
+
+	struct Entry
+	{
+		CameraCommand cmd;
+		Command fn;
+		// Only for axis commands
+		CameraAxis axis;
+		int iValue;
+		ValueCommand fnValue;
+		// Only for CameraAxis::PanTilt, iValue is the pan value
+		int iValue2;
+		PairCommand fnPair;
+	};
+
+	// A recall that is polled until the camera stands still. Only used by the worker thread.
+	struct Motion
+	{
+		UINT uMotion;			// Counts the recalls, a poll for an older one is ignored
+		bool bActive;
+		int iTarget;
+		LONGLONG llStart;
+		DWORD dwInterval;		// msec until the next poll
+		bool bSampled;			// last holds a position of a camera that didn't say it is moving
+		WebcamController::AbsolutePosition last;
+		LONGLONG llLast;
+		int iOrigin;			// Target the camera rested at before, see TravelModel
+		UINT uManualMoves;		// State::uManualMoves at the start
+	};
+
+	// Everything the thread uses. It is shared, so a worker thread that hangs inside the
+	// driver can be abandoned without touching freed memory.
+	struct State
+	{
+		State(HWND hWnd, UINT uMsg, WORD wCam)
+			: hWndNotify(hWnd), uMsgNotify(uMsg), wCamera(wCam)
+			, evQueue(FALSE, FALSE), evStop(FALSE, TRUE), evSettled(TRUE, TRUE)
+		{}
+
+		WebcamController camera;
+		MotorPulseScheduler* pScheduler{ nullptr };		// Held by the worker thread, see ThreadProc
+		const HWND hWndNotify;
+		const UINT uMsgNotify;
+		const WORD wCamera;
+
+		CCriticalSection cs;
+		std::deque<Entry> queue;
+		bool bClosed{ false };		// The queue takes no more commands, protected by cs
+		CEvent evQueue;
+		CEvent evStop;
+		CEvent evSettled;
+		std::atomic<UINT> uStarted{ 0 };
+		std::atomic<UINT> uRunning{ 0 };		// Number of the command with an armed deadline, 0 if none
+		std::atomic<DWORD> dwDeadline{ DEFAULT_DEADLINE };
+		std::atomic<bool> bQuarantined{ false };
+		std::atomic<bool> bCoalesce{ true };
+		LatencyHistogram aCommandLatency[static_cast<int>(CameraCommand::NUM_COMMANDS)];
+		PresetStore presets;
+		Motion motion{};
+		LatencyHistogram aArrivalLatency[NUM_TARGETS];
+		TravelModel travel{ NUM_TARGETS };
+		std::atomic<int> iOrigin{ TravelModel::UNKNOWN };	// Target the camera rests at
+		std::atomic<UINT> uManualMoves{ 0 };				// Axis commands posted so far
+		// The UI sets the intent, the worker sends the steps
+		mutable CCriticalSection csMotion;
+		MotionEngine engine;
+		bool bControlling{ false };		// A control step is armed or queued
+		LONGLONG llNextControl{ 0 };	// Only used by the worker thread
+	};
+
+	static UINT AFX_CDECL ThreadProc(LPVOID p); // AFX_THREADPROC
+	static void RunCommands(const std::shared_ptr<State>& spState);
+	static UINT ArmDeadline(const std::shared_ptr<State>& spState, CameraCommand cmd, LONGLONG llStart);
+	static bool DisarmDeadline(State& state, UINT uCommand);
+	static void DropCommands(State& state);
+	static void Post(State& state, CameraCommand cmd, Command fn, bool bUrgent);
+	static void PostAxis(State& state, Entry entry, bool bSum);
+	static HRESULT SavePosition(WebcamController& camera, PresetStore& presets, UINT uId, const CString& strName);
+	static HRESULT GotoPosition(WebcamController& camera, const PresetStore& presets, UINT uId);
+	// Wraps a recall: the settled event is reset now and the camera is polled after it succeeded.
+	// A recall that is dropped sets it again, see DropCommands.
+	Command Recall(int iTarget, Command fn);
+	static void BeginMotion(const std::shared_ptr<State>& spState, int iTarget, LONGLONG llStart);
+	static void SchedulePoll(const std::shared_ptr<State>& spState);
+	static HRESULT PollMotion(const std::shared_ptr<State>& spState, WebcamController& camera, UINT uMotion);
+	static void PostControl(const std::shared_ptr<State>& spState);
+	static HRESULT Control(const std::shared_ptr<State>& spState, WebcamController& camera);
+
+	std::shared_ptr<State> m_spState;
+	CWinThread* m_pThread;
+};
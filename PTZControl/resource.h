@@ -11,6 +11,9 @@
 #define IDR_ACCELERATOR                 132
 #define IDD_SETTINGS                    133
 #define IDP_TXT_CAMERAS                 133
+#define IDD_DIAGNOSTICS                 135
+#define IDP_ERR_SAVETRACE               136
+#define IDP_ERR_CALIBRATION             137
 #define IDC_BT_LEFT                     1000
 #define IDC_BT_RIGHT                    1001
 #define IDC_CHECK1                      1001
@@ -37,40 +40,29 @@
 #define IDC_EDIT1                       1011
 #define IDC_ED_MOTORTIME                1011
 #define IDC_BT_PRESET7                  1012
-#define IDC_ED_TOOLTIP_2_1              1012
 #define IDC_BT_PRESET8                  1013
-#define IDC_ED_TOOLTIP_2_2              1013
 #define IDC_BT_ZOOM_IN                  1014
-#define IDC_ED_TOOLTIP_2_3              1014
 #define IDC_BT_ZOOM_OUT                 1015
-#define IDC_ED_TOOLTIP_2_4              1015
 #define IDC_BT_EXIT                     1016
-#define IDC_ED_TOOLTIP_2_5              1016
 #define IDC_BT_SETTINGS                 1017
-#define IDC_ED_TOOLTIP_2_6              1017
 #define IDC_BT_WEBCAM1                  1018
-#define IDC_ED_TOOLTIP_2_7              1018
 #define IDC_BT_WEBCAM2                  1019
-#define IDC_ED_TOOLTIP_2_8              1019
 #define IDC_BT_WEBCAM3                  1020
-#define IDC_ED_TOOLTIP_3_1              1020
-#define IDC_ED_TOOLTIP_3_2              1021
-#define IDC_ED_TOOLTIP__3_3             1022
-#define IDC_ED_TOOLTIP_3_3              1022
-#define IDC_ED_TOOLTIP_3_4              1023
-#define IDC_ED_TOOLTIP_3_5              1024
-#define IDC_ED_TOOLTIP_3_6              1025
-#define IDC_ED_TOOLTIP_3_7              1026
-#define IDC_ED_TOOLTIP_3_8              1027
+#define IDC_ST_CAMERA                   1028
+#define IDC_BT_DIAGNOSTICS              1029
+#define IDC_ED_DIAGNOSTICS              1030
+#define IDC_BT_SAVE                     1031
+#define IDC_BT_SAVETRACE                1032
+#define IDC_BT_CALIBRATE                1033
 #define DC_BT_SETTINGS                  32791
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        135
+#define _APS_NEXT_RESOURCE_VALUE        138
 #define _APS_NEXT_COMMAND_VALUE         32799
-#define _APS_NEXT_CONTROL_VALUE         1012
+#define _APS_NEXT_CONTROL_VALUE         1034
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif